@@ -0,0 +1,56 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: cache.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module holds what the disk caches share: the hash of their 
+*           keys, the path of their files and the creation of their 
+*           directories.
+*******************************************************************************/
+#ifndef __TAWY__CACHE_H__
+#define __TAWY__CACHE_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAWY_CACHE_HASH_BASIS 14695981039346656037ull  // FNV-1a 64 offset basis.
+#define TAWY_CACHE_HASH_PRIME 1099511628211ull
+
+
+/*******************************************************************************
+* Function  : cache_hash
+* Brief     : Accumulate bytes in a FNV-1a 64 hash.
+* Parameters:
+*    1. h   : The current hash, TAWY_CACHE_HASH_BASIS to start one.
+*    2. data: The bytes to accumulate.
+*    3. size: Their number.
+* Returns   :
+*    hash: The new hash.
+*******************************************************************************/
+unsigned long long cache_hash(unsigned long long, const void *, size_t);
+
+
+/*******************************************************************************
+* Function  : cache_path
+* Brief     : Build the path of the cache file of a key.
+* Parameters:
+*    1. dir      : The directory of the cache, ending with '/'.
+*    2. key      : The key.
+*    3. extension: The extension of the file, e.g. ".bin".
+*    4. path     : The buffer receiving the path.
+*    5. len      : The size of this buffer.
+*******************************************************************************/
+void cache_path(const char *, unsigned long long, const char *, char *, size_t);
+
+
+/*******************************************************************************
+* Function  : cache_make_dirs
+* Brief     : Create every directory of a path ending with '/'.
+* Parameters:
+*    1. dirs: The path, e.g. "cache/programs/".
+* Returns   :
+*    true : Every directory exists.
+*    false: One of them could not be created.
+*******************************************************************************/
+bool cache_make_dirs(const char *);
+
+#endif
\ No newline at end of file
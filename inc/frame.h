@@ -0,0 +1,67 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: frame.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module manages the constants shared by every program during a
+*           frame, uploaded once in a uniform buffer object.
+*******************************************************************************/
+#ifndef __TAWY__FRAME_H__
+#define __TAWY__FRAME_H__
+#include <cglm/cglm.h>
+#include "object.h"
+#include "window.h"
+
+#define TAWY_FRAME_BINDING 0
+#define TAWY_FRAME_BLOCK   "Frame"
+
+
+/*******************************************************************************
+* Struct    : frame_constants
+* Brief     : The CPU image of the "Frame" uniform block, laid out as std140.
+*             It must match the block declared in the GLSL sources.
+* Attributes:
+*    1. view           : The camera view matrix.
+*    2. projection     : The camera projection matrix.
+*    3. view_projection: projection * view, computed once per frame.
+*    4. viewport       : The framebuffer size in pixels.
+*    5. time           : The time in seconds since GLFW was initialized.
+*******************************************************************************/
+typedef struct frame_constants
+{
+  mat4  view;
+  mat4  projection;
+  mat4  view_projection;
+  vec2  viewport;
+  float time;
+  float padding;
+}frame_constants;
+
+
+/*******************************************************************************
+* Struct    : frame
+* Brief     : Defines an instance of the per-frame constants.
+* Attributes:
+*    1. ubo      : The OpenGL uniform buffer bound to TAWY_FRAME_BINDING.
+*    2. win      : The window providing the viewport size.
+*    3. constants: The values to upload on next enable(). Set view and 
+*                  projection, the rest is computed.
+* Class     : The structure storing our handlers.
+*******************************************************************************/
+typedef struct frame
+{
+  const void *__cls__;
+
+  unsigned int    ubo;
+  window         *win;
+  frame_constants constants;
+}frame;
+
+
+/*******************************************************************************
+* Class     : Frame
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+extern const void *Frame;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: gltf.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module maps binary glTF 2.0 files (.glb). Their accessors
+*           already lie in the binary chunk as the GPU reads them: they are
+*           located and checked, never copied, and handed to OpenGL with the
+*           layout the file gives. It does not call OpenGL.
+*******************************************************************************/
+#ifndef __TAWY__GLTF_H__
+#define __TAWY__GLTF_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include "vertex_format.h"
+
+#define TAWY_GLTF_EXTENSION ".glb"
+#define TAWY_GLTF_MAGIC     0x46546c67u  // "glTF"
+#define TAWY_GLTF_VERSION   2
+#define TAWY_GLTF_JSON      0x4e4f534au  // "JSON", the first chunk.
+#define TAWY_GLTF_BIN       0x004e4942u  // "BIN", the second one.
+#define TAWY_GLTF_NAME_LEN  256
+#define TAWY_GLTF_TRIANGLES 4            // The mode of triangle lists, as glTF numbers them.
+#define TAWY_GLTF_STRIDE    252          // The largest byteStride, a multiple of 4 from 4.
+
+
+/*******************************************************************************
+* Struct    : gltf_accessor
+* Brief     : Defines where an attribute, or the indices, of a primitive lie in
+*             the binary chunk. glTF names component types as OpenGL does.
+* Attributes:
+*    1. offset     : Its first element, from the start of the binary chunk.
+*    2. count      : Its number of elements, 0 if the primitive has none.
+*    3. type       : The OpenGL type of its components.
+*    4. size       : Its number of components.
+*    5. stride     : The distance between two elements, in bytes.
+*    6. normalized : True if integer components map to [0, 1] or [-1, 1].
+*******************************************************************************/
+typedef struct gltf_accessor
+{
+  size_t        offset;
+  unsigned int  count;
+  unsigned int  type;
+  int           size;
+  unsigned int  stride;
+  bool          normalized;
+}gltf_accessor;
+
+
+/*******************************************************************************
+* Struct    : gltf_primitive
+* Brief     : Defines triangles of a mesh drawn with a single material.
+* Attributes:
+*    1. attribute  : Its attributes, by location in the vertex shader.
+*    2. indices    : Its indices, tightly packed.
+*    3. image      : The image of its base color, -1 if none.
+*******************************************************************************/
+typedef struct gltf_primitive
+{
+  gltf_accessor attribute[TAWY_VERTEX_ATTRIBUTES];
+  gltf_accessor indices;
+  int           image;
+}gltf_primitive;
+
+
+/*******************************************************************************
+* Struct    : gltf_image
+* Brief     : Defines an image, embedded in the binary chunk or next to the file.
+* Attributes:
+*    1. offset, size : The encoded image in the binary chunk. 0 bytes if it
+*                      is a file.
+*    2. uri          : The file, relative to the model. Empty if embedded.
+*******************************************************************************/
+typedef struct gltf_image
+{
+  size_t offset;
+  size_t size;
+  char   uri[TAWY_GLTF_NAME_LEN];
+}gltf_image;
+
+
+/*******************************************************************************
+* Struct    : gltf
+* Brief     : A mapped .glb file. Node transforms are not applied.
+* Attributes:
+*    1. map, map_size   : The whole file, mapped.
+*    2. bin, bin_size   : Its binary chunk.
+*    3. geometry        : The range of the binary chunk every accessor lies
+*       geometry_size     in, so that images around it are not uploaded.
+*    4. primitives      : Its indexed triangle primitives, in file order.
+*    5. images          : Its images.
+*    6. bounds          : The sphere bounding its positions, center then
+*                         radius.
+*******************************************************************************/
+typedef struct gltf
+{
+  void                *map;
+  size_t               map_size;
+  const unsigned char *bin;
+  size_t               bin_size;
+  size_t               geometry;
+  size_t               geometry_size;
+
+  gltf_primitive      *primitives;
+  unsigned int         primitive_cnt;
+  gltf_image          *images;
+  unsigned int         image_cnt;
+  float                bounds[4];
+}gltf;
+
+
+/*******************************************************************************
+* Function  : gltf_map
+* Brief     : Map a .glb file and locate its primitives. Primitives that are not
+*             indexed triangles are skipped.
+* Parameters:
+*    1. file    : Receives the file.
+*    2. path    : The .glb file.
+* Returns   :
+*    true : The file is mapped. Release it with gltf_release().
+*    false: It could not be mapped, is not a glTF 2.0 binary, an accessor
+*           lies outside of its binary chunk, an index names no vertex, or it
+*           requires an extension.
+*******************************************************************************/
+bool gltf_map(gltf *, const char *);
+
+
+/*******************************************************************************
+* Function  : gltf_release
+* Brief     : Unmap a .glb file.
+* Parameters:
+*    1. file    : The file.
+*******************************************************************************/
+void gltf_release(gltf *);
+
+#endif
\ No newline at end of file
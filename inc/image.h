@@ -0,0 +1,123 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: image.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module prepares decoded images for upload: flips, expands,
+*           premultiplies and downsamples them, with SSE2 or AVX2 when the CPU
+*           has them, on a pool of threads for large images.
+*******************************************************************************/
+#ifndef __TAWY__IMAGE_H__
+#define __TAWY__IMAGE_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAWY_IMAGE_THREADS         4
+#define TAWY_IMAGE_ROWS_PER_THREAD 64  // Fewer rows are not worth a thread.
+
+
+typedef enum
+{
+  IMAGE_SCALAR,
+  IMAGE_SSE2,
+  IMAGE_AVX2,
+} image_isa;
+
+
+typedef enum
+{
+  IMAGE_BOX,     // Averages 2x2 texels, as glGenerateMipmap does.
+  IMAGE_KAISER,  // A Kaiser windowed sinc over 6x6 texels, sharper.
+} image_filter;
+
+
+/*******************************************************************************
+* Function  : image_simd
+* Brief     : Choose the instruction set of the kernels, at most the best one
+*             the CPU supports. The best one is chosen by default.
+* Parameters:
+*    1. isa     : The instruction set wanted.
+* Returns   :
+*    isa: The instruction set now used.
+*******************************************************************************/
+image_isa image_simd(image_isa);
+
+
+/*******************************************************************************
+* Function  : image_flip
+* Brief     : Copy an image, its last row first. Rows are copied whole, with
+*             no kernel of its own: memcpy is as fast as memory allows.
+* Parameters:
+*    1. dst     : The destination, width * height * channels bytes.
+*    2. src     : The image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels.
+*******************************************************************************/
+void image_flip(unsigned char *, const unsigned char *, int, int, int);
+
+
+/*******************************************************************************
+* Function  : image_expand
+* Brief     : Copy an RGB image as RGBA, opaque, flipping it in the same pass.
+*             Drivers store RGB as RGBA anyway, and convert RGB uploads slowly.
+* Parameters:
+*    1. dst     : The destination, width * height * 4 bytes.
+*    2. src     : The RGB image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. flip    : True to copy its last row first.
+*******************************************************************************/
+void image_expand(unsigned char *, const unsigned char *, int, int, bool);
+
+
+/*******************************************************************************
+* Function  : image_premultiply
+* Brief     : Multiply the colors of an RGBA image by its alpha, in place, so
+*             that filtering and blending do not bleed transparent colors.
+* Parameters:
+*    1. pixels  : The RGBA image.
+*    2. width   : Its width.
+*    3. height  : Its height.
+*******************************************************************************/
+void image_premultiply(unsigned char *, int, int);
+
+
+/*******************************************************************************
+* Function  : image_downsample
+* Brief     : Compute the next mip level of an image, half its size. Colors of
+*             sRGB images are filtered linearly, alpha is always linear.
+* Parameters:
+*    1. dst     : The level, max(1, width / 2) * max(1, height / 2) texels.
+*    2. src     : The image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels, from 1 to 4.
+*    6. filter  : The filter.
+*    7. srgb    : True if its colors are sRGB encoded.
+* Returns   :
+*    true : The level is computed.
+*    false: Memory could not be allocated for the Kaiser filter.
+*******************************************************************************/
+bool image_downsample(unsigned char *, const unsigned char *, int, int, int, image_filter, bool);
+
+
+/*******************************************************************************
+* Function  : image_mipmaps
+* Brief     : Compute every mip level of an image, down to 1x1, each from the
+*             previous one. Levels follow the image, tightly packed.
+* Parameters:
+*    1. chain   : The image, followed by room for its levels.
+*    2. width   : Its width.
+*    3. height  : Its height.
+*    4. channels: Its number of channels, from 1 to 4.
+*    5. levels  : The number of levels, the image included.
+*    6. filter  : The filter.
+*    7. srgb    : True if its colors are sRGB encoded.
+* Returns   :
+*    true : Every level is computed.
+*    false: Memory could not be allocated for the Kaiser filter.
+*******************************************************************************/
+bool image_mipmaps(unsigned char *, int, int, int, int, image_filter, bool);
+
+#endif
\ No newline at end of file
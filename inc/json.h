@@ -0,0 +1,147 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: json.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module tokenizes JSON text in place: values are not copied,
+*           tokens point into the text. Each token knows where its subtree
+*           ends, so that lookups skip whole values.
+*******************************************************************************/
+#ifndef __TAWY__JSON_H__
+#define __TAWY__JSON_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAWY_JSON_DEPTH 64  // Deeper values are rejected, not recursed into.
+
+
+typedef enum
+{
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT,
+} json_type;
+
+
+/*******************************************************************************
+* Struct    : json_token
+* Brief     : A value of the text. Objects are followed by their keys, each
+*             followed by its value, and arrays by their elements.
+* Attributes:
+*    1. type    : The type of the value.
+*    2. start   : Its first character, after the quote of strings.
+*    3. end     : The character after it, the closing quote of strings.
+*    4. size    : The number of elements of an array, or of keys of an object.
+*    5. next    : The token after its subtree.
+*******************************************************************************/
+typedef struct json_token
+{
+  json_type    type;
+  unsigned int start;
+  unsigned int end;
+  unsigned int size;
+  unsigned int next;
+}json_token;
+
+
+/*******************************************************************************
+* Struct    : json
+* Brief     : A tokenized text. The first token is its root value.
+*******************************************************************************/
+typedef struct json
+{
+  const char   *text;
+  json_token   *tokens;
+  unsigned int  cnt;
+}json;
+
+
+/*******************************************************************************
+* Function  : json_parse
+* Brief     : Tokenize a JSON text, that must outlive its tokens.
+* Parameters:
+*    1. doc     : Receives the tokens.
+*    2. text    : The text, not necessarily null terminated.
+*    3. len     : Its length.
+* Returns   :
+*    true : The text is tokenized. Release it with json_release().
+*    false: It is not valid JSON, too deep, or memory is exhausted.
+*******************************************************************************/
+bool json_parse(json *, const char *, size_t);
+
+
+/*******************************************************************************
+* Function  : json_get
+* Brief     : The value of a key of an object.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. object  : The object, -1 is allowed.
+*    3. key     : The key.
+* Returns   :
+*    token: The value.
+*    -1   : The token is not an object, or has no such key.
+*******************************************************************************/
+int json_get(const json *, int, const char *);
+
+
+/*******************************************************************************
+* Function  : json_at
+* Brief     : An element of an array.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. array   : The array, -1 is allowed.
+*    3. n       : The index of the element.
+* Returns   :
+*    token: The element.
+*    -1   : The token is not an array, or is shorter.
+*******************************************************************************/
+int json_at(const json *, int, unsigned int);
+
+
+/*******************************************************************************
+* Function  : json_size
+* Brief     : The number of elements of an array, 0 for any other token.
+*******************************************************************************/
+unsigned int json_size(const json *, int);
+
+
+/*******************************************************************************
+* Function  : json_number
+* Brief     : The value of a number, or a fallback if the token is not one.
+*******************************************************************************/
+double json_number(const json *, int, double);
+
+
+/*******************************************************************************
+* Function  : json_bool
+* Brief     : The value of a boolean, or a fallback if the token is not one.
+*******************************************************************************/
+bool json_bool(const json *, int, bool);
+
+
+/*******************************************************************************
+* Function  : json_string
+* Brief     : Copy a string, its escapes decoded. Characters escaped outside of
+*             ASCII become '?'.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. token   : The string, -1 is allowed.
+*    3. out     : Receives the string, truncated.
+*    4. len     : Its size.
+* Returns   :
+*    true : The string is copied whole.
+*    false: The token is not a string, or was truncated.
+*******************************************************************************/
+bool json_string(const json *, int, char *, size_t);
+
+
+/*******************************************************************************
+* Function  : json_release
+* Brief     : Free the tokens of a text.
+*******************************************************************************/
+void json_release(json *);
+
+#endif
\ No newline at end of file
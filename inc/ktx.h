@@ -0,0 +1,69 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: ktx.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes the KTX 1.1 container, written by the texture
+*           baker and read by the texture loader.
+*******************************************************************************/
+#ifndef __TAWY__KTX_H__
+#define __TAWY__KTX_H__
+
+#define TAWY_KTX_EXTENSION   ".ktx"
+#define TAWY_KTX_ENDIANNESS  0x04030201
+#define TAWY_KTX_MAX_LEVELS  16
+#define TAWY_KTX_ORIENTATION "KTXorientation"
+#define TAWY_KTX_BOTTOM_UP   "S=r,T=u"  // The first row is the bottom one.
+
+//
+// The identifier opening every file: "«KTX 11»\r\n\x1A\n".
+//
+#define TAWY_KTX_IDENTIFIER  {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A}
+
+
+/*******************************************************************************
+* Enum      : ktx_format
+* Brief     : The block compressed formats baked, with the values of their 
+*             OpenGL internal formats.
+*******************************************************************************/
+typedef enum
+{
+  KTX_BC1 = 0x83F0,  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, opaque RGB.
+  KTX_BC3 = 0x83F3,  // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, RGB with alpha.
+  KTX_BC4 = 0x8DBB,  // GL_COMPRESSED_RED_RGTC1, one channel.
+  KTX_BC5 = 0x8DBD,  // GL_COMPRESSED_RG_RGTC2, two channels.
+} ktx_format;
+
+
+/*******************************************************************************
+* Struct    : ktx_header
+* Brief     : What follows the identifier. Then come key/value pairs, then for
+*             each mip level, its size in bytes and its blocks.
+* Attributes:
+*    1. endianness         : TAWY_KTX_ENDIANNESS, as written.
+*    2. gl_type, gl_type_size, gl_format: 0, 1, 0 for compressed formats.
+*    3. gl_internal_format : One of ktx_format.
+*    4. gl_base_format     : GL_RED, GL_RG, GL_RGB or GL_RGBA.
+*    5. width, height      : The size of the base level, in pixels.
+*    6. depth, array_elements, faces: 0, 0, 1 for a 2D texture.
+*    7. levels             : The number of mip levels.
+*    8. key_value_bytes    : The size of the key/value pairs.
+*******************************************************************************/
+typedef struct ktx_header
+{
+  unsigned int endianness;
+  unsigned int gl_type;
+  unsigned int gl_type_size;
+  unsigned int gl_format;
+  unsigned int gl_internal_format;
+  unsigned int gl_base_format;
+  unsigned int width;
+  unsigned int height;
+  unsigned int depth;
+  unsigned int array_elements;
+  unsigned int faces;
+  unsigned int levels;
+  unsigned int key_value_bytes;
+}ktx_header;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,189 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: mesh.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module optimizes indexed triangle lists for the vertex stage:
+*           it welds identical vertices, orders triangles for the post-
+*           transform cache then in clusters against overdraw, and orders
+*           vertices for fetch. It also simplifies them into levels of 
+*           detail. Used at load or bake time.
+*******************************************************************************/
+#ifndef __TAWY__MESH_H__
+#define __TAWY__MESH_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAWY_MESH_CACHE_SIZE 16    // The FIFO post-transform cache statistics simulate.
+#define TAWY_MESH_OVERDRAW   1.05f // How much the ACMR may grow to cut a mesh in more clusters.
+
+
+/*******************************************************************************
+* Struct    : mesh_stats
+* Brief     : Counts of the vertex stage drawing a mesh, summed over meshes to
+*             report an asset.
+* Attributes:
+*    1. triangles   : The number of triangles drawn.
+*    2. vertices    : The number of vertices in the buffer.
+*    3. transformed : The number of vertices the simulated cache misses.
+*******************************************************************************/
+typedef struct mesh_stats
+{
+  unsigned long triangles;
+  unsigned long vertices;
+  unsigned long transformed;
+}mesh_stats;
+
+
+/*******************************************************************************
+* Function  : mesh_statistics
+* Brief     : Simulate the post-transform cache drawing a mesh.
+* Parameters:
+*    1. stats   : The counts the mesh is added to.
+*    2. indices : Its triangles, 3 indices each.
+*    3. cnt     : Its number of indices.
+*    4. vertices: Its number of vertices.
+*******************************************************************************/
+void mesh_statistics(mesh_stats *, const unsigned int *, unsigned int, unsigned int);
+
+
+/*******************************************************************************
+* Function  : mesh_acmr
+* Brief     : The average cache miss ratio: vertices transformed per triangle.
+*             0.5 is ideal for a regular grid, 3 means no reuse at all.
+*******************************************************************************/
+float mesh_acmr(const mesh_stats *);
+
+
+/*******************************************************************************
+* Function  : mesh_atvr
+* Brief     : The average transformed to vertex ratio: vertices transformed per
+*             vertex in the buffer. 1 is ideal.
+*******************************************************************************/
+float mesh_atvr(const mesh_stats *);
+
+
+/*******************************************************************************
+* Function  : mesh_bounds
+* Brief     : Compute the sphere bounding vertices: the center of their box, 
+*             and the distance to the farthest.
+* Parameters:
+*    1. bounds   : Receives the center, then the radius.
+*    2. positions: The position of the first vertex, 3 floats.
+*    3. stride   : The size of a vertex, in bytes.
+*    4. vcnt     : The number of vertices.
+*******************************************************************************/
+void mesh_bounds(float *, const float *, size_t, unsigned int);
+
+
+/*******************************************************************************
+* Function  : mesh_weld
+* Brief     : Merge vertices whose bytes are identical, keeping the first of
+*             each, and point indices to them.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, compacted in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+* Returns   :
+*    vcnt: The number of vertices left, all of them if memory is exhausted.
+*******************************************************************************/
+unsigned int mesh_weld(unsigned int *, unsigned int, void *, unsigned int, size_t);
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_cache
+* Brief     : Order triangles so that they reuse the vertices recently
+*             transformed, following Forsyth's linear-speed scoring.
+* Parameters:
+*    1. indices : The triangles, reordered.
+*    2. cnt     : The number of indices.
+*    3. vcnt    : The number of vertices.
+* Returns   :
+*    true : Triangles are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_cache(unsigned int *, unsigned int, unsigned int);
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_overdraw
+* Brief     : Cut triangles, ordered for the cache, in clusters as short as
+*             their ACMR from a cold cache allows, within threshold of the one
+*             of the mesh, and draw the clusters facing out of the mesh first,
+*             as they tend to hide the others.
+* Parameters:
+*    1. indices  : The triangles, reordered.
+*    2. cnt      : The number of indices.
+*    3. positions: The position of the first vertex, 3 floats.
+*    4. stride   : The size of a vertex, in bytes.
+*    5. vcnt     : The number of vertices.
+*    6. threshold: How much the ACMR may grow, TAWY_MESH_OVERDRAW by default.
+* Returns   :
+*    true : Triangles are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_overdraw(unsigned int *, unsigned int, const float *, size_t, unsigned int, float);
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_fetch
+* Brief     : Order vertices as triangles first use them, so that fetching them
+*             walks the buffer forward. Unused vertices go last.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, reordered in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+* Returns   :
+*    true : Vertices are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_fetch(unsigned int *, unsigned int, void *, unsigned int, size_t);
+
+
+/*******************************************************************************
+* Function  : mesh_optimize
+* Brief     : Run every pass on a mesh: weld, cache, overdraw, then fetch. A
+*             pass short of memory is skipped. Positions must lead vertices.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, rewritten in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+*    6. before  : The counts the mesh as given is added to, or NULL.
+*    7. after   : The counts the optimized mesh is added to, or NULL.
+* Returns   :
+*    vcnt: The number of vertices left.
+*******************************************************************************/
+unsigned int mesh_optimize(unsigned int *, unsigned int, void *, unsigned int, size_t, mesh_stats *, mesh_stats *);
+
+
+/*******************************************************************************
+* Function  : mesh_simplify
+* Brief     : Collapse edges of a mesh, cheapest first by the quadric error of 
+*             the planes around them, until its indices fit a target. Vertices
+*             only move onto a neighbour, so that the result indexes the same
+*             vertices. Vertices on borders, or sharing their position with
+*             another vertex as along seams of texture coordinates, stay.
+* Parameters:
+*    1. dst      : Receives the triangles, as many indices as given at most.
+*    2. indices  : The triangles.
+*    3. cnt      : The number of indices.
+*    4. positions: The position of the first vertex, 3 floats.
+*    5. stride   : The size of a vertex, in bytes.
+*    6. vcnt     : The number of vertices.
+*    7. target   : The number of indices wanted.
+*    8. error    : Receives the distance from the surface the worst collapse
+*                  moved it by, in the units of positions.
+* Returns   :
+*    cnt: The number of indices written, above target if no collapse is left.
+*         The triangles are copied as they are if memory is exhausted.
+*******************************************************************************/
+unsigned int mesh_simplify(unsigned int *, const unsigned int *, unsigned int, const float *, size_t, unsigned int,
+                           unsigned int, float *);
+
+#endif
\ No newline at end of file
@@ -8,7 +8,24 @@
 *******************************************************************************/
 #ifndef __TAWY__MODEL_H__
 #define __TAWY__MODEL_H__
+#include "frame.h"
+#include "shader.h"
+#include "tawymesh.h"
 #include "texture.h"
+#include "vertex_format.h"
+#include "virtual_texture.h"
+
+#define TAWY_MODEL_DIR      "res/models/"
+#define TAWY_MODEL_PATH_LEN 256
+#define TAWY_MODEL_TEXTURES 16
+
+//
+// A level of detail is drawn while its error covers TAWY_MODEL_LOD_PIXELS
+// on screen at most. A coarser level must fit TAWY_MODEL_LOD_HYSTERESIS of
+// it to replace the current one, so that levels do not flicker in between.
+//
+#define TAWY_MODEL_LOD_PIXELS     1.0f
+#define TAWY_MODEL_LOD_HYSTERESIS 0.75f
 
 /*******************************************************************************
 * Struct    : model
@@ -16,8 +33,25 @@
 *             multiple entities.
 * Attributes:
 *    1. vao  : The OpenGL Vertex Array Object for this instance.
-*    2. vbo  : The OpenGL Vertex Buffer Object for this instance.
+*    2. vbo  : The OpenGL Vertex Buffer Objects, one per stream of its format.
 *    3. ebo  : The OpenGL Element Buffer Object for this instance.
+*    4. features: The shader features this model's material requires, to pick
+*                 the cheapest program permutation serving it.
+*    5. path    : The model file, relative to the working directory. Empty if
+*                 the model is built in.
+*    6. bounds  : The sphere bounding its vertices, center then radius, in 
+*                 model space.
+*    7. virtual : The virtual texture it is drawn with instead of its 
+*                 textures, NULL if none.
+*    8. submeshes  : The meshes of its file, drawn in a single call. NULL if
+*                    the model is built in.
+*    9. format     : The layout of its vertices in its buffers.
+*   10. index_type : The OpenGL type of its indices.
+*   11. position_scale  : What dequantizes its positions: they are scaled,
+*   12. position_offset : then offset. 1 and 0 for float positions.
+*   13. lod_cnt    : Its number of levels of detail, each submesh_cnt 
+*                    submeshes in the table. 1 if it has none.
+*   14. lod_error  : The error of each level, in model space.
 * Class     : The structure storing our handlers.
 *******************************************************************************/
 typedef struct model
@@ -25,21 +59,124 @@ typedef struct model
   const void *__cls__;
 
   unsigned int vao;
-  unsigned int vbo;
+  unsigned int vbo[TAWY_VERTEX_STREAMS];
   unsigned int ebo;
 
   unsigned int vertices;
   unsigned int elements;
 
-  float        *coordinates;
-  unsigned int *indices;  // Temporary. But could be useful if I want to reshape later.
-
+  submesh      *submeshes;
+  unsigned int  submesh_cnt;
+  vertex_format format;
+  unsigned int  index_type;
+  vec3          position_scale;
+  vec3          position_offset;
+  unsigned int  lod_cnt;
+  float         lod_error[TAWY_MESH_LODS];
 
-  texture      *texture[16]; // Allowing max 16 textures per model.
+  texture      *texture[TAWY_MODEL_TEXTURES]; // Shared through texture_acquire().
   unsigned int  texture_cnt;
+  unsigned int  features;
+  char          path[TAWY_MODEL_PATH_LEN];
+  vec4          bounds;
+
+  virtual_texture *virtual;
 }model;
 
 
+/*******************************************************************************
+* Function  : vertex_format_enable
+* Brief     : Point the attributes of the bound vertex array to their streams.
+* Parameters:
+*    1. format  : The format.
+*    2. buffers : The buffer of each stream.
+*******************************************************************************/
+void vertex_format_enable(const vertex_format *, const unsigned int *);
+
+
+/*******************************************************************************
+* Function  : model_enable
+* Brief     : Bind the maps of a model and set its constants for the next draw.
+* Parameters:
+*    1. self    : The instance of the model.
+*******************************************************************************/
+void model_enable(model *);
+
+
+/*******************************************************************************
+* Function  : model_map
+* Brief     : Give a model a map by name: a virtual texture if the file is 
+*             tiled, a shared texture otherwise.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. file    : The file, relative to TAWY_TEXTURE_DIR.
+* Returns   :
+*    true : The map is acquired.
+*    false: It could not be loaded, or the model has no room for it.
+*******************************************************************************/
+bool model_map(model *, const char *);
+
+
+/*******************************************************************************
+* Function  : model_stream
+* Brief     : Project the bounds of a model drawn this frame, and tell its 
+*             textures the size it covers on screen, so that they stream the
+*             levels it needs. Textures are assumed to wrap it once.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. model   : Its model matrix for this draw.
+*    3. frame   : The frame it is drawn in, enabled.
+*******************************************************************************/
+void model_stream(model *, mat4, const frame *);
+
+
+/*******************************************************************************
+* Function  : model_lod
+* Brief     : Project the error of each level of detail of a model drawn this
+*             frame, at the nearest of its bounds, and pick the coarsest level
+*             within TAWY_MODEL_LOD_PIXELS for the next draw. Finer levels are
+*             picked at once, coarser ones only within the hysteresis. The
+*             level is kept by the entity, and given to model_draw(): entities
+*             sharing a model each draw their own.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. model   : Its model matrix for this draw.
+*    3. frame   : The frame it is drawn in, enabled.
+*    4. level   : The level the entity drawn last used, 0 at first. Receives
+*                 the level picked.
+* Returns   :
+*    level : The level picked.
+*******************************************************************************/
+unsigned int model_lod(model *, mat4, const frame *, unsigned int *);
+
+
+/*******************************************************************************
+* Function  : model_draw
+* Brief     : Draw a model at a level of detail, with its maps. Enabling it 
+*             draws the finest level. Models without levels draw as enabled.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. level   : The level, from model_lod(). Clamped to those it has.
+* Returns   :
+*    true : The model is drawn.
+*    false: It could not be.
+*******************************************************************************/
+bool model_draw(model *, unsigned int);
+
+
+/*******************************************************************************
+* Function  : model_class
+* Brief     : The class that loads a model file: GltfModel for binary glTF 
+*             files, AssimpModel for any other. Both take the file and the 
+*             maps by name.
+* Parameters:
+*    1. file    : The model file.
+* Returns   :
+*    class : The class to create it with.
+*******************************************************************************/
+const void *model_class(const char *);
+
+
 /*******************************************************************************
 * Class     : Model
 * Brief     : Defines a class that will handle our basic functions.
@@ -48,4 +185,6 @@ extern const void *Model;
 
 extern const void *AssimpModel;
 
+extern const void *GltfModel;
+
 #endif
\ No newline at end of file
@@ -25,6 +25,8 @@
 *                         user).
 *    8. __enable__      : Make this instance active. Make OpenGL use its buffer
 *                         or the program for instance.
+*    9. __reload__      : Rebuild this instance if it depends on a file that
+*                         has changed on disk, keeping it untouched on failure.
 *******************************************************************************/
 typedef struct class
 {
@@ -36,6 +38,7 @@ typedef struct class
   bool  (*__should_close__)(void *);
   bool  (*__prepare__)(void *);
   bool  (*__enable__)(void *);
+  bool  (*__reload__)(void *, const char *);
 }class;
 
 
@@ -139,4 +142,18 @@ bool prepare(void *);
 *    false: One of the steps to enable one instance failed.
 *******************************************************************************/
 bool enable(void *, ...);
+
+
+/*******************************************************************************
+* Function  : reload
+* Brief     : Let an instance rebuild itself if it depends on a file that has
+*             changed on disk.
+* Parameters:
+*    1. self    : The instance of the class.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The instance depends on this file and started reloading.
+*    false: The instance does not depend on this file, or cannot reload.
+*******************************************************************************/
+bool reload(void *, const char *);
 #endif
@@ -9,6 +9,9 @@
 #define __TAWY__PROGRAM_H__
 #include "object.h"
 
+#define TAWY_UNIFORM_NAME_LEN 64
+#define TAWY_PROGRAM_FILE_LEN 64
+
 
 typedef enum 
 {
@@ -18,6 +21,67 @@ typedef enum
   UNIFORM_MAT4,
 } uniform_type;
 
+
+typedef enum
+{
+  PROGRAM_PENDING,
+  PROGRAM_READY,
+  PROGRAM_FAILED,
+} program_status;
+
+
+/*******************************************************************************
+* Struct    : uniform
+* Brief     : An active uniform, as reflected from the linked program.
+* Attributes:
+*    1. name     : The uniform name, without any trailing "[0]".
+*    2. location : The location of the uniform in the program.
+*    3. type     : The OpenGL type of the uniform (GL_FLOAT_MAT4...).
+*    4. size     : The number of elements if the uniform is an array.
+*    5. unit     : The texture unit bound to this uniform if it is a sampler,
+*                  -1 otherwise.
+*    6. shadowed : True once value holds what OpenGL holds for this uniform.
+*    7. value    : CPU side copy of the last uploaded value. Uniforms larger
+*                  than a mat4 are not shadowed and are always uploaded.
+*******************************************************************************/
+typedef struct uniform
+{
+  char         name[TAWY_UNIFORM_NAME_LEN];
+  int          location;
+  unsigned int type;
+  int          size;
+  int          unit;
+  bool         shadowed;
+  float        value[16];
+}uniform;
+
+
+/*******************************************************************************
+* Struct    : program_stats
+* Brief     : Counters of the GL calls issued, or elided because they would 
+*             not have changed anything, by every program. And of how 
+*             programs were obtained at startup.
+* Attributes:
+*    1. uploads_issued : glUniform* calls sent to OpenGL.
+*    2. uploads_skipped: Uploads elided since the value was already there.
+*    3. binds_issued   : glUseProgram calls sent to OpenGL.
+*    4. binds_skipped  : glUseProgram elided since the program was current.
+*    5. cache_hits     : Programs loaded from the on-disk binary cache.
+*    6. cache_misses   : Programs compiled from GLSL sources.
+*    7. cache_saved    : Compile and link time saved by cache hits, in seconds.
+*******************************************************************************/
+typedef struct program_stats
+{
+  unsigned long uploads_issued;
+  unsigned long uploads_skipped;
+  unsigned long binds_issued;
+  unsigned long binds_skipped;
+  unsigned long cache_hits;
+  unsigned long cache_misses;
+  double        cache_saved;
+}program_stats;
+
+
 /*******************************************************************************
 * Struct    : program
 * Brief     : Defines an instance of a program containing its shaders/
@@ -25,19 +89,108 @@ typedef enum
 *    1. id               : The identifier of the linked shaders program
 *    2. fragment_shader  : The OpenGL Fragment shader
 *    3. vertex_shader    : The OpenGL Vertex shader
+*    4. uniforms         : The active uniforms, reflected at link time. A
+*                          handle is an index in this array.
+*    5. uniform_cnt      : The number of active uniforms.
+*    6. slots            : Open addressing hash table, name -> handle.
+*    7. slot_mask        : The number of slots minus one (power of two).
+*    8. status           : Pending while the driver compiles and links it.
+*    9. key              : The key of the program in the binary cache.
+*   10. build_time       : The time spent submitting and completing its
+*                          compilation, in seconds, not the time it waited.
+*   11. vertex, fragment : The files it is built from, to reload it.
+*   12. features         : The features it is built with, to reload it.
+*   13. next             : Its reloaded version, until it replaces this one.
 * Class     : The structure storing our handlers.
 *******************************************************************************/
 typedef struct program
 {
   const void *__cls__;
 
-  unsigned int id;
-  unsigned int fragment_shader;
-  unsigned int vertex_shader;
+  unsigned int       id;
+  unsigned int       fragment_shader;
+  unsigned int       vertex_shader;
+  program_status     status;
+  unsigned long long key;
+  double             build_time;
 
+  uniform           *uniforms;
+  unsigned int       uniform_cnt;
+  int               *slots;
+  unsigned int       slot_mask;
+
+  char               vertex[TAWY_PROGRAM_FILE_LEN];
+  char               fragment[TAWY_PROGRAM_FILE_LEN];
+  unsigned int       features;
+  struct program    *next;
 }program;
 
 
+/*******************************************************************************
+* Function  : program_uniform
+* Brief     : Resolve a uniform name to a handle, once, outside the render loop.
+* Parameters:
+*    1. self    : The instance of the program.
+*    2. name    : The uniform name.
+* Returns   :
+*    handle: The handle to pass to program_set().
+*    -1    : The program has no active uniform with this name.
+*******************************************************************************/
+int program_uniform(program *, const char *);
+
+
+/*******************************************************************************
+* Function  : program_set
+* Brief     : Upload a uniform value through its handle, with no string lookup.
+*             The value layout is deduced from the reflected uniform type.
+* Parameters:
+*    1. self    : The instance of the program. It must be enabled.
+*    2. handle  : The handle obtained from program_uniform().
+*    3. value   : The pointer to the value to upload.
+* Returns   :
+*    true : The value has been transferred to the uniform.
+*    false: The handle is invalid, or its type is not supported.
+*******************************************************************************/
+bool program_set(program *, int, const void *);
+
+
+/*******************************************************************************
+* Function  : program_async
+* Brief     : Choose how the next programs are built. Asynchronously, new() 
+*             submits them to the driver and returns them pending: prepare()
+*             polls them, enable() waits for them.
+* Parameters:
+*    1. async   : True to compile asynchronously.
+*******************************************************************************/
+void program_async(bool);
+
+
+/*******************************************************************************
+* Function  : program_warm_up
+* Brief     : Wait for programs, then draw with each of them once, offscreen,
+*             so that drivers finish any deferred work before the first 
+*             visible frame instead of during it.
+* Parameters:
+*    1. self    : First program to warm up.
+*    2. args    : Other programs to warm up. MUST BE NULL TERMINATED!
+* Returns   :
+*    true : Every program is ready and has been drawn with.
+*    false: One of the programs failed to compile or link.
+*******************************************************************************/
+bool program_warm_up(program *, ...);
+
+
+/*******************************************************************************
+* Function  : program_statistics
+* Brief     : Access the counters of issued and skipped GL calls.
+* Parameters:
+*    1. reset   : If true, counters are zeroed after being read.
+* Returns   :
+*    stats: A copy of the counters.
+*******************************************************************************/
+program_stats program_statistics(bool);
+
+
 /*******************************************************************************
 * Class     : Program
 * Brief     : Defines a class that will handle our basic functions.
@@ -0,0 +1,67 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: program_cache.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module stores linked programs on disk, as driver binaries, so
+*           that next launches do not compile GLSL again.
+*******************************************************************************/
+#ifndef __TAWY__PROGRAM_CACHE_H__
+#define __TAWY__PROGRAM_CACHE_H__
+#include <stdbool.h>
+
+#define TAWY_PROGRAM_CACHE_DIR "cache/programs/"
+
+
+/*******************************************************************************
+* Function  : program_cache_key
+* Brief     : Hash what makes a program binary valid: its sources, its defines,
+*             and the vendor, renderer and version of the driver.
+* Parameters:
+*    1. vertex  : The vertex shader source.
+*    2. fragment: The fragment shader source.
+*    3. defines : The defines injected in both sources, or NULL.
+* Returns   :
+*    key: A 64 bits key identifying the binary in the cache.
+*******************************************************************************/
+unsigned long long program_cache_key(const char *, const char *, const char *);
+
+
+/*******************************************************************************
+* Function  : program_cache_load
+* Brief     : Load a program binary from the cache into a new program object.
+* Parameters:
+*    1. key       : The key from program_cache_key().
+*    2. build_time: Stores how long the compilation took when it was cached.
+* Returns   :
+*    id: The linked program.
+*    0 : The binary is missing, or has been rejected by the driver.
+*******************************************************************************/
+unsigned int program_cache_load(unsigned long long, double *);
+
+
+/*******************************************************************************
+* Function  : program_cache_store
+* Brief     : Save the binary of a freshly linked program in the cache.
+* Parameters:
+*    1. id        : The linked program. It must have been linked with the 
+*                   GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+*    2. key       : The key from program_cache_key().
+*    3. build_time: How long it took to compile and link it, in seconds.
+* Returns   :
+*    true : The binary has been written.
+*    false: The driver has no binary format, or the file could not be written.
+*******************************************************************************/
+bool program_cache_store(unsigned int, unsigned long long, double);
+
+
+/*******************************************************************************
+* Function  : program_cache_enabled
+* Brief     : Tell whether the driver exposes at least one program binary format.
+* Returns   :
+*    true : The cache can be used.
+*    false: Programs must always be compiled.
+*******************************************************************************/
+bool program_cache_enabled(void);
+
+#endif
\ No newline at end of file
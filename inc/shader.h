@@ -0,0 +1,78 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: shader.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module preprocesses GLSL sources, resolving their #include and
+*           injecting feature #define, and caches the program permutations.
+*******************************************************************************/
+#ifndef __TAWY__SHADER_H__
+#define __TAWY__SHADER_H__
+#include "program.h"
+
+#define TAWY_GLSL_DIR           "src/render/glsl/"
+#define TAWY_SHADER_DEFINES_LEN 256
+
+
+/*******************************************************************************
+* Enum      : shader_feature
+* Brief     : The feature keys a permutation can be compiled with. Each of them
+*             is injected as a #define of the same name, minus the prefix.
+*******************************************************************************/
+typedef enum
+{
+  FEATURE_DIFFUSE_MAP = 1 << 0,  // Samples texture1.
+  FEATURE_DETAIL_MAP  = 1 << 1,  // Mixes texture2 over texture1.
+  FEATURE_VIRTUAL_MAP = 1 << 2,  // Samples a virtual texture instead of textures.
+  FEATURE_FEEDBACK    = 1 << 3,  // Writes the virtual pages seen, for the feedback pass.
+} shader_feature;
+
+
+/*******************************************************************************
+* Function  : shader_defines
+* Brief     : Write the #define lines matching a set of features.
+* Parameters:
+*    1. features: A combination of shader_feature.
+*    2. defines : The buffer to write to, TAWY_SHADER_DEFINES_LEN bytes long.
+* Returns   :
+*    defines: The buffer, for convenience.
+*******************************************************************************/
+char *shader_defines(unsigned int, char *);
+
+
+/*******************************************************************************
+* Function  : shader_source
+* Brief     : Load a GLSL file of any size from TAWY_GLSL_DIR, expand its 
+*             #include "file" directives, and inject defines after #version.
+* Parameters:
+*    1. filename: The GLSL file, relative to TAWY_GLSL_DIR.
+*    2. defines : The #define lines to inject, or NULL.
+* Returns   :
+*    source: The preprocessed source, to be released with free().
+*    NULL  : The file, or one of its includes, could not be read.
+*******************************************************************************/
+char *shader_source(const char *, const char *);
+
+
+/*******************************************************************************
+* Function  : permutation
+* Brief     : Get the program built from a pair of shaders and a set of 
+*             features. It is compiled on first request, and shared afterwards.
+* Parameters:
+*    1. vertex  : The vertex shader file.
+*    2. fragment: The fragment shader file.
+*    3. features: A combination of shader_feature.
+* Returns   :
+*    program: The permutation.
+*    NULL   : The permutation could not be built.
+*******************************************************************************/
+program *permutation(const char *, const char *, unsigned int);
+
+
+/*******************************************************************************
+* Function  : permutations_clear
+* Brief     : Delete every permutation built so far.
+*******************************************************************************/
+void permutations_clear(void);
+
+#endif
\ No newline at end of file
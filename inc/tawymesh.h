@@ -0,0 +1,217 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: tawymesh.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes the baked mesh file: its vertices and indices
+*           already laid out as the GPU reads them, mapped and handed straight
+*           to OpenGL. It also imports any file assimp reads into the same 
+*           layout, for the tawymesh tool to bake, or for models not baked.
+*******************************************************************************/
+#ifndef __TAWY__TAWYMESH_H__
+#define __TAWY__TAWYMESH_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include "vertex_format.h"
+
+#define TAWY_MESH_EXTENSION ".tawymesh"
+#define TAWY_MESH_MAGIC     0x3248534du  // "MSH2"
+#define TAWY_MESH_ALIGN     16           // Blobs start on this many bytes.
+#define TAWY_MESH_NAME_LEN  256
+#define TAWY_MESH_TEXTURES  16
+
+//
+// Models not baked are imported with these options, see mesh_option.
+//
+#define TAWY_MESH_OPTIONS   (TAWY_MESH_COMPRESS | TAWY_MESH_OPTIMIZE)
+
+//
+// Imported meshes are simplified into up to TAWY_MESH_LODS levels of detail,
+// each with TAWY_MESH_LOD_RATIO of the triangles of the previous one, see 
+// mesh_simplify(). A level that keeps more than TAWY_MESH_LOD_KEEP of them,
+// the previous level being mostly locked, ends the chain. Set TAWY_MESH_LODS
+// to 1 to import the meshes as they are.
+//
+#define TAWY_MESH_LODS      4
+#define TAWY_MESH_LOD_RATIO 0.5f
+#define TAWY_MESH_LOD_KEEP  0.85f
+
+
+/*******************************************************************************
+* Enum      : mesh_option
+* Brief     : What tawymesh_import() does to the meshes it imports, chosen at
+*             each import: models use TAWY_MESH_OPTIONS, the tawymesh tool 
+*             its flags.
+*******************************************************************************/
+typedef enum
+{
+  TAWY_MESH_COMPRESS = 1 << 0,  // 16 bits positions within their box, packed normals, 16 bits texture
+                                // coordinates, and 16 bits indices when submeshes are small enough.
+  TAWY_MESH_OPTIMIZE = 1 << 1,  // Welds vertices, and reorders triangles and vertices for the vertex stage.
+  TAWY_MESH_VERBOSE  = 1 << 2,  // Prints what optimizing and simplifying achieved, for tools.
+} mesh_option;
+
+
+/*******************************************************************************
+* Struct    : submesh
+* Brief     : Defines a mesh of a model file, laid after the previous one in the
+*             vertex and index buffers of the model.
+* Attributes:
+*    1. base_vertex : Its first vertex in the vertex buffer, added to each of
+*                     its indices.
+*    2. first_index : Its first index in the index buffer.
+*    3. count       : Its number of indices, 3 per triangle.
+*    4. material    : The index of its material in the file.
+*******************************************************************************/
+typedef struct submesh
+{
+  int          base_vertex;
+  unsigned int first_index;
+  unsigned int count;
+  unsigned int material;
+}submesh;
+
+
+/*******************************************************************************
+* Struct    : tawymesh_header
+* Brief     : What opens the file. Blobs follow, each at its offset from the
+*             start of the file, aligned on TAWY_MESH_ALIGN.
+* Attributes:
+*    1. magic      : TAWY_MESH_MAGIC.
+*    2. vertices   : The number of vertices of every stream.
+*    3. elements   : The number of indices.
+*    4. index_type : GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+*    5. submesh_cnt: The number of submeshes of a level of detail.
+*    6. lod_cnt    : The number of levels of detail, 1 at least. They share
+*                    the vertices, each has its own indices.
+*    7. lod_error  : The distance, in model space, the surface of each level
+*                    moved from the first one at most. 0 for the first.
+*    8. texture_cnt: The number of diffuse textures its materials name.
+*    9. format     : The layout of its vertices in their streams.
+*   10. position_scale, position_offset: What dequantizes positions.
+*   11. bounds     : The sphere bounding its vertices, center then radius.
+*   12. submeshes  : The offset of the submesh table: submesh_cnt submeshes
+*                    per level, the finest level first.
+*   13. textures   : The offset of the texture names, relative to the file,
+*                    TAWY_MESH_NAME_LEN bytes each.
+*   14. streams    : The offset of each vertex stream.
+*   15. indices    : The offset of the indices.
+*   16. size       : The size of the file.
+*******************************************************************************/
+typedef struct tawymesh_header
+{
+  unsigned int       magic;
+  unsigned int       vertices;
+  unsigned int       elements;
+  unsigned int       index_type;
+  unsigned int       submesh_cnt;
+  unsigned int       lod_cnt;
+  float              lod_error[TAWY_MESH_LODS];
+  unsigned int       texture_cnt;
+  vertex_format      format;
+  float              position_scale[3];
+  float              position_offset[3];
+  float              bounds[4];
+  unsigned long long submeshes;
+  unsigned long long textures;
+  unsigned long long streams[TAWY_VERTEX_STREAMS];
+  unsigned long long indices;
+  unsigned long long size;
+}tawymesh_header;
+
+
+/*******************************************************************************
+* Struct    : tawymesh
+* Brief     : A mesh in the layout of the file, mapped from a baked file or 
+*             imported in memory. Its pointers point within its data.
+* Attributes:
+*    1. header   : Its header, at the start of its data.
+*    2. submeshes: Its submesh table, level after level.
+*    3. textures : Its texture names.
+*    4. streams  : Its vertex streams.
+*    5. indices  : Its indices, of index_type.
+*    6. data     : The whole file.
+*    7. size     : Its size.
+*    8. mapped   : True if the data is mapped, false if allocated.
+*******************************************************************************/
+typedef struct tawymesh
+{
+  const tawymesh_header *header;
+  const submesh         *submeshes;
+  const char           (*textures)[TAWY_MESH_NAME_LEN];
+  const unsigned char   *streams[TAWY_VERTEX_STREAMS];
+  const void            *indices;
+  void                  *data;
+  size_t                 size;
+  bool                   mapped;
+}tawymesh;
+
+
+/*******************************************************************************
+* Function  : tawymesh_baked
+* Brief     : The baked file of a model file: its extension is replaced.
+* Parameters:
+*    1. file    : The model file.
+*    2. path    : Receives the baked file, TAWY_MESH_NAME_LEN bytes.
+* Returns   :
+*    true : The baked file exists, is newer than the model file, and opens
+*           with TAWY_MESH_MAGIC.
+*    false: It must be baked again.
+*******************************************************************************/
+bool tawymesh_baked(const char *, char *);
+
+
+/*******************************************************************************
+* Function  : tawymesh_map
+* Brief     : Map a baked file, and check that its blobs lie within it and
+*             that its indices stay within their submesh.
+* Parameters:
+*    1. mesh    : Receives the mesh.
+*    2. file    : The baked file.
+* Returns   :
+*    true : The mesh is mapped. Release it with tawymesh_release().
+*    false: The file could not be mapped, or is not a baked mesh.
+*******************************************************************************/
+bool tawymesh_map(tawymesh *, const char *);
+
+
+/*******************************************************************************
+* Function  : tawymesh_import
+* Brief     : Import every mesh of a model file, one after the other, optimized
+*             and compressed as its options tell, and simplified as
+*             TAWY_MESH_LODS tells.
+*             .obj files are read by wavefront.h, any other file by assimp.
+* Parameters:
+*    1. mesh    : Receives the mesh.
+*    2. file    : The model file.
+*    3. options : A combination of mesh_option.
+* Returns   :
+*    true : The mesh is imported. Release it with tawymesh_release().
+*    false: The file could not be imported, has no triangle, or memory is
+*           exhausted.
+*******************************************************************************/
+bool tawymesh_import(tawymesh *, const char *, unsigned int);
+
+
+/*******************************************************************************
+* Function  : tawymesh_write
+* Brief     : Write a mesh to a baked file, aside and then renamed over it.
+* Parameters:
+*    1. mesh    : The mesh.
+*    2. file    : The baked file.
+* Returns   :
+*    true : The file is written.
+*    false: It could not be, a previous file is left as it was.
+*******************************************************************************/
+bool tawymesh_write(const tawymesh *, const char *);
+
+
+/*******************************************************************************
+* Function  : tawymesh_release
+* Brief     : Unmap or free a mesh.
+* Parameters:
+*    1. mesh    : The mesh.
+*******************************************************************************/
+void tawymesh_release(tawymesh *);
+
+#endif
\ No newline at end of file
@@ -7,28 +7,201 @@
 *******************************************************************************/
 #ifndef __TAWY__TEXTURE_H__
 #define __TAWY__TEXTURE_H__
+#include <stddef.h>
 #include "object.h"
 
+#define TAWY_TEXTURE_DIR          "res/textures/"
+#define TAWY_TEXTURE_PATH_LEN     256
+#define TAWY_TEXTURE_BUDGET       (1024ull << 20)  // Half of a 2 GB card, the rest for buffers.
+#define TAWY_TEXTURE_IDLE_FRAMES  120              // Textures bound more recently are never evicted.
+#define TAWY_TEXTURE_COARSEST     64               // New and evicted textures load levels this large at most.
+
+
+typedef enum
+{
+  TEXTURE_FLIP_Y      = 1 << 0,  // The image is flipped vertically on load.
+  TEXTURE_CLAMP       = 1 << 1,  // Coordinates are clamped to edges, not repeated.
+  TEXTURE_SRGB        = 1 << 2,  // The image holds sRGB colors, made linear when sampled.
+  TEXTURE_PREMULTIPLY = 1 << 3,  // Colors are multiplied by alpha on load, to blend with GL_ONE.
+} texture_option;
+
+
+typedef enum
+{
+  TEXTURE_PENDING,
+  TEXTURE_READY,
+  TEXTURE_FAILED,
+} texture_status;
+
 
 /*******************************************************************************
 * Struct    : texture
 * Brief     : Defines an instance of a model that is potentially shared between
 *             multiple entities.
 * Attributes:
-
+*    1. id             : The OpenGL texture array holding it. The placeholder
+*                        while pending.
+*    2. width, height  : The size of the image uploaded, in pixels. Smaller
+*                        than the file while its finest levels are not.
+*    3. number_channels: The number of channels in the image file.
+*    4. path           : The image file, relative to the working directory,
+*                        normalized so that it identifies the file. The name
+*                        of the image if it is in memory.
+*    5. options        : The texture_option flags it has been loaded with.
+*    6. refs           : The number of owners acquired from the registry.
+*    7. modified       : The modification time of the file when it was loaded,
+*                        in nanoseconds, so that shared textures reload once.
+*    8. status         : Pending until its image is decoded and uploaded.
+*    9. pool           : The texture array it is placed in, NULL if none.
+*   10. layer          : Its layer in the texture array.
+*   11. rect           : Its offset and scale in the layer, if in an atlas.
+*   12. footprint      : The video memory it takes in its array, every level
+*                        included, in bytes. 0 while it uses the placeholder.
+*   13. used           : The last frame it was bound in, by textures_enable().
+*   14. evicted        : True while only its smallest levels are loaded, to
+*                        fit the budget. It is restored when bound.
+*   15. lod            : The level of the file uploaded as its first level, 0
+*                        if its finest level is resident.
+*   16. largest        : The size its levels are loaded to fit in, 0 for all.
+*   17. needed         : The largest size it was drawn at this frame, in 
+*                        pixels, 0 if unknown.
+*   18. source         : The encoded image, owned, if it was given in memory
+*                        rather than as a file. NULL otherwise.
 * Class     : The structure storing our handlers.
 *******************************************************************************/
 typedef struct texture
 {
   const void *__cls__;
 
-  unsigned int id;
-  int          width;
-  int          height;
-  int          number_channels;
+  unsigned int   id;
+  int            width;
+  int            height;
+  int            number_channels;
+  char           path[TAWY_TEXTURE_PATH_LEN];
+  unsigned int   options;
+  unsigned int   refs;
+  long long      modified;
+  texture_status status;
+
+  struct texture_pool *pool;
+  int                  layer;
+  float                rect[4];
+  size_t               footprint;
+  unsigned long        used;
+  bool                 evicted;
+  int                  lod;
+  int                  largest;
+  float                needed;
+
+  unsigned char       *source;
+  size_t               source_size;
 }texture;
 
 
+/*******************************************************************************
+* Function  : texture_acquire
+* Brief     : Obtain the texture of an image file with given options, loading
+*             it only if no owner holds it yet. Memory and load time scale with
+*             unique textures, not with the number of models using them.
+* Parameters:
+*    1. dir     : The directory the file is relative to. Ignored if the file is
+*                 absolute.
+*    2. file    : The image file. It may contain '.', '..' or '\\' separators.
+*    3. options : The texture_option flags to load it with.
+* Returns   :
+*    texture: The shared texture. Give it back with texture_release().
+*    NULL   : The image could not be loaded.
+*******************************************************************************/
+texture *texture_acquire(const char *, const char *, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_acquire_memory
+* Brief     : Obtain the texture of an image held in memory, such as one 
+*             embedded in a model file. The encoded image is copied, and 
+*             decoded as files are, but never cached nor written to disk. 
+*             Owners giving the same name and content share it.
+* Parameters:
+*    1. name    : The name of the image, that identifies it in the registry.
+*    2. data    : The encoded image.
+*    3. size    : Its size, in bytes.
+*    4. options : The texture_option flags to load it with.
+* Returns   :
+*    texture: The shared texture. Give it back with texture_release().
+*    NULL   : The image could not be copied, or its name is too long.
+*******************************************************************************/
+texture *texture_acquire_memory(const char *, const void *, size_t, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_release
+* Brief     : Give a texture back to the registry. It is deleted with its last
+*             owner.
+* Parameters:
+*    1. self    : The texture obtained from texture_acquire(). May be NULL.
+*******************************************************************************/
+void texture_release(texture *);
+
+
+/*******************************************************************************
+* Function  : texture_budget
+* Brief     : Set the video memory texture arrays may use. Over it, textures 
+*             not bound for TAWY_TEXTURE_IDLE_FRAMES are evicted, least 
+*             recently used first. TAWY_TEXTURE_BUDGET by default.
+* Parameters:
+*    1. bytes   : The budget, in bytes. 0 to never evict.
+*******************************************************************************/
+void texture_budget(size_t);
+
+
+/*******************************************************************************
+* Function  : texture_touch
+* Brief     : Record that a texture is bound this frame. If it was evicted, 
+*             textures_stream() restores it, its smallest levels are used 
+*             until then.
+* Parameters:
+*    1. self    : The texture.
+*******************************************************************************/
+void texture_touch(texture *);
+
+
+/*******************************************************************************
+* Function  : texture_need
+* Brief     : Record the size a texture is drawn at this frame, so that only 
+*             the levels this size needs are streamed. Textures bound without
+*             it are streamed whole.
+* Parameters:
+*    1. self    : The texture.
+*    2. pixels  : The size it covers on screen, in pixels.
+*******************************************************************************/
+void texture_need(texture *, float);
+
+
+/*******************************************************************************
+* Function  : textures_stream
+* Brief     : Stream the finer levels of textures drawn last frame larger than
+*             their first level, and drop the levels of textures drawn at a 
+*             quarter of it or less. Call it once per frame, before 
+*             textures_evict().
+* Returns   :
+*    cnt: The number of textures streamed in or out by this call.
+*******************************************************************************/
+unsigned int textures_stream(void);
+
+
+/*******************************************************************************
+* Function  : textures_evict
+* Brief     : Start a new frame, and evict the least recently used textures 
+*             while texture arrays exceed the budget. Evicted textures use the
+*             placeholder until their smallest levels are uploaded, and arrays
+*             are deleted once emptied. Call it once per frame, from the GL 
+*             thread.
+* Returns   :
+*    cnt: The number of textures evicted by this call.
+*******************************************************************************/
+unsigned int textures_evict(void);
+
+
 /*******************************************************************************
 * Class     : Texture
 * Brief     : Defines a class that will handle our basic functions.
@@ -0,0 +1,156 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_array.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module packs textures into layers of 2D texture arrays, and
+*           small ones into atlas pages, so that draws select a layer instead
+*           of binding textures.
+*******************************************************************************/
+#ifndef __TAWY__TEXTURE_ARRAY_H__
+#define __TAWY__TEXTURE_ARRAY_H__
+#include "texture.h"
+
+#define TAWY_TEXTURE_ATLAS_SIZE    1024  // The size of atlas pages, in pixels.
+#define TAWY_TEXTURE_ATLAS_MAX     256   // Larger textures get a whole layer.
+#define TAWY_TEXTURE_ATLAS_PADDING 4     // Wrapped texels around atlas entries,
+                                         // ATLAS_MAX_LOD in texture.glsl follows.
+#define TAWY_TEXTURE_UPLOAD_UNIT   16    // The unit uploads bind to. No draw uses it.
+
+//
+// Vertex attributes carrying, for the draw, where its maps are. They are not
+// arrays but constant values, set with glVertexAttrib*().
+//
+#define TAWY_ATTRIB_DIFFUSE_RECT   3
+#define TAWY_ATTRIB_DETAIL_RECT    4
+#define TAWY_ATTRIB_MAPS           5
+
+
+/*******************************************************************************
+* Struct    : texture_region
+* Brief     : Where an image is written in its texture array.
+* Attributes:
+*    1. x, y          : The corner of the region, padding included.
+*    2. layer         : The layer of the array.
+*    3. width, height : The size of the region, padding included.
+*    4. padding       : The number of wrapped texels around the image.
+*    5. levels        : The number of levels to write. Only the first in atlas
+*                       pages, which generate the others.
+*    6. format        : The internal format of the array. Compressed levels 
+*                       are written with it.
+*******************************************************************************/
+typedef struct texture_region
+{
+  int          x;
+  int          y;
+  int          layer;
+  int          width;
+  int          height;
+  int          padding;
+  int          levels;
+  unsigned int format;
+}texture_region;
+
+
+/*******************************************************************************
+* Function  : texture_placeholder
+* Brief     : Access the 1x1 texture array standing in for textures not uploaded yet.
+*             It must be called from the GL thread.
+* Returns   :
+*    id: The OpenGL texture, created on first call.
+*******************************************************************************/
+unsigned int texture_placeholder(void);
+
+
+/*******************************************************************************
+* Function  : texture_array_place
+* Brief     : Reserve room for an image in an array of same size and format, or
+*             in an atlas page if it is small, adding an array when they are 
+*             full. The texture is given its array, layer and rect. It must be
+*             called from the GL thread.
+* Parameters:
+*    1. self    : The texture. It must not be placed already.
+*    2. width   : The width of the image.
+*    3. height  : The height of the image.
+*    4. channels: The number of channels of the image, from 1 to 4.
+*    5. format  : The compressed format of a baked image, 0 otherwise.
+*    6. levels  : The number of levels the image comes with, 1 if decoded.
+*    7. region  : Receives where the image must be written, from the unit
+*                 TAWY_TEXTURE_UPLOAD_UNIT.
+* Returns   :
+*    true : The texture is placed.
+*    false: The image does not fit in any array.
+*******************************************************************************/
+bool texture_array_place(texture *, int, int, int, unsigned int, int, texture_region *);
+
+
+/*******************************************************************************
+* Function  : texture_array_remove
+* Brief     : Give the room of a texture back, and make it use the placeholder.
+*             Arrays are deleted with their last texture.
+* Parameters:
+*    1. self    : The texture, placed or not.
+*******************************************************************************/
+void texture_array_remove(texture *);
+
+
+/*******************************************************************************
+* Function  : texture_arrays_mipmap
+* Brief     : Generate mipmaps of the arrays written since last call, once for
+*             all the images written to them.
+*******************************************************************************/
+void texture_arrays_mipmap(void);
+
+
+/*******************************************************************************
+* Function  : texture_units_bind
+* Brief     : Bind a texture to a draw unit, only if the unit does not hold it
+*             already. Arrays and 2D textures are shadowed apart, as OpenGL
+*             binds them apart.
+* Parameters:
+*    1. unit    : The unit, below TAWY_TEXTURE_UPLOAD_UNIT.
+*    2. target  : GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D.
+*    3. id      : The texture.
+*******************************************************************************/
+void texture_units_bind(unsigned int, unsigned int, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_units_forget
+* Brief     : Clear the shadow of the units a texture is bound to, before it is
+*             deleted: OpenGL may give its name to another texture.
+* Parameters:
+*    1. id      : The texture.
+*******************************************************************************/
+void texture_units_forget(unsigned int);
+
+
+/*******************************************************************************
+* Function  : textures_enable
+* Brief     : Bind the arrays of textures to units 0, 1... only if they are not
+*             bound already, and set the attributes telling the draw the layers
+*             and rects of its diffuse and detail maps.
+* Parameters:
+*    1. textures: The textures of the draw.
+*    2. cnt     : The number of textures.
+*******************************************************************************/
+void textures_enable(texture * const *, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_arrays_footprint
+* Brief     : The video memory allocated by texture arrays, used or not.
+* Returns   :
+*    size: The size of every level of every layer of every array, in bytes.
+*******************************************************************************/
+size_t texture_arrays_footprint(void);
+
+
+/*******************************************************************************
+* Function  : texture_arrays_clear
+* Brief     : Delete the placeholder and forget what units are bound to. Arrays
+*             are already deleted with their last texture.
+*******************************************************************************/
+void texture_arrays_clear(void);
+
+#endif
\ No newline at end of file
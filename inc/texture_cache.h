@@ -0,0 +1,121 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_cache.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module builds the mip chain of decoded images, and stores it
+*           on disk so that next launches map it instead of decoding.
+*******************************************************************************/
+#ifndef __TAWY__TEXTURE_CACHE_H__
+#define __TAWY__TEXTURE_CACHE_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include "image.h"
+
+#define TAWY_TEXTURE_CACHE_DIR  "cache/textures/"
+#define TAWY_TEXTURE_LEVELS     16
+#define TAWY_TEXTURE_MIP_FILTER IMAGE_KAISER  // Sharper than glGenerateMipmap.
+
+
+/*******************************************************************************
+* Struct    : texture_levels
+* Brief     : The mip levels of an image, ready to upload, in a mapped file or
+*             built in memory.
+* Attributes:
+*    1. map, map_size : The mapped file or the built levels, released by 
+*                       texture_levels_release().
+*    2. allocated     : True if the levels are built, not mapped.
+*    3. width, height : The size of the first level.
+*    4. channels      : The number of channels of the levels.
+*    5. format        : The compressed format of the levels, 0 if they are
+*                       plain texels, one byte per channel.
+*    6. count         : The number of levels.
+*    7. data, size    : Per level, where it is in the map and its size.
+*******************************************************************************/
+typedef struct texture_levels
+{
+  void                *map;
+  size_t               map_size;
+  bool                 allocated;
+  int                  width;
+  int                  height;
+  int                  channels;
+  unsigned int         format;
+  int                  count;
+  const unsigned char *data[TAWY_TEXTURE_LEVELS];
+  unsigned int         size[TAWY_TEXTURE_LEVELS];
+}texture_levels;
+
+
+/*******************************************************************************
+* Function  : texture_cache_key
+* Brief     : Hash what makes a cached image valid: the content of its file,
+*             not its name or date, and the options it is decoded with.
+* Parameters:
+*    1. data    : The content of the image file.
+*    2. size    : Its size.
+*    3. options : The texture options.
+* Returns   :
+*    key: A 64 bits key identifying the image in the cache.
+*******************************************************************************/
+unsigned long long texture_cache_key(const void *, size_t, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_cache_load
+* Brief     : Map a cached image and locate its levels. Nothing is read until
+*             the levels are uploaded, straight from the page cache.
+* Parameters:
+*    1. key     : The key from texture_cache_key().
+*    2. levels  : Receives the mapped levels.
+* Returns   :
+*    true : The levels are mapped.
+*    false: The image is not cached, or its file is invalid.
+*******************************************************************************/
+bool texture_cache_load(unsigned long long, texture_levels *);
+
+
+/*******************************************************************************
+* Function  : texture_levels_build
+* Brief     : Prepare a decoded image for upload: flip it, expand RGB to RGBA,
+*             premultiply its alpha, and compute its mip chain, with the SIMD
+*             kernels of image.h.
+* Parameters:
+*    1. levels  : Receives the levels, allocated.
+*    2. pixels  : The decoded image, top row first.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels, from 1 to 4.
+*    6. options : The texture options.
+* Returns   :
+*    true : The levels are built.
+*    false: Memory could not be allocated.
+*******************************************************************************/
+bool texture_levels_build(texture_levels *, const unsigned char *, int, int, int, unsigned int);
+
+
+/*******************************************************************************
+* Function  : texture_cache_store
+* Brief     : Save the levels built from a decoded image in the cache. 
+*             Concurrent stores of a key are safe: the file is written aside and
+*             renamed.
+* Parameters:
+*    1. key     : The key from texture_cache_key().
+*    2. levels  : The levels from texture_levels_build().
+* Returns   :
+*    true : The levels have been written.
+*    false: The file could not be written.
+*******************************************************************************/
+bool texture_cache_store(unsigned long long, const texture_levels *);
+
+
+/*******************************************************************************
+* Function  : texture_levels_release
+* Brief     : Unmap the file of levels, or free the built levels, and forget 
+*             them.
+* Parameters:
+*    1. levels  : The levels, mapped, built or neither.
+*******************************************************************************/
+void texture_levels_release(texture_levels *);
+
+#endif
\ No newline at end of file
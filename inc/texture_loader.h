@@ -0,0 +1,77 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_loader.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module decodes images on worker threads, and uploads them from
+*           the GL thread through a ring of pixel buffers, within a budget.
+*******************************************************************************/
+#ifndef __TAWY__TEXTURE_LOADER_H__
+#define __TAWY__TEXTURE_LOADER_H__
+#include <stddef.h>
+#include "texture.h"
+
+#define TAWY_TEXTURE_THREADS       4
+#define TAWY_TEXTURE_PBO_RING      3
+#define TAWY_TEXTURE_UPLOAD_BUDGET (4u << 20)
+
+
+/*******************************************************************************
+* Function  : texture_loader_submit
+* Brief     : Queue the decode of a texture file to the worker threads. The 
+*             texture keeps its current image until textures_upload() replaces
+*             it. A decode already queued for this texture is cancelled.
+* Parameters:
+*    1. self    : The texture, its path and options set.
+* Returns   :
+*    true : The decode is queued.
+*    false: Memory could not be allocated, or no thread could be started.
+*******************************************************************************/
+bool texture_loader_submit(texture *);
+
+
+/*******************************************************************************
+* Function  : texture_loader_cancel
+* Brief     : Forget any decode, or upload, queued for a texture.
+* Parameters:
+*    1. self    : The texture, before it is deleted.
+*******************************************************************************/
+void texture_loader_cancel(texture *);
+
+
+/*******************************************************************************
+* Function  : textures_upload
+* Brief     : Upload decoded textures, oldest first, until a byte budget is 
+*             spent. One texture is uploaded whatever its size, so that large 
+*             ones still make progress. Call it once per frame.
+* Parameters:
+*    1. budget  : The number of bytes allowed to be uploaded by this call.
+* Returns   :
+*    cnt: The number of textures still being decoded or waiting for upload.
+*******************************************************************************/
+unsigned int textures_upload(size_t);
+
+
+/*******************************************************************************
+* Function  : texture_baked_path
+* Brief     : The path of the file baked from an image: its extension replaced
+*             by TAWY_KTX_EXTENSION. The baked file is loaded instead of the 
+*             image when it is at least as recent.
+* Parameters:
+*    1. path    : The image file.
+*    2. baked   : Receives the baked file, TAWY_TEXTURE_PATH_LEN long.
+* Returns   :
+*    true : baked is set.
+*    false: The path is too long.
+*******************************************************************************/
+bool texture_baked_path(const char *, char *);
+
+
+/*******************************************************************************
+* Function  : texture_loader_stop
+* Brief     : Cancel queued work, join worker threads and release pixel 
+*             buffers. The loader restarts on next submit.
+*******************************************************************************/
+void texture_loader_stop(void);
+
+#endif
\ No newline at end of file
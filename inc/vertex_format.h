@@ -0,0 +1,115 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: vertex_format.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes how vertices lie in their buffers, and packs
+*           their attributes as the GPU reads them. It does not call OpenGL,
+*           so that tools bake meshes with it.
+*******************************************************************************/
+#ifndef __TAWY__VERTEX_FORMAT_H__
+#define __TAWY__VERTEX_FORMAT_H__
+#include <stdbool.h>
+
+//
+// Attribute locations, as vertex_shader.glsl declares them.
+//
+#define TAWY_VERTEX_POSITION   0
+#define TAWY_VERTEX_NORMAL     1
+#define TAWY_VERTEX_TEXCOORD   2
+#define TAWY_VERTEX_ATTRIBUTES 3
+#define TAWY_VERTEX_POSITION_SCALE  6  // Constant for the draw: dequantizes positions.
+#define TAWY_VERTEX_POSITION_OFFSET 7  // Constant for the draw.
+
+//
+// Positions come alone, for passes that only need depth. Every other 
+// attribute is interleaved in the shading stream, fetched in one go.
+//
+#define TAWY_STREAM_POSITIONS  0
+#define TAWY_STREAM_SHADING    1
+#define TAWY_VERTEX_STREAMS    2
+
+
+/*******************************************************************************
+* Struct    : vertex_attribute
+* Brief     : Defines where an attribute lies in the streams of a mesh.
+* Attributes:
+*    1. location   : Its location in the vertex shader.
+*    2. stream     : The stream it is interleaved in.
+*    3. size       : Its number of components.
+*    4. type       : The OpenGL type of its components.
+*    5. normalized : True if integer components map to [0, 1] or [-1, 1].
+*    6. offset     : Its offset in a vertex of the stream, in bytes.
+*******************************************************************************/
+typedef struct vertex_attribute
+{
+  unsigned int location;
+  unsigned int stream;
+  int          size;
+  unsigned int type;
+  bool         normalized;
+  unsigned int offset;
+}vertex_attribute;
+
+
+/*******************************************************************************
+* Struct    : vertex_format
+* Brief     : Defines the layout of the vertices of a mesh.
+* Attributes:
+*    1. stride    : Per stream, the size of a vertex in bytes, 0 if the stream
+*                   is empty.
+*    2. attribute : The attributes, in the order they were added.
+*******************************************************************************/
+typedef struct vertex_format
+{
+  unsigned int     stride[TAWY_VERTEX_STREAMS];
+  vertex_attribute attribute[TAWY_VERTEX_ATTRIBUTES];
+  unsigned int     attribute_cnt;
+}vertex_format;
+
+
+/*******************************************************************************
+* Function  : vertex_attribute_bytes
+* Brief     : The size of an attribute in a vertex, in bytes. Packed types hold
+*             every component in 4 bytes.
+* Parameters:
+*    1. type      : The OpenGL type of its components.
+*    2. size      : Its number of components.
+* Returns   :
+*    bytes: Its size.
+*******************************************************************************/
+unsigned int vertex_attribute_bytes(unsigned int, int);
+
+
+/*******************************************************************************
+* Function  : vertex_format_add
+* Brief     : Append an attribute to a stream of a format, after the previous
+*             ones, aligned on 4 bytes.
+* Parameters:
+*    1. format    : The format, zeroed before the first attribute.
+*    2. location  : The location of the attribute.
+*    3. stream    : The stream it goes to.
+*    4. size      : Its number of components.
+*    5. type      : The OpenGL type of its components.
+*    6. normalized: True if integer components are normalized.
+* Returns   :
+*    true : The attribute is added.
+*    false: The format has TAWY_VERTEX_ATTRIBUTES already, or the stream 
+*           does not exist: it is left as it is.
+*******************************************************************************/
+bool vertex_format_add(vertex_format *, unsigned int, unsigned int, int, unsigned int, bool);
+
+
+/*******************************************************************************
+* Function  : vertex_pack
+* Brief     : Pack the components of an attribute as its type stores them. 
+*             Normalized integers clamp them to their range, packed normals
+*             take 3 components and a zero w.
+* Parameters:
+*    1. attribute : The attribute.
+*    2. src       : Its components, in floats.
+*    3. dst       : Where it lies in its stream.
+*******************************************************************************/
+void vertex_pack(const vertex_attribute *, const float *, unsigned char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: virtual_texture.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module manages virtual textures, far larger than video memory.
+*           Only the pages a low resolution feedback pass sees are loaded, by
+*           worker threads, into a physical cache of fixed size shared by
+*           every virtual texture.
+*******************************************************************************/
+#ifndef __TAWY__VIRTUAL_TEXTURE_H__
+#define __TAWY__VIRTUAL_TEXTURE_H__
+#include "frame.h"
+#include "texture.h"
+#include "vtex.h"
+
+#define TAWY_VIRTUAL_CACHE_PAGES    32  // Pages per side of the physical cache: 72 MiB.
+#define TAWY_VIRTUAL_TEXTURES       255 // Feedback tells virtual textures apart with 8 bits.
+#define TAWY_VIRTUAL_THREADS        2
+#define TAWY_VIRTUAL_JOBS           64  // Pages being read at once, at most.
+#define TAWY_VIRTUAL_UPLOADS        16  // Pages uploaded per frame, at most.
+#define TAWY_VIRTUAL_CHANGES        32  // Pages remapped per frame before the whole table is.
+#define TAWY_VIRTUAL_FEEDBACK_SCALE 8   // The feedback pass is this many times smaller than the viewport.
+#define TAWY_VIRTUAL_FEEDBACK_RING  3   // Frames the feedback can be read back late.
+
+//
+// Samplers are bound in name order, shorter names first: "pages" then
+// "indirection".
+//
+#define TAWY_VIRTUAL_UNIT_PAGES       0
+#define TAWY_VIRTUAL_UNIT_INDIRECTION 1
+
+
+/*******************************************************************************
+* Struct    : virtual_texture
+* Brief     : Defines an instance of a virtual texture, read from a tiled file.
+* Attributes:
+*    1. id      : The OpenGL indirection texture. Each texel of its level l
+*                 maps a page of level l to the slot of the finest resident
+*                 page covering it: slot x, slot y, and the level of that page.
+*    2. path    : The tiled file, relative to the working directory.
+*    3. fd      : The tiled file, open for the workers to read pages.
+*    4. size    : The width and height of its finest level, in texels.
+*    5. levels  : Its number of levels, down to a single page.
+*    6. index   : What the feedback pass writes for it, from 1.
+*    7. first   : Per level, the index of its first page in slots.
+*    8. slots   : Per page, its slot in the physical cache, negative while
+*                 it is not resident.
+*    9. table   : The texels of every level of the indirection texture.
+*   10. changed : The pages resident or evicted since the table was last
+*                 uploaded: only the texels they cover are.
+*   11. change_cnt: Their number, above TAWY_VIRTUAL_CHANGES if they did not
+*                 fit: the whole table is then.
+* Class     : The structure storing our handlers.
+*******************************************************************************/
+typedef struct virtual_texture
+{
+  const void *__cls__;
+
+  unsigned int   id;
+  char           path[TAWY_TEXTURE_PATH_LEN];
+  int            fd;
+  int            size;
+  int            levels;
+  unsigned int   index;
+  unsigned int   first[TAWY_VTEX_LEVELS + 1];
+  int           *slots;
+  unsigned char *table;
+  unsigned int   changed[TAWY_VIRTUAL_CHANGES];
+  unsigned int   change_cnt;
+}virtual_texture;
+
+
+/*******************************************************************************
+* Function  : virtual_feedback_begin
+* Brief     : Render the next draws into the feedback buffer, at a fraction of
+*             the viewport. Draw the models with virtual textures there, with
+*             the FEATURE_FEEDBACK permutation of their program.
+* Parameters:
+*    1. frame   : The frame being drawn, enabled.
+*******************************************************************************/
+void virtual_feedback_begin(const frame *);
+
+
+/*******************************************************************************
+* Function  : virtual_feedback_end
+* Brief     : Start reading the feedback buffer back, without waiting for it,
+*             and render to the window again.
+*******************************************************************************/
+void virtual_feedback_end(void);
+
+
+/*******************************************************************************
+* Function  : virtual_textures_update
+* Brief     : Read the oldest feedback the GPU has finished, request the pages
+*             it shows missing, coarsest first, and upload the pages workers
+*             have read, replacing the least recently seen ones. Call it once
+*             per frame, from the GL thread.
+* Returns   :
+*    cnt: The number of pages uploaded by this call.
+*******************************************************************************/
+unsigned int virtual_textures_update(void);
+
+
+/*******************************************************************************
+* Function  : virtual_textures_clear
+* Brief     : Stop the workers, and delete the physical cache and the feedback
+*             buffers. Virtual textures must be deleted first.
+*******************************************************************************/
+void virtual_textures_clear(void);
+
+
+/*******************************************************************************
+* Class     : VirtualTexture
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+extern const void *VirtualTexture;
+
+#endif
\ No newline at end of file
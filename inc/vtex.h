@@ -0,0 +1,44 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: vtex.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes the tiled file of virtual textures, written
+*           by the vtex tool and read page by page by the virtual texture
+*           workers.
+*******************************************************************************/
+#ifndef __TAWY__VTEX_H__
+#define __TAWY__VTEX_H__
+
+#define TAWY_VTEX_EXTENSION ".vtex"
+#define TAWY_VTEX_MAGIC     0x31585456u  // "VTX1"
+#define TAWY_VTEX_PAGE      128          // The texels of a page, per side.
+#define TAWY_VTEX_BORDER    4            // Texels of its neighbours around a page, for filtering.
+#define TAWY_VTEX_SLOT      (TAWY_VTEX_PAGE + 2 * TAWY_VTEX_BORDER)
+#define TAWY_VTEX_LEVELS    16           // 4M texels per side at most.
+
+
+/*******************************************************************************
+* Struct    : vtex_header
+* Brief     : What opens the file. Pages follow, finest level first, each level
+*             bottom row first, each page TAWY_VTEX_SLOT texels square, RGBA,
+*             its border included and wrapped around the texture.
+* Attributes:
+*    1. magic   : TAWY_VTEX_MAGIC.
+*    2. size    : The width and height of the texture, a power of two and at
+*                 least TAWY_VTEX_PAGE.
+*    3. page    : TAWY_VTEX_PAGE, as written.
+*    4. border  : TAWY_VTEX_BORDER, as written.
+*    5. levels  : The number of levels, down to a single page.
+*******************************************************************************/
+typedef struct vtex_header
+{
+  unsigned int magic;
+  unsigned int size;
+  unsigned int page;
+  unsigned int border;
+  unsigned int levels;
+  unsigned int reserved[3];
+}vtex_header;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: watcher.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module watches asset directories from a background thread, and
+*           reloads the instances depending on files that changed.
+*******************************************************************************/
+#ifndef __TAWY__WATCHER_H__
+#define __TAWY__WATCHER_H__
+#include <pthread.h>
+#include "object.h"
+
+#define TAWY_WATCHER_DIRS     8
+#define TAWY_WATCHER_PATH_LEN 256
+
+
+/*******************************************************************************
+* Struct    : watcher
+* Brief     : Defines an instance watching a set of directories.
+* Attributes:
+*    1. fd          : The inotify file descriptor.
+*    2. wakeup      : A pipe waking the thread up when the watcher is deleted.
+*    3. thread      : The thread reading inotify events.
+*    4. lock        : Protects the queue, shared with the thread.
+*    5. dirs        : The watched directories, and their watch descriptors.
+*    6. queue       : The paths that changed since last prepare().
+*    7. objects     : The instances to reload when a path changed.
+* Class     : The structure storing our handlers.
+*******************************************************************************/
+typedef struct watcher
+{
+  const void *__cls__;
+
+  int              fd;
+  int              wakeup[2];
+  pthread_t        thread;
+  pthread_mutex_t  lock;
+
+  char             dirs[TAWY_WATCHER_DIRS][TAWY_WATCHER_PATH_LEN];
+  int              wds[TAWY_WATCHER_DIRS];
+  unsigned int     dir_cnt;
+
+  char           (*queue)[TAWY_WATCHER_PATH_LEN];
+  unsigned int     queue_cnt;
+  unsigned int     queue_cap;
+
+  void           **objects;
+  unsigned int     object_cnt;
+  unsigned int     object_cap;
+}watcher;
+
+
+/*******************************************************************************
+* Function  : watch
+* Brief     : Register instances to reload when a watched file changes. Each of
+*             them decides, through reload(), whether it depends on the file.
+* Parameters:
+*    1. self    : The instance of the watcher.
+*    2. args    : The instances to register. MUST BE NULL TERMINATED!
+* Returns   :
+*    true : Every instance has been registered.
+*    false: Memory could not be allocated, or there is no watcher.
+*******************************************************************************/
+bool watch(watcher *, ...);
+
+
+/*******************************************************************************
+* Class     : Watcher
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+extern const void *Watcher;
+#endif
\ No newline at end of file
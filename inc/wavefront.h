@@ -0,0 +1,119 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: wavefront.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module reads Wavefront .obj files without assimp. The file is
+*           mapped and cut in chunks on line boundaries, parsed on several
+*           threads, each chunk writing into its own range of the arrays of
+*           the whole file.
+*******************************************************************************/
+#ifndef __TAWY__WAVEFRONT_H__
+#define __TAWY__WAVEFRONT_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAWY_WAVEFRONT_THREADS  16
+#define TAWY_WAVEFRONT_CHUNK    (1 << 20) // Fewer bytes are not worth a thread.
+#define TAWY_WAVEFRONT_NAME_LEN 256
+
+
+/*******************************************************************************
+* Struct    : wavefront_corner
+* Brief     : A corner of a triangle: the index of each of its attributes, from
+*             0, -1 if the face gives none.
+*******************************************************************************/
+typedef struct wavefront_corner
+{
+  int position;
+  int texCoord;
+  int normal;
+}wavefront_corner;
+
+
+/*******************************************************************************
+* Struct    : wavefront_group
+* Brief     : Consecutive triangles drawn with the same material.
+* Attributes:
+*    1. first   : Its first triangle.
+*    2. count   : Its number of triangles.
+*    3. material: The index of its material.
+*******************************************************************************/
+typedef struct wavefront_group
+{
+  unsigned int first;
+  unsigned int count;
+  unsigned int material;
+}wavefront_group;
+
+
+/*******************************************************************************
+* Struct    : wavefront_material
+* Brief     : A material faces use, by name.
+* Attributes:
+*    1. name    : What usemtl names it, empty for faces before any.
+*    2. diffuse : Its diffuse map as the material library names it, relative
+*                 to the .obj file. Empty if none.
+*******************************************************************************/
+typedef struct wavefront_material
+{
+  char name[TAWY_WAVEFRONT_NAME_LEN];
+  char diffuse[TAWY_WAVEFRONT_NAME_LEN];
+}wavefront_material;
+
+
+/*******************************************************************************
+* Struct    : wavefront
+* Brief     : The contents of a .obj file. Polygons are cut in fans of
+*             triangles.
+* Attributes:
+*    1. positions : 3 floats per position,
+*    2. texCoords : 2 floats per texture coordinate,
+*    3. normals   : 3 floats per normal, in the order of the file.
+*    4. corners   : 3 corners per triangle.
+*    5. groups    : The triangles of each material, in the order of the file.
+*    6. materials : Each material used.
+*******************************************************************************/
+typedef struct wavefront
+{
+  float              *positions;
+  float              *texCoords;
+  float              *normals;
+  unsigned int        position_cnt;
+  unsigned int        texCoord_cnt;
+  unsigned int        normal_cnt;
+
+  wavefront_corner   *corners;
+  unsigned int        triangle_cnt;
+
+  wavefront_group    *groups;
+  unsigned int        group_cnt;
+
+  wavefront_material *materials;
+  unsigned int        material_cnt;
+}wavefront;
+
+
+/*******************************************************************************
+* Function  : wavefront_load
+* Brief     : Read a .obj file, and the diffuse maps of its material library.
+* Parameters:
+*    1. obj     : Receives the contents of the file.
+*    2. file    : The .obj file.
+* Returns   :
+*    true : The file is read. Release it with wavefront_release().
+*    false: It could not be mapped, a face refers to a missing attribute, or
+*           memory is exhausted.
+*******************************************************************************/
+bool wavefront_load(wavefront *, const char *);
+
+
+/*******************************************************************************
+* Function  : wavefront_release
+* Brief     : Free the contents of a .obj file.
+* Parameters:
+*    1. obj     : The contents.
+*******************************************************************************/
+void wavefront_release(wavefront *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,580 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: gltf.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module maps binary glTF 2.0 files (.glb). Their accessors
+*           already lie in the binary chunk as the GPU reads them: they are
+*           located and checked, never copied, and handed to OpenGL with the
+*           layout the file gives. It does not call OpenGL.
+*******************************************************************************/
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+
+#include "gltf.h"
+#include "json.h"
+
+
+/*******************************************************************************
+* Struct    : gltf_parser
+* Brief     : The state of the reading of a file.
+* Attributes:
+*    1. doc       : The tokens of its JSON chunk.
+*    2. file      : The file, its binary chunk located.
+*    3. name      : The file, for messages.
+*    4. accessors, views, buffers, materials, textures: The arrays of the
+*                   document, -1 if absent.
+*    5. low, high : The range of the binary chunk accessors lie in so far.
+*    6. lo, hi    : The box of the positions so far.
+*******************************************************************************/
+typedef struct gltf_parser
+{
+  json        doc;
+  gltf       *file;
+  const char *name;
+  int         accessors;
+  int         views;
+  int         buffers;
+  int         materials;
+  int         textures;
+  size_t      low;
+  size_t      high;
+  float       lo[3];
+  float       hi[3];
+}gltf_parser;
+
+
+/*******************************************************************************
+* Function  : integer
+* Brief     : Read a non-negative integer.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. token   : The number, -1 is allowed.
+*    3. value   : Receives the integer.
+* Returns   :
+*    true : value is set.
+*    false: The token is not a non-negative integer, or is too large.
+*******************************************************************************/
+static bool integer(const json *doc, int token, size_t *value)
+{
+  double n = json_number(doc, token, -1.0);
+
+  if (n < 0.0 || n > (double) UINT32_MAX || n != floor(n))
+    return false;
+
+  *value = (size_t) n;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : component_size
+* Brief     : The size of a component type, in bytes, 0 if unsupported.
+*******************************************************************************/
+static unsigned int component_size(unsigned int type)
+{
+  switch (type)
+  {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:  return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:          return 4;
+    default:                return 0;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : components
+* Brief     : The number of components of an accessor type, 0 for matrices.
+*******************************************************************************/
+static int components(const json *doc, int token)
+{
+  static const char *types[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+  char               type[8];
+
+  for (int i = 0; json_string(doc, token, type, sizeof(type)) && i < 4; i++)
+  {
+    if (!strcmp(type, types[i]))
+      return i + 1;
+  }
+  return 0;
+}
+
+
+/*******************************************************************************
+* Function  : view_range
+* Brief     : Locate a buffer view in the binary chunk. Buffers other than the
+*             chunk, in other files or in data URIs, are not read.
+* Parameters:
+*    1. p       : The parser.
+*    2. view    : The index of the view.
+*    3. offset  : Receives its start in the binary chunk.
+*    4. length  : Receives its size.
+*    5. stride  : Receives its stride, 0 if its elements are packed.
+* Returns   :
+*    true : The view lies in the binary chunk.
+*    false: It does not, does not exist, or its stride is not a multiple of
+*           4 from 4 to TAWY_GLTF_STRIDE, as glTF requires.
+*******************************************************************************/
+static bool view_range(const gltf_parser *p, size_t view, size_t *offset, size_t *length, size_t *stride)
+{
+  int    v = json_at(&p->doc, p->views, view);
+  size_t buffer;
+
+  *offset = 0;
+  *stride = 0;
+  return v >= 0 && integer(&p->doc, json_get(&p->doc, v, "buffer"), &buffer) && buffer == 0 &&
+         json_get(&p->doc, json_at(&p->doc, p->buffers, 0), "uri") < 0 &&
+         integer(&p->doc, json_get(&p->doc, v, "byteLength"), length) &&
+         (json_get(&p->doc, v, "byteOffset") < 0 || integer(&p->doc, json_get(&p->doc, v, "byteOffset"), offset)) &&
+         (json_get(&p->doc, v, "byteStride") < 0 ||
+          (integer(&p->doc, json_get(&p->doc, v, "byteStride"), stride) &&
+           *stride >= 4 && *stride <= TAWY_GLTF_STRIDE && !(*stride % 4))) &&
+         *offset <= p->file->bin_size && *length <= p->file->bin_size - *offset;
+}
+
+
+/*******************************************************************************
+* Function  : read_accessor
+* Brief     : Locate an accessor in the binary chunk, and check that all of its
+*             elements lie in its view, aligned as OpenGL needs them.
+* Parameters:
+*    1. p       : The parser, its range extended to the accessor.
+*    2. token   : The index of the accessor, a number token.
+*    3. out     : Receives the accessor.
+* Returns   :
+*    true : The accessor is located.
+*    false: It is sparse, has no view, or lies outside of it.
+*******************************************************************************/
+static bool read_accessor(gltf_parser *p, int token, gltf_accessor *out)
+{
+  const json *doc = &p->doc;
+  int         a;
+  size_t      index;
+  size_t      type;
+  size_t      count;
+  size_t      view;
+  size_t      offset = 0;
+  size_t      start;
+  size_t      length;
+  size_t      stride;
+  size_t      element;
+  size_t      end;
+
+  if (!integer(doc, token, &index) || (a = json_at(doc, p->accessors, index)) < 0 ||
+      json_get(doc, a, "sparse") >= 0 || !integer(doc, json_get(doc, a, "bufferView"), &view) ||
+      !integer(doc, json_get(doc, a, "componentType"), &type) || !component_size(type) ||
+      !integer(doc, json_get(doc, a, "count"), &count) || !count ||
+      (json_get(doc, a, "byteOffset") >= 0 && !integer(doc, json_get(doc, a, "byteOffset"), &offset)) ||
+      !(out->size = components(doc, json_get(doc, a, "type"))) ||
+      !view_range(p, view, &start, &length, &stride))
+    return false;
+
+  element = (size_t) out->size * component_size(type);
+  stride  = stride? stride : element;
+  if (offset > length || (unsigned long long) (count - 1) * stride + element > length - offset ||
+      (start + offset) % component_size(type) || stride % component_size(type))
+    return false;
+
+  out->offset     = start + offset;
+  out->count      = count;
+  out->type       = type;
+  out->stride     = stride;
+  out->normalized = json_bool(doc, json_get(doc, a, "normalized"), false);
+
+  end     = out->offset + (count - 1) * stride + element;
+  p->low  = out->offset < p->low? out->offset : p->low;
+  p->high = end > p->high? end : p->high;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : bound
+* Brief     : Extend the box of the positions by the box a position accessor
+*             declares. glTF requires it.
+* Returns   :
+*    true : The box is extended.
+*    false: The accessor declares none.
+*******************************************************************************/
+static bool bound(gltf_parser *p, int token)
+{
+  const json *doc = &p->doc;
+  size_t      index;
+  int         a;
+  int         min;
+  int         max;
+
+  if (!integer(doc, token, &index) || (a = json_at(doc, p->accessors, index)) < 0 ||
+      json_size(doc, min = json_get(doc, a, "min")) != 3 || json_size(doc, max = json_get(doc, a, "max")) != 3)
+    return false;
+
+  for (unsigned int k = 0; k < 3; k++)
+  {
+    p->lo[k] = fminf(p->lo[k], json_number(doc, json_at(doc, min, k), 0.0));
+    p->hi[k] = fmaxf(p->hi[k], json_number(doc, json_at(doc, max, k), 0.0));
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : base_color
+* Brief     : The image of the base color of a material, -1 if none.
+*******************************************************************************/
+static int base_color(const gltf_parser *p, int material)
+{
+  const json *doc = &p->doc;
+  size_t      index;
+  size_t      image;
+  int         t;
+
+  t = json_get(doc, json_get(doc, json_get(doc, material, "pbrMetallicRoughness"), "baseColorTexture"), "index");
+  if (!integer(doc, t, &index) || !integer(doc, json_get(doc, json_at(doc, p->textures, index), "source"), &image) ||
+      image >= p->file->image_cnt)
+    return -1;
+  return image;
+}
+
+
+/*******************************************************************************
+* Function  : indices_within
+* Brief     : Tell whether every index of an accessor names a vertex. They go
+*             to OpenGL as they are, which does not define what it reads past
+*             the vertices.
+* Parameters:
+*    1. p       : The parser.
+*    2. indices : The indices, packed.
+*    3. vertices: The number of vertices.
+* Returns   :
+*    true : Every index is below vertices.
+*    false: One is not.
+*******************************************************************************/
+static bool indices_within(const gltf_parser *p, const gltf_accessor *indices, unsigned int vertices)
+{
+  const unsigned char *data = p->file->bin + indices->offset;
+  unsigned int         index;
+
+  for (unsigned int i = 0; i < indices->count; i++)
+  {
+    if (indices->type == GL_UNSIGNED_BYTE)
+      index = data[i];
+    else if (indices->type == GL_UNSIGNED_SHORT)
+      index = ((const unsigned short *) data)[i];
+    else
+      index = ((const unsigned int *) data)[i];
+
+    if (index >= vertices)
+      return false;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : read_primitive
+* Brief     : Locate the attributes and indices of a primitive. Positions are
+*             floats, normals too, texture coordinates floats or normalized
+*             unsigned integers, as glTF requires without extensions.
+* Parameters:
+*    1. p         : The parser.
+*    2. primitive : The primitive, indexed triangles.
+*    3. out       : Receives the primitive.
+* Returns   :
+*    true : The primitive is located.
+*    false: An accessor is invalid, or of a type OpenGL cannot draw, or an
+*           index names no vertex.
+*******************************************************************************/
+static bool read_primitive(gltf_parser *p, int primitive, gltf_primitive *out)
+{
+  static const char *names[TAWY_VERTEX_ATTRIBUTES] = {"POSITION", "NORMAL", "TEXCOORD_0"};
+  static const int   sizes[TAWY_VERTEX_ATTRIBUTES] = {3, 3, 2};
+
+  const json    *doc        = &p->doc;
+  int            attributes = json_get(doc, primitive, "attributes");
+  int            token;
+  gltf_accessor *a;
+  size_t         material;
+
+  memset(out, 0, sizeof(*out));
+  for (unsigned int k = 0; k < TAWY_VERTEX_ATTRIBUTES; k++)
+  {
+    a = &out->attribute[k];
+    if ((token = json_get(doc, attributes, names[k])) < 0 && k != TAWY_VERTEX_POSITION)
+      continue;
+
+    if (!read_accessor(p, token, a) || a->size != sizes[k] ||
+        !(a->type == GL_FLOAT || (k == TAWY_VERTEX_TEXCOORD && a->normalized &&
+                                  (a->type == GL_UNSIGNED_BYTE || a->type == GL_UNSIGNED_SHORT))) ||
+        a->count != out->attribute[TAWY_VERTEX_POSITION].count ||
+        (k == TAWY_VERTEX_POSITION && !bound(p, token)))
+      return false;
+  }
+
+  //
+  // OpenGL reads indices packed, and never normalized. They are read once,
+  // the file being mapped, so that none reads past the vertices.
+  //
+  a = &out->indices;
+  if (!read_accessor(p, json_get(doc, primitive, "indices"), a) || a->size != 1 || a->normalized ||
+      (a->type != GL_UNSIGNED_BYTE && a->type != GL_UNSIGNED_SHORT && a->type != GL_UNSIGNED_INT) ||
+      a->stride != component_size(a->type) || !indices_within(p, a, out->attribute[TAWY_VERTEX_POSITION].count))
+    return false;
+
+  out->image = integer(doc, json_get(doc, primitive, "material"), &material)?
+               base_color(p, json_at(doc, p->materials, material)) : -1;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : read_images
+* Brief     : Locate the images of the file. Images in data URIs are not read,
+*             they are left empty.
+* Returns   :
+*    true : The images are located.
+*    false: An embedded image lies outside of the binary chunk, or memory is
+*           exhausted.
+*******************************************************************************/
+static bool read_images(gltf_parser *p)
+{
+  const json *doc    = &p->doc;
+  int         images = json_get(doc, 0, "images");
+  gltf_image *image;
+  size_t      view;
+  size_t      stride;
+  int         i;
+
+  p->file->image_cnt = json_size(doc, images);
+  if (p->file->image_cnt && NULL == (p->file->images = calloc(p->file->image_cnt, sizeof(gltf_image))))
+    return false;
+
+  for (unsigned int n = 0; n < p->file->image_cnt; n++)
+  {
+    image = &p->file->images[n];
+    i     = json_at(doc, images, n);
+
+    if (integer(doc, json_get(doc, i, "bufferView"), &view))
+    {
+      if (!view_range(p, view, &image->offset, &image->size, &stride))
+        return false;
+    }
+    else if (!json_string(doc, json_get(doc, i, "uri"), image->uri, TAWY_GLTF_NAME_LEN) ||
+             !strncmp(image->uri, "data:", 5))
+    {
+      printf("Warning, image %u of '%s' is not in the file nor next to it, it is ignored\n", n, p->name);
+      image->uri[0] = '\0';
+    }
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : read_document
+* Brief     : Read the JSON chunk: its images, then its primitives.
+* Parameters:
+*    1. p       : The parser, its document tokenized.
+* Returns   :
+*    true : The primitives are located, and there is at least one.
+*    false: The document is invalid, requires an extension, or has no
+*           indexed triangles.
+*******************************************************************************/
+static bool read_document(gltf_parser *p)
+{
+  const json   *doc      = &p->doc;
+  int           meshes   = json_get(doc, 0, "meshes");
+  int           required = json_get(doc, 0, "extensionsRequired");
+  char          name[TAWY_GLTF_NAME_LEN];
+  unsigned int  cnt      = 0;
+  unsigned int  skipped  = 0;
+  int           primitives;
+  int           primitive;
+
+  if (json_size(doc, required))
+  {
+    json_string(doc, json_at(doc, required, 0), name, sizeof(name));
+    printf("Error, '%s' requires the extension '%s'\n", p->name, name);
+    return false;
+  }
+
+  p->accessors = json_get(doc, 0, "accessors");
+  p->views     = json_get(doc, 0, "bufferViews");
+  p->buffers   = json_get(doc, 0, "buffers");
+  p->materials = json_get(doc, 0, "materials");
+  p->textures  = json_get(doc, 0, "textures");
+  if (!read_images(p))
+    return false;
+
+  for (unsigned int m = 0; m < json_size(doc, meshes); m++)
+    cnt += json_size(doc, json_get(doc, json_at(doc, meshes, m), "primitives"));
+
+  if (!cnt || NULL == (p->file->primitives = malloc(cnt * sizeof(gltf_primitive))))
+    return false;
+
+  //
+  // Points, lines, strips and fans are not drawn, nor unindexed triangles.
+  //
+  for (unsigned int m = 0; m < json_size(doc, meshes); m++)
+  {
+    primitives = json_get(doc, json_at(doc, meshes, m), "primitives");
+    for (unsigned int n = 0; n < json_size(doc, primitives); n++)
+    {
+      primitive = json_at(doc, primitives, n);
+      if (json_number(doc, json_get(doc, primitive, "mode"), TAWY_GLTF_TRIANGLES) != TAWY_GLTF_TRIANGLES ||
+          json_get(doc, primitive, "indices") < 0)
+      {
+        skipped++;
+        continue;
+      }
+
+      if (!read_primitive(p, primitive, &p->file->primitives[p->file->primitive_cnt]))
+        return false;
+      p->file->primitive_cnt++;
+    }
+  }
+
+  if (skipped)
+    printf("Warning, %u primitives of '%s' are not indexed triangles, they are skipped\n", skipped, p->name);
+  return p->file->primitive_cnt > 0;
+}
+
+
+/*******************************************************************************
+* Function  : read_chunks
+* Brief     : Check the header of a mapped file, and locate its chunks.
+* Parameters:
+*    1. file    : The mapped file, receives its binary chunk.
+*    2. text    : Receives the JSON chunk.
+*    3. len     : Receives its size.
+* Returns   :
+*    true : The chunks lie in the file.
+*    false: It is not a glTF 2.0 binary.
+*******************************************************************************/
+static bool read_chunks(gltf *file, const char **text, size_t *len)
+{
+  const unsigned char *data = file->map;
+  uint32_t             header[3];
+  uint32_t             chunk[2];
+  size_t               next;
+
+  if (file->map_size < sizeof(header) + sizeof(chunk))
+    return false;
+
+  memcpy(header, data, sizeof(header));
+  memcpy(chunk, data + sizeof(header), sizeof(chunk));
+  if (header[0] != TAWY_GLTF_MAGIC || header[1] != TAWY_GLTF_VERSION || header[2] > file->map_size ||
+      header[2] < sizeof(header) + sizeof(chunk) || chunk[1] != TAWY_GLTF_JSON ||
+      chunk[0] > header[2] - sizeof(header) - sizeof(chunk))
+    return false;
+
+  *text = (const char *) data + sizeof(header) + sizeof(chunk);
+  *len  = chunk[0];
+
+  //
+  // The binary chunk is optional, chunks start on 4 bytes.
+  //
+  next = sizeof(header) + sizeof(chunk) + ((chunk[0] + 3) & ~3u);
+  if (next <= header[2] && header[2] - next >= sizeof(chunk))
+  {
+    memcpy(chunk, data + next, sizeof(chunk));
+    if (chunk[1] == TAWY_GLTF_BIN && chunk[0] <= header[2] - next - sizeof(chunk))
+    {
+      file->bin      = data + next + sizeof(chunk);
+      file->bin_size = chunk[0];
+    }
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : gltf_map
+* Brief     : Map a .glb file and locate its primitives. Primitives that are not
+*             indexed triangles are skipped.
+* Parameters:
+*    1. file    : Receives the file.
+*    2. path    : The .glb file.
+* Returns   :
+*    true : The file is mapped. Release it with gltf_release().
+*    false: It could not be mapped, is not a glTF 2.0 binary, an accessor
+*           lies outside of its binary chunk, an index names no vertex, or it
+*           requires an extension.
+*******************************************************************************/
+bool gltf_map(gltf *file, const char *path)
+{
+  gltf_parser  p = {.file = file, .name = path, .low = SIZE_MAX, .high = 0,
+                    .lo = {FLT_MAX, FLT_MAX, FLT_MAX}, .hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+  struct stat  st;
+  const char  *text;
+  size_t       len;
+  bool         ret;
+  int          fd;
+
+  memset(file, 0, sizeof(*file));
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return false;
+
+  if (fstat(fd, &st) || st.st_size <= 0 ||
+      MAP_FAILED == (file->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+  {
+    close(fd);
+    file->map = NULL;
+    printf("Error, failed to map '%s'\n", path);
+    return false;
+  }
+  close(fd);
+  file->map_size = st.st_size;
+
+  ret = read_chunks(file, &text, &len) && json_parse(&p.doc, text, len) && p.doc.tokens[0].type == JSON_OBJECT;
+  ret = ret && read_document(&p);
+  json_release(&p.doc);
+
+  if (!ret)
+  {
+    printf("Error, '%s' is not a glTF 2.0 binary, or one that can be drawn\n", path);
+    gltf_release(file);
+    return false;
+  }
+
+  //
+  // Accessors are uploaded from the start of a word, their alignment kept.
+  //
+  file->geometry      = p.low & ~(size_t) 3;
+  file->geometry_size = p.high - file->geometry;
+
+  for (unsigned int k = 0; k < 3; k++)
+    file->bounds[k] = (p.lo[k] + p.hi[k]) * 0.5f;
+  file->bounds[3] = 0.5f * sqrtf((p.hi[0] - p.lo[0]) * (p.hi[0] - p.lo[0]) + (p.hi[1] - p.lo[1]) * (p.hi[1] - p.lo[1]) +
+                                 (p.hi[2] - p.lo[2]) * (p.hi[2] - p.lo[2]));
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : gltf_release
+* Brief     : Unmap a .glb file.
+* Parameters:
+*    1. file    : The file.
+*******************************************************************************/
+void gltf_release(gltf *file)
+{
+  if (file->map)
+    munmap(file->map, file->map_size);
+  free(file->primitives);
+  free(file->images);
+  memset(file, 0, sizeof(*file));
+}
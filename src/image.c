@@ -0,0 +1,1228 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: image.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module prepares decoded images for upload: flips, expands,
+*           premultiplies and downsamples them, with SSE2 or AVX2 when the CPU
+*           has them, on a pool of threads for large images.
+*******************************************************************************/
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "image.h"
+
+#define KAISER_TAPS  6
+#define KAISER_ALPHA 4.0
+
+
+/*******************************************************************************
+* Struct    : image_job
+* Brief     : The rows of a level computed by one thread.
+* Attributes:
+*    1. dst, src        : The level, and the image it is computed from.
+*    2. width, height   : The size of the image.
+*    3. channels        : Its number of channels.
+*    4. srgb            : True if its colors are sRGB encoded.
+*    5. rows            : The horizontally filtered rows, for Kaiser.
+*    6. first, last     : The range of rows computed.
+*    7. kernel          : What computes them.
+*******************************************************************************/
+typedef struct image_job
+{
+  unsigned char       *dst;
+  const unsigned char *src;
+  int                  width;
+  int                  height;
+  int                  channels;
+  bool                 srgb;
+  float               *rows;
+  int                  first;
+  int                  last;
+  void               (*kernel)(const struct image_job *);
+}image_job;
+
+
+static int            isa  = -1;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static float          to_linear[256];     // sRGB to linear, 0 to 255.
+static unsigned char  to_srgb[65536];     // Linear, 0 to 65535, to sRGB.
+static float          weights[KAISER_TAPS];
+
+//
+// The pool computing rows along the calling thread. One caller at a time 
+// posts a job, split in slices the threads take in turn.
+//
+static pthread_once_t   pool_once   = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  pool_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  lock        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   wake        = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   idle        = PTHREAD_COND_INITIALIZER;
+static const image_job *posted;
+static int              posted_rows;
+static int              slice_cnt;
+static int              next_slice;
+static int              busy        = 0;
+static int              workers     = 0;
+static unsigned int     generation  = 0;
+
+
+/*******************************************************************************
+* Function  : best_isa
+* Brief     : The best instruction set the CPU supports.
+*******************************************************************************/
+static image_isa best_isa(void)
+{
+#ifdef __SSE2__
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2")? IMAGE_AVX2 : IMAGE_SSE2;
+#else
+  return IMAGE_SCALAR;
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : init
+* Brief     : Compute the sRGB conversion tables and the Kaiser weights, and
+*             choose the best instruction set unless one was chosen.
+*******************************************************************************/
+static void init(void)
+{
+  double x;
+  double sum = 0.0;
+  double bessel;
+  double norm;
+
+  for (int i = 0; i < 256; i++)
+  {
+    x            = i / 255.0;
+    to_linear[i] = 255.0 * (x <= 0.04045? x / 12.92 : pow((x + 0.055) / 1.055, 2.4));
+  }
+
+  for (int i = 0; i < 65536; i++)
+  {
+    x          = i / 65535.0;
+    to_srgb[i] = 255.0 * (x <= 0.0031308? x * 12.92 : 1.055 * pow(x, 1.0 / 2.4) - 0.055) + 0.5;
+  }
+
+  //
+  // Taps sit at 0.5, 1.5 and 2.5 texels from the center of the level texel,
+  // the window spans 3 texels on each side. I0 is summed as its series.
+  //
+  for (int k = 0; k < KAISER_TAPS; k++)
+  {
+    x = fabs(k - (KAISER_TAPS - 1) / 2.0) / 3.0;
+
+    bessel = norm = 1.0;
+    for (int i = 1; i < 20; i++)
+    {
+      bessel += pow(pow(KAISER_ALPHA * sqrt(1.0 - x * x) / 2.0, i) / tgamma(i + 1), 2);
+      norm   += pow(pow(KAISER_ALPHA / 2.0, i) / tgamma(i + 1), 2);
+    }
+
+    weights[k] = (x? sin(M_PI * x * 1.5) / (M_PI * x * 1.5) : 1.0) * bessel / norm;
+    sum       += weights[k];
+  }
+
+  for (int k = 0; k < KAISER_TAPS; k++)
+    weights[k] /= sum;
+
+  if (isa < 0)
+    isa = best_isa();
+}
+
+
+/*******************************************************************************
+* Function  : take_slices
+* Brief     : Compute the slices of rows of the posted job not taken yet.
+*******************************************************************************/
+static void take_slices(void)
+{
+  image_job slice = *posted;
+  int       i;
+
+  while ((i = __atomic_fetch_add(&next_slice, 1, __ATOMIC_RELAXED)) < slice_cnt)
+  {
+    slice.first = posted_rows * i / slice_cnt;
+    slice.last  = posted_rows * (i + 1) / slice_cnt;
+    slice.kernel(&slice);
+  }
+}
+
+
+/*******************************************************************************
+* Function  : work
+* Brief     : A thread of the pool. It sleeps until a job is posted, helps 
+*             compute its rows, and reports when it is done.
+*******************************************************************************/
+static void *work(void *arg)
+{
+  unsigned int seen = 0;
+
+  pthread_mutex_lock(&lock);
+  while (true)
+  {
+    while (seen == generation)
+      pthread_cond_wait(&wake, &lock);
+
+    seen = generation;
+    pthread_mutex_unlock(&lock);
+    take_slices();
+    pthread_mutex_lock(&lock);
+
+    if (--busy == 0)
+      pthread_cond_signal(&idle);
+  }
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : start_pool
+* Brief     : Start the threads of the pool, once for the process. They live
+*             as long as it does.
+*******************************************************************************/
+static void start_pool(void)
+{
+  pthread_t thread;
+
+  while (workers + 1 < TAWY_IMAGE_THREADS && !pthread_create(&thread, NULL, work, NULL))
+  {
+    pthread_detach(thread);
+    workers++;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : parallel
+* Brief     : Split rows between the pool and the calling thread, and wait for
+*             them all. Rows run on the calling thread alone if they are few,
+*             or if another one is using the pool.
+* Parameters:
+*    1. job     : The job, its range of rows unset.
+*    2. rows    : The number of rows.
+*******************************************************************************/
+static void parallel(const image_job *job, int rows)
+{
+  image_job whole = *job;
+  int       cnt   = rows / TAWY_IMAGE_ROWS_PER_THREAD;
+
+  cnt = cnt < 1? 1 : cnt > TAWY_IMAGE_THREADS? TAWY_IMAGE_THREADS : cnt;
+  if (cnt > 1)
+    pthread_once(&pool_once, start_pool);
+
+  if (cnt == 1 || !workers || pthread_mutex_trylock(&pool_lock))
+  {
+    whole.first = 0;
+    whole.last  = rows;
+    whole.kernel(&whole);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  posted      = job;
+  posted_rows = rows;
+  slice_cnt   = cnt;
+  next_slice  = 0;
+  busy        = workers;
+  generation++;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  take_slices();
+
+  pthread_mutex_lock(&lock);
+  while (busy)
+    pthread_cond_wait(&idle, &lock);
+  pthread_mutex_unlock(&lock);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+
+/*******************************************************************************
+* Function  : box_texel
+* Brief     : Average 2x2 texels of a channel, linearly or in sRGB.
+*******************************************************************************/
+static unsigned char box_texel(const unsigned char *r0, const unsigned char *r1, int x0, int x1, bool srgb)
+{
+  float sum;
+
+  if (!srgb)
+    return (r0[x0] + r0[x1] + r1[x0] + r1[x1] + 2) / 4;
+
+  sum = to_linear[r0[x0]] + to_linear[r0[x1]] + to_linear[r1[x0]] + to_linear[r1[x1]];
+  return to_srgb[(int) (sum * (65535.0f / 1020.0f) + 0.5f)];
+}
+
+
+/*******************************************************************************
+* Function  : box_row
+* Brief     : Average 2x2 texels of the source into a row of the level. The 
+*             last row or column of an odd size is dropped, as in OpenGL, and
+*             one of size 1 averaged with itself.
+* Parameters:
+*    1. job     : The rows to compute.
+*    2. y       : The row of the level.
+*    3. from    : The first texel of the row to compute, the ones before it
+*                 having been computed with SIMD.
+*******************************************************************************/
+static void box_row(const image_job *job, int y, int from)
+{
+  int                  w      = job->width  > 1? job->width  / 2 : 1;
+  int                  ch     = job->channels;
+  size_t               stride = (size_t) job->width * ch;
+  int                  alpha  = (ch == 2 || ch == 4)? ch - 1 : -1;
+  const unsigned char *r0     = job->src + stride * (2 * y < job->height? 2 * y : job->height - 1);
+  const unsigned char *r1     = job->src + stride * (2 * y + 1 < job->height? 2 * y + 1 : job->height - 1);
+  unsigned char       *dst    = job->dst + ((size_t) w * y + from) * ch;
+  int                  x0;
+  int                  x1;
+
+  for (int x = from; x < w; x++)
+  {
+    x0 = (2 * x < job->width? 2 * x : job->width - 1) * ch;
+    x1 = (2 * x + 1 < job->width? 2 * x + 1 : job->width - 1) * ch;
+
+    for (int c = 0; c < ch; c++)
+      *dst++ = box_texel(r0 + c, r1 + c, x0, x1, job->srgb && c != alpha);
+  }
+}
+
+
+/*******************************************************************************
+* Function  : box_scalar
+* Brief     : The scalar box kernel, and the reference of the others.
+*******************************************************************************/
+static void box_scalar(const image_job *job)
+{
+  for (int y = job->first; y < job->last; y++)
+    box_row(job, y, 0);
+}
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : linear_sse2
+* Brief     : Load an sRGB RGBA texel as linear floats in 0..255, its alpha 
+*             kept as is.
+*******************************************************************************/
+static inline __m128 linear_sse2(const uint8_t *texel)
+{
+  return _mm_setr_ps(to_linear[texel[0]], to_linear[texel[1]], to_linear[texel[2]], texel[3]);
+}
+
+
+/*******************************************************************************
+* Function  : box_srgb_sse2
+* Brief     : The box kernel for sRGB RGBA images, a level texel at a time: its
+*             4 texels are summed as vectors, scaled and rounded together, 
+*             colors to an index of to_srgb, alpha to its value. It matches 
+*             box_texel() exactly, sums being added in the same order.
+*******************************************************************************/
+static void box_srgb_sse2(const image_job *job)
+{
+  int            w      = job->width / 2;
+  size_t         stride = (size_t) job->width * 4;
+  const __m128   scale  = _mm_setr_ps(65535.0f / 1020.0f, 65535.0f / 1020.0f, 65535.0f / 1020.0f, 0.25f);
+  const __m128   half   = _mm_set1_ps(0.5f);
+  const uint8_t *r0;
+  const uint8_t *r1;
+  uint8_t       *dst;
+  int32_t        t[4];
+  __m128         sum;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    r0  = job->src + stride * (2 * y);
+    r1  = job->src + stride * (2 * y + 1 < job->height? 2 * y + 1 : 2 * y);
+    dst = job->dst + (size_t) w * y * 4;
+
+    for (int x = 0; x < w; x++, r0 += 8, r1 += 8, dst += 4)
+    {
+      sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(linear_sse2(r0), linear_sse2(r0 + 4)), linear_sse2(r1)), 
+                       linear_sse2(r1 + 4));
+      _mm_storeu_si128((__m128i *) t, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(sum, scale), half)));
+
+      dst[0] = to_srgb[t[0]];
+      dst[1] = to_srgb[t[1]];
+      dst[2] = to_srgb[t[2]];
+      dst[3] = t[3];
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : box_sse2
+* Brief     : The box kernel for linear RGBA and single channel images, 4 and
+*             16 source texels at a time, and for sRGB RGBA images. Others are
+*             left to the scalar one.
+*******************************************************************************/
+static void box_sse2(const image_job *job)
+{
+  int            w      = job->width / 2;
+  size_t         stride = (size_t) job->width * job->channels;
+  const __m128i  two    = _mm_set1_epi16(2);
+  const __m128i  low    = _mm_set1_epi16(0x00ff);
+  const __m128i  zero   = _mm_setzero_si128();
+  const uint8_t *r0;
+  const uint8_t *r1;
+  uint8_t       *dst;
+  __m128i        a, b, lo, hi;
+  int            x = 0;
+
+  if (job->width < 2 || (job->channels != 4 && job->channels != 1) || (job->srgb && job->channels != 4))
+  {
+    box_scalar(job);
+    return;
+  }
+
+  if (job->srgb)
+  {
+    box_srgb_sse2(job);
+    return;
+  }
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    r0  = job->src + stride * (2 * y);
+    r1  = job->src + stride * (2 * y + 1 < job->height? 2 * y + 1 : 2 * y);
+    dst = job->dst + (size_t) w * y * job->channels;
+
+    if (job->channels == 4)
+    {
+      for (x = 0; x + 2 <= w; x += 2)
+      {
+        a  = _mm_loadu_si128((const __m128i *) (r0 + 8 * x));
+        b  = _mm_loadu_si128((const __m128i *) (r1 + 8 * x));
+        lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+        _mm_storel_epi64((__m128i *) (dst + 4 * x), _mm_packus_epi16(lo, lo));
+      }
+    }
+    else
+    {
+      for (x = 0; x + 8 <= w; x += 8)
+      {
+        a  = _mm_loadu_si128((const __m128i *) (r0 + 2 * x));
+        b  = _mm_loadu_si128((const __m128i *) (r1 + 2 * x));
+        lo = _mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8));
+        hi = _mm_add_epi16(_mm_and_si128(b, low), _mm_srli_epi16(b, 8));
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, hi), two), 2);
+        _mm_storel_epi64((__m128i *) (dst + x), _mm_packus_epi16(lo, lo));
+      }
+    }
+
+    //
+    // The remaining texels of the row.
+    //
+    box_row(job, y, x);
+  }
+}
+
+
+/*******************************************************************************
+* Function  : box_avx2
+* Brief     : The box kernel of box_sse2(), twice as wide. sRGB images are left
+*             to box_sse2(), their lookups leave no room for wider vectors.
+*******************************************************************************/
+AVX2 static void box_avx2(const image_job *job)
+{
+  int            w      = job->width / 2;
+  size_t         stride = (size_t) job->width * job->channels;
+  const __m256i  two    = _mm256_set1_epi16(2);
+  const __m256i  low    = _mm256_set1_epi16(0x00ff);
+  const __m256i  zero   = _mm256_setzero_si256();
+  const uint8_t *r0;
+  const uint8_t *r1;
+  uint8_t       *dst;
+  __m256i        a, b, lo, hi;
+  int            x = 0;
+
+  if (job->srgb)
+  {
+    box_sse2(job);
+    return;
+  }
+
+  if (job->width < 2 || (job->channels != 4 && job->channels != 1))
+  {
+    box_scalar(job);
+    return;
+  }
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    r0  = job->src + stride * (2 * y);
+    r1  = job->src + stride * (2 * y + 1 < job->height? 2 * y + 1 : 2 * y);
+    dst = job->dst + (size_t) w * y * job->channels;
+
+    //
+    // Lanes are processed apart, their halves are gathered before storing.
+    //
+    if (job->channels == 4)
+    {
+      for (x = 0; x + 4 <= w; x += 4)
+      {
+        a  = _mm256_loadu_si256((const __m256i *) (r0 + 8 * x));
+        b  = _mm256_loadu_si256((const __m256i *) (r1 + 8 * x));
+        lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+        hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), two), 2);
+        lo = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, lo), 0x08);
+        _mm_storeu_si128((__m128i *) (dst + 4 * x), _mm256_castsi256_si128(lo));
+      }
+    }
+    else
+    {
+      for (x = 0; x + 16 <= w; x += 16)
+      {
+        a  = _mm256_loadu_si256((const __m256i *) (r0 + 2 * x));
+        b  = _mm256_loadu_si256((const __m256i *) (r1 + 2 * x));
+        lo = _mm256_add_epi16(_mm256_and_si256(a, low), _mm256_srli_epi16(a, 8));
+        hi = _mm256_add_epi16(_mm256_and_si256(b, low), _mm256_srli_epi16(b, 8));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, hi), two), 2);
+        lo = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, lo), 0x08);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm256_castsi256_si128(lo));
+      }
+    }
+
+    box_row(job, y, x);
+  }
+}
+#endif
+
+
+/*******************************************************************************
+* Function  : kaiser_line
+* Brief     : Widen a row of the source to floats in 0..255, made linear for 
+*             sRGB colors, padded with its edge texels so that taps need no
+*             clamping: texel t of the line is texel t - 2 of the row.
+* Parameters:
+*    1. job     : The rows to compute.
+*    2. line    : Receives the line, (width + KAISER_TAPS) * channels floats.
+*    3. y       : The row of the source.
+*******************************************************************************/
+static void kaiser_line(const image_job *job, float *line, int y)
+{
+  int                  ch    = job->channels;
+  int                  alpha = (ch == 2 || ch == 4)? ch - 1 : -1;
+  size_t               cnt   = (size_t) job->width * ch;
+  const unsigned char *src   = job->src + cnt * y;
+  float               *texel = line + 2 * ch;
+
+  //
+  // 1. The row, then its edge texels repeated on each side.
+  //
+  if (!job->srgb)
+  {
+    for (size_t i = 0; i < cnt; i++)
+      texel[i] = src[i];
+  }
+  else
+  {
+    for (size_t i = 0; i < cnt; i++)
+      texel[i] = to_linear[src[i]];
+    if (alpha >= 0)
+    {
+      for (size_t i = alpha; i < cnt; i += ch)
+        texel[i] = src[i];
+    }
+  }
+
+  for (int t = 0; t < 2; t++)
+    memcpy(line + t * ch, texel, ch * sizeof(float));
+  for (int t = job->width + 2; t < job->width + KAISER_TAPS; t++)
+    memcpy(line + t * ch, texel + cnt - ch, ch * sizeof(float));
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_row
+* Brief     : Filter a line horizontally, into a row of the filtered rows.
+* Parameters:
+*    1. job     : The rows to compute.
+*    2. row     : The filtered row.
+*    3. line    : The line from kaiser_line().
+*    4. from    : The first texel of the row to compute, the ones before it
+*                 having been computed with SIMD.
+*******************************************************************************/
+static void kaiser_row(const image_job *job, float *row, const float *line, int from)
+{
+  int          ch = job->channels;
+  int          w  = job->width > 1? job->width / 2 : 1;
+  const float *p;
+  float        sum;
+
+  for (int i = from; i < w; i++)
+  {
+    for (int c = 0; c < ch; c++)
+    {
+      p   = line + 2 * i * ch + c;
+      sum = 0.0f;
+      for (int k = 0; k < KAISER_TAPS; k++, p += ch)
+        sum += weights[k] * *p;
+      row[i * ch + c] = sum;
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_horizontal
+* Brief     : The scalar horizontal Kaiser kernel, and the reference of the
+*             others. Rows of the source are filtered to floats.
+*******************************************************************************/
+static void kaiser_horizontal(const image_job *job)
+{
+  int    cnt = (job->width > 1? job->width / 2 : 1) * job->channels;
+  float *line;
+
+  if (NULL == (line = malloc((size_t) (job->width + KAISER_TAPS) * job->channels * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_line(job, line, y);
+    kaiser_row(job, job->rows + (size_t) cnt * y, line, 0);
+  }
+  free(line);
+}
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : kaiser_horizontal_sse2
+* Brief     : The horizontal Kaiser kernel, 4 values at a time: a texel of 4
+*             channels, or 4 texels of 1 channel, every other one gathered.
+*******************************************************************************/
+static void kaiser_horizontal_sse2(const image_job *job)
+{
+  int          ch  = job->channels;
+  int          cnt = (job->width > 1? job->width / 2 : 1) * ch;
+  const float *p;
+  float       *line;
+  float       *row;
+  __m128       sum;
+  int          i;
+
+  if (NULL == (line = malloc((size_t) (job->width + KAISER_TAPS) * ch * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_line(job, line, y);
+    row = job->rows + (size_t) cnt * y;
+    i   = 0;
+
+    if (ch == 4)
+    {
+      for (; i + 4 <= cnt; i += 4)
+      {
+        sum = _mm_setzero_ps();
+        p   = line + 2 * i;
+        for (int k = 0; k < KAISER_TAPS; k++, p += 4)
+          sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(p)));
+        _mm_storeu_ps(row + i, sum);
+      }
+    }
+    else if (ch == 1)
+    {
+      for (; i + 4 <= cnt; i += 4)
+      {
+        sum = _mm_setzero_ps();
+        p   = line + 2 * i;
+        for (int k = 0; k < KAISER_TAPS; k++, p++)
+          sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]),
+                                           _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), 0x88)));
+        _mm_storeu_ps(row + i, sum);
+      }
+    }
+    kaiser_row(job, row, line, i / ch);
+  }
+  free(line);
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_horizontal_avx2
+* Brief     : The horizontal Kaiser kernel of kaiser_horizontal_sse2(), twice
+*             as wide.
+*******************************************************************************/
+AVX2 static void kaiser_horizontal_avx2(const image_job *job)
+{
+  int          ch  = job->channels;
+  int          cnt = (job->width > 1? job->width / 2 : 1) * ch;
+  const float *p;
+  float       *line;
+  float       *row;
+  __m256       sum;
+  __m256       v;
+  int          i;
+
+  if (NULL == (line = malloc((size_t) (job->width + KAISER_TAPS) * ch * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_line(job, line, y);
+    row = job->rows + (size_t) cnt * y;
+    i   = 0;
+
+    if (ch == 4)
+    {
+      for (; i + 8 <= cnt; i += 8)
+      {
+        sum = _mm256_setzero_ps();
+        p   = line + 2 * i;
+        for (int k = 0; k < KAISER_TAPS; k++, p += 4)
+        {
+          v   = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 8), 1);
+          sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), v));
+        }
+        _mm256_storeu_ps(row + i, sum);
+      }
+    }
+    else if (ch == 1)
+    {
+      for (; i + 8 <= cnt; i += 8)
+      {
+        sum = _mm256_setzero_ps();
+        p   = line + 2 * i;
+        for (int k = 0; k < KAISER_TAPS; k++, p++)
+        {
+          v   = _mm256_shuffle_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8), 0x88);
+          v   = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(v), 0xd8));
+          sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), v));
+        }
+        _mm256_storeu_ps(row + i, sum);
+      }
+    }
+    kaiser_row(job, row, line, i / ch);
+  }
+  free(line);
+}
+#endif
+
+
+/*******************************************************************************
+* Function  : kaiser_store
+* Brief     : Round filtered values of a row to texels, encoding sRGB colors.
+*******************************************************************************/
+static void kaiser_store(const image_job *job, unsigned char *dst, const float *row, int from, int cnt)
+{
+  int   ch    = job->channels;
+  int   alpha = (ch == 2 || ch == 4)? ch - 1 : -1;
+  float v;
+
+  for (int i = from; i < cnt; i++)
+  {
+    v = row[i] < 0.0f? 0.0f : row[i] > 255.0f? 255.0f : row[i];
+    if (job->srgb && i % ch != alpha)
+      dst[i] = to_srgb[(int) (v * 257.0f + 0.5f)];
+    else
+      dst[i] = v + 0.5f;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_taps
+* Brief     : Locate the horizontally filtered rows summed into a row of the 
+*             level, clamped to the image.
+* Parameters:
+*    1. job     : The rows to compute.
+*    2. rows    : Receives the row of each tap.
+*    3. y       : The row of the level.
+*******************************************************************************/
+static void kaiser_taps(const image_job *job, const float **rows, int y)
+{
+  int w = job->width > 1? job->width / 2 : 1;
+  int r;
+
+  for (int k = 0; k < KAISER_TAPS; k++)
+  {
+    r       = 2 * y - KAISER_TAPS / 2 + 1 + k;
+    r       = r < 0? 0 : r >= job->height? job->height - 1 : r;
+    rows[k] = job->rows + (size_t) w * job->channels * r;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_scalar
+* Brief     : The scalar vertical Kaiser kernel, and the reference of the
+*             others.
+*******************************************************************************/
+static void kaiser_scalar(const image_job *job)
+{
+  int          cnt = (job->width > 1? job->width / 2 : 1) * job->channels;
+  const float *rows[KAISER_TAPS];
+  float       *acc;
+
+  if (NULL == (acc = malloc(cnt * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_taps(job, rows, y);
+    for (int i = 0; i < cnt; i++)
+    {
+      acc[i] = 0.0f;
+      for (int k = 0; k < KAISER_TAPS; k++)
+        acc[i] += weights[k] * rows[k][i];
+    }
+    kaiser_store(job, job->dst + (size_t) cnt * y, acc, 0, cnt);
+  }
+  free(acc);
+}
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : kaiser_sse2
+* Brief     : The vertical Kaiser kernel, 4 values at a time. Linear values are
+*             rounded and packed with SSE2 too.
+*******************************************************************************/
+static void kaiser_sse2(const image_job *job)
+{
+  int          cnt = (job->width > 1? job->width / 2 : 1) * job->channels;
+  const float *rows[KAISER_TAPS];
+  float       *acc;
+  __m128       sum;
+  __m128i      v;
+  int          packed;
+  int          i;
+
+  if (NULL == (acc = malloc(cnt * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_taps(job, rows, y);
+    for (i = 0; i + 4 <= cnt; i += 4)
+    {
+      sum = _mm_setzero_ps();
+      for (int k = 0; k < KAISER_TAPS; k++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+      _mm_storeu_ps(acc + i, sum);
+
+      if (!job->srgb)
+      {
+        v = _mm_cvtps_epi32(sum);
+        v = _mm_packs_epi32(v, v);
+        packed = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+        memcpy(job->dst + (size_t) cnt * y + i, &packed, sizeof(packed));
+      }
+    }
+
+    for (; i < cnt; i++)
+    {
+      acc[i] = 0.0f;
+      for (int k = 0; k < KAISER_TAPS; k++)
+        acc[i] += weights[k] * rows[k][i];
+    }
+    kaiser_store(job, job->dst + (size_t) cnt * y, acc, job->srgb? 0 : cnt & ~3, cnt);
+  }
+  free(acc);
+}
+
+
+/*******************************************************************************
+* Function  : kaiser_avx2
+* Brief     : The vertical Kaiser kernel of kaiser_sse2(), twice as wide.
+*******************************************************************************/
+AVX2 static void kaiser_avx2(const image_job *job)
+{
+  int          cnt = (job->width > 1? job->width / 2 : 1) * job->channels;
+  const float *rows[KAISER_TAPS];
+  float       *acc;
+  __m256       sum;
+  __m256i      v;
+  __m128i      p;
+  int          i;
+
+  if (NULL == (acc = malloc(cnt * sizeof(float))))
+    return;
+
+  for (int y = job->first; y < job->last; y++)
+  {
+    kaiser_taps(job, rows, y);
+    for (i = 0; i + 8 <= cnt; i += 8)
+    {
+      sum = _mm256_setzero_ps();
+      for (int k = 0; k < KAISER_TAPS; k++)
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+      _mm256_storeu_ps(acc + i, sum);
+
+      if (!job->srgb)
+      {
+        v = _mm256_cvtps_epi32(sum);
+        p = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64((__m128i *) (job->dst + (size_t) cnt * y + i), _mm_packus_epi16(p, p));
+      }
+    }
+
+    for (; i < cnt; i++)
+    {
+      acc[i] = 0.0f;
+      for (int k = 0; k < KAISER_TAPS; k++)
+        acc[i] += weights[k] * rows[k][i];
+    }
+    kaiser_store(job, job->dst + (size_t) cnt * y, acc, job->srgb? 0 : cnt & ~7, cnt);
+  }
+  free(acc);
+}
+#endif
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : expand_sse2
+* Brief     : Expand the texels of a row, 4 at a time, but the last ones. Each 
+*             lane is the row shifted by 3 bytes more, its 4th byte set opaque.
+* Returns   :
+*    x: The number of texels expanded.
+*******************************************************************************/
+static int expand_sse2(unsigned char *dst, const unsigned char *src, int width)
+{
+  const __m128i opaque = _mm_set1_epi32(0xff000000);
+  __m128i       v, lo, hi;
+  int           x;
+
+  //
+  // 4 texels at a time, reading 16 bytes from the row.
+  //
+  for (x = 0; 3 * x + 16 <= 3 * width; x += 4)
+  {
+    v  = _mm_loadu_si128((const __m128i *) (src + 3 * x));
+    lo = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+    hi = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+    _mm_storeu_si128((__m128i *) (dst + 4 * x), _mm_or_si128(_mm_unpacklo_epi64(lo, hi), opaque));
+  }
+  return x;
+}
+
+
+/*******************************************************************************
+* Function  : expand_avx2
+* Brief     : Expand the texels of a row, 8 at a time, but the last ones.
+* Returns   :
+*    x: The number of texels expanded.
+*******************************************************************************/
+AVX2 static int expand_avx2(unsigned char *dst, const unsigned char *src, int width)
+{
+  const __m256i gather  = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+  const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                           0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i opaque  = _mm256_set1_epi32(0xff000000);
+  __m256i       v;
+  int           x;
+
+  //
+  // 8 texels at a time, 4 in each lane, reading 32 bytes from the row.
+  //
+  for (x = 0; 3 * x + 32 <= 3 * width; x += 8)
+  {
+    v = _mm256_loadu_si256((const __m256i *) (src + 3 * x));
+    v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, gather), shuffle);
+    _mm256_storeu_si256((__m256i *) (dst + 4 * x), _mm256_or_si256(v, opaque));
+  }
+  return x;
+}
+#endif
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : premultiply_sse2
+* Brief     : Premultiply texels 4 at a time, but the last ones.
+* Returns   :
+*    i: The number of texels premultiplied.
+*******************************************************************************/
+static size_t premultiply_sse2(unsigned char *pixels, size_t cnt)
+{
+  const __m128i zero  = _mm_setzero_si128();
+  const __m128i half  = _mm_set1_epi16(128);
+  const __m128i keep  = _mm_set1_epi32(0xff000000);
+  __m128i       v, lo, hi;
+  size_t        i;
+
+  //
+  // x * a / 255, rounded, is (t + (t >> 8)) >> 8 with t = x * a + 128.
+  //
+  for (i = 0; i + 4 <= cnt; i += 4)
+  {
+    v  = _mm_loadu_si128((const __m128i *) (pixels + 4 * i));
+    lo = _mm_unpacklo_epi8(v, zero);
+    hi = _mm_unpackhi_epi8(v, zero);
+    lo = _mm_add_epi16(_mm_mullo_epi16(lo, _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff)), half);
+    hi = _mm_add_epi16(_mm_mullo_epi16(hi, _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff)), half);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    lo = _mm_or_si128(_mm_andnot_si128(keep, _mm_packus_epi16(lo, hi)), _mm_and_si128(keep, v));
+    _mm_storeu_si128((__m128i *) (pixels + 4 * i), lo);
+  }
+  return i;
+}
+
+
+/*******************************************************************************
+* Function  : premultiply_avx2
+* Brief     : Premultiply texels 8 at a time, but the last ones.
+* Returns   :
+*    i: The number of texels premultiplied.
+*******************************************************************************/
+AVX2 static size_t premultiply_avx2(unsigned char *pixels, size_t cnt)
+{
+  const __m256i zero  = _mm256_setzero_si256();
+  const __m256i half  = _mm256_set1_epi16(128);
+  const __m256i keep  = _mm256_set1_epi32(0xff000000);
+  __m256i       v, lo, hi;
+  size_t        i;
+
+  for (i = 0; i + 8 <= cnt; i += 8)
+  {
+    v  = _mm256_loadu_si256((const __m256i *) (pixels + 4 * i));
+    lo = _mm256_unpacklo_epi8(v, zero);
+    hi = _mm256_unpackhi_epi8(v, zero);
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xff), 0xff)), half);
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xff), 0xff)), half);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    lo = _mm256_or_si256(_mm256_andnot_si256(keep, _mm256_packus_epi16(lo, hi)), _mm256_and_si256(keep, v));
+    _mm256_storeu_si256((__m256i *) (pixels + 4 * i), lo);
+  }
+  return i;
+}
+#endif
+
+
+/*******************************************************************************
+* Function  : image_simd
+* Brief     : Choose the instruction set of the kernels, at most the best one
+*             the CPU supports. The best one is chosen by default.
+* Parameters:
+*    1. isa     : The instruction set wanted.
+* Returns   :
+*    isa: The instruction set now used.
+*******************************************************************************/
+image_isa image_simd(image_isa wanted)
+{
+  image_isa best = best_isa();
+
+  pthread_once(&once, init);
+  isa = wanted > best? best : wanted;
+  return isa;
+}
+
+
+/*******************************************************************************
+* Function  : image_flip
+* Brief     : Copy an image, its last row first. Rows are copied whole, with
+*             no kernel of its own: memcpy is as fast as memory allows.
+* Parameters:
+*    1. dst     : The destination, width * height * channels bytes.
+*    2. src     : The image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels.
+*******************************************************************************/
+void image_flip(unsigned char *dst, const unsigned char *src, int width, int height, int channels)
+{
+  size_t stride = (size_t) width * channels;
+
+  for (int y = 0; y < height; y++)
+    memcpy(dst + stride * y, src + stride * (height - 1 - y), stride);
+}
+
+
+/*******************************************************************************
+* Function  : image_expand
+* Brief     : Copy an RGB image as RGBA, opaque, flipping it in the same pass.
+*             Drivers store RGB as RGBA anyway, and convert RGB uploads slowly.
+* Parameters:
+*    1. dst     : The destination, width * height * 4 bytes.
+*    2. src     : The RGB image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. flip    : True to copy its last row first.
+*******************************************************************************/
+void image_expand(unsigned char *dst, const unsigned char *src, int width, int height, bool flip)
+{
+  const unsigned char *row;
+  int                  x;
+
+  pthread_once(&once, init);
+
+  for (int y = 0; y < height; y++, dst += (size_t) width * 4)
+  {
+    row = src + (size_t) width * 3 * (flip? height - 1 - y : y);
+    x   = 0;
+#ifdef __SSE2__
+    if (isa == IMAGE_AVX2)
+      x = expand_avx2(dst, row, width);
+    else if (isa == IMAGE_SSE2)
+      x = expand_sse2(dst, row, width);
+#endif
+    for (; x < width; x++)
+    {
+      dst[4 * x + 0] = row[3 * x + 0];
+      dst[4 * x + 1] = row[3 * x + 1];
+      dst[4 * x + 2] = row[3 * x + 2];
+      dst[4 * x + 3] = 255;
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : image_premultiply
+* Brief     : Multiply the colors of an RGBA image by its alpha, in place, so
+*             that filtering and blending do not bleed transparent colors.
+* Parameters:
+*    1. pixels  : The RGBA image.
+*    2. width   : Its width.
+*    3. height  : Its height.
+*******************************************************************************/
+void image_premultiply(unsigned char *pixels, int width, int height)
+{
+  size_t       cnt = (size_t) width * height;
+  size_t       i   = 0;
+  unsigned int t;
+
+  pthread_once(&once, init);
+
+#ifdef __SSE2__
+  if (isa == IMAGE_AVX2)
+    i = premultiply_avx2(pixels, cnt);
+  else if (isa == IMAGE_SSE2)
+    i = premultiply_sse2(pixels, cnt);
+#endif
+
+  for (; i < cnt; i++)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      t                 = pixels[4 * i + c] * pixels[4 * i + 3] + 128;
+      pixels[4 * i + c] = (t + (t >> 8)) >> 8;
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : image_downsample
+* Brief     : Compute the next mip level of an image, half its size. Colors of
+*             sRGB images are filtered linearly, alpha is always linear.
+* Parameters:
+*    1. dst     : The level, max(1, width / 2) * max(1, height / 2) texels.
+*    2. src     : The image.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels, from 1 to 4.
+*    6. filter  : The filter.
+*    7. srgb    : True if its colors are sRGB encoded.
+* Returns   :
+*    true : The level is computed.
+*    false: Memory could not be allocated for the Kaiser filter.
+*******************************************************************************/
+bool image_downsample(unsigned char *dst, const unsigned char *src, int width, int height, int channels,
+                      image_filter filter, bool srgb)
+{
+  image_job job = {dst, src, width, height, channels, srgb, NULL, 0, 0, box_scalar};
+  image_job horizontal;
+  int       h   = height > 1? height / 2 : 1;
+
+  pthread_once(&once, init);
+
+  horizontal = job;
+#ifdef __SSE2__
+  if (isa == IMAGE_AVX2)
+  {
+    job.kernel        = filter == IMAGE_BOX? box_avx2 : kaiser_avx2;
+    horizontal.kernel = kaiser_horizontal_avx2;
+  }
+  else if (isa == IMAGE_SSE2)
+  {
+    job.kernel        = filter == IMAGE_BOX? box_sse2 : kaiser_sse2;
+    horizontal.kernel = kaiser_horizontal_sse2;
+  }
+  else
+#endif
+  {
+    job.kernel        = filter == IMAGE_BOX? box_scalar : kaiser_scalar;
+    horizontal.kernel = kaiser_horizontal;
+  }
+
+  if (filter == IMAGE_BOX)
+  {
+    parallel(&job, h);
+    return true;
+  }
+
+  //
+  // Kaiser is separable: rows are filtered horizontally first, all of them
+  // since each level row needs 6 of them, then vertically.
+  //
+  if (NULL == (job.rows = malloc((size_t) (width > 1? width / 2 : 1) * channels * height * sizeof(float))))
+    return false;
+
+  horizontal.rows = job.rows;
+  parallel(&horizontal, height);
+  parallel(&job, h);
+
+  free(job.rows);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : image_mipmaps
+* Brief     : Compute every mip level of an image, down to 1x1, each from the
+*             previous one. Levels follow the image, tightly packed.
+* Parameters:
+*    1. chain   : The image, followed by room for its levels.
+*    2. width   : Its width.
+*    3. height  : Its height.
+*    4. channels: Its number of channels, from 1 to 4.
+*    5. levels  : The number of levels, the image included.
+*    6. filter  : The filter.
+*    7. srgb    : True if its colors are sRGB encoded.
+* Returns   :
+*    true : Every level is computed.
+*    false: Memory could not be allocated for the Kaiser filter.
+*******************************************************************************/
+bool image_mipmaps(unsigned char *chain, int width, int height, int channels, int levels, image_filter filter,
+                   bool srgb)
+{
+  unsigned char *level = chain;
+  size_t         size;
+
+  for (int l = 1; l < levels; l++)
+  {
+    size = (size_t) width * height * channels;
+    if (!image_downsample(level + size, level, width, height, channels, filter, srgb))
+      return false;
+
+    level  += size;
+    width   = width  > 1? width  / 2 : 1;
+    height  = height > 1? height / 2 : 1;
+  }
+  return true;
+}
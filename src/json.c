@@ -0,0 +1,424 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: json.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module tokenizes JSON text in place: values are not copied,
+*           tokens point into the text. Each token knows where its subtree
+*           ends, so that lookups skip whole values.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+
+/*******************************************************************************
+* Struct    : json_parser
+* Brief     : The state of a tokenization.
+* Attributes:
+*    1. text, len: The text.
+*    2. pos      : The next character read.
+*    3. doc      : The tokens so far.
+*    4. cap      : The room for tokens.
+*******************************************************************************/
+typedef struct json_parser
+{
+  const char   *text;
+  size_t        len;
+  size_t        pos;
+  json         *doc;
+  unsigned int  cap;
+}json_parser;
+
+
+/*******************************************************************************
+* Function  : skip_spaces
+* Brief     : Move past whitespace, and tell whether a character is left.
+*******************************************************************************/
+static bool skip_spaces(json_parser *p)
+{
+  while (p->pos < p->len && (p->text[p->pos] == ' '  || p->text[p->pos] == '\t' ||
+                             p->text[p->pos] == '\n' || p->text[p->pos] == '\r'))
+    p->pos++;
+  return p->pos < p->len;
+}
+
+
+/*******************************************************************************
+* Function  : add_token
+* Brief     : Append a token starting at the next character.
+* Returns   :
+*    token: The index of the token.
+*    -1   : Memory is exhausted, or the text too long.
+*******************************************************************************/
+static int add_token(json_parser *p, json_type type)
+{
+  json_token   *tokens;
+  unsigned int  cap;
+
+  if (p->doc->cnt == p->cap)
+  {
+    cap = p->cap? p->cap * 2 : 256;
+    if (NULL == (tokens = realloc(p->doc->tokens, cap * sizeof(json_token))))
+      return -1;
+
+    p->doc->tokens = tokens;
+    p->cap         = cap;
+  }
+
+  p->doc->tokens[p->doc->cnt] = (json_token) {type, (unsigned int) p->pos, (unsigned int) p->pos, 0, 0};
+  return p->doc->cnt++;
+}
+
+
+/*******************************************************************************
+* Function  : literal
+* Brief     : Match a word at the next character, and move past it.
+*******************************************************************************/
+static bool literal(json_parser *p, const char *word)
+{
+  size_t len = strlen(word);
+
+  if (p->len - p->pos < len || memcmp(p->text + p->pos, word, len))
+    return false;
+
+  p->pos += len;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : digits
+* Brief     : Move past decimal digits, and tell whether there was one.
+*******************************************************************************/
+static bool digits(json_parser *p)
+{
+  size_t start = p->pos;
+
+  while (p->pos < p->len && (unsigned) (p->text[p->pos] - '0') < 10)
+    p->pos++;
+  return p->pos > start;
+}
+
+
+/*******************************************************************************
+* Function  : scan_string
+* Brief     : Move past a string, its opening quote read. Control characters
+*             must be escaped.
+* Returns   :
+*    true : The closing quote is next.
+*    false: The text ends first, or has a raw control character.
+*******************************************************************************/
+static bool scan_string(json_parser *p)
+{
+  unsigned char c;
+
+  for (; p->pos < p->len; p->pos++)
+  {
+    c = p->text[p->pos];
+    if (c == '"')
+      return true;
+    if (c < 0x20)
+      return false;
+    if (c == '\\')
+      p->pos++;
+  }
+  return false;
+}
+
+
+/*******************************************************************************
+* Function  : parse_value
+* Brief     : Tokenize the value at the next character, and its subtree.
+* Parameters:
+*    1. p       : The parser.
+*    2. depth   : The number of arrays and objects it is within.
+* Returns   :
+*    token: The index of its token.
+*    -1   : It is invalid, too deep, or memory is exhausted.
+*******************************************************************************/
+static int parse_value(json_parser *p, int depth)
+{
+  json_token *t;
+  int         token;
+  int         key;
+  char        c;
+  char        close;
+
+  if (!skip_spaces(p) || depth > TAWY_JSON_DEPTH)
+    return -1;
+
+  c = p->text[p->pos];
+  switch (c)
+  {
+    case '{':
+    case '[':
+      if ((token = add_token(p, c == '{'? JSON_OBJECT : JSON_ARRAY)) < 0)
+        return -1;
+
+      close = c == '{'? '}' : ']';
+      p->pos++;
+      if (!skip_spaces(p))
+        return -1;
+
+      while (p->text[p->pos] != close)
+      {
+        //
+        // Objects are a key, a colon then a value, arrays only a value.
+        //
+        if (close == '}')
+        {
+          if (0 > (key = parse_value(p, depth + 1)) || p->doc->tokens[key].type != JSON_STRING ||
+              !skip_spaces(p) || p->text[p->pos++] != ':')
+            return -1;
+        }
+
+        if (parse_value(p, depth + 1) < 0 || !skip_spaces(p))
+          return -1;
+
+        p->doc->tokens[token].size++;
+        if (p->text[p->pos] == ',')
+        {
+          p->pos++;
+          if (!skip_spaces(p) || p->text[p->pos] == close)
+            return -1;
+        }
+        else if (p->text[p->pos] != close)
+          return -1;
+      }
+      p->pos++;
+      break;
+
+    case '"':
+      p->pos++;
+      if ((token = add_token(p, JSON_STRING)) < 0 || !scan_string(p))
+        return -1;
+
+      p->doc->tokens[token].end = p->pos++;
+      p->doc->tokens[token].next = p->doc->cnt;
+      return token;
+
+    case 't':
+    case 'f':
+    case 'n':
+      if ((token = add_token(p, c == 'n'? JSON_NULL : JSON_BOOL)) < 0 ||
+          !(literal(p, "true") || literal(p, "false") || literal(p, "null")))
+        return -1;
+      break;
+
+    default:
+      if ((token = add_token(p, JSON_NUMBER)) < 0)
+        return -1;
+
+      if (p->text[p->pos] == '-')
+        p->pos++;
+      if (p->pos < p->len && p->text[p->pos] == '0')
+        p->pos++;
+      else if (!digits(p))
+        return -1;
+      if (p->pos < p->len && p->text[p->pos] == '.' && (p->pos++, !digits(p)))
+        return -1;
+      if (p->pos < p->len && (p->text[p->pos] == 'e' || p->text[p->pos] == 'E'))
+      {
+        p->pos++;
+        if (p->pos < p->len && (p->text[p->pos] == '+' || p->text[p->pos] == '-'))
+          p->pos++;
+        if (!digits(p))
+          return -1;
+      }
+      break;
+  }
+
+  t       = &p->doc->tokens[token];
+  t->end  = p->pos;
+  t->next = p->doc->cnt;
+  return token;
+}
+
+
+/*******************************************************************************
+* Function  : json_parse
+* Brief     : Tokenize a JSON text, that must outlive its tokens.
+* Parameters:
+*    1. doc     : Receives the tokens.
+*    2. text    : The text, not necessarily null terminated.
+*    3. len     : Its length.
+* Returns   :
+*    true : The text is tokenized. Release it with json_release().
+*    false: It is not valid JSON, too deep, or memory is exhausted.
+*******************************************************************************/
+bool json_parse(json *doc, const char *text, size_t len)
+{
+  json_parser p = {text, len, 0, doc, 0};
+
+  memset(doc, 0, sizeof(*doc));
+  doc->text = text;
+
+  //
+  // Offsets are 32 bits. Trailing spaces, and the padding of glTF chunks,
+  // are allowed.
+  //
+  if (len >= 0xffffffffu || parse_value(&p, 0) < 0 || skip_spaces(&p))
+  {
+    json_release(doc);
+    return false;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : json_get
+* Brief     : The value of a key of an object.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. object  : The object, -1 is allowed.
+*    3. key     : The key.
+* Returns   :
+*    token: The value.
+*    -1   : The token is not an object, or has no such key.
+*******************************************************************************/
+int json_get(const json *doc, int object, const char *key)
+{
+  size_t            len = strlen(key);
+  const json_token *k;
+  unsigned int      t;
+
+  if (object < 0 || doc->tokens[object].type != JSON_OBJECT)
+    return -1;
+
+  t = object + 1;
+  for (unsigned int i = 0; i < doc->tokens[object].size; i++)
+  {
+    k = &doc->tokens[t];
+    if (k->end - k->start == len && !memcmp(doc->text + k->start, key, len))
+      return t + 1;
+    t = doc->tokens[t + 1].next;
+  }
+  return -1;
+}
+
+
+/*******************************************************************************
+* Function  : json_at
+* Brief     : An element of an array.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. array   : The array, -1 is allowed.
+*    3. n       : The index of the element.
+* Returns   :
+*    token: The element.
+*    -1   : The token is not an array, or is shorter.
+*******************************************************************************/
+int json_at(const json *doc, int array, unsigned int n)
+{
+  unsigned int t;
+
+  if (array < 0 || doc->tokens[array].type != JSON_ARRAY || n >= doc->tokens[array].size)
+    return -1;
+
+  t = array + 1;
+  while (n--)
+    t = doc->tokens[t].next;
+  return t;
+}
+
+
+/*******************************************************************************
+* Function  : json_size
+* Brief     : The number of elements of an array, 0 for any other token.
+*******************************************************************************/
+unsigned int json_size(const json *doc, int array)
+{
+  return array >= 0 && doc->tokens[array].type == JSON_ARRAY? doc->tokens[array].size : 0;
+}
+
+
+/*******************************************************************************
+* Function  : json_number
+* Brief     : The value of a number, or a fallback if the token is not one.
+*******************************************************************************/
+double json_number(const json *doc, int token, double fallback)
+{
+  char              number[64];
+  const json_token *t = token >= 0? &doc->tokens[token] : NULL;
+
+  if (!t || t->type != JSON_NUMBER || t->end - t->start >= sizeof(number))
+    return fallback;
+
+  memcpy(number, doc->text + t->start, t->end - t->start);
+  number[t->end - t->start] = '\0';
+  return strtod(number, NULL);
+}
+
+
+/*******************************************************************************
+* Function  : json_bool
+* Brief     : The value of a boolean, or a fallback if the token is not one.
+*******************************************************************************/
+bool json_bool(const json *doc, int token, bool fallback)
+{
+  if (token < 0 || doc->tokens[token].type != JSON_BOOL)
+    return fallback;
+  return doc->text[doc->tokens[token].start] == 't';
+}
+
+
+/*******************************************************************************
+* Function  : json_string
+* Brief     : Copy a string, its escapes decoded. Characters escaped outside of
+*             ASCII become '?'.
+* Parameters:
+*    1. doc     : The tokens.
+*    2. token   : The string, -1 is allowed.
+*    3. out     : Receives the string, truncated.
+*    4. len     : Its size.
+* Returns   :
+*    true : The string is copied whole.
+*    false: The token is not a string, or was truncated.
+*******************************************************************************/
+bool json_string(const json *doc, int token, char *out, size_t len)
+{
+  static const char  escapes[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+  const char        *p;
+  const char        *end;
+  const char        *e;
+  unsigned int       code;
+  size_t             n = 0;
+
+  if (token < 0 || doc->tokens[token].type != JSON_STRING || !len)
+    return false;
+
+  p   = doc->text + doc->tokens[token].start;
+  end = doc->text + doc->tokens[token].end;
+  for (; p < end && n + 1 < len; p++)
+  {
+    if (*p != '\\')
+      out[n++] = *p;
+    else if (*++p == 'u' && end - p > 4 && sscanf(p + 1, "%4x", &code) == 1)
+    {
+      out[n++] = code < 0x80? (char) code : '?';
+      p       += 4;
+    }
+    else
+    {
+      for (e = escapes; *e && *e != *p; e += 2);
+      out[n++] = *e? e[1] : *p;
+    }
+  }
+  out[n] = '\0';
+  return p == end;
+}
+
+
+/*******************************************************************************
+* Function  : json_release
+* Brief     : Free the tokens of a text.
+*******************************************************************************/
+void json_release(json *doc)
+{
+  free(doc->tokens);
+  memset(doc, 0, sizeof(*doc));
+}
@@ -0,0 +1,1043 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: mesh.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module optimizes indexed triangle lists for the vertex stage:
+*           it welds identical vertices, orders triangles for the post-
+*           transform cache then in clusters against overdraw, and orders
+*           vertices for fetch. It also simplifies them into levels of 
+*           detail. Used at load or bake time.
+*******************************************************************************/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh.h"
+
+//
+// Forsyth's scoring: a cache of 32 vertices, the last triangle's vertices
+// scored alike so that strips are not favoured, and a boost for vertices
+// with few triangles left, so that none is left alone.
+//
+#define FORSYTH_CACHE       32
+#define FORSYTH_DECAY       1.5f
+#define FORSYTH_LAST        0.75f
+#define FORSYTH_VALENCE     2.0f
+#define FORSYTH_VALENCE_POW 0.5f
+
+//
+// Collapses may turn a triangle by 60 degrees at most: the cosine of it.
+//
+#define SIMPLIFY_TURN 0.5
+
+#define EMPTY 0xffffffffu
+
+
+typedef struct cluster
+{
+  unsigned int first;
+  unsigned int cnt;
+  float        sort;
+}cluster;
+
+
+/*******************************************************************************
+* Function  : mesh_statistics
+* Brief     : Simulate the post-transform cache drawing a mesh.
+* Parameters:
+*    1. stats   : The counts the mesh is added to.
+*    2. indices : Its triangles, 3 indices each.
+*    3. cnt     : Its number of indices.
+*    4. vertices: Its number of vertices.
+*******************************************************************************/
+void mesh_statistics(mesh_stats *stats, const unsigned int *indices, unsigned int cnt, unsigned int vcnt)
+{
+  unsigned int *time;
+  unsigned int  now = TAWY_MESH_CACHE_SIZE + 1;
+
+  stats->triangles += cnt / 3;
+  stats->vertices  += vcnt;
+
+  //
+  // A vertex is still cached if fewer than the cache size were transformed
+  // since it was. Without memory, every index misses.
+  //
+  if (NULL == (time = calloc(vcnt, sizeof(unsigned int))))
+  {
+    stats->transformed += cnt;
+    return;
+  }
+
+  for (unsigned int i = 0; i < cnt; i++)
+  {
+    if (now - time[indices[i]] > TAWY_MESH_CACHE_SIZE)
+    {
+      time[indices[i]] = now++;
+      stats->transformed++;
+    }
+  }
+  free(time);
+}
+
+
+/*******************************************************************************
+* Function  : mesh_acmr
+* Brief     : The average cache miss ratio: vertices transformed per triangle.
+*******************************************************************************/
+float mesh_acmr(const mesh_stats *stats)
+{
+  return stats->triangles? (float) stats->transformed / stats->triangles : 0.0f;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_atvr
+* Brief     : The average transformed to vertex ratio: vertices transformed per
+*             vertex in the buffer.
+*******************************************************************************/
+float mesh_atvr(const mesh_stats *stats)
+{
+  return stats->vertices? (float) stats->transformed / stats->vertices : 0.0f;
+}
+
+
+/*******************************************************************************
+* Function  : position_of
+* Brief     : The position of a vertex.
+*******************************************************************************/
+static const float *position_of(const float *positions, size_t stride, unsigned int v)
+{
+  return (const float *) ((const unsigned char *) positions + v * stride);
+}
+
+
+/*******************************************************************************
+* Function  : mesh_bounds
+* Brief     : Compute the sphere bounding vertices: the center of their box, 
+*             and the distance to the farthest.
+* Parameters:
+*    1. bounds   : Receives the center, then the radius.
+*    2. positions: The position of the first vertex, 3 floats.
+*    3. stride   : The size of a vertex, in bytes.
+*    4. vcnt     : The number of vertices.
+*******************************************************************************/
+void mesh_bounds(float *bounds, const float *positions, size_t stride, unsigned int vcnt)
+{
+  const float *p;
+  float        min[3] = {0.0f, 0.0f, 0.0f};
+  float        max[3] = {0.0f, 0.0f, 0.0f};
+  float        d[3];
+
+  if (vcnt)
+  {
+    memcpy(min, positions, sizeof(min));
+    memcpy(max, positions, sizeof(max));
+  }
+
+  for (unsigned int v = 1; v < vcnt; v++)
+  {
+    p = position_of(positions, stride, v);
+    for (int c = 0; c < 3; c++)
+    {
+      min[c] = fminf(min[c], p[c]);
+      max[c] = fmaxf(max[c], p[c]);
+    }
+  }
+
+  bounds[3] = 0.0f;
+  for (int c = 0; c < 3; c++)
+    bounds[c] = (min[c] + max[c]) * 0.5f;
+
+  for (unsigned int v = 0; v < vcnt; v++)
+  {
+    p = position_of(positions, stride, v);
+    for (int c = 0; c < 3; c++)
+      d[c] = p[c] - bounds[c];
+    bounds[3] = fmaxf(bounds[3], d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+  }
+  bounds[3] = sqrtf(bounds[3]);
+}
+
+
+/*******************************************************************************
+* Function  : hash
+* Brief     : FNV-1a of the bytes of a vertex.
+*******************************************************************************/
+static unsigned int hash(const unsigned char *bytes, size_t size)
+{
+  unsigned int h = 2166136261u;
+
+  for (size_t i = 0; i < size; i++)
+    h = (h ^ bytes[i]) * 16777619u;
+  return h;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_weld
+* Brief     : Merge vertices whose bytes are identical, keeping the first of
+*             each, and point indices to them.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, compacted in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+* Returns   :
+*    vcnt: The number of vertices left, all of them if memory is exhausted.
+*******************************************************************************/
+unsigned int mesh_weld(unsigned int *indices, unsigned int cnt, void *vertices, unsigned int vcnt, size_t stride)
+{
+  unsigned char *bytes = vertices;
+  unsigned int  *table;
+  unsigned int  *remap;
+  unsigned int   size  = 1;
+  unsigned int   kept  = 0;
+  unsigned int   slot;
+
+  while (size < 2 * vcnt)
+    size *= 2;
+
+  table = malloc(size * sizeof(unsigned int));
+  remap = malloc(vcnt * sizeof(unsigned int));
+  if (!table || !remap)
+  {
+    free(table);
+    free(remap);
+    return vcnt;
+  }
+  memset(table, 0xff, size * sizeof(unsigned int));
+
+  //
+  // The table holds the kept vertices, already moved to their place: a
+  // vertex is only compared with vertices before it.
+  //
+  for (unsigned int v = 0; v < vcnt; v++)
+  {
+    slot = hash(bytes + v * stride, stride) & (size - 1);
+    while (table[slot] != EMPTY && memcmp(bytes + table[slot] * stride, bytes + v * stride, stride))
+      slot = (slot + 1) & (size - 1);
+
+    if (table[slot] == EMPTY)
+    {
+      memmove(bytes + kept * stride, bytes + v * stride, stride);
+      table[slot] = kept++;
+    }
+    remap[v] = table[slot];
+  }
+
+  for (unsigned int i = 0; i < cnt; i++)
+    indices[i] = remap[indices[i]];
+
+  free(table);
+  free(remap);
+  return kept;
+}
+
+
+/*******************************************************************************
+* Function  : vertex_score
+* Brief     : Forsyth's score of a vertex, from its position in the cache and
+*             its number of triangles left to draw.
+*******************************************************************************/
+static float vertex_score(int position, unsigned int live)
+{
+  float score = 0.0f;
+
+  if (!live)
+    return -1.0f;
+
+  if (position >= 0 && position < 3)
+    score = FORSYTH_LAST;
+  else if (position >= 3)
+    score = powf(1.0f - (float) (position - 3) / (FORSYTH_CACHE - 3), FORSYTH_DECAY);
+
+  return score + FORSYTH_VALENCE * powf((float) live, -FORSYTH_VALENCE_POW);
+}
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_cache
+* Brief     : Order triangles so that they reuse the vertices recently
+*             transformed, following Forsyth's linear-speed scoring.
+* Parameters:
+*    1. indices : The triangles, reordered.
+*    2. cnt     : The number of indices.
+*    3. vcnt    : The number of vertices.
+* Returns   :
+*    true : Triangles are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_cache(unsigned int *indices, unsigned int cnt, unsigned int vcnt)
+{
+  unsigned int  triangles = cnt / 3;
+  unsigned int *live      = calloc(vcnt, sizeof(unsigned int));
+  unsigned int *first     = calloc(vcnt + 1, sizeof(unsigned int));
+  unsigned int *adjacency = malloc(cnt * sizeof(unsigned int));
+  int          *position  = malloc(vcnt * sizeof(int));
+  float        *score     = malloc(vcnt * sizeof(float));
+  float        *tri_score = malloc(triangles * sizeof(float));
+  bool         *drawn     = calloc(triangles, sizeof(bool));
+  unsigned int *order     = malloc(cnt * sizeof(unsigned int));
+  unsigned int  cache[FORSYTH_CACHE + 3];
+  unsigned int  next[FORSYTH_CACHE + 3];
+  unsigned int  cached = 0;
+  unsigned int  fresh;
+  unsigned int  cursor = 0;
+  unsigned int  best   = EMPTY;
+  unsigned int  v, t, k;
+  float         best_score;
+  bool          ret = live && first && adjacency && position && score && tri_score && drawn && order;
+
+  if (!ret)
+    goto done;
+
+  //
+  // 1. The triangles of each vertex, contiguous from first[v].
+  //
+  for (unsigned int i = 0; i < triangles * 3; i++)
+    live[indices[i]]++;
+  for (v = 0; v < vcnt; v++)
+    first[v + 1] = first[v] + live[v];
+  for (unsigned int i = 0; i < triangles * 3; i++)
+    adjacency[first[indices[i]]++] = i / 3;
+  for (v = vcnt; v > 0; v--)
+    first[v] = first[v - 1];
+  first[0] = 0;
+
+  for (v = 0; v < vcnt; v++)
+  {
+    position[v] = -1;
+    score[v]    = vertex_score(-1, live[v]);
+  }
+
+  for (t = 0; t < triangles; t++)
+    tri_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+  //
+  // 2. Draw the best triangle around the cache, or the next one not drawn
+  //    when the cache has nothing left.
+  //
+  for (unsigned int drawn_cnt = 0; drawn_cnt < triangles; drawn_cnt++)
+  {
+    if (best == EMPTY)
+    {
+      while (drawn[cursor])
+        cursor++;
+      best = cursor;
+    }
+
+    t        = best;
+    drawn[t] = true;
+    memcpy(&order[3 * drawn_cnt], &indices[3 * t], 3 * sizeof(unsigned int));
+
+    //
+    // Its vertices have a triangle less: it leaves their list.
+    //
+    for (int c = 0; c < 3; c++)
+    {
+      v = indices[3 * t + c];
+      for (k = first[v]; adjacency[k] != t; k++);
+      adjacency[k] = adjacency[first[v] + live[v] - 1];
+      live[v]--;
+    }
+
+    //
+    // Its vertices go in front of the cache, the others move back.
+    //
+    memcpy(next, &indices[3 * t], 3 * sizeof(unsigned int));
+    fresh = 3;
+    for (k = 0; k < cached; k++)
+      if (cache[k] != next[0] && cache[k] != next[1] && cache[k] != next[2])
+        next[fresh++] = cache[k];
+
+    cached = fresh > FORSYTH_CACHE + 3? FORSYTH_CACHE + 3 : fresh;
+    memcpy(cache, next, cached * sizeof(unsigned int));
+
+    //
+    // Only vertices in the cache, and those just pushed out of it, change
+    // score, and so do only their triangles.
+    //
+    for (k = 0; k < cached; k++)
+    {
+      v           = cache[k];
+      position[v] = k < FORSYTH_CACHE? (int) k : -1;
+      score[v]    = vertex_score(position[v], live[v]);
+    }
+
+    best       = EMPTY;
+    best_score = -1.0f;
+    for (k = 0; k < cached; k++)
+    {
+      v = cache[k];
+      for (unsigned int a = first[v]; a < first[v] + live[v]; a++)
+      {
+        t            = adjacency[a];
+        tri_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+        if (tri_score[t] > best_score)
+        {
+          best       = t;
+          best_score = tri_score[t];
+        }
+      }
+    }
+
+    if (cached > FORSYTH_CACHE)
+      cached = FORSYTH_CACHE;
+  }
+
+  memcpy(indices, order, triangles * 3 * sizeof(unsigned int));
+
+done:
+  free(live);
+  free(first);
+  free(adjacency);
+  free(position);
+  free(score);
+  free(tri_score);
+  free(drawn);
+  free(order);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : by_sort
+* Brief     : Order clusters by decreasing sort key, then as they were drawn.
+*******************************************************************************/
+static int by_sort(const void *a, const void *b)
+{
+  const cluster *x = a;
+  const cluster *y = b;
+
+  if (x->sort != y->sort)
+    return x->sort < y->sort? 1 : -1;
+  return x->first < y->first? -1 : 1;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_overdraw
+* Brief     : Cut triangles, ordered for the cache, in clusters as short as
+*             their ACMR from a cold cache allows, within threshold of the one
+*             of the mesh, and draw the clusters facing out of the mesh first,
+*             as they tend to hide the others.
+* Parameters:
+*    1. indices  : The triangles, reordered.
+*    2. cnt      : The number of indices.
+*    3. positions: The position of the first vertex, 3 floats.
+*    4. stride   : The size of a vertex, in bytes.
+*    5. vcnt     : The number of vertices.
+*    6. threshold: How much the ACMR may grow, TAWY_MESH_OVERDRAW by default.
+* Returns   :
+*    true : Triangles are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_overdraw(unsigned int *indices, unsigned int cnt, const float *positions,
+                            size_t stride, unsigned int vcnt, float threshold)
+{
+  unsigned int  triangles = cnt / 3;
+  unsigned int *time      = calloc(vcnt, sizeof(unsigned int));
+  cluster      *clusters  = malloc((triangles + 1) * sizeof(cluster));
+  unsigned int *order     = malloc(cnt * sizeof(unsigned int));
+  mesh_stats    stats     = {0};
+  unsigned int  now       = TAWY_MESH_CACHE_SIZE + 1;
+  unsigned int  clusters_cnt = 0;
+  unsigned int  cluster_misses = 0;
+  float         acmr;
+  float         center[3]  = {0.0f, 0.0f, 0.0f};
+  float         centroid[3];
+  float         normal[3];
+  float         e1[3], e2[3], n[3];
+  float         area, length;
+  const float  *p[3];
+  bool          ret = time && clusters && order;
+
+  if (!ret || !triangles)
+    goto done;
+
+  mesh_statistics(&stats, indices, cnt, vcnt);
+  acmr = mesh_acmr(&stats) * threshold;
+
+  //
+  // 1. Once sorted, a cluster may follow any other: its cache starts cold.
+  //    The next one starts as soon as its ACMR is low enough.
+  //
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    if (!clusters_cnt || (float) cluster_misses / clusters[clusters_cnt - 1].cnt <= acmr)
+    {
+      clusters[clusters_cnt].first = t;
+      clusters[clusters_cnt].cnt   = 0;
+      clusters_cnt++;
+      cluster_misses = 0;
+      now           += TAWY_MESH_CACHE_SIZE + 1;
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+      if (now - time[indices[3 * t + c]] > TAWY_MESH_CACHE_SIZE)
+      {
+        time[indices[3 * t + c]] = now++;
+        cluster_misses++;
+      }
+    }
+    clusters[clusters_cnt - 1].cnt++;
+  }
+
+  //
+  // 2. The center of the mesh, over the triangles drawn.
+  //
+  for (unsigned int i = 0; i < cnt; i++)
+    for (int c = 0; c < 3; c++)
+      center[c] += position_of(positions, stride, indices[i])[c] / cnt;
+
+  //
+  // 3. A cluster facing away from the center hides more than it is hidden:
+  //    its key is how far its area weighted center lies along its normal.
+  //
+  for (unsigned int k = 0; k < clusters_cnt; k++)
+  {
+    memset(centroid, 0, sizeof(centroid));
+    memset(normal, 0, sizeof(normal));
+    area = 0.0f;
+
+    for (unsigned int t = clusters[k].first; t < clusters[k].first + clusters[k].cnt; t++)
+    {
+      for (int c = 0; c < 3; c++)
+        p[c] = position_of(positions, stride, indices[3 * t + c]);
+
+      for (int c = 0; c < 3; c++)
+      {
+        e1[c] = p[1][c] - p[0][c];
+        e2[c] = p[2][c] - p[0][c];
+      }
+      n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for (int c = 0; c < 3; c++)
+      {
+        centroid[c] += (p[0][c] + p[1][c] + p[2][c]) / 3.0f * length;
+        normal[c]   += n[c];
+      }
+      area += length;
+    }
+
+    length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    clusters[k].sort = 0.0f;
+    if (area > 0.0f && length > 0.0f)
+      for (int c = 0; c < 3; c++)
+        clusters[k].sort += (centroid[c] / area - center[c]) * normal[c] / length;
+  }
+
+  qsort(clusters, clusters_cnt, sizeof(cluster), by_sort);
+
+  cnt = 0;
+  for (unsigned int k = 0; k < clusters_cnt; k++)
+  {
+    memcpy(&order[cnt], &indices[3 * clusters[k].first], clusters[k].cnt * 3 * sizeof(unsigned int));
+    cnt += clusters[k].cnt * 3;
+  }
+  memcpy(indices, order, cnt * sizeof(unsigned int));
+
+done:
+  free(time);
+  free(clusters);
+  free(order);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_optimize_fetch
+* Brief     : Order vertices as triangles first use them, so that fetching them
+*             walks the buffer forward. Unused vertices go last.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, reordered in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+* Returns   :
+*    true : Vertices are reordered.
+*    false: Memory is exhausted, they are left as they were.
+*******************************************************************************/
+bool mesh_optimize_fetch(unsigned int *indices, unsigned int cnt, void *vertices, unsigned int vcnt, size_t stride)
+{
+  unsigned char *bytes = vertices;
+  unsigned char *copy  = malloc(vcnt * stride);
+  unsigned int  *remap = malloc(vcnt * sizeof(unsigned int));
+  unsigned int   next  = 0;
+
+  if (!copy || !remap)
+  {
+    free(copy);
+    free(remap);
+    return false;
+  }
+
+  memset(remap, 0xff, vcnt * sizeof(unsigned int));
+  memcpy(copy, bytes, vcnt * stride);
+
+  for (unsigned int i = 0; i < cnt; i++)
+  {
+    if (remap[indices[i]] == EMPTY)
+      remap[indices[i]] = next++;
+    indices[i] = remap[indices[i]];
+  }
+
+  for (unsigned int v = 0; v < vcnt; v++)
+  {
+    if (remap[v] == EMPTY)
+      remap[v] = next++;
+    memcpy(bytes + remap[v] * stride, copy + v * stride, stride);
+  }
+
+  free(copy);
+  free(remap);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_optimize
+* Brief     : Run every pass on a mesh: weld, cache, overdraw, then fetch. A
+*             pass short of memory is skipped. Positions must lead vertices.
+* Parameters:
+*    1. indices : The triangles, rewritten.
+*    2. cnt     : The number of indices.
+*    3. vertices: The vertices, rewritten in place.
+*    4. vcnt    : The number of vertices.
+*    5. stride  : The size of a vertex, in bytes.
+*    6. before  : The counts the mesh as given is added to, or NULL.
+*    7. after   : The counts the optimized mesh is added to, or NULL.
+* Returns   :
+*    vcnt: The number of vertices left.
+*******************************************************************************/
+unsigned int mesh_optimize(unsigned int *indices, unsigned int cnt, void *vertices, unsigned int vcnt,
+                           size_t stride, mesh_stats *before, mesh_stats *after)
+{
+  if (before)
+    mesh_statistics(before, indices, cnt, vcnt);
+
+  vcnt = mesh_weld(indices, cnt, vertices, vcnt, stride);
+  mesh_optimize_cache(indices, cnt, vcnt);
+  mesh_optimize_overdraw(indices, cnt, vertices, stride, vcnt, TAWY_MESH_OVERDRAW);
+  mesh_optimize_fetch(indices, cnt, vertices, vcnt, stride);
+
+  if (after)
+    mesh_statistics(after, indices, cnt, vcnt);
+  return vcnt;
+}
+
+
+/*******************************************************************************
+* Struct    : quadric
+* Brief     : The sum of squared distances to planes, weighted by the area of 
+*             their triangles: a symmetric matrix a, a vector b and a constant
+*             c, so that the error at p is p.a.p + 2 b.p + c. w sums weights.
+*******************************************************************************/
+typedef struct quadric
+{
+  double a[6];
+  double b[3];
+  double c;
+  double w;
+}quadric;
+
+
+/*******************************************************************************
+* Struct    : collapse
+* Brief     : Moving a vertex onto a neighbour, and the error it costs.
+*******************************************************************************/
+typedef struct collapse
+{
+  unsigned int from;
+  unsigned int to;
+  float        cost;
+}collapse;
+
+
+/*******************************************************************************
+* Function  : by_cost
+* Brief     : Order collapses, cheapest first.
+*******************************************************************************/
+static int by_cost(const void *a, const void *b)
+{
+  float c0 = ((const collapse *) a)->cost;
+  float c1 = ((const collapse *) b)->cost;
+
+  return (c0 > c1) - (c0 < c1);
+}
+
+
+/*******************************************************************************
+* Function  : by_key
+* Brief     : Order edges by their two vertices.
+*******************************************************************************/
+static int by_key(const void *a, const void *b)
+{
+  unsigned long long k0 = *(const unsigned long long *) a;
+  unsigned long long k1 = *(const unsigned long long *) b;
+
+  return (k0 > k1) - (k0 < k1);
+}
+
+
+/*******************************************************************************
+* Function  : normal_of
+* Brief     : The normal of a triangle, its length twice its area.
+*******************************************************************************/
+static void normal_of(const float *p0, const float *p1, const float *p2, double *n)
+{
+  double e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+  double e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+  n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+  n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+  n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+
+/*******************************************************************************
+* Function  : quadric_add_plane
+* Brief     : Add the plane of a triangle to a quadric, weighted by its area.
+*******************************************************************************/
+static void quadric_add_plane(quadric *q, const float *p0, const float *p1, const float *p2)
+{
+  double n[3];
+  double len;
+  double d;
+  double w;
+
+  normal_of(p0, p1, p2, n);
+  if ((len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2])) == 0.0)
+    return;
+
+  n[0] /= len;
+  n[1] /= len;
+  n[2] /= len;
+  d     = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+  w     = len * 0.5;
+
+  q->a[0] += w * n[0] * n[0];
+  q->a[1] += w * n[0] * n[1];
+  q->a[2] += w * n[0] * n[2];
+  q->a[3] += w * n[1] * n[1];
+  q->a[4] += w * n[1] * n[2];
+  q->a[5] += w * n[2] * n[2];
+  for (int c = 0; c < 3; c++)
+    q->b[c] += w * n[c] * d;
+  q->c += w * d * d;
+  q->w += w;
+}
+
+
+/*******************************************************************************
+* Function  : quadric_error
+* Brief     : The mean squared distance of a point to the planes of two 
+*             quadrics.
+*******************************************************************************/
+static float quadric_error(const quadric *q0, const quadric *q1, const float *p)
+{
+  double a[6];
+  double e;
+  double w = q0->w + q1->w;
+
+  for (int i = 0; i < 6; i++)
+    a[i] = q0->a[i] + q1->a[i];
+
+  e = a[0] * p[0] * p[0] + a[3] * p[1] * p[1] + a[5] * p[2] * p[2] +
+      2.0 * (a[1] * p[0] * p[1] + a[2] * p[0] * p[2] + a[4] * p[1] * p[2]) +
+      2.0 * ((q0->b[0] + q1->b[0]) * p[0] + (q0->b[1] + q1->b[1]) * p[1] + (q0->b[2] + q1->b[2]) * p[2]) +
+      q0->c + q1->c;
+  return w > 0.0 && e > 0.0? (float) (e / w) : 0.0f;
+}
+
+
+/*******************************************************************************
+* Function  : lock_vertices
+* Brief     : Find the vertices that must not move: those sharing a position
+*             with another vertex, and those on an edge without exactly two
+*             triangles, a border or a non-manifold edge.
+* Returns   :
+*    true : locked is set.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool lock_vertices(bool *locked, const unsigned int *indices, unsigned int cnt, const float *positions,
+                          size_t stride, unsigned int vcnt)
+{
+  unsigned int       *table;
+  unsigned int       *first;
+  unsigned int       *shared;
+  unsigned long long *edges;
+  unsigned int        size = 1;
+  unsigned int        slot;
+  unsigned int        a;
+  unsigned int        b;
+  unsigned int        run;
+  bool                ret  = false;
+
+  while (size < 2 * vcnt)
+    size *= 2;
+
+  table  = malloc(size * sizeof(unsigned int));
+  first  = malloc(vcnt * sizeof(unsigned int));
+  shared = calloc(vcnt, sizeof(unsigned int));
+  edges  = malloc((size_t) cnt * sizeof(unsigned long long));
+  if (!table || !first || !shared || !edges)
+    goto done;
+  memset(table, 0xff, size * sizeof(unsigned int));
+
+  //
+  // 1. The first vertex at each position, as the weld finds it.
+  //
+  for (unsigned int v = 0; v < vcnt; v++)
+  {
+    slot = hash((const unsigned char *) position_of(positions, stride, v), 3 * sizeof(float)) & (size - 1);
+    while (table[slot] != EMPTY &&
+           memcmp(position_of(positions, stride, table[slot]), position_of(positions, stride, v), 3 * sizeof(float)))
+      slot = (slot + 1) & (size - 1);
+
+    if (table[slot] == EMPTY)
+      table[slot] = v;
+    first[v] = table[slot];
+    shared[first[v]]++;
+  }
+
+  for (unsigned int v = 0; v < vcnt; v++)
+    locked[v] = shared[first[v]] > 1;
+
+  //
+  // 2. Edges between positions, counted once sorted. Seams are not borders.
+  //
+  for (unsigned int i = 0; i < cnt; i++)
+  {
+    a        = first[indices[i]];
+    b        = first[indices[i - i % 3 + (i + 1) % 3]];
+    edges[i] = a < b? (unsigned long long) a << 32 | b : (unsigned long long) b << 32 | a;
+  }
+  qsort(edges, cnt, sizeof(unsigned long long), by_key);
+
+  for (unsigned int i = 0; i < cnt; i += run)
+  {
+    for (run = 1; i + run < cnt && edges[i + run] == edges[i]; run++);
+    if (run != 2)
+      shared[edges[i] >> 32] = shared[edges[i] & 0xffffffffu] = EMPTY;
+  }
+
+  for (unsigned int v = 0; v < vcnt; v++)
+    locked[v] |= shared[first[v]] == EMPTY;
+  ret = true;
+
+done:
+  free(table);
+  free(first);
+  free(shared);
+  free(edges);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : flips
+* Brief     : Tell whether moving a vertex onto another turns one of the 
+*             triangles around it that remain further from its normal as 
+*             given than SIMPLIFY_TURN allows, over, or flattens it. Turns add
+*             up over collapses: the normal as given bounds them all.
+*******************************************************************************/
+static bool flips(const unsigned int *indices, const float *normals, const unsigned int *around, 
+                  unsigned int around_cnt, const float *positions, size_t stride, unsigned int from, unsigned int to)
+{
+  const unsigned int *t;
+  const float        *n0;
+  const float        *q[3];
+  double              n1[3];
+  double              d;
+
+  for (unsigned int i = 0; i < around_cnt; i++)
+  {
+    t = &indices[around[i] * 3];
+    if ((t[0] != from && t[1] != from && t[2] != from) || t[0] == to || t[1] == to || t[2] == to)
+      continue;
+
+    for (int c = 0; c < 3; c++)
+      q[c] = position_of(positions, stride, t[c] == from? to : t[c]);
+
+    n0 = &normals[around[i] * 3];
+    normal_of(q[0], q[1], q[2], n1);
+    d  = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+    if (d <= 0.0 || d * d < SIMPLIFY_TURN * SIMPLIFY_TURN * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]))
+      return true;
+  }
+  return false;
+}
+
+
+/*******************************************************************************
+* Function  : mesh_simplify
+* Brief     : Collapse edges of a mesh, cheapest first by the quadric error of 
+*             the planes around them, until its indices fit a target. Vertices
+*             only move onto a neighbour, so that the result indexes the same
+*             vertices. Vertices on borders, or sharing their position with
+*             another vertex as along seams of texture coordinates, stay.
+* Parameters:
+*    1. dst      : Receives the triangles, as many indices as given at most.
+*    2. indices  : The triangles.
+*    3. cnt      : The number of indices.
+*    4. positions: The position of the first vertex, 3 floats.
+*    5. stride   : The size of a vertex, in bytes.
+*    6. vcnt     : The number of vertices.
+*    7. target   : The number of indices wanted.
+*    8. error    : Receives the distance from the surface the worst collapse
+*                  moved it by, in the units of positions.
+* Returns   :
+*    cnt: The number of indices written, above target if no collapse is left.
+*         The triangles are copied as they are if memory is exhausted.
+*******************************************************************************/
+unsigned int mesh_simplify(unsigned int *dst, const unsigned int *indices, unsigned int cnt, const float *positions,
+                           size_t stride, unsigned int vcnt, unsigned int target, float *error)
+{
+  quadric      *quadrics = calloc(vcnt, sizeof(quadric));
+  bool         *locked   = malloc(vcnt * sizeof(bool));
+  bool         *moved    = malloc(vcnt * sizeof(bool));
+  unsigned int *offsets  = malloc((vcnt + 1) * sizeof(unsigned int));
+  unsigned int *around   = malloc((size_t) cnt * sizeof(unsigned int));
+  collapse     *edges    = malloc((size_t) cnt * 2 * sizeof(collapse));
+  float        *normals  = malloc((size_t) cnt * sizeof(float));
+  collapse     *c;
+  unsigned int *t;
+  unsigned int  a;
+  unsigned int  b;
+  unsigned int  edge_cnt;
+  unsigned int  collapsed;
+  unsigned int  kept;
+  double        n[3];
+  double        len;
+  float         worst    = 0.0f;
+
+  memcpy(dst, indices, (size_t) cnt * sizeof(unsigned int));
+  *error = 0.0f;
+  if (!quadrics || !locked || !moved || !offsets || !around || !edges || !normals ||
+      !lock_vertices(locked, indices, cnt, positions, stride, vcnt))
+    goto done;
+
+  //
+  // 1. Each vertex sums the planes of its triangles, each triangle keeps its
+  //    normal as given.
+  //
+  for (unsigned int i = 0; i < cnt; i += 3)
+  {
+    normal_of(position_of(positions, stride, dst[i]), position_of(positions, stride, dst[i + 1]),
+              position_of(positions, stride, dst[i + 2]), n);
+    len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int k = 0; k < 3; k++)
+      normals[i + k] = len > 0.0? (float) (n[k] / len) : 0.0f;
+
+    for (int c = 0; c < 3; c++)
+      quadric_add_plane(&quadrics[dst[i + c]], position_of(positions, stride, dst[i]),
+                        position_of(positions, stride, dst[i + 1]), position_of(positions, stride, dst[i + 2]));
+  }
+
+  //
+  // 2. Passes collapse the cheapest edges, a vertex at most once per pass so
+  //    that the triangles around it and its cost stay as computed.
+  //
+  while (cnt > target)
+  {
+    memset(offsets, 0, (vcnt + 1) * sizeof(unsigned int));
+    for (unsigned int i = 0; i < cnt; i++)
+      offsets[dst[i] + 1]++;
+    for (unsigned int v = 0; v < vcnt; v++)
+      offsets[v + 1] += offsets[v];
+    for (unsigned int i = 0; i < cnt; i++)
+      around[offsets[dst[i]]++] = i / 3;
+    for (unsigned int v = vcnt; v > 0; v--)
+      offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+
+    edge_cnt = 0;
+    for (unsigned int i = 0; i < cnt; i++)
+    {
+      a = dst[i];
+      b = dst[i - i % 3 + (i + 1) % 3];
+      if (!locked[a])
+        edges[edge_cnt++] = (collapse) {a, b, quadric_error(&quadrics[a], &quadrics[b], position_of(positions, stride, b))};
+      if (!locked[b])
+        edges[edge_cnt++] = (collapse) {b, a, quadric_error(&quadrics[b], &quadrics[a], position_of(positions, stride, a))};
+    }
+    qsort(edges, edge_cnt, sizeof(collapse), by_cost);
+
+    memset(moved, 0, vcnt * sizeof(bool));
+    collapsed = 0;
+    kept      = cnt;
+    for (unsigned int e = 0; e < edge_cnt && kept > target; e++)
+    {
+      c = &edges[e];
+      if (moved[c->from] || moved[c->to] ||
+          flips(dst, normals, &around[offsets[c->from]], offsets[c->from + 1] - offsets[c->from], positions, stride,
+                c->from, c->to))
+        continue;
+
+      //
+      // Triangles around both vertices lose their corner, and disappear.
+      //
+      for (unsigned int i = offsets[c->from]; i < offsets[c->from + 1]; i++)
+      {
+        t = &dst[around[i] * 3];
+        if (t[0] == t[1])
+          continue;
+
+        for (int k = 0; k < 3; k++)
+          t[k] = t[k] == c->from? c->to : t[k];
+        if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+        {
+          t[0]  = t[1] = t[2] = c->to;
+          kept -= 3;
+        }
+      }
+
+      for (int k = 0; k < 6; k++)
+        quadrics[c->to].a[k] += quadrics[c->from].a[k];
+      for (int k = 0; k < 3; k++)
+        quadrics[c->to].b[k] += quadrics[c->from].b[k];
+      quadrics[c->to].c += quadrics[c->from].c;
+      quadrics[c->to].w += quadrics[c->from].w;
+
+      moved[c->from] = moved[c->to] = true;
+      worst          = c->cost > worst? c->cost : worst;
+      collapsed++;
+    }
+
+    //
+    // 3. Drop the triangles gone.
+    //
+    kept = 0;
+    for (unsigned int i = 0; i < cnt; i += 3)
+    {
+      if (dst[i] == dst[i + 1])
+        continue;
+      memmove(&dst[kept], &dst[i], 3 * sizeof(unsigned int));
+      memmove(&normals[kept], &normals[i], 3 * sizeof(float));
+      kept += 3;
+    }
+    cnt = kept;
+
+    if (!collapsed)
+      break;
+  }
+  *error = sqrtf(worst);
+
+done:
+  free(quadrics);
+  free(locked);
+  free(moved);
+  free(offsets);
+  free(around);
+  free(edges);
+  free(normals);
+  return cnt;
+}
@@ -37,7 +37,8 @@
 *    2. ...      : Variadic arguments to pass to class constructor.
 * Returns   :
 *    obj  : An instance of the class.
-*    null : Class constructor returned false for some reason.
+*    null : Class constructor returned false for some reason, the instance is
+*           freed: constructors only release what they allocated.
 *******************************************************************************/ 
 void *new(const void *cls, ...)
 {
@@ -67,7 +68,10 @@ void *new(const void *cls, ...)
   {   
     va_start(args, cls);
     if (!__cls__->__init__(obj, &args))
+    {
+      free(obj);
       obj = NULL;
+    }
     va_end(args);
   }
 
@@ -223,3 +227,23 @@ bool enable(void *self, ...)
 
   return ret;
 }
+
+
+/*******************************************************************************
+* Function  : reload
+* Brief     : Let an instance rebuild itself if it depends on a file that has
+*             changed on disk.
+* Parameters:
+*    1. self    : The instance of the class.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The instance depends on this file and started reloading.
+*    false: The instance does not depend on this file, or cannot reload.
+*******************************************************************************/
+bool reload(void *self, const char *path)
+{
+  const class **obj = self;
+  if (self && *obj && (*obj)->__reload__)
+    return (*obj)->__reload__(self, path);
+  return false;
+}
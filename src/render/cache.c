@@ -0,0 +1,87 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: cache.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module holds what the disk caches share: the hash of their 
+*           keys, the path of their files and the creation of their 
+*           directories.
+*******************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+
+/*******************************************************************************
+* Function  : cache_hash
+* Brief     : Accumulate bytes in a FNV-1a 64 hash.
+* Parameters:
+*    1. h   : The current hash, TAWY_CACHE_HASH_BASIS to start one.
+*    2. data: The bytes to accumulate.
+*    3. size: Their number.
+* Returns   :
+*    hash: The new hash.
+*******************************************************************************/
+unsigned long long cache_hash(unsigned long long h, const void *data, size_t size)
+{
+  const unsigned char *p = data;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    h ^= p[i];
+    h *= TAWY_CACHE_HASH_PRIME;
+  }
+
+  return h;
+}
+
+
+/*******************************************************************************
+* Function  : cache_path
+* Brief     : Build the path of the cache file of a key.
+* Parameters:
+*    1. dir      : The directory of the cache, ending with '/'.
+*    2. key      : The key.
+*    3. extension: The extension of the file, e.g. ".bin".
+*    4. path     : The buffer receiving the path.
+*    5. len      : The size of this buffer.
+*******************************************************************************/
+void cache_path(const char *dir, unsigned long long key, const char *extension, char *path, size_t len)
+{
+  snprintf(path, len, "%s%016llx%s", dir, key, extension);
+}
+
+
+/*******************************************************************************
+* Function  : cache_make_dirs
+* Brief     : Create every directory of a path ending with '/'.
+* Parameters:
+*    1. dirs: The path, e.g. "cache/programs/".
+* Returns   :
+*    true : Every directory exists.
+*    false: One of them could not be created.
+*******************************************************************************/
+bool cache_make_dirs(const char *dirs)
+{
+  char  path[1024];
+  char *p;
+
+  strncpy(path, dirs, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+
+  for (p = strchr(path, '/'); p; p = strchr(p + 1, '/'))
+  {
+    *p = '\0';
+    if (mkdir(path, 0755) && errno != EEXIST)
+    {
+      printf("Error, could not create directory '%s'\n", path);
+      return false;
+    }
+    *p = '/';
+  }
+
+  return true;
+}
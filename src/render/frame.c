@@ -0,0 +1,115 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: frame.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module manages the constants shared by every program during a
+*           frame, uploaded once in a uniform buffer object.
+*******************************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "frame.h"
+
+
+/*******************************************************************************
+* Function  : Frame__init__
+* Brief     : The object initializer, called by new()
+* Parameters:
+*    1. self    : The instance of the frame.
+*    2. win     : The window we render to.
+* Returns   :
+*    true : The uniform buffer is allocated and bound to TAWY_FRAME_BINDING.
+*    false: No window was provided.
+*******************************************************************************/
+static bool Frame__init__(void *self, va_list *args)
+{
+  frame *obj = self;
+
+  if (NULL == (obj->win = va_arg(*args, window *)))
+  {
+    printf("Error, a frame requires a window\n");
+    return false;
+  }
+
+  memset(&obj->constants, 0, sizeof(frame_constants));
+  glm_mat4_identity(obj->constants.view);
+  glm_mat4_identity(obj->constants.projection);
+
+  glGenBuffers(1, &obj->ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, obj->ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_constants), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, TAWY_FRAME_BINDING, obj->ubo);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : Frame__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the frame to delete.
+*******************************************************************************/
+static void Frame__del__(void *self)
+{
+  frame *obj = self;
+  glDeleteBuffers(1, &obj->ubo);
+  free(self);
+}
+
+
+/*******************************************************************************
+* Function  : Frame__enable__
+* Brief     : Complete the constants of this frame, and upload them once for 
+*             all the programs. Call it once per frame, before drawing.
+* Parameters:
+*    1. self    : The instance of the frame.
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool Frame__enable__(void *self)
+{
+  frame *obj = self;
+  int    width;
+  int    height;
+
+  glfwGetFramebufferSize(obj->win->display, &width, &height);
+  obj->constants.viewport[0] = (float) width;
+  obj->constants.viewport[1] = (float) height;
+  obj->constants.time        = (float) glfwGetTime();
+  glm_mat4_mul(obj->constants.projection, obj->constants.view, obj->constants.view_projection);
+
+  glBindBuffer(GL_UNIFORM_BUFFER, obj->ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame_constants), &obj->constants);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  return true;
+}
+
+
+/*******************************************************************************
+* Class     : _Frame
+* Brief     : The class definition and its handlers
+*******************************************************************************/
+static const class _Frame = {
+  .size             = sizeof(frame),
+  .__init__         = Frame__init__,
+  .__del__          = Frame__del__,
+  .__get__          = NULL,
+  .__set__          = NULL,
+  .__should_close__ = NULL,
+  .__prepare__      = NULL,
+  .__enable__       = Frame__enable__,
+  .__reload__       = NULL
+};
+
+
+/*******************************************************************************
+* Class     : Frame
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+const void *Frame = & _Frame;
@@ -1,13 +1,43 @@
 #version 330 core
+#ifdef FEEDBACK
+out uvec4 FragColor;
+#else
 out vec4 FragColor;
+#endif
 in vec3 ourColor;
 in vec2 texCoord;
+flat in vec4 diffuseRect;
+flat in vec4 detailRect;
+flat in vec4 maps;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+#include "texture.glsl"
+
+#ifdef DIFFUSE_MAP
+uniform sampler2DArray texture1;
+#endif
+
+#ifdef DETAIL_MAP
+uniform sampler2DArray texture2;
+#endif
+
+#ifdef VIRTUAL_MAP
+#include "virtual.glsl"
+uniform sampler2D  pages;
+uniform usampler2D indirection;
+#endif
 
 void main()
 {
-  FragColor = mix(texture(texture1, texCoord),
-                  texture(texture2, texCoord), 0.2);
+#if defined(FEEDBACK)
+  FragColor = virtual_feedback(texCoord, diffuseRect);
+#elif defined(VIRTUAL_MAP)
+  FragColor = sample_virtual(pages, indirection, texCoord, diffuseRect);
+#elif defined(DIFFUSE_MAP) && defined(DETAIL_MAP)
+  FragColor = mix(sample_map(texture1, texCoord, diffuseRect, maps.x, maps.z),
+                  sample_map(texture2, texCoord, detailRect, maps.y, maps.w), 0.2);
+#elif defined(DIFFUSE_MAP)
+  FragColor = sample_map(texture1, texCoord, diffuseRect, maps.x, maps.z);
+#else
+  FragColor = vec4(0.8, 0.8, 0.8, 1.0);
+#endif
 }
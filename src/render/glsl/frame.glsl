@@ -0,0 +1,8 @@
+layout (std140) uniform Frame
+{
+  mat4  view;
+  mat4  projection;
+  mat4  view_projection;
+  vec2  viewport;
+  float time;
+};
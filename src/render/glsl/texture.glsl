@@ -0,0 +1,36 @@
+//
+// Textures live in layers of texture arrays, small ones in a rect of an atlas
+// page. Wrapping happens here, within the rect, and gradients come from the
+// unwrapped coordinates so that mip selection ignores the wrap.
+//
+// Mipmaps of atlas pages are generated across their entries: the padding of
+// TAWY_TEXTURE_ATLAS_PADDING texels keeps neighbours out of the levels below
+// log2 of it only, bilinear filtering included. Entries are not sampled past.
+//
+const float ATLAS_MAX_LOD = 1.0;
+
+vec4 sample_map(sampler2DArray map, vec2 uv, vec4 rect, float layer, float wrap)
+{
+  vec2  st = mix(clamp(uv, 0.0, 1.0), fract(uv), wrap);
+  vec2  dx = dFdx(uv) * rect.zw;
+  vec2  dy = dFdy(uv) * rect.zw;
+  vec2  size;
+  float rho;
+
+  //
+  // An entry shorter than its page: its gradients are shortened so that the
+  // level they select stays within ATLAS_MAX_LOD.
+  //
+  if (rect.z < 1.0 || rect.w < 1.0)
+  {
+    size = vec2(textureSize(map, 0).xy);
+    rho  = max(length(dx * size), length(dy * size));
+    if (rho > exp2(ATLAS_MAX_LOD))
+    {
+      dx *= exp2(ATLAS_MAX_LOD) / rho;
+      dy *= exp2(ATLAS_MAX_LOD) / rho;
+    }
+  }
+
+  return textureGrad(map, vec3(rect.xy + st * rect.zw, layer), dx, dy);
+}
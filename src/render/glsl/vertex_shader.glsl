@@ -2,17 +2,28 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aDiffuseRect;  // Constant for the draw.
+layout (location = 4) in vec4 aDetailRect;   // Constant for the draw.
+layout (location = 5) in vec4 aMaps;         // Layers, then wrap, of both maps.
+layout (location = 6) in vec3 aPosScale;     // Constant for the draw: dequantizes aPos.
+layout (location = 7) in vec3 aPosOffset;    // Constant for the draw.
 
 out vec3 ourColor;
 out vec2 texCoord;
+flat out vec4 diffuseRect;
+flat out vec4 detailRect;
+flat out vec4 maps;
+
+#include "frame.glsl"
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
 void main()
 {
-  gl_Position = projection * view * model * vec4(aPos, 1.0f);
+  gl_Position = view_projection * model * vec4(aPos * aPosScale + aPosOffset, 1.0f);
   ourColor = aColor;
   texCoord = aTexCoord;
+  diffuseRect = aDiffuseRect;
+  detailRect = aDetailRect;
+  maps = aMaps;
 }
@@ -0,0 +1,44 @@
+//
+// Virtual textures are cut in pages, cached in slots of the physical texture
+// with a border of their neighbours for filtering. Level l of the indirection
+// texture maps each page of level l to the slot of the finest resident page
+// covering it. Sizes mirror vtex.h and virtual_texture.h.
+//
+#define VIRTUAL_PAGE           128.0
+#define VIRTUAL_BORDER         4.0
+#define VIRTUAL_SLOT           (VIRTUAL_PAGE + 2.0 * VIRTUAL_BORDER)
+#define VIRTUAL_FEEDBACK_SCALE 8.0
+
+//
+// The level a fragment needs, from the texels a pixel covers. info holds the
+// size of the texture, its number of levels, and its index.
+//
+int virtual_level(vec2 uv, vec4 info, float bias)
+{
+  vec2 dx = dFdx(uv) * info.x;
+  vec2 dy = dFdy(uv) * info.x;
+
+  return int(clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + bias), 0.0, info.y - 1.0));
+}
+
+vec4 sample_virtual(sampler2D pages, usampler2D indirection, vec2 uv, vec4 info)
+{
+  vec2  st     = fract(uv);
+  int   level  = virtual_level(uv, info, 0.0);
+  uvec4 entry  = texelFetch(indirection, ivec2(st * vec2(textureSize(indirection, level))), level);
+  float count  = info.x / VIRTUAL_PAGE / exp2(float(entry.z));
+  vec2  size   = vec2(textureSize(pages, 0));
+
+  return textureLod(pages, (vec2(entry.xy) * VIRTUAL_SLOT + VIRTUAL_BORDER + fract(st * count) * VIRTUAL_PAGE) / size, 0.0);
+}
+
+//
+// The page a fragment needs: x, y, level and texture. The feedback pass is
+// smaller than the viewport, its pixels cover more texels.
+//
+uvec4 virtual_feedback(vec2 uv, vec4 info)
+{
+  int level = virtual_level(uv, info, -log2(VIRTUAL_FEEDBACK_SCALE));
+
+  return uvec4(uvec2(fract(uv) * (info.x / VIRTUAL_PAGE / exp2(float(level)))), uint(level), uint(info.z));
+}
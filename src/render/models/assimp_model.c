@@ -1,10 +1,10 @@
 /****************************************************************************
 * Title   : Tawy   
-* Filename: assimp_model.h
+* Filename: assimp_model.c
 * Author  : Guillaume Mantelet
 * Version : 1.0.0
-* Brief   : This module manages a model, enabling and disabling buffers, and
-*           loading vertices and textures from file.
+* Brief   : This module manages a model imported with assimp, or mapped from
+*           the file it was baked to, and its material textures.
 *******************************************************************************/
 #include <stdarg.h>
 #include <stdio.h>
@@ -14,201 +14,166 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include <assimp/cimport.h>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
 #include "model.h"
+#include "texture_array.h"
 
 
 /*******************************************************************************
-* Function  : elements_to_buffer
-* Brief     : Transfer assimp scene faces to OpenGL element array buffer.
+* Function  : mesh_to_buffers
+* Brief     : Transfer a mesh, laid out as the GPU reads it, to the vertex 
+*             streams and the element buffer of a model, and keep its submesh
+*             table to draw it.
 * Parameters:
-*    1. path    : The instance of the model
-*    2. scene   : The assimp scene from .obj file.
+*    1. obj     : The instance of the model, its vertex array bound.
+*    2. mesh    : The mesh, mapped or imported.
 * Returns   :
-*    true : Unconditional
+*    true : The buffers are filled.
+*    false: Memory is exhausted.
 *******************************************************************************/
-static bool elements_to_buffer(model *obj, const struct aiScene *scene)
+static bool mesh_to_buffers(model *obj, const tawymesh *mesh)
 {
-  const struct aiMesh *mesh;
-  const struct aiFace *face;
-  unsigned int         faceIndex = 0;
+  const tawymesh_header *h    = mesh->header;
+  size_t                 size = h->index_type == GL_UNSIGNED_SHORT? sizeof(unsigned short) : sizeof(unsigned int);
 
-  for (unsigned int n = 0; n < scene->mNumMeshes; n++)
+  if (NULL == (obj->submeshes = malloc((size_t) h->submesh_cnt * h->lod_cnt * sizeof(submesh))))
   {
-    mesh = scene->mMeshes[n];
-    obj->indices = malloc(mesh->mNumFaces * 3 * sizeof(unsigned int));
-    faceIndex = 0;
-
-    for (unsigned int t = 0; t < mesh->mNumFaces; t++)
-    {
-      face = &mesh->mFaces[t];
-      memcpy(&obj->indices[faceIndex], face->mIndices, 3 * sizeof(unsigned int));
-      faceIndex += 3;
-    }
-
-    obj->elements = scene->mMeshes[n]->mNumFaces * 3;
-
-    glGenBuffers(1, &obj->ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, obj->elements * 3 * sizeof(int), obj->indices, GL_STATIC_DRAW);
+    printf("Error, not enough memory for %s\n", obj->path);
+    return false;
   }
-  return true;
-}
 
+  memcpy(obj->submeshes, mesh->submeshes, (size_t) h->submesh_cnt * h->lod_cnt * sizeof(submesh));
+  memcpy(obj->lod_error, h->lod_error, sizeof(obj->lod_error));
+  memcpy(obj->position_scale, h->position_scale, sizeof(vec3));
+  memcpy(obj->position_offset, h->position_offset, sizeof(vec3));
+  memcpy(obj->bounds, h->bounds, sizeof(vec4));
+  obj->submesh_cnt = h->submesh_cnt;
+  obj->lod_cnt     = h->lod_cnt;
+  obj->format      = h->format;
+  obj->index_type  = h->index_type;
+  obj->vertices    = h->vertices;
+  obj->elements    = h->elements;
 
-/*******************************************************************************
-* Function  : normals_to_buffer
-* Brief     : Transfer assimp scene normal vectors to OpenGL array buffer.
-* Parameters:
-*    1. path    : The instance of the model
-*    2. scene   : The assimp scene from .obj file.
-* Returns   :
-*    true : Unconditional
-*******************************************************************************/
-static bool normals_to_buffer(model *obj, const struct aiScene *scene)
-{
-  const struct aiMesh *mesh;
-  unsigned int buffer;
-
-  for (unsigned int n = 0; n < scene->mNumMeshes; n++)
+  //
+  // Blobs are in their final layout: the driver copies them straight from
+  // the mapping.
+  //
+  glGenBuffers(TAWY_VERTEX_STREAMS, obj->vbo);
+  for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
   {
-    mesh = scene->mMeshes[n];
-
-    if (mesh->mNormals)
-    {     
-      glGenBuffers(1, &buffer);
-      glBindBuffer(GL_ARRAY_BUFFER, buffer);
-      glBufferData(GL_ARRAY_BUFFER, mesh->mNumVertices * 3 * sizeof(float), mesh->mNormals, GL_STATIC_DRAW);
-
-      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-      glEnableVertexAttribArray(1);
-    }
+    glBindBuffer(GL_ARRAY_BUFFER, obj->vbo[k]);
+    glBufferData(GL_ARRAY_BUFFER, (size_t) h->vertices * h->format.stride[k], mesh->streams[k], GL_STATIC_DRAW);
   }
+  vertex_format_enable(&obj->format, obj->vbo);
+
+  glGenBuffers(1, &obj->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t) h->elements * size, mesh->indices, GL_STATIC_DRAW);
   return true;
 }
 
 
 /*******************************************************************************
-* Function  : textures_to_buffer
-* Brief     : Transfer assimp scene texture coordinates to OpenGL array buffer.
+* Function  : material_textures
+* Brief     : Acquire the diffuse textures named by the mesh materials, after
+*             the ones the model already has. They are named relative to the
+*             model file, and share the texture registry with every model.
 * Parameters:
-*    1. path    : The instance of the model
-*    2. scene   : The assimp scene from .obj file.
+*    1. obj     : The instance of the model
+*    2. mesh    : The mesh, mapped or imported.
 * Returns   :
 *    true : Unconditional
 *******************************************************************************/
-static bool textures_to_buffer(model *obj, const struct aiScene *scene)
+static bool material_textures(model *obj, const tawymesh *mesh)
 {
-  const struct aiMesh *mesh;
-  float               *texCoords;
-  unsigned int         buffer;
+  char          dir[TAWY_MODEL_PATH_LEN];
+  char         *slash;
+  texture      *t;
+  unsigned int  i;
+
+  snprintf(dir, TAWY_MODEL_PATH_LEN, "%s", obj->path);
+  slash  = strrchr(dir, '/');
+  *(slash? slash + 1 : dir) = '\0';
 
-  for (unsigned int n = 0; n < scene->mNumMeshes; n++)
+  for (unsigned int n = 0; n < mesh->header->texture_cnt && obj->texture_cnt < TAWY_MODEL_TEXTURES; n++)
   {
-    mesh = scene->mMeshes[n];
-
-    if (mesh->mTextureCoords[0])
-    { 
-      texCoords = (float *)malloc(mesh->mNumVertices * 2 * sizeof(float));
-      for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-      {
-        texCoords[i * 2]     = mesh->mTextureCoords[0][i].x;
-        texCoords[i * 2 + 1] = mesh->mTextureCoords[0][i].y;
-      }
-
-      glGenBuffers(1, &buffer);
-      glBindBuffer(GL_ARRAY_BUFFER, buffer);
-      glBufferData(GL_ARRAY_BUFFER, mesh->mNumVertices * 2 * sizeof(float), texCoords, GL_STATIC_DRAW);
-
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-      glEnableVertexAttribArray(2);
-    }
+    if (NULL == (t = texture_acquire(dir, mesh->textures[n], TEXTURE_FLIP_Y)))
+      continue;
+
+    for (i = 0; i < obj->texture_cnt && obj->texture[i] != t; i++);
+    if (i < obj->texture_cnt)
+      texture_release(t);
+    else
+      obj->texture[obj->texture_cnt++] = t;
   }
   return true;
 }
 
 
 /*******************************************************************************
-* Function  : vertices_to_buffer
-* Brief     : Transfer assimp scene vertex coordinates to OpenGL array buffer.
-* Parameters:
-*    1. path    : The instance of the model
-*    2. scene   : The assimp scene from .obj file.
-* Returns   :
-*    true : Unconditional
+* Function  : is_baked
+* Brief     : Tell whether a model file is a baked mesh itself.
 *******************************************************************************/
-static bool vertices_to_buffer(model *obj, const struct aiScene *scene)
+static bool is_baked(const char *file)
 {
-  const struct aiMesh *mesh;
-
-  for (unsigned int n = 0; n < scene->mNumMeshes; n++)
-  {
-    mesh = scene->mMeshes[n];
-
-    if (mesh->mVertices)
-    {
-      obj->vertices = mesh->mNumVertices;
-      obj->coordinates = malloc(obj->vertices * 3 * sizeof(float));
-      memcpy(obj->coordinates, mesh->mVertices, obj->vertices * 3 * sizeof(float));
-
-      glGenBuffers(1, &obj->vbo);
-      glBindBuffer(GL_ARRAY_BUFFER, obj->vbo);
-      glBufferData(GL_ARRAY_BUFFER, obj->vertices * 3 * sizeof(float), obj->coordinates, GL_STATIC_DRAW);
+  size_t len = strlen(file);
+  size_t ext = strlen(TAWY_MESH_EXTENSION);
 
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-      glEnableVertexAttribArray(0);
-    }
-  }
-
-  return true;
+  return len >= ext && !strcmp(file + len - ext, TAWY_MESH_EXTENSION);
 }
 
 
 /*******************************************************************************
 * Function  : load_model
-* Brief     : obj model to OpenGL vertex array object.
+* Brief     : Model file to OpenGL vertex array object. A baked mesh, given or
+*             newer than the file, is mapped. Otherwise the file is imported,
+*             and `make meshes` bakes it for next time.
 * Parameters:
-*    1. path    : The instance of the model
-*    2. filename: The filename to extract obj model from.
+*    1. path    : The instance of the model, its path set and its vertex array
+*                 bound.
 * Returns   :
-*    true : Successfully converted obj to vertex array object.
+*    true : Successfully converted the file to vertex array object.
 *    false: File could not be located, or file is somehow corrupt.
 *******************************************************************************/
-static bool load_model(model *obj, const char *filename)
+static bool load_model(model *obj)
 { 
-  bool         ret        = true;
-  char         path[1024] = "res/models/";
-  strcat(path, filename);
-
-  const struct aiScene *scene = aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
-  if (!scene) 
-  {
-    printf("Assimp error: %s\n", aiGetErrorString());
-    return false;
-  }
-  
-  if (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-  {
-    printf("Assimp error: %s\n", aiGetErrorString());
-    ret = false;
-  }
+  char     baked[TAWY_MESH_NAME_LEN];
+  tawymesh mesh;
+  bool     ret;
 
+  if (is_baked(obj->path))
+    ret = tawymesh_map(&mesh, obj->path);
   else
-  {
-    vertices_to_buffer(obj, scene);
-    normals_to_buffer(obj, scene);
-    textures_to_buffer(obj, scene);
-    elements_to_buffer(obj, scene);
-  }
+    ret = (tawymesh_baked(obj->path, baked) && tawymesh_map(&mesh, baked)) ||
+          tawymesh_import(&mesh, obj->path, TAWY_MESH_OPTIONS);
 
-  aiReleaseImport(scene);
+  if (!ret)
+    return false;
+
+  ret = mesh_to_buffers(obj, &mesh) && material_textures(obj, &mesh);
+  tawymesh_release(&mesh);
   return ret;
 }
 
 
+/*******************************************************************************
+* Function  : delete_buffers
+* Brief     : Release the vertex array of a model, its buffers and its submesh
+*             table.
+* Parameters:
+*    1. obj     : The instance of the model
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool delete_buffers(model *obj)
+{
+  glDeleteBuffers(TAWY_VERTEX_STREAMS, obj->vbo);
+  glDeleteBuffers(1, &obj->ebo);
+  glDeleteVertexArrays(1, &obj->vao);
+  free(obj->submeshes);
+  return true;
+}
+
+
 /*******************************************************************************
 * Function  : Model__init__
 * Brief     : The object initializer, called by new()
@@ -224,60 +189,141 @@ static bool Model__init__(void *self, va_list *args)
 {
   model        *obj = self;
   char         *p;
-  unsigned int  cnt = 0;
+  unsigned int  cnt;
 
-  //
-  // 1. Create arrays and buffers: VAO, VBO and EBO
-  //
-  glGenVertexArrays(1, &obj->vao);
-  glBindVertexArray(obj->vao);
-  
-  //
-  // 2. Retrieve .obj file. Build vertices and indices from it. Vertex array and
-  //    index array will be sent to VBO and EBO respectively.
-  //
-  //if (!load_model(obj, va_arg(*args, char *), &vertices, &indices))
-  if (!load_model(obj, va_arg(*args, char *)))
-    return false;
+  obj->texture_cnt = 0;
+  obj->virtual     = NULL;
+  obj->ebo         = 0;
+  obj->submeshes   = NULL;
+  obj->submesh_cnt = 0;
+  memset(obj->vbo, 0, sizeof(obj->vbo));
+  snprintf(obj->path, TAWY_MODEL_PATH_LEN, TAWY_MODEL_DIR "%s", va_arg(*args, char *));
 
   //
-  // 4. Load textures from file.
+  // 1. Acquire textures given by name. They come before the ones named by
+  //    the materials of the model. A virtual texture replaces them.
   //
   while (true)
   {
     p = va_arg(*args, char *);
     if (!p) break;
-    printf("Loading texture: %s\n", p);
-    obj->texture[cnt++] = new(Texture, p);
+    model_map(obj, p);
   }  
 
-  obj->texture_cnt = cnt;
+  //
+  // 2. Create arrays and buffers: VAO, VBO and EBO
+  //
+  glGenVertexArrays(1, &obj->vao);
+  glBindVertexArray(obj->vao);
+  
+  //
+  // 3. Map the baked mesh, or import the model file. Its streams and indices
+  //    will be sent to VBOs and EBO respectively.
+  //
+  if (!load_model(obj))
+  {
+    for (unsigned int i = 0; i < obj->texture_cnt; i++)
+      texture_release(obj->texture[i]);
+    delete(obj->virtual, NULL);
+    delete_buffers(obj);
+    return false;
+  }
+
+  cnt           = obj->texture_cnt;
+  obj->features = obj->virtual? FEATURE_VIRTUAL_MAP :
+                  (cnt > 0? FEATURE_DIFFUSE_MAP : 0) | 
+                  (cnt > 1? FEATURE_DETAIL_MAP  : 0);
   return true;
 }
 
 
+/*******************************************************************************
+* Function  : Model__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the model to delete.
+*******************************************************************************/
+static void Model__del__(void *self)
+{
+  model *obj = self;
+
+  for (unsigned int i = 0; i < obj->texture_cnt; i++)
+    texture_release(obj->texture[i]);
+  delete(obj->virtual, NULL);
+
+  delete_buffers(obj);
+  free(self);
+}
+
+
 /*******************************************************************************
 * Function  : Model__enable__
-* Brief     : Enable our buffers before rendering them.
+* Brief     : Draw the finest level of the model, see model_draw().
 * Parameters:
-*    1. self    : The instance of the program.
+*    1. self    : The instance of the model.
 * Returns   :
 *    true : Unconditional
 *******************************************************************************/
 static bool Model__enable__(void *self)
+{
+  //
+  // Models are loaded with their submesh table, or not created: drawing it
+  // never comes back here.
+  //
+  return model_draw(self, 0);
+}
+
+
+/*******************************************************************************
+* Function  : Model__reload__
+* Brief     : Load the model again if its file, or its baked mesh, changed, and
+*             forward the change to its textures. The previous geometry stays
+*             in use if the new one cannot be loaded.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The model, or one of its textures, has been reloaded.
+*    false: The file is not ours, or could not be imported.
+*******************************************************************************/
+static bool Model__reload__(void *self, const char *path)
 {
   model *obj = self;
+  model  next;
+  char   baked[TAWY_MESH_NAME_LEN];
+  bool   ret = false;
 
   for (unsigned int i = 0; i < obj->texture_cnt; i++)
+    ret |= reload(obj->texture[i], path);
+
+  //
+  // Baking the model file again changes its baked mesh too.
+  //
+  tawymesh_baked(obj->path, baked);
+  if (strcmp(obj->path, path) && strcmp(baked, path))
+    return ret;
+
+  next             = *obj;
+  next.ebo         = 0;
+  next.submeshes   = NULL;
+  next.submesh_cnt = 0;
+  memset(next.vbo, 0, sizeof(next.vbo));
+
+  glGenVertexArrays(1, &next.vao);
+  glBindVertexArray(next.vao);
+  if (!load_model(&next))
   {
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, obj->texture[i]->id);
+    printf("Reloading %s failed, keeping previous model\n", path);
+    for (unsigned int i = obj->texture_cnt; i < next.texture_cnt; i++)
+      texture_release(next.texture[i]);
+    delete_buffers(&next);
+    return ret;
   }
-
-  glBindVertexArray(obj->vao);
-  //glDrawArrays(GL_TRIANGLES, 0, 3);
-  glDrawElements(GL_TRIANGLES, obj->elements, GL_UNSIGNED_INT, 0);
   glBindVertexArray(0);
+
+  delete_buffers(obj);
+  *obj = next;
+  printf("Reloaded %s\n", path);
   return true;
 }
 
@@ -289,12 +335,13 @@ static bool Model__enable__(void *self)
 static const class _AssimpModel = {
   .size             = sizeof(model),
   .__init__         = Model__init__,
-  .__del__          = NULL,
+  .__del__          = Model__del__,
   .__get__          = NULL,
   .__set__          = NULL,
   .__should_close__ = NULL,
   .__prepare__      = NULL,
   .__enable__       = Model__enable__,
+  .__reload__       = Model__reload__,
 };
 
 
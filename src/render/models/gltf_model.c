@@ -0,0 +1,413 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: gltf_model.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module manages a model read from a binary glTF file. Its
+*           binary chunk is uploaded once, as it is, and each primitive drawn
+*           from it with the layout its accessors give.
+*******************************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "gltf.h"
+#include "model.h"
+#include "texture_array.h"
+
+
+/*******************************************************************************
+* Struct    : gltf_draw
+* Brief     : Defines the draw of a primitive.
+* Attributes:
+*    1. vao     : Its vertex array, pointing into the buffer of the model.
+*    2. count   : Its number of indices.
+*    3. type    : The OpenGL type of its indices.
+*    4. offset  : Its first index in the buffer, in bytes.
+*******************************************************************************/
+typedef struct gltf_draw
+{
+  unsigned int vao;
+  unsigned int count;
+  unsigned int type;
+  size_t       offset;
+}gltf_draw;
+
+
+/*******************************************************************************
+* Struct    : gltf_model
+* Brief     : Defines a model read from a binary glTF file. Its vertices and
+*             indices share the first buffer of the model.
+* Attributes:
+*    1. base     : The model.
+*    2. draws    : The draw of each of its primitives.
+*    3. named    : The number of its textures given by name, before the 
+*                  images of the file.
+*******************************************************************************/
+typedef struct gltf_model
+{
+  model         base;
+  gltf_draw    *draws;
+  unsigned int  draw_cnt;
+  unsigned int  named;
+}gltf_model;
+
+
+/*******************************************************************************
+* Function  : file_to_buffers
+* Brief     : Upload the accessors of a file, straight from its mapping, and
+*             point a vertex array per primitive at them. Vertices and indices
+*             are not copied nor converted: OpenGL reads them as glTF lays
+*             them out.
+* Parameters:
+*    1. obj     : The instance of the model.
+*    2. file    : The mapped file.
+* Returns   :
+*    true : The buffer is filled.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool file_to_buffers(gltf_model *obj, const gltf *file)
+{
+  const gltf_primitive *p;
+  const gltf_accessor  *a;
+  size_t                base = file->geometry;
+
+  if (NULL == (obj->draws = calloc(file->primitive_cnt, sizeof(gltf_draw))))
+  {
+    printf("Error, not enough memory for %s\n", obj->base.path);
+    return false;
+  }
+
+  obj->draw_cnt       = file->primitive_cnt;
+  obj->base.vertices  = 0;
+  obj->base.elements  = 0;
+  memcpy(obj->base.bounds, file->bounds, sizeof(vec4));
+  glm_vec3_one(obj->base.position_scale);
+  glm_vec3_zero(obj->base.position_offset);
+
+  //
+  // 1. The range of the binary chunk accessors lie in, images excluded.
+  //
+  glGenBuffers(1, &obj->base.vbo[0]);
+  glBindBuffer(GL_ARRAY_BUFFER, obj->base.vbo[0]);
+  glBufferData(GL_ARRAY_BUFFER, file->geometry_size, file->bin + base, GL_STATIC_DRAW);
+
+  //
+  // 2. One vertex array per primitive, the same buffer holds its indices.
+  //    Attributes it has not keep their constant value.
+  //
+  for (unsigned int i = 0; i < file->primitive_cnt; i++)
+  {
+    p = &file->primitives[i];
+    glGenVertexArrays(1, &obj->draws[i].vao);
+    glBindVertexArray(obj->draws[i].vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->base.vbo[0]);
+
+    for (unsigned int k = 0; k < TAWY_VERTEX_ATTRIBUTES; k++)
+    {
+      a = &p->attribute[k];
+      if (!a->count)
+        continue;
+
+      glVertexAttribPointer(k, a->size, a->type, a->normalized, a->stride, (const void *) (a->offset - base));
+      glEnableVertexAttribArray(k);
+    }
+
+    obj->draws[i].count  = p->indices.count;
+    obj->draws[i].type   = p->indices.type;
+    obj->draws[i].offset = p->indices.offset - base;
+    obj->base.vertices  += p->attribute[TAWY_VERTEX_POSITION].count;
+    obj->base.elements  += p->indices.count;
+  }
+  glBindVertexArray(0);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : image_textures
+* Brief     : Acquire the base color images of the primitives, after the
+*             textures the model already has. Embedded images are decoded
+*             from memory, named after the file and their index; others are
+*             files relative to the model.
+* Parameters:
+*    1. obj     : The instance of the model
+*    2. file    : The mapped file.
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool image_textures(gltf_model *obj, const gltf *file)
+{
+  model            *m = &obj->base;
+  const gltf_image *image;
+  char              dir[TAWY_MODEL_PATH_LEN];
+  char              name[TAWY_MODEL_PATH_LEN + 16];
+  char             *slash;
+  texture          *t;
+  unsigned int      i;
+
+  snprintf(dir, TAWY_MODEL_PATH_LEN, "%s", m->path);
+  slash  = strrchr(dir, '/');
+  *(slash? slash + 1 : dir) = '\0';
+
+  //
+  // glTF images are top row first, as its texture coordinates expect: they
+  // are not flipped.
+  //
+  for (unsigned int n = 0; n < file->primitive_cnt && m->texture_cnt < TAWY_MODEL_TEXTURES; n++)
+  {
+    if (file->primitives[n].image < 0)
+      continue;
+
+    image = &file->images[file->primitives[n].image];
+    snprintf(name, sizeof(name), "%s#%d", m->path, file->primitives[n].image);
+    if (image->size)
+      t = texture_acquire_memory(name, file->bin + image->offset, image->size, 0);
+    else if (image->uri[0])
+      t = texture_acquire(dir, image->uri, 0);
+    else
+      continue;
+
+    if (!t)
+      continue;
+
+    for (i = 0; i < m->texture_cnt && m->texture[i] != t; i++);
+    if (i < m->texture_cnt)
+      texture_release(t);
+    else
+      m->texture[m->texture_cnt++] = t;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : load_model
+* Brief     : Map a .glb file, upload its accessors and acquire its images.
+*             The mapping is released once uploaded.
+* Parameters:
+*    1. obj     : The instance of the model, its path set.
+* Returns   :
+*    true : The model is uploaded.
+*    false: The file could not be mapped, or is invalid.
+*******************************************************************************/
+static bool load_model(gltf_model *obj)
+{
+  gltf file;
+  bool ret;
+
+  if (!gltf_map(&file, obj->base.path))
+    return false;
+
+  ret = file_to_buffers(obj, &file) && image_textures(obj, &file);
+  gltf_release(&file);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : delete_buffers
+* Brief     : Release the vertex arrays of a model and its buffer.
+* Parameters:
+*    1. obj     : The instance of the model
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool delete_buffers(gltf_model *obj)
+{
+  for (unsigned int i = 0; i < obj->draw_cnt; i++)
+    glDeleteVertexArrays(1, &obj->draws[i].vao);
+  glDeleteBuffers(1, &obj->base.vbo[0]);
+  free(obj->draws);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : GltfModel__init__
+* Brief     : The object initializer, called by new()
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. file    : The .glb file, relative to TAWY_MODEL_DIR.
+*    3. ...     : Maps given by name, relative to TAWY_TEXTURE_DIR, then NULL.
+* Returns   :
+*    true : The model is created, ready to be displayed.
+*    false: The file could not be mapped, or is invalid.
+*******************************************************************************/
+static bool GltfModel__init__(void *self, va_list *args)
+{
+  gltf_model   *obj = self;
+  model        *m   = &obj->base;
+  char         *p;
+  unsigned int  cnt;
+
+  m->texture_cnt = 0;
+  m->virtual     = NULL;
+  m->vao         = 0;
+  m->ebo         = 0;
+  m->submeshes   = NULL;
+  m->submesh_cnt = 0;
+  m->lod_cnt     = 1;
+  memset(m->lod_error, 0, sizeof(m->lod_error));
+  obj->draws     = NULL;
+  obj->draw_cnt  = 0;
+  memset(m->vbo, 0, sizeof(m->vbo));
+  snprintf(m->path, TAWY_MODEL_PATH_LEN, TAWY_MODEL_DIR "%s", va_arg(*args, char *));
+
+  //
+  // 1. Acquire textures given by name. They come before the images of the
+  //    file. A virtual texture replaces them.
+  //
+  while (true)
+  {
+    p = va_arg(*args, char *);
+    if (!p) break;
+    model_map(m, p);
+  }
+  obj->named = m->texture_cnt;
+
+  //
+  // 2. Map the file, upload its binary chunk and point vertex arrays at it.
+  //
+  if (!load_model(obj))
+  {
+    for (unsigned int i = 0; i < m->texture_cnt; i++)
+      texture_release(m->texture[i]);
+    delete(m->virtual, NULL);
+    delete_buffers(obj);
+    return false;
+  }
+
+  cnt         = m->texture_cnt;
+  m->features = m->virtual? FEATURE_VIRTUAL_MAP :
+                (cnt > 0? FEATURE_DIFFUSE_MAP : 0) |
+                (cnt > 1? FEATURE_DETAIL_MAP  : 0);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : GltfModel__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the model to delete.
+*******************************************************************************/
+static void GltfModel__del__(void *self)
+{
+  gltf_model *obj = self;
+
+  for (unsigned int i = 0; i < obj->base.texture_cnt; i++)
+    texture_release(obj->base.texture[i]);
+  delete(obj->base.virtual, NULL);
+
+  delete_buffers(obj);
+  free(self);
+}
+
+
+/*******************************************************************************
+* Function  : GltfModel__enable__
+* Brief     : Draw each primitive, with the maps of the model.
+* Parameters:
+*    1. self    : The instance of the model.
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool GltfModel__enable__(void *self)
+{
+  gltf_model *obj = self;
+
+  model_enable(&obj->base);
+
+  //
+  // Primitives lay their attributes out differently: one call each.
+  //
+  for (unsigned int i = 0; i < obj->draw_cnt; i++)
+  {
+    glBindVertexArray(obj->draws[i].vao);
+    glDrawElements(GL_TRIANGLES, obj->draws[i].count, obj->draws[i].type, (const void *) obj->draws[i].offset);
+  }
+  glBindVertexArray(0);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : GltfModel__reload__
+* Brief     : Load the model again if its file changed, and forward the change
+*             to its textures. The previous geometry stays in use if the new
+*             one cannot be loaded.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The model, or one of its textures, has been reloaded.
+*    false: The file is not ours, or could not be loaded.
+*******************************************************************************/
+static bool GltfModel__reload__(void *self, const char *path)
+{
+  gltf_model *obj = self;
+  gltf_model  next;
+  bool        ret = false;
+
+  for (unsigned int i = 0; i < obj->base.texture_cnt; i++)
+    ret |= reload(obj->base.texture[i], path);
+
+  if (strcmp(obj->base.path, path))
+    return ret;
+
+  //
+  // Images of the file are acquired again, after the textures given by name.
+  // Those that did not change are shared with the previous model.
+  //
+  next                  = *obj;
+  next.draws            = NULL;
+  next.draw_cnt         = 0;
+  next.base.vbo[0]      = 0;
+  next.base.texture_cnt = obj->named;
+
+  if (!load_model(&next))
+  {
+    printf("Reloading %s failed, keeping previous model\n", path);
+    for (unsigned int i = next.named; i < next.base.texture_cnt; i++)
+      texture_release(next.base.texture[i]);
+    delete_buffers(&next);
+    return ret;
+  }
+
+  for (unsigned int i = obj->named; i < obj->base.texture_cnt; i++)
+    texture_release(obj->base.texture[i]);
+
+  delete_buffers(obj);
+  *obj = next;
+  printf("Reloaded %s\n", path);
+  return true;
+}
+
+
+/*******************************************************************************
+* Class     : _GltfModel
+* Brief     : The class definition and its handlers
+*******************************************************************************/
+static const class _GltfModel = {
+  .size             = sizeof(gltf_model),
+  .__init__         = GltfModel__init__,
+  .__del__          = GltfModel__del__,
+  .__get__          = NULL,
+  .__set__          = NULL,
+  .__should_close__ = NULL,
+  .__prepare__      = NULL,
+  .__enable__       = GltfModel__enable__,
+  .__reload__       = GltfModel__reload__,
+};
+
+
+/*******************************************************************************
+* Class     : GltfModel
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+const void *GltfModel = &_GltfModel;
@@ -1,38 +1,51 @@
 /****************************************************************************
 * Title   : Tawy   
-* Filename: model.h
+* Filename: model.c
 * Author  : Guillaume Mantelet
 * Version : 1.0.0
-* Brief   : This module manages a model, enabling and disabling buffers, and
-*           loading vertices and textures from file.
+* Brief   : This module manages the built-in cube model, and what every model
+*           shares: its maps, streaming, levels of detail and the class that
+*           loads a file.
 *******************************************************************************/
+#include <float.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include <assimp/cimport.h>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
+#include "gltf.h"
+#include "mesh.h"
 #include "model.h"
+#include "texture_array.h"
+
+
+#define CUBE_VERTICES 36
+
+
+//
+// A vertex of the cube as the optimizer welds it, its position first.
+//
+typedef struct cube_vertex
+{
+  float position[3];
+  float texCoord[2];
+}cube_vertex;
 
 
 /*******************************************************************************
-* Function  : textures_to_buffer
-* Brief     : Transfer static texture coordinates to OpenGL array buffer.
+* Function  : cube_texcoords
+* Brief     : The static texture coordinates of the cube, one per triangle
+*             corner.
 * Parameters:
-*    1. path    : The instance of the model
-* Returns   :
-*    true : Unconditional
+*    1. cube    : Its vertices, receiving their texture coordinates.
 *******************************************************************************/
-static bool textures_to_buffer(model *obj)
+static void cube_texcoords(cube_vertex *cube)
 {
-  unsigned int buffer;
-
   float textures[] = 
   {
     0.0f, 0.0f,
@@ -78,25 +91,18 @@ static bool textures_to_buffer(model *obj)
     0.0f, 1.0f
 };
 
-  glGenBuffers(1, &buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(textures), textures, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-  glEnableVertexAttribArray(2);
-  return true;
+  for (unsigned int i = 0; i < CUBE_VERTICES; i++)
+    memcpy(cube[i].texCoord, &textures[2 * i], 2 * sizeof(float));
 }
 
 
 /*******************************************************************************
-* Function  : vertices_to_buffer
-* Brief     : Transfer static vertex coordinates to OpenGL array buffer.
+* Function  : cube_positions
+* Brief     : The static positions of the cube, one per triangle corner.
 * Parameters:
-*    1. path    : The instance of the model
-* Returns   :
-*    true : Unconditional
+*    1. cube    : Its vertices, receiving their positions.
 *******************************************************************************/
-static bool vertices_to_buffer(model *obj)
+static void cube_positions(cube_vertex *cube)
 {
   float vertices[] = 
   {
@@ -143,14 +149,8 @@ static bool vertices_to_buffer(model *obj)
     -0.5f,  0.5f, -0.5f
   };
 
-  obj->vertices = 36;
-  glGenBuffers(1, &obj->vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, obj->vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-  glEnableVertexAttribArray(0);
-  return true;
+  for (unsigned int i = 0; i < CUBE_VERTICES; i++)
+    memcpy(cube[i].position, &vertices[3 * i], 3 * sizeof(float));
 }
 
 
@@ -166,12 +166,306 @@ static bool vertices_to_buffer(model *obj)
 *******************************************************************************/
 static bool load_model(model *obj)
 { 
-  vertices_to_buffer(obj);
-  textures_to_buffer(obj);
+  cube_vertex  cube[CUBE_VERTICES];
+  float        positions[CUBE_VERTICES * 3];
+  float        texCoords[CUBE_VERTICES * 2];
+  unsigned int indices[CUBE_VERTICES];
+
+  //
+  // 1. Corners shared by two triangles of a face are welded: the cube is
+  //    drawn indexed.
+  //
+  cube_positions(cube);
+  cube_texcoords(cube);
+  for (unsigned int i = 0; i < CUBE_VERTICES; i++)
+    indices[i] = i;
+
+  obj->elements = CUBE_VERTICES;
+  obj->vertices = mesh_optimize(indices, CUBE_VERTICES, cube, CUBE_VERTICES, sizeof(cube_vertex), NULL, NULL);
+  for (unsigned int i = 0; i < obj->vertices; i++)
+  {
+    memcpy(&positions[3 * i], cube[i].position, 3 * sizeof(float));
+    memcpy(&texCoords[2 * i], cube[i].texCoord, 2 * sizeof(float));
+  }
+  mesh_bounds(obj->bounds, positions, 3 * sizeof(float), obj->vertices);
+
+  //
+  // 2. Positions and texture coordinates each have their stream.
+  //
+  memset(&obj->format, 0, sizeof(obj->format));
+  vertex_format_add(&obj->format, TAWY_VERTEX_POSITION, TAWY_STREAM_POSITIONS, 3, GL_FLOAT, false);
+  vertex_format_add(&obj->format, TAWY_VERTEX_TEXCOORD, TAWY_STREAM_SHADING, 2, GL_FLOAT, false);
+
+  glGenBuffers(TAWY_VERTEX_STREAMS, obj->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, obj->vbo[TAWY_STREAM_POSITIONS]);
+  glBufferData(GL_ARRAY_BUFFER, obj->vertices * 3 * sizeof(float), positions, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, obj->vbo[TAWY_STREAM_SHADING]);
+  glBufferData(GL_ARRAY_BUFFER, obj->vertices * 2 * sizeof(float), texCoords, GL_STATIC_DRAW);
+  vertex_format_enable(&obj->format, obj->vbo);
+
+  glGenBuffers(1, &obj->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : vertex_format_enable
+* Brief     : Point the attributes of the bound vertex array to their streams.
+* Parameters:
+*    1. format  : The format.
+*    2. buffers : The buffer of each stream.
+*******************************************************************************/
+void vertex_format_enable(const vertex_format *fmt, const unsigned int *buffers)
+{
+  const vertex_attribute *a;
+
+  for (unsigned int i = 0; i < fmt->attribute_cnt; i++)
+  {
+    a = &fmt->attribute[i];
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[a->stream]);
+    glVertexAttribPointer(a->location, a->size, a->type, a->normalized, 
+                          fmt->stride[a->stream], (const void *) (size_t) a->offset);
+    glEnableVertexAttribArray(a->location);
+  }
+}
+
+
+/*******************************************************************************
+* Function  : model_enable
+* Brief     : Bind the maps of a model and set its constants for the next draw.
+* Parameters:
+*    1. self    : The instance of the model.
+*******************************************************************************/
+void model_enable(model *obj)
+{
+  //
+  // Textures live in arrays, binds are skipped while they stay the same.
+  //
+  if (obj->virtual)
+    enable(obj->virtual, NULL);
+  else
+    textures_enable(obj->texture, obj->texture_cnt);
+
+  glVertexAttrib3fv(TAWY_VERTEX_POSITION_SCALE, obj->position_scale);
+  glVertexAttrib3fv(TAWY_VERTEX_POSITION_OFFSET, obj->position_offset);
+}
+
+
+/*******************************************************************************
+* Function  : model_map
+* Brief     : Give a model a map by name: a virtual texture if the file is 
+*             tiled, a shared texture otherwise.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. file    : The file, relative to TAWY_TEXTURE_DIR.
+* Returns   :
+*    true : The map is acquired.
+*    false: It could not be loaded, or the model has no room for it.
+*******************************************************************************/
+bool model_map(model *obj, const char *file)
+{
+  const char *dot = strrchr(file, '.');
+
+  if (dot && !strcmp(dot, TAWY_VTEX_EXTENSION))
+  {
+    if (obj->virtual)
+    {
+      printf("Error, a model has a single virtual texture, '%s' ignored\n", file);
+      return false;
+    }
+    return NULL != (obj->virtual = new(VirtualTexture, TAWY_TEXTURE_DIR, file));
+  }
+
+  if (obj->texture_cnt >= TAWY_MODEL_TEXTURES || 
+      NULL == (obj->texture[obj->texture_cnt] = texture_acquire(TAWY_TEXTURE_DIR, file, TEXTURE_FLIP_Y)))
+    return false;
+
+  obj->texture_cnt++;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : project
+* Brief     : Project the center of the bounds of a model. Lengths scale with
+*             the largest axis of the model matrix.
+* Parameters:
+*    1. obj     : The instance of the model.
+*    2. model   : Its model matrix for this draw.
+*    3. frame   : The frame it is drawn in, enabled.
+*    4. scale   : Receives the scale of lengths, from model to world space.
+* Returns   :
+*    w : The distance of the center along the view, in world space.
+*******************************************************************************/
+static float project(const model *obj, mat4 transform, const frame *f, float *scale)
+{
+  vec4 center;
+
+  *scale = sqrtf(glm_max(glm_vec3_norm2(transform[0]), 
+                         glm_max(glm_vec3_norm2(transform[1]), glm_vec3_norm2(transform[2]))));
+
+  glm_vec4((float *) obj->bounds, 1.0f, center);
+  glm_mat4_mulv(transform, center, center);
+  glm_mat4_mulv((vec4 *) f->constants.view_projection, center, center);
+  return center[3];
+}
+
+
+/*******************************************************************************
+* Function  : model_stream
+* Brief     : Project the bounds of a model drawn this frame, and tell its 
+*             textures the size it covers on screen, so that they stream the
+*             levels it needs. Textures are assumed to wrap it once.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. model   : Its model matrix for this draw.
+*    3. frame   : The frame it is drawn in, enabled.
+*******************************************************************************/
+void model_stream(model *obj, mat4 transform, const frame *f)
+{
+  float w;
+  float scale;
+  float radius;
+  float pixels;
+
+  //
+  // Its diameter on screen is 2 * radius / w in normalized coordinates, so
+  // that many pixels out of the 2 the viewport height spans. A camera inside
+  // the bounds sees it at any size: every level is needed.
+  //
+  w      = project(obj, transform, f, &scale);
+  radius = obj->bounds[3] * scale;
+  if (w <= radius)
+    pixels = FLT_MAX;
+  else
+    pixels = radius * f->constants.projection[1][1] / w * f->constants.viewport[1];
+
+  for (unsigned int i = 0; i < obj->texture_cnt; i++)
+    texture_need(obj->texture[i], pixels);
+}
+
+
+/*******************************************************************************
+* Function  : model_lod
+* Brief     : Project the error of each level of detail of a model drawn this
+*             frame, at the nearest of its bounds, and pick the coarsest level
+*             within TAWY_MODEL_LOD_PIXELS for the next draw. Finer levels are
+*             picked at once, coarser ones only within the hysteresis. The
+*             level is kept by the entity, and given to model_draw(): entities
+*             sharing a model each draw their own.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. model   : Its model matrix for this draw.
+*    3. frame   : The frame it is drawn in, enabled.
+*    4. level   : The level the entity drawn last used, 0 at first. Receives
+*                 the level picked.
+* Returns   :
+*    level : The level picked.
+*******************************************************************************/
+unsigned int model_lod(model *obj, mat4 transform, const frame *f, unsigned int *level)
+{
+  unsigned int lod = *level < obj->lod_cnt? *level : obj->lod_cnt - 1;
+  float        w;
+  float        scale;
+  float        radius;
+  float        pixels;
+
+  //
+  // 1. A unit of model space covers that many pixels at the nearest of the
+  //    bounds, any number if the camera is inside.
+  //
+  w      = project(obj, transform, f, &scale);
+  radius = obj->bounds[3] * scale;
+  if (w <= radius)
+    pixels = FLT_MAX;
+  else
+    pixels = scale * f->constants.projection[1][1] / (w - radius) * f->constants.viewport[1] * 0.5f;
+
+  //
+  // 2. A level showing its error goes finer until it does not, else coarser
+  //    while the next level stays well within.
+  //
+  if (obj->lod_error[lod] * pixels > TAWY_MODEL_LOD_PIXELS)
+    while (lod > 0 && obj->lod_error[lod] * pixels > TAWY_MODEL_LOD_PIXELS)
+      lod--;
+  else
+    while (lod + 1 < obj->lod_cnt && obj->lod_error[lod + 1] * pixels <= TAWY_MODEL_LOD_PIXELS * TAWY_MODEL_LOD_HYSTERESIS)
+      lod++;
+
+  *level = lod;
+  return lod;
+}
+
+
+/*******************************************************************************
+* Function  : model_draw
+* Brief     : Draw a model at a level of detail, with its maps. Enabling it 
+*             draws the finest level. Models without levels draw as enabled.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. level   : The level, from model_lod(). Clamped to those it has.
+* Returns   :
+*    true : The model is drawn.
+*    false: It could not be.
+*******************************************************************************/
+bool model_draw(model *obj, unsigned int level)
+{
+  submesh *sub;
+  size_t   size = obj->index_type == GL_UNSIGNED_SHORT? sizeof(unsigned short) : sizeof(unsigned int);
+
+  if (!obj->submeshes)
+    return enable(obj, NULL);
+
+  level = level < obj->lod_cnt? level : obj->lod_cnt - 1;
+  sub   = obj->submeshes + level * obj->submesh_cnt;
+
+  GLsizei      counts[obj->submesh_cnt];
+  const void  *offsets[obj->submesh_cnt];
+  GLint        bases[obj->submesh_cnt];
+
+  model_enable(obj);
+
+  //
+  // Every submesh shares the buffers and the textures: one call draws them.
+  //
+  for (unsigned int i = 0; i < obj->submesh_cnt; i++)
+  {
+    counts[i]  = sub[i].count;
+    offsets[i] = (const void *) (sub[i].first_index * size);
+    bases[i]   = sub[i].base_vertex;
+  }
+
+  glBindVertexArray(obj->vao);
+  if (obj->submesh_cnt == 1)
+    glDrawElementsBaseVertex(GL_TRIANGLES, counts[0], obj->index_type, offsets[0], bases[0]);
+  else
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, obj->index_type, offsets, obj->submesh_cnt, bases);
+  glBindVertexArray(0);
   return true;
 }
 
 
+/*******************************************************************************
+* Function  : model_class
+* Brief     : The class that loads a model file: GltfModel for binary glTF 
+*             files, AssimpModel for any other. Both take the file and the 
+*             maps by name.
+* Parameters:
+*    1. file    : The model file.
+* Returns   :
+*    class : The class to create it with.
+*******************************************************************************/
+const void *model_class(const char *file)
+{
+  size_t len = strlen(file);
+  size_t ext = strlen(TAWY_GLTF_EXTENSION);
+
+  return (len > ext && !strcasecmp(file + len - ext, TAWY_GLTF_EXTENSION))? GltfModel : AssimpModel;
+}
+
+
 /*******************************************************************************
 * Function  : Model__init__
 * Brief     : The object initializer, called by new()
@@ -187,7 +481,18 @@ static bool Model__init__(void *self, va_list *args)
 {
   model        *obj = self;
   char         *p;
-  unsigned int  cnt = 0;
+  unsigned int  cnt;
+
+  obj->path[0]     = '\0';
+  obj->texture_cnt = 0;
+  obj->virtual     = NULL;
+  obj->submeshes   = NULL;
+  obj->submesh_cnt = 0;
+  obj->lod_cnt     = 1;
+  memset(obj->lod_error, 0, sizeof(obj->lod_error));
+  obj->index_type  = GL_UNSIGNED_INT;
+  glm_vec3_one(obj->position_scale);
+  glm_vec3_zero(obj->position_offset);
 
   //
   // 1. Create arrays and buffers: VAO, VBO and EBO
@@ -202,21 +507,44 @@ static bool Model__init__(void *self, va_list *args)
   load_model(obj);
 
   //
-  // 4. Load textures from file.
+  // 4. Load textures from file. A virtual texture replaces them.
   //
   while (true)
   {
     p = va_arg(*args, char *);
     if (!p) break;
-    printf("Loading texture: %s\n", p);
-    obj->texture[cnt++] = new(Texture, p);
+    model_map(obj, p);
   }  
 
-  obj->texture_cnt = cnt;
+  cnt           = obj->texture_cnt;
+  obj->features = obj->virtual? FEATURE_VIRTUAL_MAP :
+                  (cnt > 0? FEATURE_DIFFUSE_MAP : 0) | 
+                  (cnt > 1? FEATURE_DETAIL_MAP  : 0);
   return true;
 }
 
 
+/*******************************************************************************
+* Function  : Model__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the model to delete.
+*******************************************************************************/
+static void Model__del__(void *self)
+{
+  model *obj = self;
+
+  for (unsigned int i = 0; i < obj->texture_cnt; i++)
+    texture_release(obj->texture[i]);
+  delete(obj->virtual, NULL);
+
+  glDeleteBuffers(TAWY_VERTEX_STREAMS, obj->vbo);
+  glDeleteBuffers(1, &obj->ebo);
+  glDeleteVertexArrays(1, &obj->vao);
+  free(self);
+}
+
+
 /*******************************************************************************
 * Function  : Model__enable__
 * Brief     : Enable our buffers before rendering them.
@@ -229,19 +557,36 @@ static bool Model__enable__(void *self)
 {
   model *obj = self;
 
-  for (unsigned int i = 0; i < obj->texture_cnt; i++)
-  {
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, obj->texture[i]->id);
-  }
-
+  model_enable(obj);
   glBindVertexArray(obj->vao);
-  glDrawArrays(GL_TRIANGLES, 0, obj->vertices);
+  glDrawElements(GL_TRIANGLES, obj->elements, obj->index_type, 0);
   glBindVertexArray(0);
   return true;
 }
 
 
+/*******************************************************************************
+* Function  : Model__reload__
+* Brief     : The geometry is built in, only forward the change to textures.
+* Parameters:
+*    1. self    : The instance of the model.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : One of its textures has been reloaded.
+*    false: The file is not one of ours.
+*******************************************************************************/
+static bool Model__reload__(void *self, const char *path)
+{
+  model *obj = self;
+  bool   ret = false;
+
+  for (unsigned int i = 0; i < obj->texture_cnt; i++)
+    ret |= reload(obj->texture[i], path);
+
+  return ret;
+}
+
+
 /*******************************************************************************
 * Class     : _Model
 * Brief     : The class definition and its handlers
@@ -249,12 +594,13 @@ static bool Model__enable__(void *self)
 static const class _Model = {
   .size             = sizeof(model),
   .__init__         = Model__init__,
-  .__del__          = NULL,
+  .__del__          = Model__del__,
   .__get__          = NULL,
   .__set__          = NULL,
   .__should_close__ = NULL,
   .__prepare__      = NULL,
   .__enable__       = Model__enable__,
+  .__reload__       = Model__reload__,
 };
 
 
@@ -9,44 +9,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "frame.h"
 #include "program.h"
+#include "program_cache.h"
+#include "shader.h"
 
-#define SHADER_CODE_MAX_LEN 2048
+#define FNV_OFFSET_BASIS    2166136261u
+#define FNV_PRIME           16777619u
+#define WARM_UP_SIZE        4
 
+//
+// Program currently in use by OpenGL, and counters of what we sent to it.
+//
+static unsigned int  current_program = 0;
+static program_stats stats           = {0};
 
-/******************************************************************************
-* Function  : read_glsl()
-* Brief     : Parse a target file to extract GLSL source code.
-* Parameters:
-*     1. p: Path to the file to open and read from.
-*     2. c: Buffer to store file content to.
-* Returns   : 
-*     true : The file is copied to a source buffer, ready to be compiled.
-*     false: The file could not be open
-*******************************************************************************/
-static bool read_glsl(const char *p, char *c)
-{
-  FILE *f;
-  char path[1024] = "src/render/glsl/";
-  strcat(path, p);
-
-  if (NULL == (f = fopen(path, "r")))
-  {
-    printf("Error opening file at %s\n", p);
-    return false;
-  }
-
-  if ((SHADER_CODE_MAX_LEN - 1) == fread(c, sizeof(char), SHADER_CODE_MAX_LEN - 1, f))
-  {
-    printf("Warning, code at %s may be too long (%d bytes) and may have been truncated\n", path, SHADER_CODE_MAX_LEN - 1);
-  }
-
-  fclose(f);  
-  return true;
-}
+//
+// Whether new programs come back pending, instead of compiled and linked.
+//
+static bool          async_compile   = false;
 
 
 /******************************************************************************
@@ -99,7 +84,7 @@ static bool link_status(unsigned int *program)
 
   if (!success)
   {
-    glGetShaderInfoLog(*program, 512, NULL, info);
+    glGetProgramInfoLog(*program, 512, NULL, info);
     printf("Program linking error:\n\t%s\n", info);
   }
 
@@ -107,42 +92,470 @@ static bool link_status(unsigned int *program)
 }
 
 
+/******************************************************************************
+* Function  : parallel_compile()
+* Brief     : Tell whether the driver compiles in the background, and can be
+*             polled for completion without blocking.
+* Returns   : 
+*     true : KHR or ARB_parallel_shader_compile is available.
+*     false: Querying a status blocks until compilation is done.
+*******************************************************************************/
+static bool parallel_compile(void)
+{
+  static int parallel = -1;
+
+  if (parallel == -1)
+  {
+    parallel = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+
+    // Let the driver use as many threads as it wants.
+    if (GLAD_GL_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLAD_GL_ARB_parallel_shader_compile)
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+
+  return parallel;
+}
+
+
 /******************************************************************************
 * Function  : compile_shader()
-* Brief     : Compile shader from GLSL source code.
+* Brief     : Submit shader compilation from GLSL source code. Its status is
+*             checked later, by compile_status().
 * Parameters:
 *     1. shader: Shader handle
 *     2. type  : Type of shader (fragment, vertex...)
 *     3. source: GLSL source code for this shader.
 * Returns   : 
-*     bool : The result of compilation for this shader.
+*     true : Unconditional
 *******************************************************************************/
 static bool compile_shader(unsigned int *shader, int type, const char *source)
 {
   *shader = glCreateShader(type);
   glShaderSource(*shader, 1, &source, NULL);
   glCompileShader(*shader);
-
-  return compile_status(shader, type);
+  return true;
 }
 
 
 /******************************************************************************
 * Function  : link_program()
-* Brief     : Link shader to a program.
+* Brief     : Submit linking of shaders to a program. Its status is checked 
+*             later, by link_status().
 * Parameters:
 *     1. program: Program handle
 * Returns   : 
-*     bool : The result of linking for this program.
+*     true : Unconditional
 *******************************************************************************/
 static bool link_program(program *obj)
 {
   obj->id = glCreateProgram();
   glAttachShader(obj->id, obj->vertex_shader);
   glAttachShader(obj->id, obj->fragment_shader);
+
+  if (program_cache_enabled())
+    glProgramParameteri(obj->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   glLinkProgram(obj->id);
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : hash_name()
+* Brief     : FNV-1a hash of a uniform name, used to index the slots table.
+* Parameters:
+*     1. name: The uniform name.
+* Returns   : 
+*     hash : The 32 bits hash of the name.
+*******************************************************************************/
+static unsigned int hash_name(const char *name)
+{
+  unsigned int h = FNV_OFFSET_BASIS;
+  while (*name)
+  {
+    h ^= (unsigned char) *name++;
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+
+/******************************************************************************
+* Function  : find_uniform()
+* Brief     : Find the handle of a uniform from its name in the slots table.
+* Parameters:
+*     1. obj : The program to search in.
+*     2. name: The uniform name.
+* Returns   : 
+*     handle: The index of the uniform in obj->uniforms.
+*     -1    : There is no such active uniform.
+*******************************************************************************/
+static int find_uniform(const program *obj, const char *name)
+{
+  unsigned int i;
+
+  if (!obj->slots)
+    return -1;
+
+  for (i = hash_name(name) & obj->slot_mask; obj->slots[i] != -1; i = (i + 1) & obj->slot_mask)
+  {
+    if (!strcmp(obj->uniforms[obj->slots[i]].name, name))
+      return obj->slots[i];
+  }
+
+  return -1;
+}
+
+
+/******************************************************************************
+* Function  : is_sampler()
+* Brief     : Tell whether an OpenGL uniform type is a sampler.
+* Parameters:
+*     1. type: The OpenGL type of the uniform.
+* Returns   : 
+*     bool : True if the uniform must be bound to a texture unit.
+*******************************************************************************/
+static bool is_sampler(unsigned int type)
+{
+  switch (type)
+  {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+      return true;
+  }
+  return false;
+}
+
+
+/******************************************************************************
+* Function  : uniform_bytes()
+* Brief     : Size of a single element of a uniform, as sent by program_set().
+* Parameters:
+*     1. type: The OpenGL type of the uniform.
+* Returns   : 
+*     bytes: The size of one element, 0 if the type is not supported.
+*******************************************************************************/
+static unsigned int uniform_bytes(unsigned int type)
+{
+  switch (type)
+  {
+    case GL_BOOL:
+    case GL_INT:
+    case GL_FLOAT:      return 4;
+    case GL_FLOAT_VEC2: return 8;
+    case GL_FLOAT_VEC3: return 12;
+    case GL_FLOAT_VEC4: return 16;
+    case GL_FLOAT_MAT3: return 36;
+    case GL_FLOAT_MAT4: return 64;
+  }
+  return is_sampler(type)? 4 : 0;
+}
+
+
+/******************************************************************************
+* Function  : sampler_order()
+* Brief     : qsort comparator ordering samplers so that "texture2" comes 
+*             before "texture10": shorter names first, then alphabetically.
+*******************************************************************************/
+static int sampler_order(const void *a, const void *b)
+{
+  const uniform *ua = *(const uniform **)a;
+  const uniform *ub = *(const uniform **)b;
+  size_t         la = strlen(ua->name);
+  size_t         lb = strlen(ub->name);
+
+  if (la != lb)
+    return (la < lb)? -1 : 1;
+  return strcmp(ua->name, ub->name);
+}
+
+
+/******************************************************************************
+* Function  : bind_samplers()
+* Brief     : Bind every sampler uniform to its own texture unit, once for all.
+*             Units are given in sampler name order, thus texture1 is bound to
+*             unit 0, texture2 to unit 1, and so on. A sampler array takes a
+*             unit per element, following each other.
+* Parameters:
+*     1. obj: The linked program.
+* Returns   : 
+*     true : Unconditional
+*******************************************************************************/
+static bool bind_samplers(program *obj)
+{
+  uniform      *samplers[obj->uniform_cnt + 1];
+  unsigned int  cnt  = 0;
+  int           unit = 0;
+
+  for (unsigned int i = 0; i < obj->uniform_cnt; i++)
+  {
+    if (is_sampler(obj->uniforms[i].type))
+      samplers[cnt++] = &obj->uniforms[i];
+  }
+
+  if (!cnt)
+    return true;
+
+  qsort(samplers, cnt, sizeof(uniform *), sampler_order);
+
+  glUseProgram(obj->id);
+  for (unsigned int i = 0; i < cnt; i++)
+  {
+    int units[samplers[i]->size];
+
+    for (int k = 0; k < samplers[i]->size; k++)
+      units[k] = unit + k;
+
+    //
+    // Only the unit of a single sampler fits its shadow.
+    //
+    samplers[i]->unit     = unit;
+    samplers[i]->shadowed = samplers[i]->size == 1;
+    memcpy(samplers[i]->value, &samplers[i]->unit, sizeof(int));
+    glUniform1iv(samplers[i]->location, samplers[i]->size, units);
+    unit += samplers[i]->size;
+  }
+  glUseProgram(current_program);
+
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : index_uniforms()
+* Brief     : Build the hashed table mapping uniform names to their handle.
+* Parameters:
+*     1. obj: The program, with its uniforms array filled.
+* Returns   : 
+*     true : The table is built.
+*     false: Memory could not be allocated.
+*******************************************************************************/
+static bool index_uniforms(program *obj)
+{
+  unsigned int slots = 8;
+  unsigned int s;
+
+  //
+  // 1. Size the slots table to a power of two, at most half full.
+  //
+  while (slots < 2 * obj->uniform_cnt)
+    slots <<= 1;
+
+  free(obj->slots);
+  obj->slots     = malloc(slots * sizeof(int));
+  obj->slot_mask = slots - 1;
+
+  if (!obj->slots)
+  {
+    printf("Error, failed to allocate uniforms for program %u\n", obj->id);
+    return false;
+  }
+  memset(obj->slots, -1, slots * sizeof(int));
+
+  //
+  // 2. Insert each uniform, probing linearly.
+  //
+  for (unsigned int i = 0; i < obj->uniform_cnt; i++)
+  {
+    s = hash_name(obj->uniforms[i].name) & obj->slot_mask;
+    while (obj->slots[s] != -1)
+      s = (s + 1) & obj->slot_mask;
+    obj->slots[s] = i;
+  }
+
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : reflect_uniforms()
+* Brief     : List every active uniform of the linked program, and store them
+*             in a hashed table so that they can be reached without querying
+*             OpenGL again.
+* Parameters:
+*     1. obj: The linked program.
+* Returns   : 
+*     true : The table is built.
+*     false: Memory could not be allocated.
+*******************************************************************************/
+static bool reflect_uniforms(program *obj)
+{
+  int          cnt;
+  int          len;
+  int          longest;
+  char        *bracket;
+  uniform     *u;
+
+  glGetProgramiv(obj->id, GL_ACTIVE_UNIFORMS, &cnt);
+  glGetProgramiv(obj->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+
+  obj->uniforms    = calloc(cnt? cnt : 1, sizeof(uniform));
+  obj->uniform_cnt = 0;
+
+  if (!obj->uniforms)
+  {
+    printf("Error, failed to allocate uniforms for program %u\n", obj->id);
+    return false;
+  }
+
+  for (int i = 0; i < cnt; i++)
+  {
+    char name[longest + 1];
+
+    u = &obj->uniforms[obj->uniform_cnt];
+    glGetActiveUniform(obj->id, i, longest + 1, &len, &u->size, &u->type, name);
+
+    // Uniforms of uniform blocks have no location, they are not ours.
+    if (-1 == (u->location = glGetUniformLocation(obj->id, name)))
+      continue;
+
+    if (NULL != (bracket = strchr(name, '[')))
+      *bracket = '\0';
+
+    //
+    // A truncated name would be looked up under another name, never found.
+    //
+    if (strlen(name) >= TAWY_UNIFORM_NAME_LEN)
+    {
+      printf("Error, uniform '%s' of program %u is longer than %d characters\n", name, obj->id, 
+             TAWY_UNIFORM_NAME_LEN - 1);
+      return false;
+    }
+
+    strcpy(u->name, name);
+    u->unit     = -1;
+    u->shadowed = false;
+    obj->uniform_cnt++;
+  }
+
+  return index_uniforms(obj);
+}
+
+
+/******************************************************************************
+* Function  : adopt_program()
+* Brief     : Move a reloaded program into the instance the application holds.
+*             Handles stay valid: a uniform keeps its handle if the new program
+*             still declares it, new uniforms get new handles, and uniforms 
+*             that are gone are kept with no location.
+* Parameters:
+*     1. obj : The instance in use.
+*     2. next: The reloaded program, ready. It is consumed.
+* Returns   : 
+*     true : obj now uses the reloaded program.
+*     false: Memory could not be allocated, obj is untouched.
+*******************************************************************************/
+static bool adopt_program(program *obj, program *next)
+{
+  uniform      *uniforms;
+  unsigned int  cnt = obj->uniform_cnt;
+  int           handle;
+
+  if (NULL == (uniforms = calloc(obj->uniform_cnt + next->uniform_cnt + 1, sizeof(uniform))))
+  {
+    printf("Error, failed to allocate uniforms for program %u\n", next->id);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < obj->uniform_cnt; i++)
+  {
+    if (-1 != (handle = find_uniform(next, obj->uniforms[i].name)))
+      uniforms[i] = next->uniforms[handle];
+    else
+    {
+      uniforms[i]          = obj->uniforms[i];
+      uniforms[i].location = -1;
+      uniforms[i].shadowed = false;
+    }
+  }
+
+  for (unsigned int i = 0; i < next->uniform_cnt; i++)
+  {
+    if (-1 == find_uniform(obj, next->uniforms[i].name))
+      uniforms[cnt++] = next->uniforms[i];
+  }
+
+  if (current_program == obj->id)
+    current_program = 0;
+
+  glDeleteProgram(obj->id);
+  free(obj->uniforms);
+  free(next->uniforms);
+  free(next->slots);
+
+  obj->id          = next->id;
+  obj->key         = next->key;
+  obj->uniforms    = uniforms;
+  obj->uniform_cnt = cnt;
+  obj->slots       = NULL;
+  free(next);
+
+  return index_uniforms(obj);
+}
+
+
+/******************************************************************************
+* Function  : swap_reloaded()
+* Brief     : Swap in the reloaded version of a program, once it is ready. If
+*             it failed, it is dropped and the current version stays in use.
+* Parameters:
+*     1. obj: The instance in use.
+* Returns   : 
+*     true : Unconditional
+*******************************************************************************/
+static bool swap_reloaded(program *obj)
+{
+  program *next = obj->next;
+
+  if (!next)
+    return true;
+
+  if (next->status == PROGRAM_PENDING)
+    prepare(next);
+
+  if (next->status == PROGRAM_PENDING)
+    return true;
+
+  obj->next = NULL;
+  if (next->status != PROGRAM_READY || !adopt_program(obj, next))
+  {
+    printf("Reloading %s/%s failed, keeping previous program\n", obj->vertex, obj->fragment);
+    delete(next, NULL);
+    return true;
+  }
+
+  printf("Reloaded %s/%s\n", obj->vertex, obj->fragment);
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : attach_frame_block()
+* Brief     : Attach the per-frame constants block, if the program declares it,
+*             to the binding point where the Frame uniform buffer lives.
+* Parameters:
+*     1. obj: The linked program.
+* Returns   : 
+*     true : Unconditional
+*******************************************************************************/
+static bool attach_frame_block(program *obj)
+{
+  unsigned int block = glGetUniformBlockIndex(obj->id, TAWY_FRAME_BLOCK);
+
+  if (block != GL_INVALID_INDEX)
+    glUniformBlockBinding(obj->id, block, TAWY_FRAME_BINDING);
 
-  return link_status(&obj->id);
+  return true;
 }
 
 
@@ -157,46 +570,295 @@ static bool delete_shaders(program *obj)
 {
   glDeleteShader(obj->vertex_shader);
   glDeleteShader(obj->fragment_shader);
+  obj->vertex_shader   = 0;
+  obj->fragment_shader = 0;
   return true;
 }
 
 
+/******************************************************************************
+* Function  : setup_program()
+* Brief     : Complete a linked program: reflect its uniforms, bind its samplers
+*             and attach its blocks. It is then ready to be used.
+* Parameters:
+*     1. obj: A pointer to the linked program
+* Returns   : 
+*     bool : True if the program is ready.
+*******************************************************************************/
+static bool setup_program(program *obj)
+{
+  bool ret = reflect_uniforms(obj) & 
+             bind_samplers(obj)    & 
+             attach_frame_block(obj);
+
+  obj->status = ret? PROGRAM_READY : PROGRAM_FAILED;
+  return ret;
+}
+
+
+/******************************************************************************
+* Function  : load_program()
+* Brief     : Reuse the program binary linked by a previous launch.
+* Parameters:
+*     1. obj: A pointer to the program to build
+*     2. key: The key of the program in the binary cache.
+* Returns   : 
+*     true : The driver accepted the cached binary, obj->id is linked.
+*     false: There is no such binary, or it has been rejected.
+*******************************************************************************/
+static bool load_program(program *obj, unsigned long long key)
+{
+  double start = glfwGetTime();
+  double build_time;
+
+  obj->key = key;
+  if (0 == (obj->id = program_cache_load(key, &build_time)))
+    return false;
+
+  stats.cache_hits++;
+  stats.cache_saved += build_time - (glfwGetTime() - start);
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : submit_program()
+* Brief     : Submit compilation and linking of GLSL sources, without waiting
+*             for the driver. The program is pending until finish_program().
+* Parameters:
+*     1. obj: A pointer to the program to build
+*     2. vc : The vertex shader source.
+*     3. fc : The fragment shader source.
+*     4. key: The key of the program in the binary cache.
+* Returns   : 
+*     true : Unconditional
+*******************************************************************************/
+static bool submit_program(program *obj, const char *vc, const char *fc, unsigned long long key)
+{
+  double start = glfwGetTime();
+  bool   ret;
+
+  obj->key    = key;
+  obj->status = PROGRAM_PENDING;
+
+  ret = compile_shader(&obj->vertex_shader, GL_VERTEX_SHADER, vc)     &
+        compile_shader(&obj->fragment_shader, GL_FRAGMENT_SHADER, fc) &
+        link_program(obj);
+
+  obj->build_time = glfwGetTime() - start;
+  return ret;
+}
+
+
+/******************************************************************************
+* Function  : finish_program()
+* Brief     : Check the outcome of a submitted program, cache its binary for 
+*             the next launches, and set it up. Blocks if the driver is not
+*             done with it yet.
+* Parameters:
+*     1. obj: A pointer to the pending program
+* Returns   : 
+*     bool : True if the program compiled, linked, and is ready.
+*******************************************************************************/
+static bool finish_program(program *obj)
+{
+  double start = glfwGetTime();
+  bool   ret   = compile_status(&obj->vertex_shader, GL_VERTEX_SHADER)     &
+                 compile_status(&obj->fragment_shader, GL_FRAGMENT_SHADER) &
+                 link_status(&obj->id);
+
+  //
+  // Only the time spent in the driver is the cost of building it: a pending
+  // program waits for its poll meanwhile.
+  //
+  obj->build_time += glfwGetTime() - start;
+
+  delete_shaders(obj);
+  stats.cache_misses++;
+
+  if (!ret)
+  {
+    obj->status = PROGRAM_FAILED;
+    return false;
+  }
+
+  program_cache_store(obj->id, obj->key, obj->build_time);
+  return setup_program(obj);
+}
+
+
+/******************************************************************************
+* Function  : program_complete()
+* Brief     : Poll whether the driver is done with a pending program.
+* Parameters:
+*     1. obj: A pointer to the pending program
+* Returns   : 
+*     true : Checking its status will not block. Always true when the driver
+*            cannot be polled.
+*     false: It is still being compiled or linked.
+*******************************************************************************/
+static bool program_complete(program *obj)
+{
+  int complete = 1;
+
+  if (parallel_compile())
+    glGetProgramiv(obj->id, GL_COMPLETION_STATUS_KHR, &complete);
+
+  return complete;
+}
+
+
 /*******************************************************************************
 * Function  : Program__init__
 * Brief     : The object initializer, called by new()
 * Parameters:
-*    1. self    : The instance of the model.
+*    1. self    : The instance of the program.
+*    2. vertex  : The vertex shader file, in TAWY_GLSL_DIR.
+*    3. fragment: The fragment shader file, in TAWY_GLSL_DIR.
+*    4. features: A combination of shader_feature to compile it with.
 * Returns   :
-*    true : 
-*    false: 
+*    true : The program is linked, its uniforms are reflected. Or, when 
+*           compiling asynchronously, it has been submitted and is pending.
+*    false: A source is missing, or did not compile or link.
 *******************************************************************************/
 static bool Program__init__(void *self, va_list *args)
 {
-  char     vc[SHADER_CODE_MAX_LEN] = {0};
-  char     fc[SHADER_CODE_MAX_LEN] = {0};
-  program *obj                     = self;        
+  program           *obj      = self;        
+  const char        *vertex   = va_arg(*args, char *);
+  const char        *fragment = va_arg(*args, char *);
+  unsigned int       features = va_arg(*args, unsigned int);
+  char               defines[TAWY_SHADER_DEFINES_LEN];
+  char              *vc;
+  char              *fc;
+  unsigned long long key;
+  bool               ret;
+
+  obj->uniforms        = NULL;
+  obj->uniform_cnt     = 0;
+  obj->slots           = NULL;
+  obj->vertex_shader   = 0;
+  obj->fragment_shader = 0;
+  obj->features        = features;
+  obj->next            = NULL;
+  snprintf(obj->vertex, TAWY_PROGRAM_FILE_LEN, "%s", vertex);
+  snprintf(obj->fragment, TAWY_PROGRAM_FILE_LEN, "%s", fragment);
+
+  //
+  // 1. Preprocess both stages with the defines of the requested features.
+  //
+  shader_defines(features, defines);
+  vc = shader_source(vertex, defines);
+  fc = shader_source(fragment, defines);
 
-  return read_glsl(va_arg(*args, char *), vc)                          & 
-         read_glsl(va_arg(*args, char *), fc)                          &
-         compile_shader(&obj->vertex_shader, GL_VERTEX_SHADER, vc)     &
-         compile_shader(&obj->fragment_shader, GL_FRAGMENT_SHADER, fc) &
-         link_program(obj)                                             &
-         delete_shaders(obj);
+  if (!vc || !fc)
+  {
+    free(vc);
+    free(fc);
+    return false;
+  }
+
+  //
+  // 2. Reuse the binary of a previous launch. Else submit them to the driver,
+  //    and wait for it unless programs are compiled asynchronously.
+  //
+  parallel_compile();
+  key = program_cache_key(vc, fc, defines);
+
+  if (load_program(obj, key))
+    ret = setup_program(obj);
+  else
+    ret = submit_program(obj, vc, fc, key) && (async_compile || finish_program(obj));
+
+  free(vc);
+  free(fc);
+  return ret;
 }
 
 
 /*******************************************************************************
 * Function  : Program__enable__
-* Brief     : Ask OpenGL permission to use our program
+* Brief     : Ask OpenGL permission to use our program, unless it is already
+*             the current one. A pending program is waited for.
 * Parameters:
 *    1. self    : The instance of the program.
 * Returns   :
-*    true : Unconditional
+*    true : The program is in use.
+*    false: The program failed to compile or link.
 *******************************************************************************/
 static bool Program__enable__(void *self)
 {
   program *obj = self;
+
+  if (obj->status == PROGRAM_PENDING)
+    finish_program(obj);
+
+  swap_reloaded(obj);
+
+  if (obj->status != PROGRAM_READY)
+    return false;
+
+  if (current_program == obj->id)
+  {
+    stats.binds_skipped++;
+    return true;
+  }
+
   glUseProgram(obj->id);
+  current_program = obj->id;
+  stats.binds_issued++;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : Program__prepare__
+* Brief     : Poll a pending program, and complete it once the driver is done,
+*             without ever stalling on it. Same for its reloaded version.
+* Parameters:
+*    1. self    : The instance of the program.
+* Returns   :
+*    true : The program is ready to be used.
+*    false: The program is still pending, or failed.
+*******************************************************************************/
+static bool Program__prepare__(void *self)
+{
+  program *obj = self;
+
+  if (obj->status == PROGRAM_PENDING && program_complete(obj))
+    finish_program(obj);
+
+  swap_reloaded(obj);
+  return obj->status == PROGRAM_READY;
+}
+
+
+/*******************************************************************************
+* Function  : Program__reload__
+* Brief     : Rebuild the program when a GLSL file changed. Any file may be an
+*             include of ours, and unchanged programs hit the binary cache, 
+*             so every GLSL change rebuilds. The new version is compiled as
+*             any new program, and swapped in once ready.
+* Parameters:
+*    1. self    : The instance of the program.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The file is GLSL, a new version is being built.
+*    false: The file is not GLSL, or the new version could not be submitted.
+*******************************************************************************/
+static bool Program__reload__(void *self, const char *path)
+{
+  program *obj = self;
+
+  if (strncmp(path, TAWY_GLSL_DIR, strlen(TAWY_GLSL_DIR)))
+    return false;
+
+  delete(obj->next, NULL);
+  if (NULL == (obj->next = new(Program, obj->vertex, obj->fragment, obj->features)))
+  {
+    printf("Reloading %s/%s failed, keeping previous program\n", obj->vertex, obj->fragment);
+    return false;
+  }
+
   return true;
 }
 
@@ -215,18 +877,18 @@ static bool Program__enable__(void *self)
 *******************************************************************************/
 static bool Program__get__(void *self, const char *attr, void **value)
 {
-  program *obj = self;
-  int location = glGetUniformLocation(obj->id, attr);
+  program *obj    = self;
+  int      handle = find_uniform(obj, attr);
 
-  if (location == -1)
+  if (handle == -1)
   {
     printf("Error, program %u has no attribute named '%s'\n", obj->id, attr);
     *value = 0;
     return false;
   }
 
-  *value = &location;  
-  return false;
+  *value = &obj->uniforms[handle].location;
+  return true;
 }
 
 
@@ -245,36 +907,284 @@ static bool Program__get__(void *self, const char *attr, void **value)
 *******************************************************************************/
 static bool Program__set__(void *self, const char *attr, void *value, va_list *args)
 {
-  program *obj = self;
-  int location = glGetUniformLocation(obj->id, attr);
+  program     *obj    = self;
+  int          handle = find_uniform(obj, attr);
+  unsigned int type;
+  bool         valid;
 
-  if (location == -1)
+  if (handle == -1)
   {
     printf("Error, program %u has no attribute named '%s'\n", obj->id, attr);
     return false;
   }
 
+  type = obj->uniforms[handle].type;
   switch (va_arg(*args, int))
   {
     case UNIFORM_BOOL:
     case UNIFORM_INT:
-      glUniform1i(location, *(int *)value);
-      return true;
+      valid = (type == GL_INT || type == GL_BOOL || is_sampler(type));
+      break;
 
     case UNIFORM_FLOAT:
-      glUniform1f(location, *(float *)value);
-      return true;
+      valid = (type == GL_FLOAT);
+      break;
 
     case UNIFORM_MAT4:
-      glUniformMatrix4fv(location, 1, GL_FALSE, (float *)value);
-      return true;
+      valid = (type == GL_FLOAT_MAT4);
+      break;
 
     default:
       printf("Error, unknown uniform type\n");
       return false;
   }
- 
-  return false;
+
+  if (!valid)
+  {
+    printf("Error, uniform '%s' of program %u has another type\n", attr, obj->id);
+    return false;
+  }
+
+  return program_set(obj, handle, value);
+}
+
+
+/*******************************************************************************
+* Function  : program_uniform
+* Brief     : Resolve a uniform name to a handle, once, outside the render loop.
+* Parameters:
+*    1. self    : The instance of the program.
+*    2. name    : The uniform name.
+* Returns   :
+*    handle: The handle to pass to program_set().
+*    -1    : The program has no active uniform with this name.
+*******************************************************************************/
+int program_uniform(program *obj, const char *name)
+{
+  int handle = find_uniform(obj, name);
+
+  if (handle == -1)
+    printf("Error, program %u has no attribute named '%s'\n", obj->id, name);
+
+  return handle;
+}
+
+
+/*******************************************************************************
+* Function  : program_set
+* Brief     : Upload a uniform value through its handle, with no string lookup.
+*             The value layout is deduced from the reflected uniform type, and
+*             the upload is skipped if the value did not change.
+* Parameters:
+*    1. self    : The instance of the program. It must be enabled.
+*    2. handle  : The handle obtained from program_uniform().
+*    3. value   : The pointer to the value to upload.
+* Returns   :
+*    true : The value has been transferred to the uniform.
+*    false: The handle is invalid, or its type is not supported.
+*******************************************************************************/
+bool program_set(program *obj, int handle, const void *value)
+{
+  uniform      *u;
+  unsigned int  bytes;
+
+  if (handle < 0 || (unsigned int) handle >= obj->uniform_cnt)
+    return false;
+
+  //
+  // 1. Elide the upload if OpenGL already holds this very value.
+  //
+  u     = &obj->uniforms[handle];
+  bytes = uniform_bytes(u->type) * u->size;
+
+  if (bytes && bytes <= sizeof(u->value))
+  {
+    if (u->shadowed && !memcmp(u->value, value, bytes))
+    {
+      stats.uploads_skipped++;
+      return true;
+    }
+
+    memcpy(u->value, value, bytes);
+    u->shadowed = true;
+  }
+
+  //
+  // 2. Upload it.
+  //
+  stats.uploads_issued++;
+  switch (u->type)
+  {
+    case GL_BOOL:
+    case GL_INT:
+      glUniform1iv(u->location, u->size, value);
+      return true;
+
+    case GL_FLOAT:
+      glUniform1fv(u->location, u->size, value);
+      return true;
+
+    case GL_FLOAT_VEC2:
+      glUniform2fv(u->location, u->size, value);
+      return true;
+
+    case GL_FLOAT_VEC3:
+      glUniform3fv(u->location, u->size, value);
+      return true;
+
+    case GL_FLOAT_VEC4:
+      glUniform4fv(u->location, u->size, value);
+      return true;
+
+    case GL_FLOAT_MAT3:
+      glUniformMatrix3fv(u->location, u->size, GL_FALSE, value);
+      return true;
+
+    case GL_FLOAT_MAT4:
+      glUniformMatrix4fv(u->location, u->size, GL_FALSE, value);
+      return true;
+
+    default:
+      if (is_sampler(u->type))
+      {
+        glUniform1iv(u->location, u->size, value);
+        return true;
+      }
+      printf("Error, unsupported type 0x%x for uniform '%s'\n", u->type, u->name);
+      return false;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : program_statistics
+* Brief     : Access the counters of issued and skipped GL calls.
+* Parameters:
+*    1. reset   : If true, counters are zeroed after being read.
+* Returns   :
+*    stats: A copy of the counters.
+*******************************************************************************/
+program_stats program_statistics(bool reset)
+{
+  program_stats copy = stats;
+
+  if (reset)
+    memset(&stats, 0, sizeof(stats));
+
+  return copy;
+}
+
+
+/*******************************************************************************
+* Function  : program_async
+* Brief     : Choose how the next programs are built. Asynchronously, new() 
+*             submits them to the driver and returns them pending: prepare()
+*             polls them, enable() waits for them.
+* Parameters:
+*    1. async   : True to compile asynchronously.
+*******************************************************************************/
+void program_async(bool async)
+{
+  async_compile = async;
+}
+
+
+/*******************************************************************************
+* Function  : program_warm_up
+* Brief     : Wait for programs, then draw with each of them once, offscreen,
+*             so that drivers finish any deferred work before the first 
+*             visible frame instead of during it.
+* Parameters:
+*    1. self    : First program to warm up.
+*    2. args    : Other programs to warm up. MUST BE NULL TERMINATED!
+* Returns   :
+*    true : Every program is ready and has been drawn with.
+*    false: One of the programs failed to compile or link.
+*******************************************************************************/
+bool program_warm_up(program *self, ...)
+{
+  va_list          va;
+  program         *p;
+  unsigned int     fbo;
+  unsigned int     rbo[2];
+  unsigned int     vao;
+  int              viewport[4];
+  bool             ret   = true;
+  struct timespec  delay = { 0, 1000000 };
+
+  //
+  // 1. A tiny offscreen target, with the formats of the default framebuffer.
+  //
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(2, rbo);
+  glGenVertexArrays(1, &vao);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glBindRenderbuffer(GL_RENDERBUFFER, rbo[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WARM_UP_SIZE, WARM_UP_SIZE);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo[0]);
+  glBindRenderbuffer(GL_RENDERBUFFER, rbo[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WARM_UP_SIZE, WARM_UP_SIZE);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo[1]);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glViewport(0, 0, WARM_UP_SIZE, WARM_UP_SIZE);
+  glBindVertexArray(vao);
+
+  //
+  // 2. Draw a triangle with each program, as soon as it is ready.
+  //
+  va_start(va, self);
+  for (p = self; p != NULL; p = va_arg(va, program *))
+  {
+    while (p->status == PROGRAM_PENDING && !prepare(p))
+      nanosleep(&delay, NULL);
+
+    if (p->status != PROGRAM_READY)
+    {
+      ret = false;
+      continue;
+    }
+
+    enable(p, NULL);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+  va_end(va);
+  glFinish();
+
+  //
+  // 3. Restore the default framebuffer.
+  //
+  glBindVertexArray(0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteRenderbuffers(2, rbo);
+  glDeleteFramebuffers(1, &fbo);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : Program__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the program to delete.
+*******************************************************************************/
+static void Program__del__(void *self)
+{
+  program *obj = self;
+
+  if (current_program == obj->id)
+    current_program = 0;
+
+  delete(obj->next, NULL);
+  delete_shaders(obj);
+  glDeleteProgram(obj->id);
+  free(obj->uniforms);
+  free(obj->slots);
+  free(self);
 }
 
 
@@ -285,12 +1195,13 @@ static bool Program__set__(void *self, const char *attr, void *value, va_list *a
 static const class _Program = {
   .size             = sizeof(program),
   .__init__         = Program__init__,
-  .__del__          = NULL,
+  .__del__          = Program__del__,
   .__get__          = Program__get__,
   .__set__          = Program__set__,
   .__should_close__ = NULL,
-  .__prepare__      = NULL,
-  .__enable__       = Program__enable__
+  .__prepare__      = Program__prepare__,
+  .__enable__       = Program__enable__,
+  .__reload__       = Program__reload__
 };
 
 
@@ -0,0 +1,225 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: program_cache.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module stores linked programs on disk, as driver binaries, so
+*           that next launches do not compile GLSL again.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+#include "cache.h"
+#include "program_cache.h"
+
+#define PROGRAM_CACHE_MAGIC 0x31475250u  // "PRG1"
+
+
+/*******************************************************************************
+* Struct    : program_cache_header
+* Brief     : What precedes the driver binary in a cache file.
+* Attributes:
+*    1. magic     : PROGRAM_CACHE_MAGIC.
+*    2. format    : The binary format returned by glGetProgramBinary.
+*    3. length    : The length of the binary following this header.
+*    4. key       : The key of this entry, against file name collisions.
+*    5. build_time: How long the program took to compile and link.
+*******************************************************************************/
+typedef struct program_cache_header
+{
+  unsigned int       magic;
+  unsigned int       format;
+  unsigned int       length;
+  unsigned int       reserved;
+  unsigned long long key;
+  double             build_time;
+}program_cache_header;
+
+
+/******************************************************************************
+* Function  : hash()
+* Brief     : Accumulate a string, and a separator, in a FNV-1a 64 hash.
+* Parameters:
+*     1. h: The current hash.
+*     2. s: The string to accumulate. NULL is hashed as an empty string.
+* Returns   : 
+*     hash : The new hash.
+*******************************************************************************/
+static unsigned long long hash(unsigned long long h, const char *s)
+{
+  static const unsigned char separator = 0xff;
+
+  h = cache_hash(h, s, s? strlen(s) : 0);
+  return cache_hash(h, &separator, 1);
+}
+
+
+/*******************************************************************************
+* Function  : program_cache_enabled
+* Brief     : Tell whether the driver exposes at least one program binary format.
+* Returns   :
+*    true : The cache can be used.
+*    false: Programs must always be compiled.
+*******************************************************************************/
+bool program_cache_enabled(void)
+{
+  static int enabled = -1;
+  int        formats = 0;
+
+  if (enabled == -1)
+  {
+    if (GLAD_GL_ARB_get_program_binary)
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    enabled = (formats > 0);
+  }
+
+  return enabled;
+}
+
+
+/*******************************************************************************
+* Function  : program_cache_key
+* Brief     : Hash what makes a program binary valid: its sources, its defines,
+*             and the vendor, renderer and version of the driver.
+* Parameters:
+*    1. vertex  : The vertex shader source.
+*    2. fragment: The fragment shader source.
+*    3. defines : The defines injected in both sources, or NULL.
+* Returns   :
+*    key: A 64 bits key identifying the binary in the cache.
+*******************************************************************************/
+unsigned long long program_cache_key(const char *vertex, const char *fragment, const char *defines)
+{
+  unsigned long long h = TAWY_CACHE_HASH_BASIS;
+
+  h = hash(h, vertex);
+  h = hash(h, fragment);
+  h = hash(h, defines);
+  h = hash(h, (const char *) glGetString(GL_VENDOR));
+  h = hash(h, (const char *) glGetString(GL_RENDERER));
+  h = hash(h, (const char *) glGetString(GL_VERSION));
+  return h;
+}
+
+
+/*******************************************************************************
+* Function  : program_cache_load
+* Brief     : Load a program binary from the cache into a new program object.
+* Parameters:
+*    1. key       : The key from program_cache_key().
+*    2. build_time: Stores how long the compilation took when it was cached.
+* Returns   :
+*    id: The linked program.
+*    0 : The binary is missing, or has been rejected by the driver.
+*******************************************************************************/
+unsigned int program_cache_load(unsigned long long key, double *build_time)
+{
+  FILE                 *f;
+  char                  path[1024];
+  program_cache_header  header;
+  void                 *binary;
+  unsigned int          id      = 0;
+  int                   success = 0;
+
+  if (!program_cache_enabled())
+    return 0;
+
+  cache_path(TAWY_PROGRAM_CACHE_DIR, key, ".bin", path, sizeof(path));
+  if (NULL == (f = fopen(path, "rb")))
+    return 0;
+
+  //
+  // 1. Read the header and the binary following it.
+  //
+  if (1 != fread(&header, sizeof(header), 1, f) || 
+      header.magic != PROGRAM_CACHE_MAGIC       || 
+      header.key   != key                       ||
+      NULL == (binary = malloc(header.length)))
+  {
+    fclose(f);
+    return 0;
+  }
+
+  if (1 != fread(binary, header.length, 1, f))
+  {
+    free(binary);
+    fclose(f);
+    return 0;
+  }
+  fclose(f);
+
+  //
+  // 2. Hand it to the driver. It is free to reject it, e.g. after an update.
+  //
+  id = glCreateProgram();
+  glProgramBinary(id, header.format, binary, header.length);
+  free(binary);
+
+  glGetProgramiv(id, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    printf("Program binary %016llx rejected by the driver, compiling it again\n", key);
+    glDeleteProgram(id);
+    return 0;
+  }
+
+  *build_time = header.build_time;
+  return id;
+}
+
+
+/*******************************************************************************
+* Function  : program_cache_store
+* Brief     : Save the binary of a freshly linked program in the cache.
+* Parameters:
+*    1. id        : The linked program. It must have been linked with the 
+*                   GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+*    2. key       : The key from program_cache_key().
+*    3. build_time: How long it took to compile and link it, in seconds.
+* Returns   :
+*    true : The binary has been written.
+*    false: The driver has no binary format, or the file could not be written.
+*******************************************************************************/
+bool program_cache_store(unsigned int id, unsigned long long key, double build_time)
+{
+  FILE                 *f;
+  char                  path[1024];
+  program_cache_header  header = {0};
+  void                 *binary;
+  int                   length = 0;
+  bool                  ret;
+
+  if (!program_cache_enabled())
+    return false;
+
+  glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0 || NULL == (binary = malloc(length)))
+    return false;
+
+  glGetProgramBinary(id, length, &length, &header.format, binary);
+
+  header.magic      = PROGRAM_CACHE_MAGIC;
+  header.length     = length;
+  header.key        = key;
+  header.build_time = build_time;
+
+  cache_path(TAWY_PROGRAM_CACHE_DIR, key, ".bin", path, sizeof(path));
+  if (!cache_make_dirs(TAWY_PROGRAM_CACHE_DIR) || NULL == (f = fopen(path, "wb")))
+  {
+    printf("Error, could not write program cache at %s\n", path);
+    free(binary);
+    return false;
+  }
+
+  ret = (1 == fwrite(&header, sizeof(header), 1, f)) && 
+        (1 == fwrite(binary, length, 1, f));
+  fclose(f);
+  free(binary);
+
+  if (!ret)
+    remove(path);
+
+  return ret;
+}
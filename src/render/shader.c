@@ -0,0 +1,361 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: shader.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module preprocesses GLSL sources, resolving their #include and
+*           injecting feature #define, and caches the program permutations.
+*******************************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shader.h"
+
+#define SHADER_INCLUDE_DEPTH 16
+#define SHADER_NAME_LEN      64
+
+
+/*******************************************************************************
+* Struct    : source
+* Brief     : A growable buffer receiving the preprocessed source.
+*******************************************************************************/
+typedef struct source
+{
+  char   *data;
+  size_t  len;
+  size_t  cap;
+}source;
+
+
+/*******************************************************************************
+* Struct    : permutation_entry
+* Brief     : A program built from a pair of shaders and a set of features.
+*******************************************************************************/
+typedef struct permutation_entry
+{
+  char          vertex[SHADER_NAME_LEN];
+  char          fragment[SHADER_NAME_LEN];
+  unsigned int  features;
+  program      *p;
+}permutation_entry;
+
+
+//
+// Feature keys, and the name they are defined with in GLSL.
+//
+static const struct { unsigned int feature; const char *name; } feature_names[] = 
+{
+  { FEATURE_DIFFUSE_MAP, "DIFFUSE_MAP" },
+  { FEATURE_DETAIL_MAP,  "DETAIL_MAP"  },
+  { FEATURE_VIRTUAL_MAP, "VIRTUAL_MAP" },
+  { FEATURE_FEEDBACK,    "FEEDBACK"    },
+};
+
+static permutation_entry *permutations     = NULL;
+static unsigned int       permutation_cnt  = 0;
+static unsigned int       permutation_cap  = 0;
+
+
+/******************************************************************************
+* Function  : append()
+* Brief     : Append text to a source buffer, growing it as needed.
+* Parameters:
+*     1. s   : The source buffer.
+*     2. text: The text to append.
+*     3. len : The length of this text.
+* Returns   : 
+*     true : The text has been appended.
+*     false: Memory could not be allocated.
+*******************************************************************************/
+static bool append(source *s, const char *text, size_t len)
+{
+  char   *data;
+  size_t  cap = s->cap? s->cap : 1024;
+
+  while (cap < s->len + len + 1)
+    cap <<= 1;
+
+  if (cap != s->cap)
+  {
+    if (NULL == (data = realloc(s->data, cap)))
+    {
+      printf("Error, failed to allocate %zu bytes for GLSL source\n", cap);
+      return false;
+    }
+    s->data = data;
+    s->cap  = cap;
+  }
+
+  memcpy(s->data + s->len, text, len);
+  s->len += len;
+  s->data[s->len] = '\0';
+  return true;
+}
+
+
+/******************************************************************************
+* Function  : read_glsl()
+* Brief     : Read a whole GLSL file, whatever its size.
+* Parameters:
+*     1. filename: The file, relative to TAWY_GLSL_DIR.
+* Returns   : 
+*     text : The null terminated content, to be released with free().
+*     NULL : The file could not be read.
+*******************************************************************************/
+static char *read_glsl(const char *filename)
+{
+  FILE *f;
+  char  path[1024];
+  char *text;
+  long  len;
+
+  snprintf(path, sizeof(path), TAWY_GLSL_DIR "%s", filename);
+  if (NULL == (f = fopen(path, "rb")))
+  {
+    printf("Error opening file at %s\n", path);
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  if (len < 0 || NULL == (text = malloc(len + 1)))
+  {
+    printf("Error reading file at %s\n", path);
+    fclose(f);
+    return NULL;
+  }
+
+  len = fread(text, 1, len, f);
+  text[len] = '\0';
+  fclose(f);
+  return text;
+}
+
+
+/******************************************************************************
+* Function  : directive()
+* Brief     : Tell whether a line holds a given preprocessor directive.
+* Parameters:
+*     1. line: The line, possibly indented.
+*     2. name: The directive, e.g. "#include".
+* Returns   : 
+*     args : What follows the directive on the line.
+*     NULL : The line does not hold this directive.
+*******************************************************************************/
+static const char *directive(const char *line, const char *name)
+{
+  size_t len = strlen(name);
+
+  while (*line == ' ' || *line == '\t')
+    line++;
+
+  return strncmp(line, name, len)? NULL : line + len;
+}
+
+
+/******************************************************************************
+* Function  : expand()
+* Brief     : Append a GLSL file to a source, expanding its #include.
+* Parameters:
+*     1. out     : The source buffer receiving the expansion.
+*     2. filename: The file to expand.
+*     3. defines : The lines to inject after #version, or NULL. Only the top
+*                  level file receives them.
+*     4. depth   : The current include depth.
+* Returns   : 
+*     true : The file is expanded.
+*     false: The file or an include is missing, or includes are recursive.
+*******************************************************************************/
+static bool expand(source *out, const char *filename, const char *defines, unsigned int depth)
+{
+  char        *text;
+  const char  *line;
+  const char  *end;
+  const char  *args;
+  const char  *quote;
+  char         name[SHADER_NAME_LEN];
+  char         marker[32];
+  unsigned int number = 1;
+  bool         ret    = true;
+
+  if (depth >= SHADER_INCLUDE_DEPTH)
+  {
+    printf("Error, #include of '%s' is nested too deep\n", filename);
+    return false;
+  }
+
+  if (NULL == (text = read_glsl(filename)))
+    return false;
+
+  if (defines && !directive(text, "#version"))
+    ret &= append(out, defines, strlen(defines));
+
+  for (line = text; ret && *line; line = end, number++)
+  {
+    end = strchr(line, '\n');
+    end = end? end + 1 : line + strlen(line);
+
+    //
+    // 1. #include "file": expand it, then restore line numbering.
+    //
+    if ((args = directive(line, "#include")))
+    {
+      if (NULL == (args = memchr(args, '"', end - args)) ||
+          NULL == (quote = memchr(args + 1, '"', end - args - 1)) ||
+          (size_t)(quote - args - 1) >= sizeof(name))
+      {
+        printf("Error, malformed #include in %s at line %u\n", filename, number);
+        ret = false;
+        break;
+      }
+
+      memcpy(name, args + 1, quote - args - 1);
+      name[quote - args - 1] = '\0';
+
+      snprintf(marker, sizeof(marker), "#line 1\n");
+      ret &= append(out, marker, strlen(marker)) && expand(out, name, NULL, depth + 1);
+      if (ret && out->data[out->len - 1] != '\n')
+        ret &= append(out, "\n", 1);
+      snprintf(marker, sizeof(marker), "#line %u\n", number + 1);
+      ret &= append(out, marker, strlen(marker));
+      continue;
+    }
+
+    ret &= append(out, line, end - line);
+
+    //
+    // 2. #version must come first. Defines come right after it.
+    //
+    if (defines && directive(line, "#version"))
+    {
+      if (end[-1] != '\n')
+        ret &= append(out, "\n", 1);
+      snprintf(marker, sizeof(marker), "#line %u\n", number + 1);
+      ret &= append(out, defines, strlen(defines)) && append(out, marker, strlen(marker));
+    }
+  }
+
+  free(text);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : shader_defines
+* Brief     : Write the #define lines matching a set of features.
+* Parameters:
+*    1. features: A combination of shader_feature.
+*    2. defines : The buffer to write to, TAWY_SHADER_DEFINES_LEN bytes long.
+* Returns   :
+*    defines: The buffer, for convenience.
+*******************************************************************************/
+char *shader_defines(unsigned int features, char *defines)
+{
+  size_t len = 0;
+
+  defines[0] = '\0';
+  for (unsigned int i = 0; i < sizeof(feature_names) / sizeof(feature_names[0]); i++)
+  {
+    if (features & feature_names[i].feature)
+      len += snprintf(defines + len, TAWY_SHADER_DEFINES_LEN - len, "#define %s\n", feature_names[i].name);
+  }
+
+  return defines;
+}
+
+
+/*******************************************************************************
+* Function  : shader_source
+* Brief     : Load a GLSL file of any size from TAWY_GLSL_DIR, expand its 
+*             #include "file" directives, and inject defines after #version.
+* Parameters:
+*    1. filename: The GLSL file, relative to TAWY_GLSL_DIR.
+*    2. defines : The #define lines to inject, or NULL.
+* Returns   :
+*    source: The preprocessed source, to be released with free().
+*    NULL  : The file, or one of its includes, could not be read.
+*******************************************************************************/
+char *shader_source(const char *filename, const char *defines)
+{
+  source out = {0};
+
+  if (!expand(&out, filename, (defines && *defines)? defines : NULL, 0))
+  {
+    free(out.data);
+    return NULL;
+  }
+
+  return out.data;
+}
+
+
+/*******************************************************************************
+* Function  : permutation
+* Brief     : Get the program built from a pair of shaders and a set of 
+*             features. It is compiled on first request, and shared afterwards.
+* Parameters:
+*    1. vertex  : The vertex shader file.
+*    2. fragment: The fragment shader file.
+*    3. features: A combination of shader_feature.
+* Returns   :
+*    program: The permutation.
+*    NULL   : The permutation could not be built.
+*******************************************************************************/
+program *permutation(const char *vertex, const char *fragment, unsigned int features)
+{
+  permutation_entry *entry;
+  program           *p;
+  unsigned int       cap;
+
+  for (unsigned int i = 0; i < permutation_cnt; i++)
+  {
+    entry = &permutations[i];
+    if (entry->features == features && 
+        !strcmp(entry->vertex, vertex) && 
+        !strcmp(entry->fragment, fragment))
+      return entry->p;
+  }
+
+  if (NULL == (p = new(Program, vertex, fragment, features)))
+    return NULL;
+
+  if (permutation_cnt == permutation_cap)
+  {
+    cap = permutation_cap? permutation_cap * 2 : 8;
+    if (NULL == (entry = realloc(permutations, cap * sizeof(permutation_entry))))
+    {
+      printf("Error, failed to allocate permutations\n");
+      delete(p, NULL);
+      return NULL;
+    }
+    permutations    = entry;
+    permutation_cap = cap;
+  }
+
+  entry = &permutations[permutation_cnt++];
+  snprintf(entry->vertex, SHADER_NAME_LEN, "%s", vertex);
+  snprintf(entry->fragment, SHADER_NAME_LEN, "%s", fragment);
+  entry->features = features;
+  entry->p        = p;
+  return p;
+}
+
+
+/*******************************************************************************
+* Function  : permutations_clear
+* Brief     : Delete every permutation built so far.
+*******************************************************************************/
+void permutations_clear(void)
+{
+  for (unsigned int i = 0; i < permutation_cnt; i++)
+    delete(permutations[i].p, NULL);
+
+  free(permutations);
+  permutations    = NULL;
+  permutation_cnt = 0;
+  permutation_cap = 0;
+}
@@ -9,58 +9,565 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "texture.h"
+#include "texture_array.h"
+#include "texture_loader.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#define TEXTURE_PATH_PARTS (TAWY_TEXTURE_PATH_LEN / 2)
 
 
+static texture      **textures    = NULL;  // Every texture acquired, and owned.
+static unsigned int   texture_cnt = 0;
+static unsigned int   texture_cap = 0;
+static size_t         budget      = TAWY_TEXTURE_BUDGET;
+static unsigned long  frame_cnt   = 0;
+
+
+/*******************************************************************************
+* Function  : normalize_path
+* Brief     : Join a file to its directory and resolve '.', '..', repeated and
+*             '\\' separators lexically, so that every spelling of a path to
+*             the same file gives the same string.
+* Parameters:
+*    1. dir     : The directory the file is relative to.
+*    2. file    : The file, ignoring dir if absolute.
+*    3. path    : Receives the normalized path, TAWY_TEXTURE_PATH_LEN long.
+* Returns   :
+*    true : path is normalized.
+*    false: The path is empty or too long.
+*******************************************************************************/
+static bool normalize_path(const char *dir, const char *file, char *path)
+{
+  char          joined[TAWY_TEXTURE_PATH_LEN * 2];
+  char         *part;
+  char         *save;
+  size_t        marks[TEXTURE_PATH_PARTS];
+  size_t        len    = 0;
+  unsigned int  depth  = 0;
+  unsigned int  ups    = 0;
+  bool          absolute;
+
+  //
+  // 1. Join, and use a single kind of separator. Models authored on Windows
+  //    name their textures with backslashes.
+  //
+  if (file[0] == '/' || file[0] == '\\' || !dir[0])
+    snprintf(joined, sizeof(joined), "%s", file);
+  else
+    snprintf(joined, sizeof(joined), "%s/%s", dir, file);
+
+  for (char *c = joined; *c; c++)
+  {
+    if (*c == '\\')
+      *c = '/';
+  }
+
+  absolute = (joined[0] == '/');
+  if (absolute)
+    path[len++] = '/';
+
+  //
+  // 2. Keep a stack of the components, where '..' pops the last one. Leading
+  //    '..' of a relative path cannot be resolved, and are kept.
+  //
+  for (part = strtok_r(joined, "/", &save); part; part = strtok_r(NULL, "/", &save))
+  {
+    if (!strcmp(part, "."))
+      continue;
+
+    if (!strcmp(part, "..") && depth > ups)
+    {
+      len = marks[--depth];
+      continue;
+    }
+
+    if (!strcmp(part, "..") && absolute)
+      continue;
+
+    if (depth == TEXTURE_PATH_PARTS || len + strlen(part) + 2 > TAWY_TEXTURE_PATH_LEN)
+      return false;
+
+    ups           += !strcmp(part, "..");
+    marks[depth++] = len;
+    if (len > (absolute? 1 : 0))
+      path[len++] = '/';
+    memcpy(&path[len], part, strlen(part));
+    len += strlen(part);
+  }
+
+  path[len] = '\0';
+  return depth > ups;
+}
+
+
+/*******************************************************************************
+* Function  : file_modified
+* Brief     : Obtain the modification time of a file.
+* Parameters:
+*    1. path    : The path of the file.
+* Returns   :
+*    time : The modification time, in nanoseconds.
+*    0    : The file does not exist.
+*******************************************************************************/
+static long long file_modified(const char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st))
+    return 0;
+  return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+
+/*******************************************************************************
+* Function  : texture_modified
+* Brief     : Obtain the modification time of a texture: the latest of its 
+*             image and of the file baked from it, either may be loaded.
+* Parameters:
+*    1. self    : The texture, its path set.
+* Returns   :
+*    time : The modification time, in nanoseconds.
+*    0    : The image does not exist.
+*******************************************************************************/
+static long long texture_modified(const texture *obj)
+{
+  char      baked[TAWY_TEXTURE_PATH_LEN];
+  long long image = file_modified(obj->path);
+  long long bake  = texture_baked_path(obj->path, baked)? file_modified(baked) : 0;
+
+  return (image && bake > image)? bake : image;
+}
+
+
+/*******************************************************************************
+* Function  : acquire
+* Brief     : Obtain the texture of a path with given options from the 
+*             registry, creating it only if no owner holds it yet.
+* Parameters:
+*    1. path    : The normalized image file, or the name of an image in memory.
+*    2. options : The texture_option flags to load it with.
+*    3. source  : The encoded image, copied, NULL to read the file.
+*    4. size    : Its size, in bytes.
+* Returns   :
+*    texture: The shared texture. Give it back with texture_release().
+*    NULL   : The image could not be loaded.
+*******************************************************************************/
+static texture *acquire(const char *path, unsigned int options, const void *source, size_t size)
+{
+  texture      **entries;
+  texture       *t;
+  unsigned int   cap;
+
+  //
+  // Images in memory are shared only while their content is the same: a
+  // model file saved again gives its images anew under the same names.
+  //
+  for (unsigned int i = 0; i < texture_cnt; i++)
+  {
+    t = textures[i];
+    if (t->options == options && !strcmp(t->path, path) && (!source == !t->source) &&
+        (!source || (t->source_size == size && !memcmp(t->source, source, size))))
+    {
+      t->refs++;
+      return t;
+    }
+  }
+
+  if (texture_cnt == texture_cap)
+  {
+    cap = texture_cap? texture_cap * 2 : 16;
+    if (NULL == (entries = realloc(textures, cap * sizeof(texture *))))
+    {
+      printf("Error, failed to allocate textures\n");
+      return NULL;
+    }
+    textures    = entries;
+    texture_cap = cap;
+  }
+
+  printf("Loading texture: %s\n", path);
+  if (NULL == (t = new(Texture, path, options, source, size)))
+    return NULL;
+
+  textures[texture_cnt++] = t;
+  return t;
+}
+
+
+/*******************************************************************************
+* Function  : texture_acquire
+* Brief     : Obtain the texture of an image file with given options, loading
+*             it only if no owner holds it yet. Memory and load time scale with
+*             unique textures, not with the number of models using them.
+* Parameters:
+*    1. dir     : The directory the file is relative to. Ignored if the file is
+*                 absolute.
+*    2. file    : The image file. It may contain '.', '..' or '\\' separators.
+*    3. options : The texture_option flags to load it with.
+* Returns   :
+*    texture: The shared texture. Give it back with texture_release().
+*    NULL   : The image could not be loaded.
+*******************************************************************************/
+texture *texture_acquire(const char *dir, const char *file, unsigned int options)
+{
+  char path[TAWY_TEXTURE_PATH_LEN];
+
+  if (!normalize_path(dir, file, path))
+  {
+    printf("Error, invalid texture path '%s%s'\n", dir, file);
+    return NULL;
+  }
+
+  return acquire(path, options, NULL, 0);
+}
+
+
+/*******************************************************************************
+* Function  : texture_acquire_memory
+* Brief     : Obtain the texture of an image held in memory, such as one 
+*             embedded in a model file. The encoded image is copied, and 
+*             decoded as files are, but never cached nor written to disk. 
+*             Owners giving the same name and content share it.
+* Parameters:
+*    1. name    : The name of the image, that identifies it in the registry.
+*    2. data    : The encoded image.
+*    3. size    : Its size, in bytes.
+*    4. options : The texture_option flags to load it with.
+* Returns   :
+*    texture: The shared texture. Give it back with texture_release().
+*    NULL   : The image could not be copied, or its name is too long.
+*******************************************************************************/
+texture *texture_acquire_memory(const char *name, const void *data, size_t size, unsigned int options)
+{
+  if (strlen(name) >= TAWY_TEXTURE_PATH_LEN || !size)
+  {
+    printf("Error, invalid texture '%s'\n", name);
+    return NULL;
+  }
+
+  return acquire(name, options, data, size);
+}
+
+
+/*******************************************************************************
+* Function  : texture_release
+* Brief     : Give a texture back to the registry. It is deleted with its last
+*             owner.
+* Parameters:
+*    1. self    : The texture obtained from texture_acquire(). May be NULL.
+*******************************************************************************/
+void texture_release(texture *obj)
+{
+  if (!obj || --obj->refs)
+    return;
+
+  for (unsigned int i = 0; i < texture_cnt; i++)
+  {
+    if (textures[i] == obj)
+    {
+      textures[i] = textures[--texture_cnt];
+      break;
+    }
+  }
+
+  delete(obj, NULL);
+
+  //
+  // Worker threads are not needed anymore with the last texture.
+  //
+  if (!texture_cnt)
+  {
+    free(textures);
+    textures    = NULL;
+    texture_cap = 0;
+    texture_loader_stop();
+    texture_arrays_clear();
+  }
+}
+
+
+/*******************************************************************************
+* Function  : least_recent
+* Brief     : Order textures by the last frame they were bound in, oldest first.
+*******************************************************************************/
+static int least_recent(const void *a, const void *b)
+{
+  const texture *t0 = *(texture * const *) a;
+  const texture *t1 = *(texture * const *) b;
+
+  return (t0->used > t1->used) - (t0->used < t1->used);
+}
+
+
+/*******************************************************************************
+* Function  : texture_budget
+* Brief     : Set the video memory texture arrays may use. Over it, textures 
+*             not bound for TAWY_TEXTURE_IDLE_FRAMES are evicted, least 
+*             recently used first. TAWY_TEXTURE_BUDGET by default.
+* Parameters:
+*    1. bytes   : The budget, in bytes. 0 to never evict.
+*******************************************************************************/
+void texture_budget(size_t bytes)
+{
+  budget = bytes;
+}
+
+
+/*******************************************************************************
+* Function  : texture_touch
+* Brief     : Record that a texture is bound this frame, and restore it if it
+*             was evicted. Its smallest levels are used until then.
+* Parameters:
+*    1. self    : The texture.
+*******************************************************************************/
+void texture_touch(texture *obj)
+{
+  obj->used    = frame_cnt;
+  obj->evicted = false;
+}
+
+
+/*******************************************************************************
+* Function  : texture_need
+* Brief     : Record the size a texture is drawn at this frame, so that only 
+*             the levels this size needs are streamed. Textures bound without
+*             it are streamed whole.
+* Parameters:
+*    1. self    : The texture.
+*    2. pixels  : The size it covers on screen, in pixels.
+*******************************************************************************/
+void texture_need(texture *obj, float pixels)
+{
+  obj->needed = pixels > obj->needed? pixels : obj->needed;
+}
+
+
+/*******************************************************************************
+* Function  : textures_stream
+* Brief     : Stream the finer levels of textures drawn last frame larger than
+*             their first level, and drop the levels of textures drawn at a 
+*             quarter of it or less. Call it once per frame, before 
+*             textures_evict().
+* Returns   :
+*    cnt: The number of textures streamed in or out by this call.
+*******************************************************************************/
+unsigned int textures_stream(void)
+{
+  texture      *t;
+  int           target;
+  int           size;
+  unsigned int  cnt = 0;
+
+  for (unsigned int i = 0; i < texture_cnt; i++)
+  {
+    t      = textures[i];
+    target = 0;
+    size   = t->width > t->height? t->width : t->height;
+
+    //
+    // 1. The size wanted, the power of two covering what was drawn, all the
+    //    levels if unknown. Textures not drawn are left to eviction.
+    //
+    if (t->used != frame_cnt || t->status != TEXTURE_READY)
+    {
+      t->needed = 0.0f;
+      continue;
+    }
+
+    if (t->needed > 0.0f)
+    {
+      for (target = TAWY_TEXTURE_COARSEST; target < t->needed && target < size << t->lod; target *= 2);
+    }
+    if (target >= size << t->lod)
+      target = 0;
+    t->needed = 0.0f;
+
+    //
+    // 2. Finer levels as soon as they are needed, coarser ones only once the
+    //    first level is twice too large: it does not flip between two.
+    //
+    if ((t->lod && t->largest && (!target || target > t->largest)) ||
+        (target && size > 2 * target && (!t->largest || t->largest > target)))
+    {
+      t->largest = target;
+      cnt       += texture_loader_submit(t);
+    }
+  }
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : textures_evict
+* Brief     : Start a new frame, and evict the least recently used textures 
+*             while texture arrays exceed the budget. Evicted textures use the
+*             placeholder until their smallest levels are uploaded, and arrays
+*             are deleted once emptied. Call it once per frame, from the GL 
+*             thread.
+* Returns   :
+*    cnt: The number of textures evicted by this call.
+*******************************************************************************/
+unsigned int textures_evict(void)
+{
+  static bool    warned = false;
+  texture      **idle;
+  size_t         size;
+  unsigned int   idle_cnt = 0;
+  unsigned int   cnt      = 0;
+
+  frame_cnt++;
+  if (!budget || (size = texture_arrays_footprint()) <= budget)
+  {
+    warned = false;
+    return 0;
+  }
+
+  if (NULL == (idle = malloc(texture_cnt * sizeof(texture *))))
+    return 0;
+
+  //
+  // 1. Textures idle long enough, with levels finer than the coarsest in an
+  //    array. Others are drawn with, still loading, or evicted already.
+  //
+  for (unsigned int i = 0; i < texture_cnt; i++)
+  {
+    if (textures[i]->pool && !textures[i]->evicted && frame_cnt - textures[i]->used > TAWY_TEXTURE_IDLE_FRAMES &&
+        (textures[i]->width > TAWY_TEXTURE_COARSEST || textures[i]->height > TAWY_TEXTURE_COARSEST))
+      idle[idle_cnt++] = textures[i];
+  }
+  qsort(idle, idle_cnt, sizeof(texture *), least_recent);
+
+  //
+  // 2. Evict the oldest until what they free brings arrays under budget. 
+  //    Their smallest levels are loaded back, a few KiB each.
+  //
+  for (unsigned int i = 0; i < idle_cnt && size > budget; i++, cnt++)
+  {
+    size            -= idle[i]->footprint < size? idle[i]->footprint : size;
+    idle[i]->evicted = true;
+    idle[i]->largest = TAWY_TEXTURE_COARSEST;
+    texture_array_remove(idle[i]);
+    texture_loader_submit(idle[i]);
+  }
+  free(idle);
+
+  if (size > budget && !warned)
+    printf("Warning, textures exceed their budget by %.1f MiB, none idle for %d frames\n",
+           (size - budget) / (1024.0 * 1024.0), TAWY_TEXTURE_IDLE_FRAMES);
+  warned = size > budget;
+  return cnt;
+}
 
 
 /*******************************************************************************
 * Function  : Texture__init__
-* Brief     : The object initializer, called by new()
+* Brief     : The object initializer, called by new(). Prefer texture_acquire(),
+*             which shares textures between their owners.
 * Parameters:
-*    1. self    : The instance of the model.
-*    2. filename: The filename of the texture to load.
+*    1. self    : The instance of the texture.
+*    2. path    : The image file, relative to the working directory, or the
+*                 name of the image in memory.
+*    3. options : The texture_option flags to load it with.
+*    4. source  : The encoded image, copied, NULL to read the file.
+*    5. size    : Its size, in bytes.
 * Returns   :
-*    true : 
-*    false: 
+*    true : The texture holds the image, with one owner.
+*    false: The image could not be decoded.
 *******************************************************************************/
 static bool Texture__init__(void *self, va_list *args)
 {
-  texture       *obj        = self;
-  unsigned char *data;
-  char           path[1024] = "res/textures/";
-  unsigned int   texture_type;
-
-  glGenTextures(1, &obj->id);
-  glBindTexture(GL_TEXTURE_2D, obj->id);
+  texture    *obj = self;
+  const void *source;
 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  snprintf(obj->path, TAWY_TEXTURE_PATH_LEN, "%s", va_arg(*args, char *));
+  obj->options         = va_arg(*args, unsigned int);
+  source               = va_arg(*args, const void *);
+  obj->source_size     = va_arg(*args, size_t);
+  obj->source          = NULL;
+  obj->refs            = 1;
+  obj->width           = 0;
+  obj->height          = 0;
+  obj->number_channels = 0;
 
-  strcat(path, va_arg(*args, char *));
+  //
+  // The placeholder stands in for the image until it is decoded and uploaded.
+  //
+  obj->pool     = NULL;
+  obj->used     = frame_cnt;
+  obj->evicted  = false;
+  obj->lod      = 0;
+  obj->largest  = TAWY_TEXTURE_COARSEST;
+  obj->needed   = 0.0f;
+  obj->status   = TEXTURE_PENDING;
+  texture_array_remove(obj);
 
-  char *dot = strrchr(path, '.');
-  texture_type = (dot && !strcmp(dot, ".png"))? GL_RGBA : GL_RGB;
+  //
+  // An image in memory has no file to watch, it is never reloaded.
+  //
+  if (source && NULL != (obj->source = malloc(obj->source_size)))
+    memcpy(obj->source, source, obj->source_size);
 
-  stbi_set_flip_vertically_on_load(true);
-  if (NULL != (data = stbi_load(path, &obj->width, &obj->height, &obj->number_channels, 0)))
+  obj->modified = source? (obj->source != NULL) : texture_modified(obj);
+  if (!obj->modified)
   {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, obj->width, obj->height, 0, texture_type, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(data);
-    return true;
+    printf("Error, failed to load texture '%s'\n", obj->path);
+    return false;
   }
 
-  printf("Error, failed to load texture '%s'\n", path);
-  return false;
+  return texture_loader_submit(obj);
+}
+
+
+/*******************************************************************************
+* Function  : Texture__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the texture to delete.
+*******************************************************************************/
+static void Texture__del__(void *self)
+{
+  texture *obj = self;
+
+  texture_loader_cancel(obj);
+  texture_array_remove(obj);
+  free(obj->source);
+  free(self);
+}
+
+
+/*******************************************************************************
+* Function  : Texture__reload__
+* Brief     : Decode the image again if its file changed. The previous image
+*             stays in use until the new one is uploaded, or if it cannot be
+*             decoded. Owners sharing the texture all forward the change, it
+*             is decoded once. Baking the image reloads it too.
+* Parameters:
+*    1. self    : The instance of the texture.
+*    2. path    : The path of the file that changed.
+* Returns   :
+*    true : The new image is being decoded.
+*    false: The file is not ours, or has already been reloaded.
+*******************************************************************************/
+static bool Texture__reload__(void *self, const char *path)
+{
+  texture   *obj = self;
+  char       baked[TAWY_TEXTURE_PATH_LEN];
+  long long  modified;
+
+  if (obj->source || (strcmp(obj->path, path) && (!texture_baked_path(obj->path, baked) || strcmp(baked, path))) ||
+      (modified = texture_modified(obj)) == obj->modified)
+    return false;
+
+  obj->modified = modified;
+  if (!texture_loader_submit(obj))
+    return false;
+
+  printf("Reloading %s\n", path);
+  return true;
 }
 
 
@@ -71,12 +578,13 @@ static bool Texture__init__(void *self, va_list *args)
 static const class _Texture = {
   .size             = sizeof(texture),
   .__init__         = Texture__init__,
-  .__del__          = NULL,
+  .__del__          = Texture__del__,
   .__get__          = NULL,
   .__set__          = NULL,
   .__should_close__ = NULL,
   .__prepare__      = NULL,
   .__enable__       = NULL,
+  .__reload__       = Texture__reload__,
 };
 
 
@@ -0,0 +1,618 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_array.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module packs textures into layers of 2D texture arrays, and
+*           small ones into atlas pages, so that draws select a layer instead
+*           of binding textures.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+#include "ktx.h"
+#include "texture_array.h"
+#include "texture_loader.h"
+
+
+/*******************************************************************************
+* Struct    : texture_shelf
+* Brief     : The open shelf of an atlas page: entries are placed left to right
+*             on it, and a new shelf is opened above when it is full.
+*******************************************************************************/
+typedef struct texture_shelf
+{
+  int x;
+  int y;
+  int height;
+}texture_shelf;
+
+
+/*******************************************************************************
+* Struct    : texture_pool
+* Brief     : A 2D texture array holding images of one size and format, one per
+*             layer, or atlas pages holding small images of one format.
+* Attributes:
+*    1. id             : The OpenGL texture array.
+*    2. width, height  : The size of its layers.
+*    3. channels       : The number of channels of its images.
+*    4. format         : The compressed format of its baked images, 0 for 
+*                        texels.
+*    5. internal       : The sized internal format of the array.
+*    6. levels         : The number of levels allocated.
+*    7. generated      : True if only the first level is written, and the 
+*                        others generated. Otherwise images bring them all.
+*    8. clamp          : True if its images are clamped, not repeated.
+*    9. atlas          : True if its layers are atlas pages.
+*   10. layers         : The number of layers allocated.
+*   11. used           : Per layer, the number of images in it.
+*   12. shelves        : Per layer, the open shelf if it is an atlas page.
+*   13. members        : The textures placed in it.
+*   14. dirty          : True if images were written since mipmaps were.
+*   15. next           : The next pool.
+*******************************************************************************/
+typedef struct texture_pool
+{
+  unsigned int         id;
+  int                  width;
+  int                  height;
+  int                  channels;
+  unsigned int         format;
+  unsigned int         internal;
+  int                  levels;
+  bool                 generated;
+  bool                 clamp;
+  bool                 atlas;
+
+  int                  layers;
+  unsigned int        *used;
+  texture_shelf       *shelves;
+
+  texture            **members;
+  unsigned int         member_cnt;
+  unsigned int         member_cap;
+
+  bool                 dirty;
+  struct texture_pool *next;
+}texture_pool;
+
+
+static texture_pool *pools        = NULL;
+static int           max_layers   = 0;
+static unsigned int  placeholder  = 0;
+static unsigned int  bound[TAWY_TEXTURE_UPLOAD_UNIT];     // Shadow of units 0..15,
+static unsigned int  bound_2d[TAWY_TEXTURE_UPLOAD_UNIT];  // arrays and 2D apart.
+
+
+/*******************************************************************************
+* Function  : texture_units_bind
+* Brief     : Bind a texture to a draw unit, only if the unit does not hold it
+*             already. Arrays and 2D textures are shadowed apart, as OpenGL
+*             binds them apart.
+* Parameters:
+*    1. unit    : The unit, below TAWY_TEXTURE_UPLOAD_UNIT.
+*    2. target  : GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D.
+*    3. id      : The texture.
+*******************************************************************************/
+void texture_units_bind(unsigned int unit, unsigned int target, unsigned int id)
+{
+  unsigned int *shadow = target == GL_TEXTURE_2D_ARRAY? &bound[unit] : &bound_2d[unit];
+
+  if (*shadow == id)
+    return;
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(target, id);
+  *shadow = id;
+}
+
+
+/*******************************************************************************
+* Function  : texture_units_forget
+* Brief     : Clear the shadow of the units a texture is bound to, before it is
+*             deleted: OpenGL may give its name to another texture.
+* Parameters:
+*    1. id      : The texture.
+*******************************************************************************/
+void texture_units_forget(unsigned int id)
+{
+  for (unsigned int i = 0; i < TAWY_TEXTURE_UPLOAD_UNIT; i++)
+  {
+    if (bound[i] == id)
+      bound[i] = 0;
+    if (bound_2d[i] == id)
+      bound_2d[i] = 0;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : internal_format
+* Brief     : The sized internal format of images, from their channels: R8, 
+*             RG8, RGB8 or RGBA8, and their sRGB variants for color. Compressed
+*             formats have an sRGB variant only with EXT_texture_sRGB.
+* Parameters:
+*    1. channels: The number of channels of the images.
+*    2. format  : Their compressed format, 0 for texels.
+*    3. srgb    : True if they hold sRGB encoded colors.
+* Returns   :
+*    format: The internal format to allocate arrays with.
+*******************************************************************************/
+static unsigned int internal_format(int channels, unsigned int format, bool srgb)
+{
+  static const unsigned int linear[] = {0, GL_R8, GL_RG8, GL_RGB8,  GL_RGBA8};
+  static const unsigned int gamma[]  = {0, GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8};
+
+  switch (format)
+  {
+    case 0:       return (srgb? gamma : linear)[channels];
+    case KTX_BC1: return (srgb && GLAD_GL_EXT_texture_sRGB)? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : format;
+    case KTX_BC3: return (srgb && GLAD_GL_EXT_texture_sRGB)? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : format;
+    default:      return format;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : image_size
+* Brief     : The size of an image in a pool: one byte per channel, or 4x4 
+*             blocks of 8 bytes for BC1 and BC4, of 16 bytes otherwise.
+*******************************************************************************/
+static size_t image_size(const texture_pool *obj, int width, int height)
+{
+  size_t block = (obj->format == KTX_BC1 || obj->format == KTX_BC4)? 8 : 16;
+
+  width  = width  > 1? width  : 1;
+  height = height > 1? height : 1;
+  if (!obj->format)
+    return (size_t) width * height * obj->channels;
+  return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * block;
+}
+
+
+/*******************************************************************************
+* Function  : footprint
+* Brief     : The size of a region of a pool at every level allocated. Atlas
+*             entries own no texel of the levels they are smaller than, which
+*             their neighbours share.
+*******************************************************************************/
+static size_t footprint(const texture_pool *obj, int width, int height)
+{
+  size_t size = 0;
+
+  for (int l = 0; l < obj->levels && (!obj->atlas || (width >> l && height >> l)); l++)
+    size += image_size(obj, width >> l, height >> l);
+  return size;
+}
+
+
+/*******************************************************************************
+* Function  : level_count
+* Brief     : The number of levels down to 1x1.
+*******************************************************************************/
+static int level_count(int width, int height)
+{
+  int levels = 1;
+
+  while (width >> levels || height >> levels)
+    levels++;
+  return levels;
+}
+
+
+/*******************************************************************************
+* Function  : create_array
+* Brief     : Create the OpenGL array of a pool, with a number of layers. It is
+*             left bound to the upload unit.
+* Parameters:
+*    1. obj     : The pool.
+*    2. layers  : The number of layers.
+* Returns   :
+*    id: The new array.
+*******************************************************************************/
+static unsigned int create_array(const texture_pool *obj, int layers)
+{
+  static const unsigned int formats[] = {0, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+  int          width;
+  int          height;
+
+  unsigned int wrap = obj->clamp? GL_CLAMP_TO_EDGE : GL_REPEAT;
+  unsigned int id;
+
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glGenTextures(1, &id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, obj->levels > 1? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  //
+  // Every level is allocated once, generated ones included, immutable if 
+  // the driver allows it.
+  //
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, obj->levels - 1);
+  if (GLAD_GL_ARB_texture_storage)
+  {
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, obj->levels, obj->internal, obj->width, obj->height, layers);
+    return id;
+  }
+
+  for (int l = 0; l < obj->levels; l++)
+  {
+    width  = obj->width  >> l? obj->width  >> l : 1;
+    height = obj->height >> l? obj->height >> l : 1;
+
+    if (obj->format)
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, obj->internal, width, height, layers, 
+                             0, image_size(obj, width, height) * layers, NULL);
+    else
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, l, obj->internal, width, height, layers, 
+                   0, formats[obj->channels], GL_UNSIGNED_BYTE, NULL);
+  }
+  return id;
+}
+
+
+/*******************************************************************************
+* Function  : new_pool
+* Brief     : Create a pool, and link it with the others. Its array is 
+*             allocated once with all its layers, and never resized.
+* Parameters:
+*    1. layers  : The number of layers, clamped to what OpenGL allows.
+* Returns   :
+*    pool: The new pool.
+*    NULL: Memory could not be allocated.
+*******************************************************************************/
+static texture_pool *new_pool(int width, int height, int channels, unsigned int format, unsigned int internal, int levels,
+                              bool clamp, bool atlas, int layers)
+{
+  texture_pool *obj;
+
+  if (!max_layers)
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  layers = layers > max_layers? max_layers : layers;
+
+  if (NULL == (obj = calloc(1, sizeof(texture_pool))) ||
+      NULL == (obj->used = calloc(layers, sizeof(unsigned int))) ||
+      NULL == (obj->shelves = calloc(layers, sizeof(texture_shelf))))
+  {
+    printf("Error, failed to allocate texture array\n");
+    if (obj)
+      free(obj->used);
+    free(obj);
+    return NULL;
+  }
+
+  obj->width    = width;
+  obj->height   = height;
+  obj->channels = channels;
+  obj->format    = format;
+  obj->internal  = internal;
+  obj->generated = !levels;
+  obj->levels    = levels? levels : level_count(width, height);
+  obj->clamp    = clamp;
+  obj->atlas    = atlas;
+  obj->layers   = layers;
+  obj->id       = create_array(obj, layers);
+  obj->next     = pools;
+  pools         = obj;
+  return obj;
+}
+
+
+/*******************************************************************************
+* Function  : delete_pool
+* Brief     : Unlink a pool from the others, and delete it with its array.
+*******************************************************************************/
+static void delete_pool(texture_pool *obj)
+{
+  texture_pool **p;
+
+  for (p = &pools; *p != obj; p = &(*p)->next);
+  *p = obj->next;
+
+  texture_units_forget(obj->id);
+  glDeleteTextures(1, &obj->id);
+  free(obj->used);
+  free(obj->shelves);
+  free(obj->members);
+  free(obj);
+}
+
+
+/*******************************************************************************
+* Function  : pack
+* Brief     : Find room for an entry in a layer of a pool. Atlas pages pack it 
+*             on their open shelf, or on a new one above. Other pools need a
+*             free layer.
+* Parameters:
+*    1. obj     : The pool.
+*    2. region  : Its size set, receives its position.
+* Returns   :
+*    true : The region is reserved.
+*    false: The pool is full.
+*******************************************************************************/
+static bool pack(texture_pool *obj, texture_region *region)
+{
+  texture_shelf *shelf;
+  texture_shelf  next;
+
+  for (int layer = 0; layer < obj->layers; layer++)
+  {
+    if (!obj->atlas)
+    {
+      if (obj->used[layer])
+        continue;
+      region->x     = 0;
+      region->y     = 0;
+      region->layer = layer;
+      return true;
+    }
+
+    shelf = &obj->shelves[layer];
+    next  = *shelf;
+    if (next.x + region->width > obj->width)
+    {
+      next.y      += next.height;
+      next.x       = 0;
+      next.height  = 0;
+    }
+
+    if (next.y + region->height > obj->height)
+      continue;
+
+    region->x     = next.x;
+    region->y     = next.y;
+    region->layer = layer;
+    next.x       += region->width;
+    next.height   = next.height > region->height? next.height : region->height;
+    *shelf        = next;
+    return true;
+  }
+  return false;
+}
+
+
+/*******************************************************************************
+* Function  : texture_placeholder
+* Brief     : Access the 1x1 texture array standing in for textures not uploaded
+*             yet. It must be called from the GL thread.
+* Returns   :
+*    id: The OpenGL texture, created on first call.
+*******************************************************************************/
+unsigned int texture_placeholder(void)
+{
+  static const unsigned char grey[] = {204, 204, 204, 255};  // As untextured.
+
+  if (!placeholder)
+  {
+    glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+    glGenTextures(1, &placeholder);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, placeholder);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+  }
+  return placeholder;
+}
+
+
+/*******************************************************************************
+* Function  : texture_array_place
+* Brief     : Reserve room for an image in an array of same size and format, or
+*             in an atlas page if it is small, adding an array when they are 
+*             full. The texture is given its array, layer and rect. It must be
+*             called from the GL thread.
+* Parameters:
+*    1. self    : The texture. It must not be placed already.
+*    2. width   : The width of the image.
+*    3. height  : The height of the image.
+*    4. channels: The number of channels of the image, from 1 to 4.
+*    5. format  : The compressed format of a baked image, 0 if decoded.
+*    6. levels  : The number of levels of a baked image, 1 if decoded.
+*    7. region  : Receives where the image must be written, from the unit
+*                 TAWY_TEXTURE_UPLOAD_UNIT.
+* Returns   :
+*    true : The texture is placed.
+*    false: The image does not fit in any array.
+*******************************************************************************/
+bool texture_array_place(texture *obj, int width, int height, int channels, unsigned int format, int levels,
+                         texture_region *region)
+{
+  texture_pool  *pool;
+  texture      **members;
+  int            layers   = 0;
+  bool           clamp    = (obj->options & TEXTURE_CLAMP) != 0;
+  bool           atlas    = !clamp && !format && width <= TAWY_TEXTURE_ATLAS_MAX && height <= TAWY_TEXTURE_ATLAS_MAX;
+  int            size     = atlas? TAWY_TEXTURE_ATLAS_SIZE : 0;
+  unsigned int   internal = internal_format(channels, format, (obj->options & TEXTURE_SRGB) != 0);
+
+  //
+  // Atlas pages generate their levels: neighbours bleed into them. Levels
+  // are 0 for pools generating them.
+  //
+  levels          = (atlas || (levels == 1 && !format))? 0 : levels;
+  region->levels  = levels? levels : 1;
+  region->format  = internal;
+  region->padding = atlas? TAWY_TEXTURE_ATLAS_PADDING : 0;
+  region->width   = width  + 2 * region->padding;
+  region->height  = height + 2 * region->padding;
+
+  //
+  // 1. The first pool of this kind with room, or a new one with as many 
+  //    layers as they all have: arrays are never copied into larger ones,
+  //    and their number grows with the log of the layers needed.
+  //
+  for (pool = pools; pool; pool = pool->next)
+  {
+    if (pool->atlas    != atlas    || pool->clamp     != clamp   || 
+        pool->internal != internal || pool->generated != !levels || (levels && pool->levels != levels) ||
+        (!atlas && (pool->width != width || pool->height != height)))
+      continue;
+
+    if (pack(pool, region))
+      break;
+    layers += pool->layers;
+  }
+
+  if (!pool && (NULL == (pool = new_pool(atlas? size : width, atlas? size : height, channels, format, internal, levels,
+                                       clamp, atlas, layers? layers : 1)) ||
+                !pack(pool, region)))
+    return false;
+
+  if (pool->member_cnt == pool->member_cap)
+  {
+    if (NULL == (members = realloc(pool->members, (pool->member_cap + 16) * sizeof(texture *))))
+      return false;
+    pool->members     = members;
+    pool->member_cap += 16;
+  }
+
+  //
+  // 2. The rect selects the image, without padding, in its layer.
+  //
+  pool->members[pool->member_cnt++] = obj;
+  pool->used[region->layer]++;
+  pool->dirty = pool->generated;
+
+  obj->pool    = pool;
+  obj->id      = pool->id;
+  obj->layer   = region->layer;
+  obj->rect[0] = (float) (region->x + region->padding) / pool->width;
+  obj->rect[1] = (float) (region->y + region->padding) / pool->height;
+  obj->rect[2] = (float) width  / pool->width;
+  obj->rect[3] = (float) height / pool->height;
+
+  obj->footprint = footprint(pool, region->width, region->height);
+
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pool->id);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : texture_array_remove
+* Brief     : Give the room of a texture back, and make it use the placeholder.
+*             Arrays are deleted with their last texture.
+* Parameters:
+*    1. self    : The texture, placed or not.
+*******************************************************************************/
+void texture_array_remove(texture *obj)
+{
+  texture_pool *pool = obj->pool;
+
+  for (unsigned int i = 0; pool && i < pool->member_cnt; i++)
+  {
+    if (pool->members[i] == obj)
+    {
+      pool->members[i] = pool->members[--pool->member_cnt];
+      break;
+    }
+  }
+
+  //
+  // Atlas pages are packed again once empty, not entry by entry.
+  //
+  if (pool && !--pool->used[obj->layer])
+    memset(&pool->shelves[obj->layer], 0, sizeof(texture_shelf));
+
+  if (pool && !pool->member_cnt)
+    delete_pool(pool);
+
+  obj->pool    = NULL;
+  obj->id      = texture_placeholder();
+  obj->layer   = 0;
+  obj->rect[0] = 0.0f;
+  obj->rect[1] = 0.0f;
+  obj->rect[2] = 1.0f;
+  obj->rect[3] = 1.0f;
+
+  obj->footprint = 0;
+}
+
+
+/*******************************************************************************
+* Function  : texture_arrays_mipmap
+* Brief     : Generate mipmaps of the arrays written since last call, once for
+*             all the images written to them.
+*******************************************************************************/
+void texture_arrays_mipmap(void)
+{
+  for (texture_pool *pool = pools; pool; pool = pool->next)
+  {
+    if (!pool->dirty)
+      continue;
+
+    glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pool->id);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    pool->dirty = false;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : textures_enable
+* Brief     : Bind the arrays of textures to units 0, 1... only if they are not
+*             bound already, and set the attributes telling the draw the layers
+*             and rects of its diffuse and detail maps.
+* Parameters:
+*    1. textures: The textures of the draw.
+*    2. cnt     : The number of textures.
+*******************************************************************************/
+void textures_enable(texture * const *textures, unsigned int cnt)
+{
+  static const float full[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+
+  const texture *diffuse = cnt > 0? textures[0] : NULL;
+  const texture *detail  = cnt > 1? textures[1] : NULL;
+
+  for (unsigned int i = 0; i < cnt && i < TAWY_TEXTURE_UPLOAD_UNIT; i++)
+  {
+    texture_touch(textures[i]);
+    texture_units_bind(i, GL_TEXTURE_2D_ARRAY, textures[i]->id);
+  }
+
+  glVertexAttrib4fv(TAWY_ATTRIB_DIFFUSE_RECT, diffuse? diffuse->rect : full);
+  glVertexAttrib4fv(TAWY_ATTRIB_DETAIL_RECT, detail? detail->rect : full);
+  glVertexAttrib4f(TAWY_ATTRIB_MAPS, 
+                   diffuse? diffuse->layer : 0.0f, 
+                   detail?  detail->layer  : 0.0f,
+                   (diffuse && (diffuse->options & TEXTURE_CLAMP))? 0.0f : 1.0f,
+                   (detail  && (detail->options  & TEXTURE_CLAMP))? 0.0f : 1.0f);
+}
+
+
+/*******************************************************************************
+* Function  : texture_arrays_footprint
+* Brief     : The video memory allocated by texture arrays, used or not.
+* Returns   :
+*    size: The size of every level of every layer of every array, in bytes.
+*******************************************************************************/
+size_t texture_arrays_footprint(void)
+{
+  size_t size = 0;
+
+  for (texture_pool *pool = pools; pool; pool = pool->next)
+    size += footprint(pool, pool->width, pool->height) * pool->layers;
+  return size;
+}
+
+
+/*******************************************************************************
+* Function  : texture_arrays_clear
+* Brief     : Delete the placeholder and forget what units are bound to. Arrays
+*             are already deleted with their last texture.
+*******************************************************************************/
+void texture_arrays_clear(void)
+{
+  texture_units_forget(placeholder);
+  glDeleteTextures(1, &placeholder);
+  placeholder = 0;
+}
@@ -0,0 +1,310 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_cache.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module builds the mip chain of decoded images, and stores it
+*           on disk so that next launches map it instead of decoding.
+*******************************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "image.h"
+#include "texture.h"
+#include "texture_cache.h"
+
+#define TEXTURE_CACHE_MAGIC 0x32584554u  // "TEX2"
+
+
+/*******************************************************************************
+* Struct    : texture_cache_header
+* Brief     : What precedes the levels in a cache file. They follow it largest
+*             first, tightly packed.
+* Attributes:
+*    1. magic            : TEXTURE_CACHE_MAGIC.
+*    2. width, height    : The size of the first level.
+*    3. channels         : The number of channels of the image.
+*    4. levels           : The number of levels.
+*    5. key              : The key of this entry, against file name collisions.
+*******************************************************************************/
+typedef struct texture_cache_header
+{
+  unsigned int       magic;
+  unsigned int       width;
+  unsigned int       height;
+  unsigned int       channels;
+  unsigned int       levels;
+  unsigned int       reserved;
+  unsigned long long key;
+}texture_cache_header;
+
+
+/******************************************************************************
+* Function  : level_size()
+* Brief     : The size of a level of an image, one byte per channel.
+*******************************************************************************/
+static size_t level_size(int width, int height, int channels, int level)
+{
+  size_t w = width  >> level? width  >> level : 1;
+  size_t h = height >> level? height >> level : 1;
+
+  return w * h * channels;
+}
+
+
+/******************************************************************************
+* Function  : level_count()
+* Brief     : The number of levels down to 1x1, as glGenerateMipmap makes them.
+*******************************************************************************/
+static int level_count(int width, int height)
+{
+  int levels = 1;
+
+  while ((width >> levels || height >> levels) && levels < TAWY_TEXTURE_LEVELS)
+    levels++;
+  return levels;
+}
+
+
+/*******************************************************************************
+* Function  : texture_cache_key
+* Brief     : Hash what makes a cached image valid: the content of its file,
+*             not its name or date, and the options it is decoded with.
+* Parameters:
+*    1. data    : The content of the image file.
+*    2. size    : Its size.
+*    3. options : The texture options.
+* Returns   :
+*    key: A 64 bits key identifying the image in the cache.
+*******************************************************************************/
+unsigned long long texture_cache_key(const void *data, size_t size, unsigned int options)
+{
+  unsigned long long h = cache_hash(TAWY_CACHE_HASH_BASIS, data, size);
+
+  //
+  // Only these options, and the filter, change the stored texels.
+  //
+  h ^= (options & (TEXTURE_FLIP_Y | TEXTURE_SRGB | TEXTURE_PREMULTIPLY)) | TAWY_TEXTURE_MIP_FILTER << 8;
+  h *= TAWY_CACHE_HASH_PRIME;
+  return h;
+}
+
+
+/*******************************************************************************
+* Function  : texture_cache_load
+* Brief     : Map a cached image and locate its levels. Nothing is read until
+*             the levels are uploaded, straight from the page cache.
+* Parameters:
+*    1. key     : The key from texture_cache_key().
+*    2. levels  : Receives the mapped levels.
+* Returns   :
+*    true : The levels are mapped.
+*    false: The image is not cached, or its file is invalid.
+*******************************************************************************/
+bool texture_cache_load(unsigned long long key, texture_levels *levels)
+{
+  char                        path[1024];
+  const texture_cache_header *header;
+  struct stat                 st;
+  size_t                      offset = sizeof(texture_cache_header);
+  int                         fd;
+
+  memset(levels, 0, sizeof(texture_levels));
+
+  cache_path(TAWY_TEXTURE_CACHE_DIR, key, ".tex", path, sizeof(path));
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return false;
+
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(texture_cache_header) ||
+      MAP_FAILED == (levels->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+  {
+    levels->map = NULL;
+    close(fd);
+    return false;
+  }
+  close(fd);
+  levels->map_size = st.st_size;
+
+  //
+  // 1. The header must be ours, and describe exactly the file.
+  //
+  header = levels->map;
+  if (header->magic != TEXTURE_CACHE_MAGIC || header->key != key ||
+      !header->channels || header->channels > 4 ||
+      !header->levels || header->levels > TAWY_TEXTURE_LEVELS)
+  {
+    texture_levels_release(levels);
+    return false;
+  }
+
+  levels->width    = header->width;
+  levels->height   = header->height;
+  levels->channels = header->channels;
+  levels->count    = header->levels;
+
+  //
+  // 2. Levels follow, largest first.
+  //
+  for (int l = 0; l < levels->count; l++)
+  {
+    levels->data[l] = (const unsigned char *) levels->map + offset;
+    levels->size[l] = level_size(levels->width, levels->height, levels->channels, l);
+    offset         += levels->size[l];
+  }
+
+  if (offset != levels->map_size)
+  {
+    texture_levels_release(levels);
+    return false;
+  }
+
+  //
+  // The first upload will read the whole file, start reading it now.
+  //
+  madvise(levels->map, levels->map_size, MADV_WILLNEED);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : texture_levels_build
+* Brief     : Prepare a decoded image for upload: flip it, expand RGB to RGBA,
+*             premultiply its alpha, and compute its mip chain, with the SIMD
+*             kernels of image.h.
+* Parameters:
+*    1. levels  : Receives the levels, allocated.
+*    2. pixels  : The decoded image, top row first.
+*    3. width   : Its width.
+*    4. height  : Its height.
+*    5. channels: Its number of channels, from 1 to 4.
+*    6. options : The texture options.
+* Returns   :
+*    true : The levels are built.
+*    false: Memory could not be allocated.
+*******************************************************************************/
+bool texture_levels_build(texture_levels *levels, const unsigned char *pixels, int width, int height, int channels,
+                          unsigned int options)
+{
+  bool           flip = (options & TEXTURE_FLIP_Y) != 0;
+  unsigned char *chain;
+  size_t         size = 0;
+
+  memset(levels, 0, sizeof(texture_levels));
+  levels->width     = width;
+  levels->height    = height;
+  levels->channels  = channels == 3? 4 : channels;
+  levels->count     = level_count(width, height);
+
+  for (int l = 0; l < levels->count; l++)
+  {
+    levels->size[l] = level_size(width, height, levels->channels, l);
+    size           += levels->size[l];
+  }
+
+  if (NULL == (chain = malloc(size)))
+    return false;
+
+  //
+  // 1. The first level, flipped if needed, in the same pass as the expansion.
+  //
+  if (channels == 3)
+    image_expand(chain, pixels, width, height, flip);
+  else if (flip)
+    image_flip(chain, pixels, width, height, channels);
+  else
+    memcpy(chain, pixels, levels->size[0]);
+
+  if ((options & TEXTURE_PREMULTIPLY) && levels->channels == 4)
+    image_premultiply(chain, width, height);
+
+  //
+  // 2. Each level from the previous one, sRGB colors filtered linearly.
+  //
+  if (!image_mipmaps(chain, width, height, levels->channels, levels->count, TAWY_TEXTURE_MIP_FILTER,
+                     (options & TEXTURE_SRGB) && levels->channels >= 3))
+  {
+    free(chain);
+    return false;
+  }
+
+  levels->map       = chain;
+  levels->map_size  = size;
+  levels->allocated = true;
+  for (int l = 0; l < levels->count; chain += levels->size[l++])
+    levels->data[l] = chain;
+
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : texture_cache_store
+* Brief     : Save the levels built from a decoded image in the cache. 
+*             Concurrent stores of a key are safe: the file is written aside and
+*             renamed.
+* Parameters:
+*    1. key     : The key from texture_cache_key().
+*    2. levels  : The levels from texture_levels_build().
+* Returns   :
+*    true : The levels have been written.
+*    false: The file could not be written.
+*******************************************************************************/
+bool texture_cache_store(unsigned long long key, const texture_levels *levels)
+{
+  FILE                 *f;
+  char                  path[1024];
+  char                  temp[1100];
+  texture_cache_header  header = {0};
+  bool                  ret;
+
+  header.magic    = TEXTURE_CACHE_MAGIC;
+  header.width    = levels->width;
+  header.height   = levels->height;
+  header.channels = levels->channels;
+  header.levels   = levels->count;
+  header.key      = key;
+
+  //
+  // Write it aside, so that readers never map a partial file.
+  //
+  cache_path(TAWY_TEXTURE_CACHE_DIR, key, ".tex", path, sizeof(path));
+  snprintf(temp, sizeof(temp), "%s.%d.%lx", path, (int) getpid(), (unsigned long) pthread_self());
+  if (!cache_make_dirs(TAWY_TEXTURE_CACHE_DIR) || NULL == (f = fopen(temp, "wb")))
+  {
+    printf("Error, could not write texture cache at %s\n", path);
+    return false;
+  }
+
+  ret = (1 == fwrite(&header, sizeof(header), 1, f)) &&
+        (1 == fwrite(levels->map, levels->map_size, 1, f));
+  ret = !fclose(f) && ret && !rename(temp, path);
+
+  if (!ret)
+    remove(temp);
+
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : texture_levels_release
+* Brief     : Unmap the file of levels, or free the built levels, and forget 
+*             them.
+* Parameters:
+*    1. levels  : The levels, mapped, built or neither.
+*******************************************************************************/
+void texture_levels_release(texture_levels *levels)
+{
+  if (levels->allocated)
+    free(levels->map);
+  else if (levels->map)
+    munmap(levels->map, levels->map_size);
+  memset(levels, 0, sizeof(texture_levels));
+}
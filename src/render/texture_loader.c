@@ -0,0 +1,782 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: texture_loader.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module decodes images on worker threads, and uploads them from
+*           the GL thread through a ring of pixel buffers, within a budget.
+*******************************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+#include "ktx.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+
+/*******************************************************************************
+* Struct    : texture_job
+* Brief     : The decode of one texture file, from submission to upload.
+* Attributes:
+*    1. target  : The texture receiving the image. NULL once cancelled.
+*    2. path    : The image file, copied so that workers never read target.
+*    3. options : The options of the texture, copied for the same reason.
+*    4. source  : The encoded image if the texture holds it in memory, copied
+*                 for the same reason. NULL to read the file.
+*    5. pixels  : The decoded image, top row first, if its levels could not
+*                 be built. NULL if decoding failed.
+*    6. width, height, channels: The size and layout of the image.
+*    7. levels  : The levels mapped from a baked or cached file, or built 
+*                 from the decoded image. Their count is 0 if none.
+*    8. largest : The size levels must fit in, 0 for every level. Textures
+*                 stream only the levels they need.
+*    9. lod     : The number of levels skipped to fit.
+*   10. next    : The next job of the same queue.
+*******************************************************************************/
+typedef struct texture_job
+{
+  texture             *target;
+  char                 path[TAWY_TEXTURE_PATH_LEN];
+  unsigned int         options;
+  unsigned char       *source;
+  size_t               source_size;
+  unsigned char       *pixels;
+  int                  width;
+  int                  height;
+  int                  channels;
+  texture_levels       levels;
+  int                  largest;
+  int                  lod;
+  struct texture_job  *next;
+}texture_job;
+
+
+/*******************************************************************************
+* Struct    : job_queue
+* Brief     : A FIFO of jobs.
+*******************************************************************************/
+typedef struct job_queue
+{
+  texture_job *head;
+  texture_job *tail;
+}job_queue;
+
+
+static pthread_mutex_t lock           = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake           = PTHREAD_COND_INITIALIZER;
+static job_queue       decode_queue   = {NULL, NULL};  // Waiting for a worker.
+static job_queue       upload_queue   = {NULL, NULL};  // Decoded, waiting for GL.
+static texture_job    *decoding[TAWY_TEXTURE_THREADS]; // Taken by a worker.
+static pthread_t       workers[TAWY_TEXTURE_THREADS];
+static unsigned int    worker_cnt     = 0;
+static bool            stopping       = false;
+
+static unsigned int    pbos[TAWY_TEXTURE_PBO_RING];
+static unsigned int    pbo_next       = 0;
+static bool            pbos_created   = false;
+
+
+/*******************************************************************************
+* Function  : push
+* Brief     : Append a job to a queue. The lock must be held.
+*******************************************************************************/
+static void push(job_queue *queue, texture_job *job)
+{
+  job->next = NULL;
+  if (queue->tail)
+    queue->tail->next = job;
+  else
+    queue->head = job;
+  queue->tail = job;
+}
+
+
+/*******************************************************************************
+* Function  : pop
+* Brief     : Take the oldest job of a queue. The lock must be held.
+* Returns   :
+*    job : The oldest job.
+*    NULL: The queue is empty.
+*******************************************************************************/
+static texture_job *pop(job_queue *queue)
+{
+  texture_job *job = queue->head;
+
+  if (job && !(queue->head = job->next))
+    queue->tail = NULL;
+  return job;
+}
+
+
+/*******************************************************************************
+* Function  : cancel
+* Brief     : Detach every job, queued or being decoded, from a texture. The 
+*             lock must be held.
+*******************************************************************************/
+static void cancel(const texture *target)
+{
+  job_queue *queues[] = {&decode_queue, &upload_queue};
+
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    for (texture_job *job = queues[i]->head; job; job = job->next)
+    {
+      if (job->target == target)
+        job->target = NULL;
+    }
+  }
+
+  for (unsigned int i = 0; i < TAWY_TEXTURE_THREADS; i++)
+  {
+    if (decoding[i] && decoding[i]->target == target)
+      decoding[i]->target = NULL;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : map_file
+* Brief     : Map a whole file in memory, read only.
+* Parameters:
+*    1. path    : The file.
+*    2. size    : Receives its size.
+* Returns   :
+*    data: Its content, to unmap.
+*    NULL: It could not be mapped, or is empty.
+*******************************************************************************/
+static void *map_file(const char *path, size_t *size)
+{
+  struct stat  st;
+  void        *data;
+  int          fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+
+  if (fstat(fd, &st) || st.st_size <= 0 ||
+      MAP_FAILED == (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+    data = NULL;
+
+  close(fd);
+  *size = data? st.st_size : 0;
+  return data;
+}
+
+
+/*******************************************************************************
+* Function  : parse_ktx
+* Brief     : Check that a baked file can be uploaded as is, and locate its 
+*             levels. Its rows must be bottom-up, as flipped textures expect,
+*             and its format supported by the driver.
+* Parameters:
+*    1. levels  : The mapped file, receives its format, size and levels.
+* Returns   :
+*    true : The levels of the file are located.
+*    false: The file is not usable, the image must be decoded instead.
+*******************************************************************************/
+static bool parse_ktx(texture_levels *levels)
+{
+  static const unsigned char identifier[12] = TAWY_KTX_IDENTIFIER;
+
+  ktx_header           header;
+  const unsigned char *data = levels->map;
+  const unsigned char *p    = data + sizeof(identifier) + sizeof(ktx_header);
+  const unsigned char *end  = data + levels->map_size;
+  unsigned int         size;
+  bool                 bottom_up = false;
+
+  if (levels->map_size < sizeof(identifier) + sizeof(ktx_header) || memcmp(data, identifier, sizeof(identifier)))
+    return false;
+  memcpy(&header, data + sizeof(identifier), sizeof(ktx_header));
+
+  if (header.endianness != TAWY_KTX_ENDIANNESS || header.depth || header.array_elements || header.faces != 1 ||
+      !header.levels || header.levels > TAWY_TEXTURE_LEVELS || header.key_value_bytes > end - p)
+    return false;
+
+  switch (header.gl_internal_format)
+  {
+    case KTX_BC1: levels->channels = 3; break;
+    case KTX_BC3: levels->channels = 4; break;
+    case KTX_BC4: levels->channels = 1; break;
+    case KTX_BC5: levels->channels = 2; break;
+    default:      return false;
+  }
+
+  if ((header.gl_internal_format == KTX_BC1 || header.gl_internal_format == KTX_BC3) && !GLAD_GL_EXT_texture_compression_s3tc)
+    return false;
+
+  //
+  // 1. Key/value pairs, only orientation matters.
+  //
+  for (const unsigned char *kv = p; kv + 4 <= p + header.key_value_bytes; kv += 4 + ((size + 3) & ~3u))
+  {
+    memcpy(&size, kv, 4);
+    if (size > p + header.key_value_bytes - kv - 4)
+      return false;
+    if (!strcmp((const char *) kv + 4, TAWY_KTX_ORIENTATION) && strstr((const char *) kv + 4 + sizeof(TAWY_KTX_ORIENTATION), "T=u"))
+      bottom_up = true;
+  }
+
+  if (!bottom_up)
+    return false;
+
+  //
+  // 2. Levels, each preceded by its size.
+  //
+  p += header.key_value_bytes;
+  for (unsigned int l = 0; l < header.levels; l++)
+  {
+    if (end - p < 4)
+      return false;
+    memcpy(&size, p, 4);
+    if (size > end - p - 4)
+      return false;
+
+    levels->data[l] = p + 4;
+    levels->size[l] = size;
+    p += 4 + ((size + 3) & ~3u);
+  }
+
+  levels->format = header.gl_internal_format;
+  levels->count  = header.levels;
+  levels->width  = header.width;
+  levels->height = header.height;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : decode
+* Brief     : Map the baked file of a texture if it is up to date, or else its
+*             levels from the cache, or else decode its image, build its levels
+*             and cache them for next time. An image whose levels could not be
+*             built is kept as decoded: its upload flips it if needed. Images
+*             in memory are never baked nor cached: they are decoded each 
+*             time, nothing of them is written to disk.
+* Parameters:
+*    1. job     : The job to decode. Its pixels, or levels, are set on success.
+*******************************************************************************/
+static void decode(texture_job *job)
+{
+  texture_levels     *levels = &job->levels;
+  bool                flip   = (job->options & TEXTURE_FLIP_Y) != 0;
+  char                baked[TAWY_TEXTURE_PATH_LEN];
+  struct stat         src;
+  struct stat         dst;
+  void               *image;
+  size_t              size;
+  unsigned long long  key;
+  bool                cached;
+
+  job->pixels = NULL;
+  job->lod    = 0;
+  memset(levels, 0, sizeof(texture_levels));
+
+  //
+  // 1. The baked file, only if it is not older than the image.
+  //
+  if (flip && !job->source && texture_baked_path(job->path, baked) &&
+      !stat(job->path, &src) && !stat(baked, &dst) && dst.st_mtime >= src.st_mtime &&
+      NULL != (levels->map = map_file(baked, &levels->map_size)) && !parse_ktx(levels))
+    texture_levels_release(levels);
+
+  //
+  // 2. The cached image, keyed by the content of the image file: mapping it
+  //    is enough to hash it, and to decode it on a miss.
+  //
+  image  = job->source;
+  size   = job->source_size;
+  cached = !job->source;
+  if (!levels->count && (image || NULL != (image = map_file(job->path, &size))))
+  {
+    key = cached? texture_cache_key(image, size, job->options) : 0;
+    if (!(cached && texture_cache_load(key, levels)) &&
+        NULL != (job->pixels = stbi_load_from_memory(image, size, &job->width, &job->height, &job->channels, 0)) &&
+        texture_levels_build(levels, job->pixels, job->width, job->height, job->channels, job->options))
+    {
+      if (cached)
+        texture_cache_store(key, levels);
+      stbi_image_free(job->pixels);
+      job->pixels = NULL;
+    }
+    if (image != job->source)
+      munmap(image, size);
+  }
+
+  //
+  // 3. Levels larger than wanted are skipped, they stay in the page cache.
+  //
+  while (job->largest && levels->count > 1 && (levels->width > job->largest || levels->height > job->largest))
+  {
+    memmove(levels->data, levels->data + 1, (levels->count - 1) * sizeof(levels->data[0]));
+    memmove(levels->size, levels->size + 1, (levels->count - 1) * sizeof(levels->size[0]));
+    levels->width  = levels->width  > 1? levels->width  / 2 : 1;
+    levels->height = levels->height > 1? levels->height / 2 : 1;
+    levels->count--;
+    job->lod++;
+  }
+
+  if (levels->count)
+  {
+    job->width    = levels->width;
+    job->height   = levels->height;
+    job->channels = levels->channels;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : texture_baked_path
+* Brief     : The path of the file baked from an image: its extension replaced
+*             by TAWY_KTX_EXTENSION. The baked file is loaded instead of the 
+*             image when it is at least as recent.
+* Parameters:
+*    1. path    : The image file.
+*    2. baked   : Receives the baked file, TAWY_TEXTURE_PATH_LEN long.
+* Returns   :
+*    true : baked is set.
+*    false: The path is too long.
+*******************************************************************************/
+bool texture_baked_path(const char *path, char *baked)
+{
+  const char *dot   = strrchr(path, '.');
+  const char *slash = strrchr(path, '/');
+  int         len   = (dot && (!slash || dot > slash))? (int) (dot - path) : (int) strlen(path);
+
+  return snprintf(baked, TAWY_TEXTURE_PATH_LEN, "%.*s" TAWY_KTX_EXTENSION, len, path) < TAWY_TEXTURE_PATH_LEN;
+}
+
+
+/*******************************************************************************
+* Function  : work
+* Brief     : A worker thread. It decodes queued jobs until the loader stops.
+* Parameters:
+*    1. arg     : The index of the worker.
+* Returns   :
+*    NULL : Unconditional
+*******************************************************************************/
+static void *work(void *arg)
+{
+  unsigned int  index = (uintptr_t) arg;
+  texture_job  *job;
+
+  pthread_mutex_lock(&lock);
+  while (true)
+  {
+    while (!stopping && !decode_queue.head)
+      pthread_cond_wait(&wake, &lock);
+    if (stopping)
+      break;
+
+    //
+    // The job stays visible while decoded, so that it can still be cancelled.
+    // Cancelled jobs are handed to the GL thread anyway, which frees them.
+    //
+    job             = pop(&decode_queue);
+    decoding[index] = job;
+    if (job->target)
+    {
+      pthread_mutex_unlock(&lock);
+      decode(job);
+      pthread_mutex_lock(&lock);
+    }
+
+    decoding[index] = NULL;
+    push(&upload_queue, job);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : start_workers
+* Brief     : Start the worker threads, leaving one core to the GL thread.
+* Returns   :
+*    true : At least one worker is running.
+*    false: No thread could be started.
+*******************************************************************************/
+static bool start_workers(void)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  long cnt   = cores < 1? 1 : cores > TAWY_TEXTURE_THREADS? TAWY_TEXTURE_THREADS : cores;
+
+  stopping = false;
+  while (worker_cnt < cnt && !pthread_create(&workers[worker_cnt], NULL, work, (void *)(uintptr_t) worker_cnt))
+    worker_cnt++;
+
+  if (!worker_cnt)
+    printf("Error, failed to start texture workers\n");
+  return worker_cnt > 0;
+}
+
+
+/*******************************************************************************
+* Function  : wrap
+* Brief     : Wrap a coordinate into [0, size).
+*******************************************************************************/
+static int wrap(int x, int size)
+{
+  return ((x % size) + size) % size;
+}
+
+
+/*******************************************************************************
+* Function  : copy_rows
+* Brief     : Write an image to its destination, bottom row first if the 
+*             texture is flipped, since OpenGL expects the bottom row first. 
+*             Padding around it repeats the image, as sampling it would.
+* Parameters:
+*    1. dst     : The destination, typically mapped pixel buffer memory.
+*    2. pixels  : The image.
+*    3. job     : The job, with the size and layout of the image.
+*    4. flip    : True to flip the image vertically.
+*    5. region  : The region the destination is written to.
+*******************************************************************************/
+static void copy_rows(unsigned char *dst, const unsigned char *pixels, const texture_job *job, bool flip, 
+                      const texture_region *region)
+{
+  size_t               pixel  = job->channels;
+  size_t               stride = (size_t) job->width * pixel;
+  int                  pad    = region->padding;
+  const unsigned char *src;
+  int                  row;
+
+  for (int y = 0; y < region->height; y++, dst += region->width * pixel)
+  {
+    row = wrap(y - pad, job->height);
+    src = pixels + stride * (flip? job->height - 1 - row : row);
+
+    memcpy(dst + pad * pixel, src, stride);
+    for (int x = 0; x < pad; x++)
+    {
+      memcpy(dst + x * pixel, src + wrap(x - pad, job->width) * pixel, pixel);
+      memcpy(dst + (pad + job->width + x) * pixel, src + wrap(x, job->width) * pixel, pixel);
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : free_job
+* Brief     : Release a job and whatever it decoded or mapped.
+*******************************************************************************/
+static void free_job(texture_job *job)
+{
+  stbi_image_free(job->pixels);
+  texture_levels_release(&job->levels);
+  free(job->source);
+  free(job);
+}
+
+
+/*******************************************************************************
+* Function  : copy_levels
+* Brief     : Write the first levels of a baked or cached file one after the 
+*             other. They are already in the orientation of the texture, and 
+*             compressed if they are: there is nothing else to do with them.
+* Parameters:
+*    1. dst     : The destination, typically mapped pixel buffer memory.
+*    2. levels  : The mapped levels.
+*    3. count   : The number of levels to write.
+*******************************************************************************/
+static void copy_levels(unsigned char *dst, const texture_levels *levels, int count)
+{
+  for (int l = 0; l < count; dst += levels->size[l++])
+    memcpy(dst, levels->data[l], levels->size[l]);
+}
+
+
+/*******************************************************************************
+* Function  : upload
+* Brief     : Write a decoded image, or the levels of a baked or cached file,
+*             to its place in a texture array through the next pixel buffer of
+*             the ring. The buffer is orphaned first, so the driver never waits
+*             for a transfer still reading its previous contents. Mapped levels
+*             are copied from the page cache to the buffer, and nowhere else.
+* Parameters:
+*    1. job     : The decoded job, its target set.
+* Returns   :
+*    size: The number of bytes uploaded.
+*    0   : There is no room for it in texture arrays, or neither the pixel
+*          buffer nor client memory could hold it.
+*******************************************************************************/
+static size_t upload(const texture_job *job)
+{
+  static const unsigned int formats[] = {0, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+  texture              *obj    = job->target;
+  const texture_levels *levels = &job->levels;
+  const unsigned char  *pixels = levels->count? levels->data[0] : job->pixels;
+  bool                  flip   = (obj->options & TEXTURE_FLIP_Y) && !levels->count;
+  bool                  whole;
+  texture_region        region;
+  size_t                size = 0;
+  size_t                bytes;
+  unsigned char        *dst;
+  unsigned char        *copy = NULL;
+  unsigned char        *src;
+  int                   width;
+  int                   height;
+
+  //
+  // 1. A reloaded texture may change size, it is placed again.
+  //
+  texture_array_remove(obj);
+  if (!texture_array_place(obj, job->width, job->height, job->channels, levels->format, 
+                           levels->count? levels->count : 1, &region))
+  {
+    printf("Error, no room for texture '%s'\n", job->path);
+    return 0;
+  }
+
+  if (!pbos_created)
+  {
+    glGenBuffers(TAWY_TEXTURE_PBO_RING, pbos);
+    pbos_created = true;
+  }
+
+  //
+  // 2. Write the rows straight into the mapped pixel buffer. Should mapping 
+  //    fail, upload from client memory instead. Levels are written as they 
+  //    are, unless the first one alone goes to a padded atlas entry.
+  //
+  whole = levels->count && !region.padding;
+  if (whole)
+  {
+    for (int l = 0; l < region.levels; l++)
+      size += levels->size[l];
+  }
+  else
+    size = (size_t) region.width * region.height * job->channels;
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[pbo_next]);
+  pbo_next = (pbo_next + 1) % TAWY_TEXTURE_PBO_RING;
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+  if (NULL != (dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)))
+  {
+    if (whole)
+      copy_levels(dst, levels, region.levels);
+    else
+      copy_rows(dst, pixels, job, flip, &region);
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+      dst = NULL;
+  }
+
+  if (!dst)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (NULL == (copy = malloc(size)))
+    {
+      printf("Error, not enough memory to upload texture '%s'\n", job->path);
+      texture_array_remove(obj);
+      return 0;
+    }
+
+    if (whole)
+      copy_levels(copy, levels, region.levels);
+    else
+      copy_rows(copy, pixels, job, flip, &region);
+  }
+
+  //
+  // 3. Write the region of its layer, rows are tightly packed. The array is
+  //    bound to the upload unit by texture_array_place().
+  //
+  src = dst? NULL : copy;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int l = 0; l < region.levels; l++, src += bytes)
+  {
+    width  = region.width  >> l? region.width  >> l : 1;
+    height = region.height >> l? region.height >> l : 1;
+    bytes  = whole? levels->size[l] : size;
+
+    if (levels->format)
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, region.x, region.y, region.layer, width, height, 1,
+                                region.format, bytes, src);
+    else
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, region.x, region.y, region.layer, width, height, 1,
+                      formats[job->channels], GL_UNSIGNED_BYTE, src);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  free(copy);
+  return size;
+}
+
+
+/*******************************************************************************
+* Function  : texture_loader_submit
+* Brief     : Queue the decode of a texture file to the worker threads. The 
+*             texture keeps its current image until textures_upload() replaces
+*             it. A decode already queued for this texture is cancelled.
+* Parameters:
+*    1. self    : The texture, its path and options set.
+* Returns   :
+*    true : The decode is queued.
+*    false: Memory could not be allocated, or no thread could be started.
+*******************************************************************************/
+bool texture_loader_submit(texture *obj)
+{
+  texture_job *job;
+
+  if (!worker_cnt && !start_workers())
+    return false;
+
+  if (NULL == (job = malloc(sizeof(texture_job))))
+  {
+    printf("Error, failed to allocate texture job\n");
+    return false;
+  }
+  job->target      = obj;
+  job->options     = obj->options;
+  job->largest     = obj->largest;
+  job->pixels      = NULL;
+  job->source      = NULL;
+  job->source_size = obj->source_size;
+  memset(&job->levels, 0, sizeof(texture_levels));
+  snprintf(job->path, TAWY_TEXTURE_PATH_LEN, "%s", obj->path);
+
+  //
+  // Workers decode their own copy of an image in memory: the texture may be
+  // deleted while they do.
+  //
+  if (obj->source && NULL == (job->source = malloc(obj->source_size)))
+  {
+    printf("Error, failed to allocate texture job\n");
+    free(job);
+    return false;
+  }
+  if (obj->source)
+    memcpy(job->source, obj->source, obj->source_size);
+
+  pthread_mutex_lock(&lock);
+  cancel(obj);
+  push(&decode_queue, job);
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : texture_loader_cancel
+* Brief     : Forget any decode, or upload, queued for a texture.
+* Parameters:
+*    1. self    : The texture, before it is deleted.
+*******************************************************************************/
+void texture_loader_cancel(texture *obj)
+{
+  pthread_mutex_lock(&lock);
+  cancel(obj);
+  pthread_mutex_unlock(&lock);
+}
+
+
+/*******************************************************************************
+* Function  : textures_upload
+* Brief     : Upload decoded textures, oldest first, until a byte budget is 
+*             spent. One texture is uploaded whatever its size, so that large 
+*             ones still make progress. Call it once per frame.
+* Parameters:
+*    1. budget  : The number of bytes allowed to be uploaded by this call.
+* Returns   :
+*    cnt: The number of textures still being decoded or waiting for upload.
+*******************************************************************************/
+unsigned int textures_upload(size_t budget)
+{
+  texture_job  *job;
+  texture      *obj;
+  size_t        size;
+  size_t        spent = 0;
+  unsigned int  cnt   = 0;
+
+  while (spent < budget)
+  {
+    pthread_mutex_lock(&lock);
+    job = pop(&upload_queue);
+    pthread_mutex_unlock(&lock);
+    if (!job)
+      break;
+
+    //
+    // A texture that failed to decode keeps its previous image, if any.
+    //
+    if (NULL != (obj = job->target) && !job->pixels && !job->levels.count)
+    {
+      printf("Error, failed to load texture '%s'\n", job->path);
+      if (obj->status == TEXTURE_PENDING)
+        obj->status = TEXTURE_FAILED;
+    }
+
+    else if (obj && (size = upload(job)))
+    {
+      obj->width           = job->width;
+      obj->height          = job->height;
+      obj->number_channels = job->channels;
+      obj->lod             = job->lod;
+      obj->status          = TEXTURE_READY;
+      spent               += size;
+    }
+
+    else if (obj)
+      obj->status = TEXTURE_FAILED;
+
+    free_job(job);
+  }
+
+  //
+  // Mipmaps of an array are generated once for every image written to it.
+  //
+  texture_arrays_mipmap();
+
+  pthread_mutex_lock(&lock);
+  for (job = decode_queue.head; job; job = job->next)
+    cnt++;
+  for (job = upload_queue.head; job; job = job->next)
+    cnt++;
+  for (unsigned int i = 0; i < TAWY_TEXTURE_THREADS; i++)
+    cnt += (decoding[i] != NULL);
+  pthread_mutex_unlock(&lock);
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : texture_loader_stop
+* Brief     : Cancel queued work, join worker threads and release pixel 
+*             buffers. The loader restarts on next submit.
+*******************************************************************************/
+void texture_loader_stop(void)
+{
+  texture_job *job;
+
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  while (worker_cnt)
+    pthread_join(workers[--worker_cnt], NULL);
+
+  while ((job = pop(&decode_queue)) || (job = pop(&upload_queue)))
+    free_job(job);
+
+  if (pbos_created)
+    glDeleteBuffers(TAWY_TEXTURE_PBO_RING, pbos);
+  pbos_created = false;
+}
@@ -0,0 +1,954 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: virtual_texture.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module manages virtual textures, far larger than video memory.
+*           Only the pages a low resolution feedback pass sees are loaded, by
+*           worker threads, into a physical cache of fixed size shared by
+*           every virtual texture.
+*******************************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "texture_array.h"
+#include "virtual_texture.h"
+
+#define CACHE_SIZE  (TAWY_VIRTUAL_CACHE_PAGES * TAWY_VTEX_SLOT)
+#define SLOT_COUNT  (TAWY_VIRTUAL_CACHE_PAGES * TAWY_VIRTUAL_CACHE_PAGES)
+#define SLOT_BYTES  ((size_t) TAWY_VTEX_SLOT * TAWY_VTEX_SLOT * 4)
+
+
+//
+// What the slot of a page holds while it is not resident. Pages requested by
+// the feedback being read hold PAGE_REQUESTED minus their request index.
+//
+typedef enum
+{
+  PAGE_ABSENT    = -1,
+  PAGE_LOADING   = -2,
+  PAGE_FAILED    = -3,  // Never requested again.
+  PAGE_REQUESTED = -4,
+} page_state;
+
+
+typedef enum
+{
+  JOB_FREE,
+  JOB_QUEUED,
+  JOB_READING,
+  JOB_READ,
+  JOB_FAILED,
+} job_state;
+
+
+/*******************************************************************************
+* Struct    : page_slot
+* Brief     : A slot of the physical cache.
+* Attributes:
+*    1. owner   : The virtual texture of the page it holds, NULL if free.
+*    2. page    : The page it holds.
+*    3. seen    : The last frame a feedback showed the page, or its children.
+*    4. pinned  : True for the coarsest page of each texture, the fallback of
+*                 every other, never evicted.
+*******************************************************************************/
+typedef struct page_slot
+{
+  virtual_texture *owner;
+  unsigned int     page;
+  unsigned long    seen;
+  bool             pinned;
+}page_slot;
+
+
+/*******************************************************************************
+* Struct    : page_job
+* Brief     : A page read by a worker. Jobs are a fixed pool, which bounds the
+*             reads in flight.
+* Attributes:
+*    1. state   : Where the job is.
+*    2. target  : The virtual texture, NULL once deleted.
+*    3. fd      : Its file, for the worker.
+*    4. page    : The page to read.
+*    5. priority: Workers take the highest first.
+*    6. texels  : Receives the page, border included.
+*******************************************************************************/
+typedef struct page_job
+{
+  job_state        state;
+  virtual_texture *target;
+  int              fd;
+  unsigned int     page;
+  unsigned int     priority;
+  unsigned char   *texels;
+}page_job;
+
+
+/*******************************************************************************
+* Struct    : page_request
+* Brief     : A missing page seen by the feedback being read.
+*******************************************************************************/
+typedef struct page_request
+{
+  virtual_texture *target;
+  unsigned int     page;
+  int              level;
+  unsigned int     hits;
+}page_request;
+
+
+/*******************************************************************************
+* Struct    : feedback_readback
+* Brief     : A feedback being copied to a pixel buffer, until its fence.
+*******************************************************************************/
+typedef struct feedback_readback
+{
+  unsigned int pbo;
+  GLsync       fence;
+  int          width;
+  int          height;
+}feedback_readback;
+
+
+static pthread_mutex_t    lock          = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     wake          = PTHREAD_COND_INITIALIZER;  // Jobs queued, or stopping.
+static pthread_cond_t     read_done     = PTHREAD_COND_INITIALIZER;  // A worker finished a read.
+static page_job           jobs[TAWY_VIRTUAL_JOBS];
+static pthread_t          workers[TAWY_VIRTUAL_THREADS];
+static unsigned int       worker_cnt    = 0;
+static bool               stopping      = false;
+
+static virtual_texture   *registered[TAWY_VIRTUAL_TEXTURES + 1];     // By index, from 1.
+static unsigned int       pages_id      = 0;                         // The physical cache.
+static page_slot          slots[SLOT_COUNT];
+static unsigned long      frame_cnt     = 0;
+
+static page_request      *requests      = NULL;
+static unsigned int       request_cnt   = 0;
+static unsigned int       request_cap   = 0;
+
+static unsigned int       feedback_fbo  = 0;
+static unsigned int       feedback_rbos[2];                          // Pages, depth.
+static int                feedback_size[2];
+static int                viewport[4];                               // Restored after the feedback.
+static feedback_readback  readbacks[TAWY_VIRTUAL_FEEDBACK_RING];
+static unsigned int       readback_next = 0;
+
+
+/*******************************************************************************
+* Function  : level_pages
+* Brief     : The number of pages per side of a level.
+*******************************************************************************/
+static unsigned int level_pages(const virtual_texture *obj, int level)
+{
+  return (obj->size / TAWY_VTEX_PAGE) >> level;
+}
+
+
+/*******************************************************************************
+* Function  : work
+* Brief     : A worker thread. It reads the queued page of highest priority,
+*             until stopped.
+* Returns   :
+*    NULL : Unconditional
+*******************************************************************************/
+static void *work(void *arg)
+{
+  page_job *job;
+  ssize_t   size;
+
+  (void) arg;
+  pthread_mutex_lock(&lock);
+  while (true)
+  {
+    job = NULL;
+    for (unsigned int i = 0; !stopping && i < TAWY_VIRTUAL_JOBS; i++)
+    {
+      if (jobs[i].state == JOB_QUEUED && (!job || jobs[i].priority > job->priority))
+        job = &jobs[i];
+    }
+
+    if (stopping)
+      break;
+    if (!job)
+    {
+      pthread_cond_wait(&wake, &lock);
+      continue;
+    }
+
+    //
+    // Pages follow each other in the file, in the order of their index.
+    //
+    job->state = JOB_READING;
+    pthread_mutex_unlock(&lock);
+    size = pread(job->fd, job->texels, SLOT_BYTES, sizeof(vtex_header) + job->page * SLOT_BYTES);
+    pthread_mutex_lock(&lock);
+
+    if (!job->target)
+      job->state = JOB_FREE;
+    else
+      job->state = size == (ssize_t) SLOT_BYTES? JOB_READ : JOB_FAILED;
+    pthread_cond_broadcast(&read_done);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : start
+* Brief     : Allocate the physical cache and the page buffers, and start the
+*             workers, on first use.
+* Returns   :
+*    true : The cache is allocated and at least one worker is running.
+*    false: Memory could not be allocated, or no thread could be started.
+*******************************************************************************/
+static bool start(void)
+{
+  int max = 0;
+
+  if (worker_cnt)
+    return true;
+
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max);
+  if (max < CACHE_SIZE)
+  {
+    printf("Error, virtual texture cache needs %d texels, the driver allows %d\n", CACHE_SIZE, max);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_JOBS; i++)
+  {
+    if (!jobs[i].texels && NULL == (jobs[i].texels = malloc(SLOT_BYTES)))
+    {
+      printf("Error, failed to allocate virtual texture pages\n");
+      return false;
+    }
+  }
+
+  //
+  // The cache has a single level: borders filter across pages, and every
+  // level of the texture has pages of its own.
+  //
+  glGenTextures(1, &pages_id);
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glBindTexture(GL_TEXTURE_2D, pages_id);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, CACHE_SIZE, CACHE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  memset(slots, 0, sizeof(slots));
+
+  stopping = false;
+  while (worker_cnt < TAWY_VIRTUAL_THREADS && !pthread_create(&workers[worker_cnt], NULL, work, NULL))
+    worker_cnt++;
+
+  if (!worker_cnt)
+    printf("Error, failed to start virtual texture workers\n");
+  return worker_cnt > 0;
+}
+
+
+/*******************************************************************************
+* Function  : change
+* Brief     : Record a page resident or evicted, for the table to remap the 
+*             texels it covers.
+*******************************************************************************/
+static void change(virtual_texture *obj, unsigned int page)
+{
+  if (obj->change_cnt < TAWY_VIRTUAL_CHANGES)
+    obj->changed[obj->change_cnt] = page;
+  if (obj->change_cnt <= TAWY_VIRTUAL_CHANGES)
+    obj->change_cnt++;
+}
+
+
+/*******************************************************************************
+* Function  : upload
+* Brief     : Write a page in a slot of the physical cache, replacing the page
+*             seen least recently. Pages seen by the last feedback stay: it
+*             stamped them before frame_cnt moved on. Pinned pages replace any
+*             other but pinned ones, there are fewer textures than slots.
+* Parameters:
+*    1. obj     : The virtual texture.
+*    2. page    : The page.
+*    3. texels  : Its texels, border included.
+*    4. pinned  : True to never evict it.
+* Returns   :
+*    slot: The slot it is written in.
+*    -1  : Every slot holds a page still in sight.
+*******************************************************************************/
+static int upload(virtual_texture *obj, unsigned int page, const unsigned char *texels, bool pinned)
+{
+  int slot = -1;
+
+  for (int i = 0; i < SLOT_COUNT; i++)
+  {
+    if (!slots[i].owner)
+    {
+      slot = i;
+      break;
+    }
+    if (!slots[i].pinned && (pinned || slots[i].seen + 1 < frame_cnt) && (slot < 0 || slots[i].seen < slots[slot].seen))
+      slot = i;
+  }
+
+  if (slot < 0)
+    return -1;
+
+  if (slots[slot].owner)
+  {
+    slots[slot].owner->slots[slots[slot].page] = PAGE_ABSENT;
+    change(slots[slot].owner, slots[slot].page);
+  }
+
+  slots[slot].owner  = obj;
+  slots[slot].page   = page;
+  slots[slot].seen   = frame_cnt;
+  slots[slot].pinned = pinned;
+  obj->slots[page]   = slot;
+  change(obj, page);
+
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glBindTexture(GL_TEXTURE_2D, pages_id);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, slot % TAWY_VIRTUAL_CACHE_PAGES * TAWY_VTEX_SLOT,
+                  slot / TAWY_VIRTUAL_CACHE_PAGES * TAWY_VTEX_SLOT, TAWY_VTEX_SLOT, TAWY_VTEX_SLOT,
+                  GL_RGBA, GL_UNSIGNED_BYTE, texels);
+  return slot;
+}
+
+
+/*******************************************************************************
+* Function  : remap
+* Brief     : Map the pages a page covers, itself included, to the finest 
+*             resident page covering them, its level first so that missing 
+*             pages inherit the entry of their parent, and upload them.
+* Parameters:
+*    1. obj     : The virtual texture.
+*    2. page    : The page.
+*******************************************************************************/
+static void remap(virtual_texture *obj, unsigned int page)
+{
+  unsigned char *entry;
+  unsigned int   pages;
+  unsigned int   x, y, cnt = 1;
+  int            level = obj->levels - 1;
+  int            slot;
+
+  while (level > 0 && page < obj->first[level])
+    level--;
+
+  pages = level_pages(obj, level);
+  x     = (page - obj->first[level]) % pages;
+  y     = (page - obj->first[level]) / pages;
+
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glBindTexture(GL_TEXTURE_2D, obj->id);
+  for (int l = level; l >= 0; l--, x *= 2, y *= 2, cnt *= 2)
+  {
+    pages = level_pages(obj, l);
+    for (unsigned int py = y; py < y + cnt; py++)
+    {
+      for (unsigned int px = x; px < x + cnt; px++)
+      {
+        page  = obj->first[l] + py * pages + px;
+        entry = obj->table + 4 * page;
+        if ((slot = obj->slots[page]) >= 0)
+        {
+          entry[0] = slot % TAWY_VIRTUAL_CACHE_PAGES;
+          entry[1] = slot / TAWY_VIRTUAL_CACHE_PAGES;
+          entry[2] = l;
+          entry[3] = 0;
+        }
+        else
+          memcpy(entry, obj->table + 4 * (obj->first[l + 1] + (py / 2) * (pages / 2) + px / 2), 4);
+      }
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pages);
+    glTexSubImage2D(GL_TEXTURE_2D, l, x, y, cnt, cnt, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                    obj->table + 4 * (obj->first[l] + y * pages + x));
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+
+/*******************************************************************************
+* Function  : build_table
+* Brief     : Remap the pages changed since the table was last uploaded, or
+*             every page from the coarsest, which covers them all, if they 
+*             were too many.
+* Parameters:
+*    1. obj     : The virtual texture.
+*******************************************************************************/
+static void build_table(virtual_texture *obj)
+{
+  if (obj->change_cnt > TAWY_VIRTUAL_CHANGES)
+    remap(obj, obj->first[obj->levels - 1]);
+  else
+  {
+    for (unsigned int i = 0; i < obj->change_cnt; i++)
+      remap(obj, obj->changed[i]);
+  }
+  obj->change_cnt = 0;
+}
+
+
+/*******************************************************************************
+* Function  : request
+* Brief     : Record a page a feedback texel shows, and its parents, which
+*             stand for it until it is loaded. Resident ones are kept from
+*             eviction, missing ones are requested.
+* Parameters:
+*    1. obj     : The virtual texture.
+*    2. level   : The level of the page.
+*    3. x, y    : The page in its level.
+*******************************************************************************/
+static void request(virtual_texture *obj, int level, unsigned int x, unsigned int y)
+{
+  page_request *grown;
+  unsigned int  page;
+  int           state;
+
+  for (; level < obj->levels; level++, x /= 2, y /= 2)
+  {
+    page  = obj->first[level] + y * level_pages(obj, level) + x;
+    state = obj->slots[page];
+
+    if (state >= 0)
+      slots[state].seen = frame_cnt;
+
+    else if (state <= PAGE_REQUESTED)
+      requests[PAGE_REQUESTED - state].hits++;
+
+    else if (state == PAGE_ABSENT)
+    {
+      if (request_cnt == request_cap)
+      {
+        if (NULL == (grown = realloc(requests, (request_cap + 256) * sizeof(page_request))))
+          return;
+        requests     = grown;
+        request_cap += 256;
+      }
+
+      requests[request_cnt] = (page_request) {obj, page, level, 1};
+      obj->slots[page]      = PAGE_REQUESTED - (int) request_cnt++;
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : request_order
+* Brief     : qsort comparator putting coarse pages first, they stand for more
+*             of the texture, then the pages most seen.
+*******************************************************************************/
+static int request_order(const void *a, const void *b)
+{
+  const page_request *ra = a;
+  const page_request *rb = b;
+
+  if (ra->level != rb->level)
+    return ra->level > rb->level? -1 : 1;
+  if (ra->hits != rb->hits)
+    return ra->hits > rb->hits? -1 : 1;
+  return 0;
+}
+
+
+/*******************************************************************************
+* Function  : read_feedback
+* Brief     : Read the oldest feedback the GPU has copied, if any, and queue
+*             the reads of the pages it shows missing, as many as there are
+*             free jobs.
+* Returns   :
+*    true : A feedback has been read.
+*    false: None is ready yet.
+*******************************************************************************/
+static bool read_feedback(void)
+{
+  feedback_readback  *rb = NULL;
+  const uint16_t     *texels;
+  virtual_texture    *obj;
+  unsigned int        job = 0;
+  GLenum              ret;
+
+  //
+  // 1. The oldest copy, only once its fence has passed: mapping it earlier
+  //    would wait for the GPU.
+  //
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_FEEDBACK_RING && !rb; i++)
+  {
+    if (readbacks[(readback_next + i) % TAWY_VIRTUAL_FEEDBACK_RING].fence)
+      rb = &readbacks[(readback_next + i) % TAWY_VIRTUAL_FEEDBACK_RING];
+  }
+
+  if (!rb)
+    return false;
+
+  ret = glClientWaitSync(rb->fence, 0, 0);
+  if (ret != GL_ALREADY_SIGNALED && ret != GL_CONDITION_SATISFIED)
+    return false;
+
+  glDeleteSync(rb->fence);
+  rb->fence = NULL;
+
+  //
+  // 2. Each texel names a page: x, y, level, and the texture index, 0 where
+  //    no virtual texture was drawn.
+  //
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+  texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t) rb->width * rb->height * 8, GL_MAP_READ_BIT);
+  request_cnt = 0;
+
+  for (int i = 0; texels && i < rb->width * rb->height; i++, texels += 4)
+  {
+    if (!texels[3] || texels[3] > TAWY_VIRTUAL_TEXTURES || NULL == (obj = registered[texels[3]]) ||
+        texels[2] >= obj->levels || texels[0] >= level_pages(obj, texels[2]) || texels[1] >= level_pages(obj, texels[2]))
+      continue;
+
+    request(obj, texels[2], texels[0], texels[1]);
+  }
+
+  if (texels)
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  //
+  // 3. Queue the most wanted. Others are requested again by next feedbacks.
+  //
+  qsort(requests, request_cnt, sizeof(page_request), request_order);
+
+  pthread_mutex_lock(&lock);
+  for (unsigned int i = 0; i < request_cnt; i++)
+  {
+    while (job < TAWY_VIRTUAL_JOBS && jobs[job].state != JOB_FREE)
+      job++;
+
+    if (job == TAWY_VIRTUAL_JOBS)
+    {
+      requests[i].target->slots[requests[i].page] = PAGE_ABSENT;
+      continue;
+    }
+
+    jobs[job].state    = JOB_QUEUED;
+    jobs[job].target   = requests[i].target;
+    jobs[job].fd       = requests[i].target->fd;
+    jobs[job].page     = requests[i].page;
+    jobs[job].priority = request_cnt - i;
+    requests[i].target->slots[requests[i].page] = PAGE_LOADING;
+  }
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : virtual_feedback_begin
+* Brief     : Render the next draws into the feedback buffer, at a fraction of
+*             the viewport. Draw the models with virtual textures there, with
+*             the FEATURE_FEEDBACK permutation of their program.
+* Parameters:
+*    1. frame   : The frame being drawn, enabled.
+*******************************************************************************/
+void virtual_feedback_begin(const frame *f)
+{
+  static const unsigned int none[4] = {0, 0, 0, 0};
+  static const float        far     = 1.0f;
+
+  int width  = ((int) f->constants.viewport[0] + TAWY_VIRTUAL_FEEDBACK_SCALE - 1) / TAWY_VIRTUAL_FEEDBACK_SCALE;
+  int height = ((int) f->constants.viewport[1] + TAWY_VIRTUAL_FEEDBACK_SCALE - 1) / TAWY_VIRTUAL_FEEDBACK_SCALE;
+
+  width  = width  > 0? width  : 1;
+  height = height > 0? height : 1;
+
+  //
+  // The buffer follows the size of the viewport. Pages are integers, 16 bits
+  // each: x, y, level and texture.
+  //
+  if (!feedback_fbo)
+  {
+    glGenFramebuffers(1, &feedback_fbo);
+    glGenRenderbuffers(2, feedback_rbos);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+  if (feedback_size[0] != width || feedback_size[1] != height)
+  {
+    glBindRenderbuffer(GL_RENDERBUFFER, feedback_rbos[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedback_rbos[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedback_rbos[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_rbos[1]);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      printf("Error, virtual texture feedback buffer is incomplete\n");
+    feedback_size[0] = width;
+    feedback_size[1] = height;
+  }
+
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glViewport(0, 0, width, height);
+  glClearBufferuiv(GL_COLOR, 0, none);
+  glClearBufferfv(GL_DEPTH, 0, &far);
+}
+
+
+/*******************************************************************************
+* Function  : virtual_feedback_end
+* Brief     : Start reading the feedback buffer back, without waiting for it,
+*             and render to the window again.
+*******************************************************************************/
+void virtual_feedback_end(void)
+{
+  feedback_readback *rb = &readbacks[readback_next];
+
+  //
+  // A copy the GPU has not finished yet is not replaced: this feedback is
+  // dropped instead, the GPU is behind anyway.
+  //
+  if (!rb->fence)
+  {
+    if (!rb->pbo)
+      glGenBuffers(1, &rb->pbo);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+    if (rb->width != feedback_size[0] || rb->height != feedback_size[1])
+    {
+      glBufferData(GL_PIXEL_PACK_BUFFER, (size_t) feedback_size[0] * feedback_size[1] * 8, NULL, GL_STREAM_READ);
+      rb->width  = feedback_size[0];
+      rb->height = feedback_size[1];
+    }
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, rb->width, rb->height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb->fence     = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback_next = (readback_next + 1) % TAWY_VIRTUAL_FEEDBACK_RING;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+
+/*******************************************************************************
+* Function  : virtual_textures_update
+* Brief     : Read the oldest feedback the GPU has finished, request the pages
+*             it shows missing, coarsest first, and upload the pages workers
+*             have read, replacing the least recently seen ones. Call it once
+*             per frame, from the GL thread.
+* Returns   :
+*    cnt: The number of pages uploaded by this call.
+*******************************************************************************/
+unsigned int virtual_textures_update(void)
+{
+  page_job     *job;
+  unsigned int  cnt = 0;
+
+  if (!worker_cnt)
+    return 0;
+
+  if (read_feedback())
+    frame_cnt++;
+
+  //
+  // Read pages are left alone by workers, they are uploaded without the lock.
+  //
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_JOBS && cnt < TAWY_VIRTUAL_UPLOADS; i++)
+  {
+    job = &jobs[i];
+    pthread_mutex_lock(&lock);
+    if (job->state != JOB_READ && job->state != JOB_FAILED)
+    {
+      pthread_mutex_unlock(&lock);
+      continue;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (job->state == JOB_FAILED)
+    {
+      printf("Error, failed to read page %u of '%s'\n", job->page, job->target->path);
+      job->target->slots[job->page] = PAGE_FAILED;
+    }
+    else if (upload(job->target, job->page, job->texels, false) >= 0)
+      cnt++;
+    else
+      job->target->slots[job->page] = PAGE_ABSENT;
+
+    pthread_mutex_lock(&lock);
+    job->state = JOB_FREE;
+    pthread_mutex_unlock(&lock);
+  }
+
+  for (unsigned int i = 1; i <= TAWY_VIRTUAL_TEXTURES; i++)
+  {
+    if (registered[i] && registered[i]->change_cnt)
+      build_table(registered[i]);
+  }
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : virtual_textures_clear
+* Brief     : Stop the workers, and delete the physical cache and the feedback
+*             buffers. Virtual textures must be deleted first.
+*******************************************************************************/
+void virtual_textures_clear(void)
+{
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  while (worker_cnt)
+    pthread_join(workers[--worker_cnt], NULL);
+
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_JOBS; i++)
+  {
+    free(jobs[i].texels);
+    memset(&jobs[i], 0, sizeof(page_job));
+  }
+
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_FEEDBACK_RING; i++)
+  {
+    if (readbacks[i].fence)
+      glDeleteSync(readbacks[i].fence);
+    glDeleteBuffers(1, &readbacks[i].pbo);
+    memset(&readbacks[i], 0, sizeof(feedback_readback));
+  }
+
+  if (feedback_fbo)
+  {
+    glDeleteFramebuffers(1, &feedback_fbo);
+    glDeleteRenderbuffers(2, feedback_rbos);
+  }
+  feedback_fbo     = 0;
+  feedback_size[0] = 0;
+  feedback_size[1] = 0;
+
+  texture_units_forget(pages_id);
+  glDeleteTextures(1, &pages_id);
+  pages_id = 0;
+
+  free(requests);
+  requests    = NULL;
+  request_cap = 0;
+}
+
+
+/*******************************************************************************
+* Function  : VirtualTexture__init__
+* Brief     : The object initializer, called by new()
+* Parameters:
+*    1. self    : The instance of the virtual texture.
+*    2. dir     : The directory the file is relative to.
+*    3. file    : The tiled file, written by the vtex tool.
+* Returns   :
+*    true : The texture is created, its coarsest page resident.
+*    false: The file is missing or invalid, or every index is taken.
+*******************************************************************************/
+static bool VirtualTexture__init__(void *self, va_list *args)
+{
+  virtual_texture *obj  = self;
+  const char      *dir  = va_arg(*args, const char *);
+  const char      *file = va_arg(*args, const char *);
+  vtex_header      header;
+  unsigned char   *texels;
+  unsigned int     pages;
+
+  memset((char *) obj + sizeof(obj->__cls__), 0, sizeof(virtual_texture) - sizeof(obj->__cls__));
+  snprintf(obj->path, TAWY_TEXTURE_PATH_LEN, "%s%s", file[0] == '/'? "" : dir, file);
+
+  //
+  // 1. A free index for the feedback, and a valid file.
+  //
+  for (obj->index = 1; obj->index <= TAWY_VIRTUAL_TEXTURES && registered[obj->index]; obj->index++);
+
+  if (obj->index > TAWY_VIRTUAL_TEXTURES || !start() ||
+      (obj->fd = open(obj->path, O_RDONLY)) < 0)
+  {
+    printf("Error, failed to open virtual texture '%s'\n", obj->path);
+    return false;
+  }
+
+  if (pread(obj->fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != TAWY_VTEX_MAGIC ||
+      header.page != TAWY_VTEX_PAGE || header.border != TAWY_VTEX_BORDER || header.size < TAWY_VTEX_PAGE ||
+      (header.size & (header.size - 1)) || !header.levels || header.levels > TAWY_VTEX_LEVELS ||
+      (header.size / TAWY_VTEX_PAGE) >> (header.levels - 1) != 1)
+  {
+    printf("Error, '%s' is not a virtual texture\n", obj->path);
+    close(obj->fd);
+    return false;
+  }
+
+  obj->size   = header.size;
+  obj->levels = header.levels;
+  for (int l = 0; l < obj->levels; l++)
+  {
+    pages             = level_pages(obj, l);
+    obj->first[l + 1] = obj->first[l] + pages * pages;
+  }
+
+  //
+  // 2. Every page absent, and an indirection texel for each of them.
+  //
+  if (NULL == (obj->slots = malloc(obj->first[obj->levels] * sizeof(int))) ||
+      NULL == (obj->table = malloc(obj->first[obj->levels] * 4)) ||
+      NULL == (texels = malloc(SLOT_BYTES)))
+  {
+    printf("Error, failed to allocate virtual texture '%s'\n", obj->path);
+    free(obj->slots);
+    free(obj->table);
+    close(obj->fd);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < obj->first[obj->levels]; i++)
+    obj->slots[i] = PAGE_ABSENT;
+
+  glGenTextures(1, &obj->id);
+  glActiveTexture(GL_TEXTURE0 + TAWY_TEXTURE_UPLOAD_UNIT);
+  glBindTexture(GL_TEXTURE_2D, obj->id);
+  for (int l = 0; l < obj->levels; l++)
+  {
+    pages = level_pages(obj, l);
+    glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8UI, pages, pages, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, obj->levels - 1);
+
+  //
+  // 3. The coarsest page is read now, and pinned: every other page falls back
+  //    to it until loaded. Remapping it maps them all.
+  //
+  if (pread(obj->fd, texels, SLOT_BYTES, sizeof(vtex_header) + obj->first[obj->levels - 1] * SLOT_BYTES) != (ssize_t) SLOT_BYTES ||
+      upload(obj, obj->first[obj->levels - 1], texels, true) < 0)
+  {
+    printf("Error, failed to load the coarsest page of '%s'\n", obj->path);
+    free(texels);
+    free(obj->slots);
+    free(obj->table);
+    glDeleteTextures(1, &obj->id);
+    close(obj->fd);
+    return false;
+  }
+
+  free(texels);
+  registered[obj->index] = obj;
+  build_table(obj);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : VirtualTexture__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the virtual texture to delete.
+*******************************************************************************/
+static void VirtualTexture__del__(void *self)
+{
+  virtual_texture *obj = self;
+  bool             reading;
+
+  //
+  // Pages being read are waited for, their file is about to close.
+  //
+  pthread_mutex_lock(&lock);
+  for (unsigned int i = 0; i < TAWY_VIRTUAL_JOBS; i++)
+  {
+    if (jobs[i].target == obj)
+    {
+      jobs[i].target = NULL;
+      if (jobs[i].state != JOB_READING)
+        jobs[i].state = JOB_FREE;
+    }
+  }
+
+  do
+  {
+    reading = false;
+    for (unsigned int i = 0; i < TAWY_VIRTUAL_JOBS; i++)
+      reading |= jobs[i].state == JOB_READING && jobs[i].fd == obj->fd;
+    if (reading)
+      pthread_cond_wait(&read_done, &lock);
+  }while (reading);
+  pthread_mutex_unlock(&lock);
+
+  for (int i = 0; i < SLOT_COUNT; i++)
+  {
+    if (slots[i].owner == obj)
+      memset(&slots[i], 0, sizeof(page_slot));
+  }
+
+  registered[obj->index] = NULL;
+  texture_units_forget(obj->id);
+  glDeleteTextures(1, &obj->id);
+  close(obj->fd);
+  free(obj->slots);
+  free(obj->table);
+  free(self);
+}
+
+
+/*******************************************************************************
+* Function  : VirtualTexture__enable__
+* Brief     : Bind the physical cache and the indirection texture, and tell the
+*             draw the size, levels and index of the texture through the
+*             attribute of its diffuse rect.
+* Parameters:
+*    1. self    : The instance of the virtual texture.
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool VirtualTexture__enable__(void *self)
+{
+  virtual_texture *obj = self;
+
+  texture_units_bind(TAWY_VIRTUAL_UNIT_PAGES, GL_TEXTURE_2D, pages_id);
+  texture_units_bind(TAWY_VIRTUAL_UNIT_INDIRECTION, GL_TEXTURE_2D, obj->id);
+
+  glVertexAttrib4f(TAWY_ATTRIB_DIFFUSE_RECT, obj->size, obj->levels, obj->index, 0.0f);
+  return true;
+}
+
+
+/*******************************************************************************
+* Class     : _VirtualTexture
+* Brief     : The class definition and its handlers
+*******************************************************************************/
+static const class _VirtualTexture = {
+  .size             = sizeof(virtual_texture),
+  .__init__         = VirtualTexture__init__,
+  .__del__          = VirtualTexture__del__,
+  .__get__          = NULL,
+  .__set__          = NULL,
+  .__should_close__ = NULL,
+  .__prepare__      = NULL,
+  .__enable__       = VirtualTexture__enable__,
+  .__reload__       = NULL,
+};
+
+
+/*******************************************************************************
+* Class     : VirtualTexture
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+const void *VirtualTexture = &_VirtualTexture;
@@ -246,7 +246,8 @@ static const class _Window = {
   .__set__          = NULL,
   .__should_close__ = Window__should_close__,
   .__prepare__      = Window__prepare__,
-  .__enable__       = Window__enable__
+  .__enable__       = Window__enable__,
+  .__reload__       = NULL
 };
 
 
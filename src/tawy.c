@@ -8,64 +8,137 @@
 #include <stdio.h>
 #include <cglm/cglm.h>
 
+#include "frame.h"
 #include "model.h"
 #include "program.h"
+#include "shader.h"
+#include "texture.h"
+#include "texture_array.h"
+#include "texture_loader.h"
+#include "virtual_texture.h"
+#include "watcher.h"
 #include "window.h"
 
 
 int main(void)
 {
   window *win = new(Window, 800, 600, "tawy");  // The windows creates context. It must come first!
-  model *m    = new(AssimpModel, "cube.obj", "container.jpg", "awesomeface.png", NULL);
+  model *m    = new(model_class("cube.obj"), "cube.obj", "container.jpg", "awesomeface.png", NULL);
   //model *m    = new(Model, "container.jpg", "awesomeface.png", NULL);
-  program *p  = new(Program, "vertex_shader.glsl", "fragment_shader.glsl");
+  frame   *f  = new(Frame, win);
 
-  if (!p)
+  if (!m || !f)
   {
-    delete(m, win, NULL);
+    delete(win, NULL);
+    return 1;
+  }
+
+  //
+  // The cheapest program serving the material of our model. Every program is
+  // submitted up front, then warmed up before the first visible frame.
+  //
+  program_async(true);
+  program *p  = permutation("vertex_shader.glsl", "fragment_shader.glsl", m->features);
+  program *fb = NULL;
+
+  //
+  // A model with a virtual texture is drawn once more, small, to tell which
+  // of its pages are seen.
+  //
+  if (m->virtual)
+    fb = permutation("vertex_shader.glsl", "fragment_shader.glsl", m->features | FEATURE_FEEDBACK);
+
+  if (!p || (m->virtual && !fb) || !program_warm_up(p, fb, NULL))
+  {
+    permutations_clear();
+    delete(m, f, win, NULL);
     return 1;
   }
 
   printf("%s (%dx%d)\n", win->title, win->width, win->height);
 
-  //unsigned int x = 0;
+  program_stats stats = program_statistics(false);
+  printf("Program cache  : %lu hits, %lu misses, %.1f ms saved\n", stats.cache_hits, stats.cache_misses, stats.cache_saved * 1000.0);
 
-  enable(p, NULL);
-  
-  char buf[64];
-  for (unsigned int i = 0; i < m->texture_cnt; i++)
-  {
-    snprintf(buf, 64, "texture%d", i + 1);
-    set(p, buf, &i, UNIFORM_INT);
-  }
+  //unsigned int x = 0;
 
+  //
+  // Uniforms are resolved once. Samplers are already bound to their texture
+  // unit by the program itself.
+  //
+  int model_uniform    = program_uniform(p, "model");
+  int feedback_uniform = fb? program_uniform(fb, "model") : -1;
+
+  //
+  // Assets are reloaded between frames when saved. Running without it is fine.
+  //
+  watcher *w  = new(Watcher, TAWY_GLSL_DIR, TAWY_TEXTURE_DIR, TAWY_MODEL_DIR, NULL);
+  watch(w, p, m, fb, NULL);
+
+  //
+  // The level of detail the entity was drawn with, so that it changes level
+  // with hysteresis. Entities sharing the model each draw their own.
+  //
+  unsigned int lod = 0;
 
   while (!should_close(win))
   {
     prepare(win);
-    enable(p, NULL);
-
-    mat4 projection;
-    glm_mat4_identity(projection);
-    //glm_perspective(glm_rad(45.0f), win->width / win->height, 0.1f, 100.0f, projection);
-    set(p, "projection", &projection, UNIFORM_MAT4);
-
-    mat4 view;
-    glm_mat4_identity(view);
-    set(p, "view", &view, UNIFORM_MAT4);
+    prepare(w);
+
+    //
+    // Textures decoded by workers are uploaded a few at a time, the model is
+    // drawn with placeholders until then. Textures load the levels last frame
+    // showed, and those unused for a while make room when arrays exceed the 
+    // budget. Virtual textures load the pages their feedback showed.
+    //
+    textures_upload(TAWY_TEXTURE_UPLOAD_BUDGET);
+    textures_stream();
+    textures_evict();
+    virtual_textures_update();
+
+    //
+    // Camera constants are uploaded once per frame, for every program.
+    //
+    glm_mat4_identity(f->constants.projection);
+    //glm_perspective(glm_rad(45.0f), win->width / win->height, 0.1f, 100.0f, f->constants.projection);
+    glm_mat4_identity(f->constants.view);
+    enable(f, p, NULL);
 
     mat4 model;
     glm_mat4_identity(model);
     //glm_translate(model, (vec3){0.5f, 0.0f, 0.0f});
     glm_rotate(model, 50.0f, (vec3){0.5f, 1.0f, 0.0f});
-    set(p, "model", &model, UNIFORM_MAT4);
+    program_set(p, model_uniform, model);
+    model_stream(m, model, f);
+    model_lod(m, model, f, &lod);
+
+    if (fb)
+    {
+      virtual_feedback_begin(f);
+      enable(fb, NULL);
+      program_set(fb, feedback_uniform, model);
+      model_draw(m, lod);
+      virtual_feedback_end();
+      enable(p, NULL);
+    }
 
 
-    enable(m, win, NULL);
+    model_draw(m, lod);
+    enable(win, NULL);
 
     //set(p, "ourColor", &x, UNIFORM_VEC4);
   }
 
-  delete(m, p, win, NULL);
+  stats = program_statistics(false);
+  printf("Uniform uploads: %lu issued, %lu skipped\n", stats.uploads_issued, stats.uploads_skipped);
+  printf("Program binds  : %lu issued, %lu skipped\n", stats.binds_issued, stats.binds_skipped);
+  printf("Texture memory : %.1f MiB\n", texture_arrays_footprint() / (1024.0 * 1024.0));
+
+  delete(w, NULL);
+  permutations_clear();
+  delete(m, f, NULL);
+  virtual_textures_clear();
+  delete(win, NULL);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,1002 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: tawymesh.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes the baked mesh file: its vertices and indices
+*           already laid out as the GPU reads them, mapped and handed straight
+*           to OpenGL. It also imports .obj files, and any file assimp reads,
+*           into the same layout, for the tawymesh tool to bake, or for models
+*           not baked.
+*******************************************************************************/
+#include <fcntl.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "mesh.h"
+#include "tawymesh.h"
+#include "wavefront.h"
+
+
+//
+// A vertex as the optimizer welds it: every attribute in floats, the position
+// first.
+//
+typedef struct import_vertex
+{
+  float position[3];
+  float normal[3];
+  float texCoord[2];
+}import_vertex;
+
+
+/*******************************************************************************
+* Struct    : import_part
+* Brief     : A mesh of the file, as its reader gives it, becoming a submesh.
+* Attributes:
+*    1. vertices  : Its vertices, welded and reordered in place.
+*    2. indices   : Its triangles, rewritten in place.
+*    3. vertex_cnt: Its number of vertices.
+*    4. index_cnt : Its number of indices.
+*    5. material  : The index of its material in the file.
+*    6. normals   : True if its vertices have normals,
+*    7. texCoords : and texture coordinates. Else they are zeros.
+*******************************************************************************/
+typedef struct import_part
+{
+  import_vertex *vertices;
+  unsigned int  *indices;
+  unsigned int   vertex_cnt;
+  unsigned int   index_cnt;
+  unsigned int   material;
+  bool           normals;
+  bool           texCoords;
+}import_part;
+
+
+/*******************************************************************************
+* Struct    : import
+* Brief     : A mesh being imported, before it is laid out as the file.
+* Attributes:
+*    1. header   : Its header, offsets aside.
+*    2. submeshes: Its submesh table, level after level.
+*    3. textures : Its texture names.
+*    4. streams  : Its vertex streams.
+*    5. indices  : Its indices, 32 bits until laid out.
+*    6. positions: Its positions in floats, to bound it.
+*    7. options  : A combination of mesh_option.
+*******************************************************************************/
+typedef struct import
+{
+  tawymesh_header  header;
+  submesh         *submeshes;
+  char           (*textures)[TAWY_MESH_NAME_LEN];
+  unsigned char   *streams[TAWY_VERTEX_STREAMS];
+  unsigned int    *indices;
+  float           *positions;
+  unsigned int     options;
+}import;
+
+
+/*******************************************************************************
+* Function  : align
+* Brief     : Round an offset up to the alignment of blobs.
+*******************************************************************************/
+static unsigned long long align(unsigned long long offset)
+{
+  return (offset + TAWY_MESH_ALIGN - 1) & ~(unsigned long long) (TAWY_MESH_ALIGN - 1);
+}
+
+
+/*******************************************************************************
+* Function  : index_size
+* Brief     : The size of an index of a mesh, in bytes.
+*******************************************************************************/
+static size_t index_size(const tawymesh_header *header)
+{
+  return header->index_type == GL_UNSIGNED_SHORT? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+
+/*******************************************************************************
+* Function  : point
+* Brief     : Point the blobs of a mesh within its data.
+*******************************************************************************/
+static void point(tawymesh *mesh)
+{
+  const unsigned char *data = mesh->data;
+
+  mesh->header    = mesh->data;
+  mesh->submeshes = (const submesh *) (data + mesh->header->submeshes);
+  mesh->textures  = (const char (*)[TAWY_MESH_NAME_LEN]) (data + mesh->header->textures);
+  mesh->indices   = data + mesh->header->indices;
+  for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
+    mesh->streams[k] = data + mesh->header->streams[k];
+}
+
+
+/*******************************************************************************
+* Function  : within
+* Brief     : Tell whether a blob lies within the file.
+*******************************************************************************/
+static bool within(const tawymesh_header *header, unsigned long long offset, unsigned long long size)
+{
+  return offset >= sizeof(tawymesh_header) && offset <= header->size && size <= header->size - offset;
+}
+
+
+/*******************************************************************************
+* Function  : tawymesh_baked
+* Brief     : The baked file of a model file: its extension is replaced.
+* Parameters:
+*    1. file    : The model file.
+*    2. path    : Receives the baked file, TAWY_MESH_NAME_LEN bytes.
+* Returns   :
+*    true : The baked file exists, is newer than the model file, and opens
+*           with TAWY_MESH_MAGIC.
+*    false: It must be baked again.
+*******************************************************************************/
+bool tawymesh_baked(const char *file, char *path)
+{
+  const char   *dot   = strrchr(file, '.');
+  const char   *slash = strrchr(file, '/');
+  int           len   = (dot && (!slash || dot > slash))? (int) (dot - file) : (int) strlen(file);
+  struct stat   src;
+  struct stat   dst;
+  unsigned int  magic = 0;
+  int           fd;
+
+  //
+  // Seconds are compared, as for baked textures.
+  //
+  snprintf(path, TAWY_MESH_NAME_LEN, "%.*s" TAWY_MESH_EXTENSION, len, file);
+  if (stat(file, &src) || stat(path, &dst) || dst.st_mtime < src.st_mtime)
+    return false;
+
+  //
+  // A file baked by another version is stale too, however recent.
+  //
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return false;
+  if (read(fd, &magic, sizeof(magic)) != sizeof(magic))
+    magic = 0;
+  close(fd);
+  return magic == TAWY_MESH_MAGIC;
+}
+
+
+/*******************************************************************************
+* Function  : tawymesh_map
+* Brief     : Map a baked file, and check that its blobs lie within it and
+*             that its indices stay within their submesh.
+* Parameters:
+*    1. mesh    : Receives the mesh.
+*    2. file    : The baked file.
+* Returns   :
+*    true : The mesh is mapped. Release it with tawymesh_release().
+*    false: The file could not be mapped, or is not a baked mesh.
+*******************************************************************************/
+bool tawymesh_map(tawymesh *mesh, const char *file)
+{
+  const tawymesh_header  *h;
+  const vertex_attribute *a;
+  const submesh          *sub;
+  struct stat             st;
+  unsigned int            end;
+  unsigned int            n;
+  bool                    ret;
+  int                     fd;
+
+  memset(mesh, 0, sizeof(*mesh));
+  if ((fd = open(file, O_RDONLY)) < 0)
+    return false;
+
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(tawymesh_header) ||
+      MAP_FAILED == (mesh->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+  {
+    close(fd);
+    printf("Error, failed to map '%s'\n", file);
+    return false;
+  }
+  close(fd);
+
+  mesh->size   = st.st_size;
+  mesh->mapped = true;
+  h            = mesh->data;
+
+  //
+  // 1. The blobs lie within the file, and the attributes within their 
+  //    vertex.
+  //
+  ret = h->magic == TAWY_MESH_MAGIC && h->size == mesh->size &&
+        (h->index_type == GL_UNSIGNED_SHORT || h->index_type == GL_UNSIGNED_INT) &&
+        h->format.attribute_cnt <= TAWY_VERTEX_ATTRIBUTES && h->texture_cnt <= TAWY_MESH_TEXTURES &&
+        h->submesh_cnt >= 1 && h->lod_cnt >= 1 && h->lod_cnt <= TAWY_MESH_LODS &&
+        within(h, h->submeshes, (unsigned long long) h->submesh_cnt * h->lod_cnt * sizeof(submesh)) &&
+        within(h, h->textures, (unsigned long long) h->texture_cnt * TAWY_MESH_NAME_LEN) &&
+        within(h, h->indices, (unsigned long long) h->elements * index_size(h));
+
+  for (unsigned int k = 0; ret && k < TAWY_VERTEX_STREAMS; k++)
+    ret = within(h, h->streams[k], (unsigned long long) h->vertices * h->format.stride[k]);
+
+  for (unsigned int k = 0; ret && k < h->format.attribute_cnt; k++)
+  {
+    a   = &h->format.attribute[k];
+    ret = a->stream < TAWY_VERTEX_STREAMS && a->size >= 1 && a->size <= 4 &&
+          a->offset <= h->format.stride[a->stream] &&
+          vertex_attribute_bytes(a->type, a->size) <= h->format.stride[a->stream] - a->offset;
+  }
+
+  if (ret)
+    point(mesh);
+
+  //
+  // 2. Each submesh indexes its own vertices: those from its base vertex to
+  //    the base vertex of the next submesh of the first level, every level
+  //    sharing them.
+  //
+  for (unsigned int s = 0; ret && s < h->submesh_cnt * h->lod_cnt; s++)
+  {
+    sub  = &mesh->submeshes[s];
+    n    = s % h->submesh_cnt;
+    end  = n + 1 < h->submesh_cnt? (unsigned int) mesh->submeshes[n + 1].base_vertex : h->vertices;
+    ret  = sub->base_vertex == mesh->submeshes[n].base_vertex && sub->base_vertex >= 0 &&
+           (unsigned int) sub->base_vertex <= end && end <= h->vertices &&
+           sub->first_index <= h->elements && sub->count <= h->elements - sub->first_index;
+
+    for (unsigned int i = sub->first_index; ret && i < sub->first_index + sub->count; i++)
+    {
+      ret = (h->index_type == GL_UNSIGNED_SHORT? ((const unsigned short *) mesh->indices)[i] :
+                                                  ((const unsigned int *) mesh->indices)[i]) < end - sub->base_vertex;
+    }
+  }
+
+  if (!ret)
+  {
+    printf("Error, '%s' is not a baked mesh, or was baked by another version\n", file);
+    tawymesh_release(mesh);
+  }
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : triangles_of
+* Brief     : Count the triangles of an assimp mesh. Points and lines are left
+*             by triangulation, they are not drawn.
+* Parameters:
+*    1. mesh    : The assimp mesh.
+* Returns   :
+*    cnt: The number of its faces with 3 indices.
+*******************************************************************************/
+static unsigned int triangles_of(const struct aiMesh *mesh)
+{
+  unsigned int cnt = 0;
+
+  if (!mesh->mVertices)
+    return 0;
+
+  for (unsigned int t = 0; t < mesh->mNumFaces; t++)
+    cnt += mesh->mFaces[t].mNumIndices == 3;
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : gather
+* Brief     : Copy the vertices of an assimp mesh in floats, for the optimizer
+*             to weld and reorder. Attributes the mesh lacks are left to zero.
+* Parameters:
+*    1. vertices: Room for every vertex of the mesh.
+*    2. mesh    : The assimp mesh.
+*******************************************************************************/
+static void gather(import_vertex *vertices, const struct aiMesh *mesh)
+{
+  memset(vertices, 0, mesh->mNumVertices * sizeof(import_vertex));
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+  {
+    memcpy(vertices[i].position, &mesh->mVertices[i], 3 * sizeof(float));
+    if (mesh->mNormals)
+      memcpy(vertices[i].normal, &mesh->mNormals[i], 3 * sizeof(float));
+    if (mesh->mTextureCoords[0])
+      memcpy(vertices[i].texCoord, &mesh->mTextureCoords[0][i], 2 * sizeof(float));
+  }
+}
+
+
+/*******************************************************************************
+* Function  : to_streams
+* Brief     : Pack the vertices of a mesh in the streams, as the format lays
+*             them. Positions are brought in the box of the whole mesh first.
+* Parameters:
+*    1. header  : The header, its format and dequantization set.
+*    2. streams : The first vertex of the mesh in each stream.
+*    3. vertices: The vertices of the mesh.
+*    4. cnt     : Their number.
+*******************************************************************************/
+static void to_streams(const tawymesh_header *header, unsigned char **streams, const import_vertex *vertices, unsigned int cnt)
+{
+  const vertex_format    *fmt = &header->format;
+  const vertex_attribute *a;
+  const float            *src;
+  float                   position[3];
+  float                   inverse[3];
+
+  for (int c = 0; c < 3; c++)
+    inverse[c] = header->position_scale[c] > 0.0f? 1.0f / header->position_scale[c] : 0.0f;
+
+  for (unsigned int k = 0; k < fmt->attribute_cnt; k++)
+  {
+    a = &fmt->attribute[k];
+    for (unsigned int i = 0; i < cnt; i++)
+    {
+      if (a->location == TAWY_VERTEX_POSITION)
+      {
+        for (int c = 0; c < 3; c++)
+          position[c] = (vertices[i].position[c] - header->position_offset[c]) * inverse[c];
+        src = position;
+      }
+      else if (a->location == TAWY_VERTEX_NORMAL)
+        src = vertices[i].normal;
+      else
+        src = vertices[i].texCoord;
+
+      vertex_pack(a, src, streams[a->stream] + (size_t) i * fmt->stride[a->stream] + a->offset);
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : choose_format
+* Brief     : Lay the vertices of a mesh, compressed if asked to.
+*             Positions are then 16 bits within the box of the mesh, normals
+*             packed in 10 bits each, and texture coordinates 16 bits unsigned
+*             if they stay in [0, 1], half floats if they wrap.
+* Parameters:
+*    1. header  : The header, receiving the format and the dequantization.
+*    2. min     : The box of its positions,
+*    3. max     : both corners.
+*    4. normals : True if a mesh has normals.
+*    5. wrap    : True if texture coordinates leave [0, 1], false if they stay
+*                 in, or there are none.
+*    6. texCoords: True if a mesh has texture coordinates.
+*    7. compress: True to compress them, false to keep floats.
+*******************************************************************************/
+static void choose_format(tawymesh_header *header, const float *min, const float *max, bool normals, bool wrap, bool texCoords,
+                          bool compress)
+{
+  vertex_format *fmt = &header->format;
+
+  memset(fmt, 0, sizeof(*fmt));
+  for (int c = 0; c < 3; c++)
+  {
+    header->position_scale[c]  = 1.0f;
+    header->position_offset[c] = 0.0f;
+  }
+
+  if (!compress)
+  {
+    vertex_format_add(fmt, TAWY_VERTEX_POSITION, TAWY_STREAM_POSITIONS, 3, GL_FLOAT, false);
+    if (normals)
+      vertex_format_add(fmt, TAWY_VERTEX_NORMAL, TAWY_STREAM_SHADING, 3, GL_FLOAT, false);
+    if (texCoords)
+      vertex_format_add(fmt, TAWY_VERTEX_TEXCOORD, TAWY_STREAM_SHADING, 2, GL_FLOAT, false);
+    return;
+  }
+
+  for (int c = 0; c < 3; c++)
+  {
+    header->position_scale[c]  = max[c] - min[c];
+    header->position_offset[c] = min[c];
+  }
+
+  vertex_format_add(fmt, TAWY_VERTEX_POSITION, TAWY_STREAM_POSITIONS, 3, GL_UNSIGNED_SHORT, true);
+  if (normals)
+    vertex_format_add(fmt, TAWY_VERTEX_NORMAL, TAWY_STREAM_SHADING, 4, GL_INT_2_10_10_10_REV, true);
+  if (texCoords && wrap)
+    vertex_format_add(fmt, TAWY_VERTEX_TEXCOORD, TAWY_STREAM_SHADING, 2, GL_HALF_FLOAT, false);
+  else if (texCoords)
+    vertex_format_add(fmt, TAWY_VERTEX_TEXCOORD, TAWY_STREAM_SHADING, 2, GL_UNSIGNED_SHORT, true);
+}
+
+
+/*******************************************************************************
+* Function  : simplify_parts
+* Brief     : Simplify the meshes of a file, laid out, into its next levels of
+*             detail. Each level is simplified from the first, indexes its 
+*             vertices and follows the previous one in the index buffer and the
+*             submesh table.
+* Parameters:
+*    1. in      : The mesh being imported, its first level laid out.
+*    2. parts   : The meshes of the file, as laid out.
+*    3. cnt     : Their number.
+*    4. file    : The model file, for messages.
+* Returns   :
+*    true : The levels that simplify enough are added.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool simplify_parts(import *in, import_part *parts, unsigned int cnt, const char *file)
+{
+  tawymesh_header *h = &in->header;
+  import_part     *part;
+  submesh         *sub;
+  unsigned int    *indices;
+  submesh         *submeshes;
+  unsigned int     first    = h->elements;
+  unsigned int     previous = h->elements;
+  unsigned int     total;
+  unsigned int     target;
+  float            ratio    = 1.0f;
+  float            error;
+
+  h->lod_cnt      = 1;
+  h->lod_error[0] = 0.0f;
+  for (unsigned int l = 1; l < TAWY_MESH_LODS; l++)
+  {
+    //
+    // 1. A level has as many indices as the first one at most.
+    //
+    indices       = realloc(in->indices, ((size_t) h->elements + first) * sizeof(unsigned int));
+    in->indices   = indices? indices : in->indices;
+    submeshes     = realloc(in->submeshes, (size_t) (l + 1) * cnt * sizeof(submesh));
+    in->submeshes = submeshes? submeshes : in->submeshes;
+    if (!indices || !submeshes)
+      return false;
+
+    //
+    // 2. Simplify every mesh towards its share of the level.
+    //
+    ratio          *= TAWY_MESH_LOD_RATIO;
+    total           = 0;
+    h->lod_error[l] = 0.0f;
+    for (unsigned int n = 0; n < cnt; n++)
+    {
+      part             = &parts[n];
+      sub              = &in->submeshes[l * cnt + n];
+      *sub             = in->submeshes[n];
+      sub->first_index = h->elements + total;
+      target           = (unsigned int) (part->index_cnt * ratio) / 3 * 3;
+      sub->count       = mesh_simplify(&in->indices[sub->first_index], part->indices, part->index_cnt,
+                                       part->vertices[0].position, sizeof(import_vertex), part->vertex_cnt,
+                                       target, &error);
+      if (in->options & TAWY_MESH_OPTIMIZE)
+        mesh_optimize_cache(&in->indices[sub->first_index], sub->count, part->vertex_cnt);
+
+      h->lod_error[l] = error > h->lod_error[l]? error : h->lod_error[l];
+      total          += sub->count;
+    }
+
+    //
+    // 3. A level that barely simplifies ends the chain.
+    //
+    if (total > previous * TAWY_MESH_LOD_KEEP)
+      break;
+
+    if (in->options & TAWY_MESH_VERBOSE)
+      printf("Simplified %s: level %u, %u -> %u triangles, error %g\n", file, l, first / 3, total / 3,
+             h->lod_error[l]);
+    h->elements += total;
+    h->lod_cnt++;
+    previous     = total;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : import_meshes
+* Brief     : Import the meshes of a file, one after the other, and record
+*             where each lies in the submesh table. Indices stay relative to
+*             their mesh, its base vertex is added at draw. Meshes without
+*             normals or texture coordinates get zeros, so that attributes
+*             stay aligned. Levels of detail follow.
+* Parameters:
+*    1. in      : The mesh being imported.
+*    2. parts   : The meshes of the file, optimized in place.
+*    3. cnt     : Their number.
+*    4. file    : The model file, for messages.
+* Returns   :
+*    true : The meshes are imported.
+*    false: The file has no triangle, or memory is exhausted.
+*******************************************************************************/
+static bool import_meshes(import *in, import_part *parts, unsigned int cnt, const char *file)
+{
+  tawymesh_header *h = &in->header;
+  import_part     *part;
+  submesh         *sub;
+  unsigned char   *first[TAWY_VERTEX_STREAMS];
+  mesh_stats       before = {0};
+  mesh_stats       after  = {0};
+  float            min[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+  float            max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  const float     *p;
+  unsigned int     vertices = 0;
+  unsigned int     elements = 0;
+  unsigned int     largest  = 0;
+  bool             has_normals   = false;
+  bool             has_texCoords = false;
+  bool             wrap          = false;
+  bool             ret           = true;
+
+  //
+  // 1. Count the vertices and indices of every mesh, and find the ranges
+  //    its attributes span.
+  //
+  for (unsigned int n = 0; n < cnt; n++)
+  {
+    part           = &parts[n];
+    vertices      += part->vertex_cnt;
+    elements      += part->index_cnt;
+    has_normals   |= part->normals;
+    has_texCoords |= part->texCoords;
+
+    for (unsigned int i = 0; i < part->vertex_cnt; i++)
+    {
+      p = part->vertices[i].position;
+      for (int c = 0; c < 3; c++)
+      {
+        min[c] = p[c] < min[c]? p[c] : min[c];
+        max[c] = p[c] > max[c]? p[c] : max[c];
+      }
+
+      p     = part->vertices[i].texCoord;
+      wrap |= p[0] < 0.0f || p[0] > 1.0f || p[1] < 0.0f || p[1] > 1.0f;
+    }
+  }
+
+  if (!elements)
+  {
+    printf("Error, %s has no triangle\n", file);
+    return false;
+  }
+
+  //
+  // 2. Positions have their own stream, the attributes some mesh has are
+  //    interleaved in the shading stream.
+  //
+  choose_format(h, min, max, has_normals, wrap, has_texCoords, in->options & TAWY_MESH_COMPRESS);
+
+  in->positions = malloc((size_t) vertices * 3 * sizeof(float));
+  in->indices   = malloc((size_t) elements * sizeof(unsigned int));
+  in->submeshes = malloc(cnt * sizeof(submesh));
+  for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
+    ret &= !h->format.stride[k] || NULL != (in->streams[k] = calloc(vertices, h->format.stride[k]));
+
+  if (!ret || !in->positions || !in->indices || !in->submeshes)
+  {
+    printf("Error, not enough memory for %s\n", file);
+    return false;
+  }
+
+  //
+  // 3. Lay meshes one after the other. Identical vertices are welded,
+  //    triangles and vertices reordered for the vertex stage.
+  //
+  for (unsigned int n = 0; n < cnt; n++)
+  {
+    part = &parts[n];
+    if (in->options & TAWY_MESH_OPTIMIZE)
+      part->vertex_cnt = mesh_optimize(part->indices, part->index_cnt, part->vertices, part->vertex_cnt,
+                                       sizeof(import_vertex), &before, &after);
+
+    sub              = &in->submeshes[h->submesh_cnt++];
+    sub->base_vertex = (int) h->vertices;
+    sub->first_index = h->elements;
+    sub->count       = part->index_cnt;
+    sub->material    = part->material;
+    memcpy(&in->indices[h->elements], part->indices, (size_t) part->index_cnt * sizeof(unsigned int));
+
+    for (unsigned int i = 0; i < part->vertex_cnt; i++)
+      memcpy(&in->positions[(size_t) (h->vertices + i) * 3], part->vertices[i].position, 3 * sizeof(float));
+    for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
+      first[k] = in->streams[k] + (size_t) h->vertices * h->format.stride[k];
+    to_streams(h, first, part->vertices, part->vertex_cnt);
+
+    largest      = part->vertex_cnt > largest? part->vertex_cnt : largest;
+    h->vertices += part->vertex_cnt;
+    h->elements += part->index_cnt;
+  }
+
+  if ((in->options & TAWY_MESH_OPTIMIZE) && (in->options & TAWY_MESH_VERBOSE))
+    printf("Optimized %s: ACMR %.2f -> %.2f, ATVR %.2f -> %.2f\n", file,
+           mesh_acmr(&before), mesh_acmr(&after), mesh_atvr(&before), mesh_atvr(&after));
+
+  //
+  // 4. Levels of detail follow, simplified from the meshes as laid out.
+  //
+  if (!simplify_parts(in, parts, cnt, file))
+  {
+    printf("Error, not enough memory for %s\n", file);
+    return false;
+  }
+
+  //
+  // 5. Indices are relative to their submesh: 16 bits do if every submesh
+  //    is small enough.
+  //
+  mesh_bounds(h->bounds, in->positions, 3 * sizeof(float), h->vertices);
+  h->index_type = ((in->options & TAWY_MESH_COMPRESS) && largest <= 65536)? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : add_texture
+* Brief     : Record a texture a material names, once, up to
+*             TAWY_MESH_TEXTURES.
+* Parameters:
+*    1. in      : The mesh being imported.
+*    2. name    : The texture, relative to the model file.
+* Returns   :
+*    true : The name is recorded, or was already.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool add_texture(import *in, const char *name)
+{
+  unsigned int i;
+
+  if (!in->textures && NULL == (in->textures = calloc(TAWY_MESH_TEXTURES, TAWY_MESH_NAME_LEN)))
+    return false;
+
+  if (!name[0] || strlen(name) >= TAWY_MESH_NAME_LEN || in->header.texture_cnt == TAWY_MESH_TEXTURES)
+    return true;
+
+  for (i = 0; i < in->header.texture_cnt && strcmp(in->textures[i], name); i++);
+  if (i == in->header.texture_cnt)
+    strcpy(in->textures[in->header.texture_cnt++], name);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : assimp_parts
+* Brief     : Read a file with assimp: one part per mesh of the scene, and the
+*             diffuse textures its materials name. Embedded textures are named
+*             "*<index>", they have no file.
+* Parameters:
+*    1. in      : The mesh being imported, receiving its textures.
+*    2. parts   : Receives the meshes, one per assimp mesh with triangles.
+*    3. cnt     : Receives their number.
+*    4. file    : The model file.
+* Returns   :
+*    true : The file is read.
+*    false: Assimp failed, or memory is exhausted.
+*******************************************************************************/
+static bool assimp_parts(import *in, import_part **parts, unsigned int *cnt, const char *file)
+{
+  const struct aiScene    *scene;
+  const struct aiMesh     *mesh;
+  const struct aiFace     *face;
+  const struct aiMaterial *material;
+  struct aiString          name;
+  import_part             *part;
+  bool                     ret = true;
+
+  if (NULL == (scene = aiImportFile(file, aiProcess_Triangulate | aiProcess_FlipUVs)))
+  {
+    printf("Assimp error: %s\n", aiGetErrorString());
+    return false;
+  }
+
+  if (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode ||
+      NULL == (*parts = calloc(scene->mNumMeshes + 1, sizeof(import_part))))
+  {
+    printf("Assimp error: %s\n", aiGetErrorString());
+    aiReleaseImport(scene);
+    return false;
+  }
+
+  for (unsigned int n = 0; ret && n < scene->mNumMeshes; n++)
+  {
+    mesh = scene->mMeshes[n];
+    if (!triangles_of(mesh))
+      continue;
+
+    part           = &(*parts)[(*cnt)++];
+    part->vertices = malloc(mesh->mNumVertices * sizeof(import_vertex));
+    part->indices  = malloc((size_t) triangles_of(mesh) * 3 * sizeof(unsigned int));
+    if (!part->vertices || !part->indices)
+    {
+      ret = false;
+      break;
+    }
+
+    gather(part->vertices, mesh);
+    for (unsigned int t = 0; t < mesh->mNumFaces; t++)
+    {
+      face = &mesh->mFaces[t];
+      if (face->mNumIndices != 3)
+        continue;
+
+      memcpy(&part->indices[part->index_cnt], face->mIndices, 3 * sizeof(unsigned int));
+      part->index_cnt += 3;
+    }
+    part->vertex_cnt = mesh->mNumVertices;
+    part->material   = mesh->mMaterialIndex;
+    part->normals    = mesh->mNormals != NULL;
+    part->texCoords  = mesh->mTextureCoords[0] != NULL;
+  }
+
+  for (unsigned int n = 0; ret && n < scene->mNumMaterials; n++)
+  {
+    material = scene->mMaterials[n];
+
+    for (unsigned int k = 0; ret && k < aiGetMaterialTextureCount(material, aiTextureType_DIFFUSE); k++)
+    {
+      if (aiReturn_SUCCESS == aiGetMaterialTexture(material, aiTextureType_DIFFUSE, k, &name, NULL, NULL, NULL, NULL, NULL, NULL) &&
+          name.data[0] != '*')
+        ret = add_texture(in, name.data);
+    }
+  }
+
+  if (!ret)
+    printf("Error, not enough memory for %s\n", file);
+
+  aiReleaseImport(scene);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : wavefront_parts
+* Brief     : Read a .obj file without assimp, see wavefront.h: one part per
+*             material. Faces index each attribute on its own, so each corner
+*             gets a vertex, welded to the identical ones.
+* Parameters:
+*    1. in      : The mesh being imported, receiving its textures.
+*    2. parts   : Receives the meshes, one per material with triangles.
+*    3. cnt     : Receives their number.
+*    4. file    : The .obj file.
+* Returns   :
+*    true : The file is read.
+*    false: It could not be, or memory is exhausted.
+*******************************************************************************/
+static bool wavefront_parts(import *in, import_part **parts, unsigned int *cnt, const char *file)
+{
+  wavefront               obj;
+  const wavefront_group  *group;
+  const wavefront_corner *corner;
+  import_vertex          *v;
+  import_part            *part;
+  unsigned int            triangles;
+  bool                    ret = true;
+
+  if (!wavefront_load(&obj, file))
+    return false;
+
+  if (NULL == (*parts = calloc(obj.material_cnt + 1, sizeof(import_part))))
+  {
+    printf("Error, not enough memory for %s\n", file);
+    wavefront_release(&obj);
+    return false;
+  }
+
+  for (unsigned int m = 0; ret && m < obj.material_cnt; m++)
+  {
+    triangles = 0;
+    for (unsigned int g = 0; g < obj.group_cnt; g++)
+      triangles += obj.groups[g].material == m? obj.groups[g].count : 0;
+    if (!triangles)
+      continue;
+
+    part           = &(*parts)[(*cnt)++];
+    part->vertices = calloc((size_t) triangles * 3, sizeof(import_vertex));
+    part->indices  = malloc((size_t) triangles * 3 * sizeof(unsigned int));
+    part->material = m;
+    if (!(ret = part->vertices && part->indices))
+      break;
+
+    for (unsigned int g = 0; g < obj.group_cnt; g++)
+    {
+      group = &obj.groups[g];
+      if (group->material != m)
+        continue;
+
+      corner = &obj.corners[(size_t) group->first * 3];
+      for (unsigned int c = 0; c < group->count * 3; c++, corner++)
+      {
+        v = &part->vertices[part->vertex_cnt];
+        memcpy(v->position, &obj.positions[(size_t) corner->position * 3], 3 * sizeof(float));
+        if (corner->normal >= 0)
+          memcpy(v->normal, &obj.normals[(size_t) corner->normal * 3], 3 * sizeof(float));
+        if (corner->texCoord >= 0)
+        {
+          v->texCoord[0] = obj.texCoords[(size_t) corner->texCoord * 2];
+          v->texCoord[1] = 1.0f - obj.texCoords[(size_t) corner->texCoord * 2 + 1];
+        }
+
+        part->normals   |= corner->normal >= 0;
+        part->texCoords |= corner->texCoord >= 0;
+        part->indices[part->index_cnt++] = part->vertex_cnt++;
+      }
+    }
+    part->vertex_cnt = mesh_weld(part->indices, part->index_cnt, part->vertices, part->vertex_cnt, sizeof(import_vertex));
+  }
+
+  for (unsigned int m = 0; ret && m < obj.material_cnt; m++)
+    ret = add_texture(in, obj.materials[m].diffuse);
+
+  if (!ret)
+    printf("Error, not enough memory for %s\n", file);
+
+  wavefront_release(&obj);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : lay_out
+* Brief     : Lay an imported mesh out as the file, in a single allocation.
+* Parameters:
+*    1. mesh    : Receives the mesh.
+*    2. in      : The mesh imported.
+* Returns   :
+*    true : The mesh is laid out.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool lay_out(tawymesh *mesh, import *in)
+{
+  tawymesh_header *h = &in->header;
+  unsigned char   *data;
+  unsigned short  *shorts;
+
+  h->magic     = TAWY_MESH_MAGIC;
+  h->submeshes = align(sizeof(tawymesh_header));
+  h->textures  = align(h->submeshes + (unsigned long long) h->submesh_cnt * h->lod_cnt * sizeof(submesh));
+  h->streams[0] = align(h->textures + (unsigned long long) h->texture_cnt * TAWY_MESH_NAME_LEN);
+  for (unsigned int k = 1; k < TAWY_VERTEX_STREAMS; k++)
+    h->streams[k] = align(h->streams[k - 1] + (unsigned long long) h->vertices * h->format.stride[k - 1]);
+  h->indices = align(h->streams[TAWY_VERTEX_STREAMS - 1] +
+                     (unsigned long long) h->vertices * h->format.stride[TAWY_VERTEX_STREAMS - 1]);
+  h->size    = h->indices + (unsigned long long) h->elements * index_size(h);
+
+  if (NULL == (data = calloc(1, h->size)))
+    return false;
+
+  memcpy(data, h, sizeof(*h));
+  memcpy(data + h->submeshes, in->submeshes, (size_t) h->submesh_cnt * h->lod_cnt * sizeof(submesh));
+  if (h->texture_cnt)
+    memcpy(data + h->textures, in->textures, h->texture_cnt * TAWY_MESH_NAME_LEN);
+  for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
+    memcpy(data + h->streams[k], in->streams[k], (size_t) h->vertices * h->format.stride[k]);
+
+  if (h->index_type == GL_UNSIGNED_INT)
+    memcpy(data + h->indices, in->indices, (size_t) h->elements * sizeof(unsigned int));
+  else
+  {
+    shorts = (unsigned short *) (data + h->indices);
+    for (unsigned int i = 0; i < h->elements; i++)
+      shorts[i] = (unsigned short) in->indices[i];
+  }
+
+  mesh->data   = data;
+  mesh->size   = h->size;
+  mesh->mapped = false;
+  point(mesh);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : is_wavefront
+* Brief     : Tell whether a model file is a Wavefront .obj file.
+*******************************************************************************/
+static bool is_wavefront(const char *file)
+{
+  size_t len = strlen(file);
+
+  return len >= 4 && !strcasecmp(file + len - 4, ".obj");
+}
+
+
+/*******************************************************************************
+* Function  : tawymesh_import
+* Brief     : Import every mesh of a model file, one after the other, optimized
+*             and compressed as its options tell.
+*             .obj files are read by wavefront.h, any other file by assimp.
+* Parameters:
+*    1. mesh    : Receives the mesh.
+*    2. file    : The model file.
+*    3. options : A combination of mesh_option.
+* Returns   :
+*    true : The mesh is imported. Release it with tawymesh_release().
+*    false: The file could not be imported, has no triangle, or memory is
+*           exhausted.
+*******************************************************************************/
+bool tawymesh_import(tawymesh *mesh, const char *file, unsigned int options)
+{
+  import       in    = {0};
+  import_part *parts = NULL;
+  unsigned int cnt   = 0;
+  bool         ret;
+
+  memset(mesh, 0, sizeof(*mesh));
+  in.options = options;
+  ret = is_wavefront(file)? wavefront_parts(&in, &parts, &cnt, file) : assimp_parts(&in, &parts, &cnt, file);
+  ret = ret && import_meshes(&in, parts, cnt, file);
+
+  if (ret && !(ret = lay_out(mesh, &in)))
+    printf("Error, not enough memory for %s\n", file);
+
+  for (unsigned int n = 0; parts && n < cnt; n++)
+  {
+    free(parts[n].vertices);
+    free(parts[n].indices);
+  }
+  free(parts);
+  free(in.submeshes);
+  free(in.textures);
+  free(in.indices);
+  free(in.positions);
+  for (unsigned int k = 0; k < TAWY_VERTEX_STREAMS; k++)
+    free(in.streams[k]);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : tawymesh_write
+* Brief     : Write a mesh to a baked file, aside and then renamed over it.
+* Parameters:
+*    1. mesh    : The mesh.
+*    2. file    : The baked file.
+* Returns   :
+*    true : The file is written.
+*    false: It could not be, a previous file is left as it was.
+*******************************************************************************/
+bool tawymesh_write(const tawymesh *mesh, const char *file)
+{
+  char  temp[TAWY_MESH_NAME_LEN + 16];
+  FILE *out;
+  bool  ret;
+
+  //
+  // The file is written aside and renamed, so that models never map it half
+  // written.
+  //
+  snprintf(temp, sizeof(temp), "%s.%d", file, (int) getpid());
+  if (NULL == (out = fopen(temp, "wb")))
+  {
+    printf("Error, failed to write '%s'\n", file);
+    return false;
+  }
+
+  ret = fwrite(mesh->data, mesh->size, 1, out) == 1;
+  ret = !fclose(out) && ret && !rename(temp, file);
+
+  if (!ret)
+  {
+    printf("Error, failed to write '%s'\n", file);
+    remove(temp);
+  }
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : tawymesh_release
+* Brief     : Unmap or free a mesh.
+* Parameters:
+*    1. mesh    : The mesh.
+*******************************************************************************/
+void tawymesh_release(tawymesh *mesh)
+{
+  if (mesh->mapped)
+    munmap(mesh->data, mesh->size);
+  else
+    free(mesh->data);
+  memset(mesh, 0, sizeof(*mesh));
+}
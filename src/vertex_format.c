@@ -0,0 +1,172 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: vertex_format.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module describes how vertices lie in their buffers, and packs
+*           their attributes as the GPU reads them. It does not call OpenGL,
+*           so that tools bake meshes with it.
+*******************************************************************************/
+#include <math.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "vertex_format.h"
+
+
+/*******************************************************************************
+* Function  : clamp
+* Brief     : Bring a value within a range.
+*******************************************************************************/
+static float clamp(float value, float min, float max)
+{
+  return value < min? min : (value > max? max : value);
+}
+
+
+/*******************************************************************************
+* Function  : vertex_attribute_bytes
+* Brief     : The size of an attribute in a vertex, in bytes. Packed types hold
+*             every component in 4 bytes.
+* Parameters:
+*    1. type      : The OpenGL type of its components.
+*    2. size      : Its number of components.
+* Returns   :
+*    bytes: Its size.
+*******************************************************************************/
+unsigned int vertex_attribute_bytes(unsigned int type, int size)
+{
+  switch (type)
+  {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      return size;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+      return 2 * size;
+    case GL_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+      return 4;
+    default:
+      return 4 * size;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : vertex_format_add
+* Brief     : Append an attribute to a stream of a format, after the previous
+*             ones, aligned on 4 bytes.
+* Parameters:
+*    1. format    : The format, zeroed before the first attribute.
+*    2. location  : The location of the attribute.
+*    3. stream    : The stream it goes to.
+*    4. size      : Its number of components.
+*    5. type      : The OpenGL type of its components.
+*    6. normalized: True if integer components are normalized.
+* Returns   :
+*    true : The attribute is added.
+*    false: The format has TAWY_VERTEX_ATTRIBUTES already, or the stream 
+*           does not exist: it is left as it is.
+*******************************************************************************/
+bool vertex_format_add(vertex_format *fmt, unsigned int location, unsigned int stream, 
+                       int size, unsigned int type, bool normalized)
+{
+  vertex_attribute *a;
+  unsigned int      bytes = vertex_attribute_bytes(type, size);
+
+  if (fmt->attribute_cnt >= TAWY_VERTEX_ATTRIBUTES || stream >= TAWY_VERTEX_STREAMS)
+    return false;
+
+  a                   = &fmt->attribute[fmt->attribute_cnt++];
+  a->location         = location;
+  a->stream           = stream;
+  a->size             = size;
+  a->type             = type;
+  a->normalized       = normalized;
+  a->offset           = fmt->stride[stream];
+  fmt->stride[stream] = (fmt->stride[stream] + bytes + 3) & ~3u;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : half_of
+* Brief     : Convert a float to a half float, rounded to nearest. Values out
+*             of range become infinite, tiny ones zero.
+*******************************************************************************/
+static unsigned short half_of(float value)
+{
+  unsigned int   bits;
+  unsigned int   sign;
+  int            exponent;
+  unsigned int   mantissa;
+
+  memcpy(&bits, &value, sizeof(bits));
+  sign     = (bits >> 16) & 0x8000;
+  exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+  mantissa = bits & 0x7fffff;
+
+  if (exponent >= 31)
+    return sign | 0x7c00 | ((bits & 0x7fffffff) > 0x7f800000? 0x200 : 0);
+
+  //
+  // Subnormal halves keep the implicit one in their mantissa.
+  //
+  if (exponent <= 0)
+  {
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    return sign | ((mantissa + (1u << (13 - exponent)) - 1 + ((mantissa >> (14 - exponent)) & 1)) >> (14 - exponent));
+  }
+
+  //
+  // Round to nearest even. A carry into the exponent is still right.
+  //
+  return sign | ((((unsigned int) exponent << 23 | mantissa) + 0xfff + ((mantissa >> 13) & 1)) >> 13);
+}
+
+
+/*******************************************************************************
+* Function  : vertex_pack
+* Brief     : Pack the components of an attribute as its type stores them. 
+*             Normalized integers clamp them to their range, packed normals
+*             take 3 components and a zero w.
+* Parameters:
+*    1. attribute : The attribute.
+*    2. src       : Its components, in floats.
+*    3. dst       : Where it lies in its stream.
+*******************************************************************************/
+void vertex_pack(const vertex_attribute *a, const float *src, unsigned char *dst)
+{
+  unsigned short half[4];
+  unsigned int   packed = 0;
+
+  switch (a->type)
+  {
+    case GL_UNSIGNED_SHORT:
+      for (int c = 0; c < a->size; c++)
+        half[c] = (unsigned short) lroundf(clamp(src[c], 0.0f, 1.0f) * 65535.0f);
+      memcpy(dst, half, a->size * sizeof(unsigned short));
+      break;
+
+    case GL_HALF_FLOAT:
+      for (int c = 0; c < a->size; c++)
+        half[c] = half_of(src[c]);
+      memcpy(dst, half, a->size * sizeof(unsigned short));
+      break;
+
+    case GL_INT_2_10_10_10_REV:
+      for (int c = 0; c < 3; c++)
+        packed |= ((unsigned int) lroundf(clamp(src[c], -1.0f, 1.0f) * 511.0f) & 0x3ff) << (10 * c);
+      memcpy(dst, &packed, sizeof(packed));
+      break;
+
+    default:
+      memcpy(dst, src, a->size * sizeof(float));
+      break;
+  }
+}
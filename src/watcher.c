@@ -0,0 +1,303 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: watcher.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module watches asset directories from a background thread, and
+*           reloads the instances depending on files that changed.
+*******************************************************************************/
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watcher.h"
+
+#define WATCHER_EVENTS     (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define WATCHER_BUFFER_LEN 4096
+
+
+/*******************************************************************************
+* Function  : enqueue
+* Brief     : Queue a changed path, once, for the main thread.
+* Parameters:
+*    1. obj     : The instance of the watcher. Its lock must be held.
+*    2. path    : The path that changed.
+*******************************************************************************/
+static void enqueue(watcher *obj, const char *path)
+{
+  void         *queue;
+  unsigned int  cap;
+
+  for (unsigned int i = 0; i < obj->queue_cnt; i++)
+  {
+    if (!strcmp(obj->queue[i], path))
+      return;
+  }
+
+  if (obj->queue_cnt == obj->queue_cap)
+  {
+    cap = obj->queue_cap? obj->queue_cap * 2 : 16;
+    if (NULL == (queue = realloc(obj->queue, cap * TAWY_WATCHER_PATH_LEN)))
+    {
+      printf("Error, dropping change of '%s'\n", path);
+      return;
+    }
+    obj->queue     = queue;
+    obj->queue_cap = cap;
+  }
+
+  snprintf(obj->queue[obj->queue_cnt++], TAWY_WATCHER_PATH_LEN, "%s", path);
+}
+
+
+/*******************************************************************************
+* Function  : run
+* Brief     : The watcher thread. It turns inotify events into queued paths, 
+*             until woken up by the destructor.
+* Parameters:
+*    1. self    : The instance of the watcher.
+* Returns   :
+*    NULL : Unconditional
+*******************************************************************************/
+static void *run(void *self)
+{
+  watcher                    *obj = self;
+  char                        buffer[WATCHER_BUFFER_LEN] __attribute__((aligned(__alignof__(struct inotify_event))));
+  char                        path[TAWY_WATCHER_PATH_LEN];
+  const struct inotify_event *event;
+  struct pollfd               fds[2];
+  ssize_t                     len;
+
+  fds[0].fd     = obj->fd;
+  fds[0].events = POLLIN;
+  fds[1].fd     = obj->wakeup[0];
+  fds[1].events = POLLIN;
+
+  while (poll(fds, 2, -1) > 0 && !fds[1].revents)
+  {
+    if (0 >= (len = read(obj->fd, buffer, sizeof(buffer))))
+      continue;
+
+    pthread_mutex_lock(&obj->lock);
+    for (char *p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + event->len)
+    {
+      event = (const struct inotify_event *) p;
+      if (!event->len)
+        continue;
+
+      for (unsigned int i = 0; i < obj->dir_cnt; i++)
+      {
+        if (obj->wds[i] == event->wd)
+        {
+          snprintf(path, sizeof(path), "%s%s", obj->dirs[i], event->name);
+          enqueue(obj, path);
+        }
+      }
+    }
+    pthread_mutex_unlock(&obj->lock);
+  }
+
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : watch
+* Brief     : Register instances to reload when a watched file changes. Each of
+*             them decides, through reload(), whether it depends on the file.
+* Parameters:
+*    1. self    : The instance of the watcher.
+*    2. args    : The instances to register. MUST BE NULL TERMINATED!
+* Returns   :
+*    true : Every instance has been registered.
+*    false: Memory could not be allocated, or there is no watcher.
+*******************************************************************************/
+bool watch(watcher *obj, ...)
+{
+  va_list       va;
+  void         *p;
+  void        **objects;
+  unsigned int  cap;
+  bool          ret = (obj != NULL);
+
+  va_start(va, obj);
+  for (p = va_arg(va, void *); ret && p != NULL; p = va_arg(va, void *))
+  {
+    if (obj->object_cnt == obj->object_cap)
+    {
+      cap = obj->object_cap? obj->object_cap * 2 : 16;
+      if (NULL == (objects = realloc(obj->objects, cap * sizeof(void *))))
+      {
+        ret = false;
+        break;
+      }
+      obj->objects    = objects;
+      obj->object_cap = cap;
+    }
+    obj->objects[obj->object_cnt++] = p;
+  }
+  va_end(va);
+
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : Watcher__init__
+* Brief     : The object initializer, called by new()
+* Parameters:
+*    1. self    : The instance of the watcher.
+*    2. args    : The directories to watch, each ending with '/'. MUST BE NULL
+*                 TERMINATED!
+* Returns   :
+*    true : The directories are watched from a background thread.
+*    false: inotify, or the thread, is not available.
+*******************************************************************************/
+static bool Watcher__init__(void *self, va_list *args)
+{
+  watcher *obj = self;
+  char    *dir;
+
+  obj->dir_cnt    = 0;
+  obj->queue      = NULL;
+  obj->queue_cnt  = 0;
+  obj->queue_cap  = 0;
+  obj->objects    = NULL;
+  obj->object_cnt = 0;
+  obj->object_cap = 0;
+
+  //
+  // 1. Watch every directory for files being written or moved in. Editors 
+  //    often save to a temporary file, then rename it.
+  //
+  if (-1 == (obj->fd = inotify_init1(IN_CLOEXEC)))
+  {
+    printf("Error, inotify is not available, assets will not be reloaded\n");
+    return false;
+  }
+
+  while (NULL != (dir = va_arg(*args, char *)) && obj->dir_cnt < TAWY_WATCHER_DIRS)
+  {
+    snprintf(obj->dirs[obj->dir_cnt], TAWY_WATCHER_PATH_LEN, "%s", dir);
+    if (-1 == (obj->wds[obj->dir_cnt] = inotify_add_watch(obj->fd, dir, WATCHER_EVENTS)))
+    {
+      printf("Error, cannot watch '%s'\n", dir);
+      continue;
+    }
+    obj->dir_cnt++;
+  }
+
+  //
+  // 2. Read events from a thread, so that the main loop never waits on them.
+  //
+  if (pipe(obj->wakeup))
+  {
+    close(obj->fd);
+    return false;
+  }
+
+  pthread_mutex_init(&obj->lock, NULL);
+  if (pthread_create(&obj->thread, NULL, run, obj))
+  {
+    printf("Error, failed to start watcher thread\n");
+    pthread_mutex_destroy(&obj->lock);
+    close(obj->wakeup[0]);
+    close(obj->wakeup[1]);
+    close(obj->fd);
+    return false;
+  }
+
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : Watcher__del__
+* Brief     : The object destructor, called by delete()
+* Parameters:
+*    1. self    : The instance of the watcher to delete.
+*******************************************************************************/
+static void Watcher__del__(void *self)
+{
+  watcher *obj = self;
+
+  if (1 != write(obj->wakeup[1], "", 1))
+    pthread_cancel(obj->thread);
+  pthread_join(obj->thread, NULL);
+
+  pthread_mutex_destroy(&obj->lock);
+  close(obj->wakeup[0]);
+  close(obj->wakeup[1]);
+  close(obj->fd);
+  free(obj->queue);
+  free(obj->objects);
+  free(self);
+}
+
+
+/*******************************************************************************
+* Function  : Watcher__prepare__
+* Brief     : Reload, between two frames, the instances depending on the files
+*             that changed since last call.
+* Parameters:
+*    1. self    : The instance of the watcher.
+* Returns   :
+*    true : Unconditional
+*******************************************************************************/
+static bool Watcher__prepare__(void *self)
+{
+  watcher        *obj = self;
+  char          (*queue)[TAWY_WATCHER_PATH_LEN];
+  unsigned int    cnt;
+
+  //
+  // 1. Take the queue, so that the thread is never held while we reload.
+  //
+  pthread_mutex_lock(&obj->lock);
+  queue          = obj->queue;
+  cnt            = obj->queue_cnt;
+  obj->queue     = NULL;
+  obj->queue_cnt = 0;
+  obj->queue_cap = 0;
+  pthread_mutex_unlock(&obj->lock);
+
+  //
+  // 2. Every instance decides whether it depends on each path.
+  //
+  for (unsigned int i = 0; i < cnt; i++)
+  {
+    for (unsigned int j = 0; j < obj->object_cnt; j++)
+      reload(obj->objects[j], queue[i]);
+  }
+
+  free(queue);
+  return true;
+}
+
+
+/*******************************************************************************
+* Class     : _Watcher
+* Brief     : The class definition and its handlers
+*******************************************************************************/
+static const class _Watcher = {
+  .size             = sizeof(watcher),
+  .__init__         = Watcher__init__,
+  .__del__          = Watcher__del__,
+  .__get__          = NULL,
+  .__set__          = NULL,
+  .__should_close__ = NULL,
+  .__prepare__      = Watcher__prepare__,
+  .__enable__       = NULL,
+  .__reload__       = NULL
+};
+
+
+/*******************************************************************************
+* Class     : Watcher
+* Brief     : Defines a class that will handle our basic functions.
+*******************************************************************************/
+const void *Watcher = & _Watcher;
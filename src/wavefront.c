@@ -0,0 +1,860 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: wavefront.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module reads Wavefront .obj files without assimp. The file is
+*           mapped and cut in chunks on line boundaries. A first pass counts
+*           what each chunk holds, on a pool of threads, so that the second 
+*           one, parsing, writes each chunk straight into its range of the 
+*           arrays of the whole file.
+*******************************************************************************/
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wavefront.h"
+
+
+/*******************************************************************************
+* Struct    : wavefront_job
+* Brief     : A chunk of the file, counted then parsed by one thread.
+* Attributes:
+*    1. begin, end      : The chunk, whole lines.
+*    2. obj             : The contents of the whole file, its arrays allocated
+*                         for the second pass.
+*    3. names, lengths  : The material of each group, NULL if it continues the
+*                         previous one, for the whole file.
+*    4. positions, ...  : What the chunk holds, counted by the first pass.
+*    5. first_position, ...: What the chunks before hold, the first index of
+*                         the chunk in the arrays of the whole file.
+*    6. library, library_len: The first material library it names, if any.
+*    7. ret             : False if a line could not be parsed.
+*    8. kernel          : What runs on the chunk.
+*******************************************************************************/
+typedef struct wavefront_job
+{
+  const char   *begin;
+  const char   *end;
+  wavefront    *obj;
+  const char  **names;
+  int          *lengths;
+
+  unsigned int  positions;
+  unsigned int  texCoords;
+  unsigned int  normals;
+  unsigned int  triangles;
+  unsigned int  groups;
+
+  unsigned int  first_position;
+  unsigned int  first_texCoord;
+  unsigned int  first_normal;
+  unsigned int  first_triangle;
+  unsigned int  first_group;
+
+  const char   *library;
+  int           library_len;
+  bool          ret;
+  void        (*kernel)(struct wavefront_job *);
+}wavefront_job;
+
+
+//
+// The pool running chunks along the calling thread. One file at a time posts
+// a pass, whose chunks the threads take in turn.
+//
+static pthread_once_t   pool_once  = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  pool_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  lock       = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   wake       = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   idle       = PTHREAD_COND_INITIALIZER;
+static wavefront_job   *posted;
+static int              posted_cnt;
+static int              next_job;
+static int              busy       = 0;
+static int              workers    = 0;
+static unsigned int     generation = 0;
+
+
+static const double powers[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+
+/*******************************************************************************
+* Function  : blank
+* Brief     : Tell whether a character separates tokens.
+*******************************************************************************/
+static inline bool blank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/*******************************************************************************
+* Function  : skip_blanks
+* Brief     : The first character of a line that does not separate tokens.
+*******************************************************************************/
+static inline const char *skip_blanks(const char *p, const char *eol)
+{
+  while (p < eol && blank(*p))
+    p++;
+  return p;
+}
+
+
+/*******************************************************************************
+* Function  : keyword
+* Brief     : Tell whether a line starts with a keyword, followed by a blank.
+*******************************************************************************/
+static inline bool keyword(const char *p, const char *eol, const char *word, size_t len)
+{
+  return (size_t) (eol - p) > len && !memcmp(p, word, len) && blank(p[len]);
+}
+
+
+/*******************************************************************************
+* Function  : parse_float
+* Brief     : Parse a decimal float. Its first 19 digits are kept in an integer,
+*             scaled once by a power of ten, exact up to 1e22.
+* Parameters:
+*    1. p       : The first character of the number.
+*    2. eol     : The end of the line.
+*    3. value   : Receives the number.
+* Returns   :
+*    p   : The character after the number.
+*    NULL: There is no number.
+*******************************************************************************/
+static const char *parse_float(const char *p, const char *eol, float *value)
+{
+  unsigned long long mantissa = 0;
+  double             scaled;
+  int                exponent = 0;
+  int                digits   = 0;
+  int                e        = 0;
+  bool               negative = false;
+  bool               any      = false;
+
+  if (p < eol && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  for (; p < eol && (unsigned) (*p - '0') < 10; p++, any = true)
+  {
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits  += mantissa != 0;
+    }
+    else
+      exponent++;
+  }
+
+  if (p < eol && *p == '.')
+  {
+    for (p++; p < eol && (unsigned) (*p - '0') < 10; p++, any = true)
+    {
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits  += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+
+  if (!any)
+    return NULL;
+
+  if (p < eol && (*p == 'e' || *p == 'E'))
+  {
+    bool        minus = false;
+    const char *q     = p + 1;
+
+    if (q < eol && (*q == '-' || *q == '+'))
+      minus = *q++ == '-';
+
+    if (q < eol && (unsigned) (*q - '0') < 10)
+    {
+      for (; q < eol && (unsigned) (*q - '0') < 10; q++)
+        e = e < 10000? e * 10 + (*q - '0') : e;
+      exponent += minus? -e : e;
+      p         = q;
+    }
+  }
+
+  scaled = (double) mantissa;
+  if (exponent < 0)
+    scaled /= -exponent <= 22? powers[-exponent] : pow(10.0, -exponent);
+  else if (exponent > 0)
+    scaled *= exponent <= 22? powers[exponent] : pow(10.0, exponent);
+
+  *value = (float) (negative? -scaled : scaled);
+  return p;
+}
+
+
+/*******************************************************************************
+* Function  : parse_int
+* Brief     : Parse a decimal integer, signed.
+* Returns   :
+*    p   : The character after the number.
+*    NULL: There is no number.
+*******************************************************************************/
+static const char *parse_int(const char *p, const char *eol, long long *value)
+{
+  long long n        = 0;
+  bool      negative = false;
+  bool      any      = false;
+
+  if (p < eol && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  for (; p < eol && (unsigned) (*p - '0') < 10; p++, any = true)
+    n = n < 0x100000000LL? n * 10 + (*p - '0') : n;
+
+  *value = negative? -n : n;
+  return any? p : NULL;
+}
+
+
+/*******************************************************************************
+* Function  : resolve
+* Brief     : Turn the index of an attribute in a face into its index in the
+*             whole file, from 0. Negative indices count back from the last
+*             attribute defined before the face.
+* Parameters:
+*    1. index   : The index in the face.
+*    2. defined : The number of attributes defined before the face.
+*    3. total   : The number of attributes in the whole file.
+* Returns   :
+*    index: The index, -1 if it is out of the file.
+*******************************************************************************/
+static inline int resolve(long long index, unsigned int defined, unsigned int total)
+{
+  if (!index)
+    return -1;
+
+  index = index > 0? index - 1 : (long long) defined + index;
+  return index >= 0 && index < total? (int) index : -1;
+}
+
+
+/*******************************************************************************
+* Function  : parse_corner
+* Brief     : Parse a corner of a face: v, v/vt, v//vn or v/vt/vn.
+* Parameters:
+*    1. job     : The chunk, counting the attributes defined so far.
+*    2. p       : The first character of the corner.
+*    3. eol     : The end of the line.
+*    4. corner  : Receives the corner.
+* Returns   :
+*    p   : The character after the corner.
+*    NULL: The corner could not be parsed, or refers out of the file.
+*******************************************************************************/
+static const char *parse_corner(const wavefront_job *job, const char *p, const char *eol, wavefront_corner *corner)
+{
+  const wavefront *obj = job->obj;
+  long long        index;
+
+  corner->texCoord = -1;
+  corner->normal   = -1;
+
+  if (NULL == (p = parse_int(p, eol, &index)) ||
+      0 > (corner->position = resolve(index, job->first_position + job->positions, obj->position_cnt)))
+    return NULL;
+
+  if (p == eol || *p != '/')
+    return p;
+
+  if (++p < eol && *p != '/')
+  {
+    if (NULL == (p = parse_int(p, eol, &index)) ||
+        0 > (corner->texCoord = resolve(index, job->first_texCoord + job->texCoords, obj->texCoord_cnt)))
+      return NULL;
+  }
+
+  if (p == eol || *p != '/')
+    return p;
+
+  if (NULL == (p = parse_int(p + 1, eol, &index)) ||
+      0 > (corner->normal = resolve(index, job->first_normal + job->normals, obj->normal_cnt)))
+    return NULL;
+  return p;
+}
+
+
+/*******************************************************************************
+* Function  : count_corners
+* Brief     : Count the corners of a face: its tokens.
+*******************************************************************************/
+static unsigned int count_corners(const char *p, const char *eol)
+{
+  unsigned int cnt = 0;
+
+  while ((p = skip_blanks(p, eol)) < eol && *p != '#')
+  {
+    cnt++;
+    while (p < eol && !blank(*p))
+      p++;
+  }
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : count
+* Brief     : The first pass over a chunk: count its attributes, its triangles
+*             and its groups. Each chunk starts a group, that continues the
+*             material of the previous chunk.
+*******************************************************************************/
+static void count(wavefront_job *job)
+{
+  const char   *p = job->begin;
+  const char   *eol;
+  unsigned int  corners;
+
+  job->groups = 1;
+  for (; p < job->end; p = eol + 1)
+  {
+    if (NULL == (eol = memchr(p, '\n', job->end - p)))
+      eol = job->end;
+
+    p = skip_blanks(p, eol);
+    if (keyword(p, eol, "v", 1))
+      job->positions++;
+    else if (keyword(p, eol, "vt", 2))
+      job->texCoords++;
+    else if (keyword(p, eol, "vn", 2))
+      job->normals++;
+    else if (keyword(p, eol, "f", 1))
+      job->triangles += (corners = count_corners(p + 1, eol)) > 2? corners - 2 : 0;
+    else if (keyword(p, eol, "usemtl", 6))
+      job->groups++;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : parse_floats
+* Brief     : Parse the numbers of an attribute. Numbers past cnt are ignored,
+*             missing ones after the first required are left to zero.
+* Returns   :
+*    true : The numbers are parsed.
+*    false: A number required is missing.
+*******************************************************************************/
+static bool parse_floats(const char *p, const char *eol, float *values, int cnt, int required)
+{
+  for (int i = 0; i < cnt; i++)
+  {
+    p         = skip_blanks(p, eol);
+    values[i] = 0.0f;
+    if (p == eol || *p == '#')
+      return i >= required;
+
+    if (NULL == (p = parse_float(p, eol, &values[i])))
+      return false;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : parse_face
+* Brief     : Parse a face, cut in a fan of triangles around its first corner.
+* Returns   :
+*    true : The face is parsed.
+*    false: A corner could not be parsed, or refers out of the file.
+*******************************************************************************/
+static bool parse_face(wavefront_job *job, const char *p, const char *eol)
+{
+  wavefront_corner *out = job->obj->corners + (size_t) (job->first_triangle + job->triangles) * 3;
+  wavefront_corner  first    = {0};
+  wavefront_corner  previous = {0};
+  wavefront_corner  corner;
+  unsigned int      cnt = 0;
+
+  while ((p = skip_blanks(p, eol)) < eol && *p != '#')
+  {
+    if (NULL == (p = parse_corner(job, p, eol, &corner)) || (p < eol && !blank(*p)))
+      return false;
+
+    if (cnt == 0)
+      first = corner;
+    else if (cnt >= 2)
+    {
+      *out++ = first;
+      *out++ = previous;
+      *out++ = corner;
+      job->triangles++;
+    }
+    previous = corner;
+    cnt++;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : parse
+* Brief     : The second pass over a chunk: parse its lines into its ranges of
+*             the arrays of the whole file. Counts restart from zero, and end
+*             as the first pass left them.
+*******************************************************************************/
+static void parse(wavefront_job *job)
+{
+  wavefront    *obj = job->obj;
+  const char   *p   = job->begin;
+  const char   *eol;
+  unsigned int  group;
+
+  job->positions = job->texCoords = job->normals = job->triangles = 0;
+  job->names[job->first_group]   = NULL;
+  job->obj->groups[job->first_group].first = job->first_triangle;
+  job->groups = 1;
+
+  for (; job->ret && p < job->end; p = eol + 1)
+  {
+    if (NULL == (eol = memchr(p, '\n', job->end - p)))
+      eol = job->end;
+
+    p = skip_blanks(p, eol);
+    if (keyword(p, eol, "v", 1))
+      job->ret = parse_floats(p + 1, eol, &obj->positions[(size_t) (job->first_position + job->positions++) * 3], 3, 3);
+
+    else if (keyword(p, eol, "vt", 2))
+      job->ret = parse_floats(p + 2, eol, &obj->texCoords[(size_t) (job->first_texCoord + job->texCoords++) * 2], 2, 1);
+
+    else if (keyword(p, eol, "vn", 2))
+      job->ret = parse_floats(p + 2, eol, &obj->normals[(size_t) (job->first_normal + job->normals++) * 3], 3, 3);
+
+    else if (keyword(p, eol, "f", 1))
+      job->ret = parse_face(job, p + 1, eol);
+
+    else if (keyword(p, eol, "usemtl", 6))
+    {
+      p     = skip_blanks(p + 6, eol);
+      group = job->first_group + job->groups++;
+      obj->groups[group].first = job->first_triangle + job->triangles;
+      job->names[group]   = p;
+      for (job->lengths[group] = 0; p + job->lengths[group] < eol && !blank(p[job->lengths[group]]); job->lengths[group]++);
+    }
+
+    else if (keyword(p, eol, "mtllib", 6) && !job->library)
+    {
+      job->library = skip_blanks(p + 6, eol);
+      for (job->library_len = eol - job->library; job->library_len && blank(job->library[job->library_len - 1]); job->library_len--);
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : take_jobs
+* Brief     : Run the chunks of the posted pass not taken yet.
+*******************************************************************************/
+static void take_jobs(void)
+{
+  int i;
+
+  while ((i = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < posted_cnt)
+    posted[i].kernel(&posted[i]);
+}
+
+
+/*******************************************************************************
+* Function  : work
+* Brief     : A thread of the pool. It sleeps until a pass is posted, helps 
+*             run its chunks, and reports when it is done.
+*******************************************************************************/
+static void *work(void *arg)
+{
+  unsigned int seen = 0;
+
+  pthread_mutex_lock(&lock);
+  while (true)
+  {
+    while (seen == generation)
+      pthread_cond_wait(&wake, &lock);
+
+    seen = generation;
+    pthread_mutex_unlock(&lock);
+    take_jobs();
+    pthread_mutex_lock(&lock);
+
+    if (--busy == 0)
+      pthread_cond_signal(&idle);
+  }
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : start_pool
+* Brief     : Start the threads of the pool, once for the process, one per 
+*             core besides the calling thread. They live as long as it does.
+*******************************************************************************/
+static void start_pool(void)
+{
+  long      cores = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t thread;
+
+  while (workers + 1 < TAWY_WAVEFRONT_THREADS && workers + 1 < cores &&
+         !pthread_create(&thread, NULL, work, NULL))
+  {
+    pthread_detach(thread);
+    workers++;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : parallel
+* Brief     : Run a pass on every chunk, on the pool and the calling thread, 
+*             and wait for them all. Chunks run on the calling thread alone if
+*             there is one, or if another file is using the pool.
+*******************************************************************************/
+static void parallel(wavefront_job *jobs, int cnt, void (*kernel)(wavefront_job *))
+{
+  for (int i = 0; i < cnt; i++)
+    jobs[i].kernel = kernel;
+
+  if (cnt > 1)
+    pthread_once(&pool_once, start_pool);
+
+  if (cnt == 1 || !workers || pthread_mutex_trylock(&pool_lock))
+  {
+    for (int i = 0; i < cnt; i++)
+      kernel(&jobs[i]);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  posted     = jobs;
+  posted_cnt = cnt;
+  next_job   = 0;
+  busy       = workers;
+  generation++;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  take_jobs();
+
+  pthread_mutex_lock(&lock);
+  while (busy)
+    pthread_cond_wait(&idle, &lock);
+  pthread_mutex_unlock(&lock);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+
+/*******************************************************************************
+* Function  : material_of
+* Brief     : The index of a material by name, added if new.
+* Returns   :
+*    index: The index of the material, -1 if memory is exhausted.
+*******************************************************************************/
+static int material_of(wavefront *obj, const char *name, int len)
+{
+  wavefront_material *materials;
+
+  len = len < TAWY_WAVEFRONT_NAME_LEN - 1? len : TAWY_WAVEFRONT_NAME_LEN - 1;
+  for (unsigned int m = 0; m < obj->material_cnt; m++)
+  {
+    if (!strncmp(obj->materials[m].name, name, len) && !obj->materials[m].name[len])
+      return m;
+  }
+
+  if (NULL == (materials = realloc(obj->materials, (obj->material_cnt + 1) * sizeof(wavefront_material))))
+    return -1;
+
+  obj->materials = materials;
+  memset(&materials[obj->material_cnt], 0, sizeof(wavefront_material));
+  memcpy(materials[obj->material_cnt].name, name, len);
+  return obj->material_cnt++;
+}
+
+
+/*******************************************************************************
+* Function  : merge_groups
+* Brief     : Give each group its material and its size, then drop empty ones
+*             and merge consecutive ones of the same material. The first group
+*             without usemtl gets the unnamed material.
+* Returns   :
+*    true : Groups are merged.
+*    false: Memory is exhausted.
+*******************************************************************************/
+static bool merge_groups(wavefront *obj, const char **names, const int *lengths, unsigned int cnt)
+{
+  const char      *name = "";
+  int              len  = 0;
+  int              material;
+  wavefront_group  group;
+  unsigned int     kept = 0;
+
+  for (unsigned int g = 0; g < cnt; g++)
+  {
+    if (names[g])
+    {
+      name = names[g];
+      len  = lengths[g];
+    }
+
+    group       = obj->groups[g];
+    group.count = (g + 1 < cnt? obj->groups[g + 1].first : obj->triangle_cnt) - group.first;
+    if (!group.count)
+      continue;
+
+    if (0 > (material = material_of(obj, name, len)))
+      return false;
+
+    if (kept && obj->groups[kept - 1].material == (unsigned int) material)
+      obj->groups[kept - 1].count += group.count;
+    else
+    {
+      group.material       = material;
+      obj->groups[kept++]  = group;
+    }
+  }
+
+  obj->group_cnt = kept;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : read_library
+* Brief     : Read the diffuse map of each material used from a material
+*             library. Options of map_Kd are skipped: the file is its last
+*             token. A missing library leaves materials without maps.
+* Parameters:
+*    1. obj     : The contents of the .obj file, its materials merged.
+*    2. file    : The .obj file, the library is relative to it.
+*    3. library : The library, as the .obj file names it.
+*    4. len     : The length of its name.
+*******************************************************************************/
+static void read_library(wavefront *obj, const char *file, const char *library, int len)
+{
+  char        path[TAWY_WAVEFRONT_NAME_LEN];
+  char       *line  = NULL;
+  size_t      cap   = 0;
+  const char *slash = strrchr(file, '/');
+  const char *p;
+  const char *eol;
+  const char *token;
+  int         material = -1;
+  FILE       *in;
+
+  snprintf(path, TAWY_WAVEFRONT_NAME_LEN, "%.*s%.*s", slash? (int) (slash - file + 1) : 0, file, len, library);
+  if (NULL == (in = fopen(path, "r")))
+  {
+    printf("Error, failed to read '%s'\n", path);
+    return;
+  }
+
+  //
+  // Lines are read whole, however long, the buffer growing as needed.
+  //
+  while (getline(&line, &cap, in) >= 0)
+  {
+    eol = line + strcspn(line, "\r\n");
+    p   = skip_blanks(line, eol);
+    while (eol > p && blank(eol[-1]))
+      eol--;
+
+    if (keyword(p, eol, "newmtl", 6))
+    {
+      p        = skip_blanks(p + 6, eol);
+      material = -1;
+      for (unsigned int m = 0; m < obj->material_cnt; m++)
+      {
+        if ((size_t) (eol - p) == strlen(obj->materials[m].name) && !memcmp(obj->materials[m].name, p, eol - p))
+          material = m;
+      }
+    }
+
+    else if (keyword(p, eol, "map_Kd", 6) && material >= 0)
+    {
+      for (token = eol; token > p && !blank(token[-1]); token--);
+      snprintf(obj->materials[material].diffuse, TAWY_WAVEFRONT_NAME_LEN, "%.*s", (int) (eol - token), token);
+    }
+  }
+  free(line);
+  fclose(in);
+}
+
+
+/*******************************************************************************
+* Function  : split
+* Brief     : Cut a file in chunks of whole lines, one per thread, as many as
+*             its size is worth.
+* Returns   :
+*    cnt: The number of chunks.
+*******************************************************************************/
+static int split(wavefront_job *jobs, const char *data, size_t size)
+{
+  long        cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t      cnt   = size / TAWY_WAVEFRONT_CHUNK;
+  const char *end   = data + size;
+  const char *p;
+
+  cnt = cnt < 1? 1 : cnt > TAWY_WAVEFRONT_THREADS? TAWY_WAVEFRONT_THREADS : cnt;
+  cnt = cores > 0 && (size_t) cores < cnt? (size_t) cores : cnt;
+
+  jobs[0].begin = data;
+  for (size_t i = 1; i < cnt; i++)
+  {
+    p = memchr(data + size * i / cnt, '\n', end - (data + size * i / cnt));
+    p = p? p + 1 : end;
+    p = p > jobs[i - 1].begin? p : jobs[i - 1].begin;
+    jobs[i - 1].end = p;
+    jobs[i].begin   = p;
+  }
+  jobs[cnt - 1].end = end;
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : wavefront_load
+* Brief     : Read a .obj file, and the diffuse maps of its material library.
+* Parameters:
+*    1. obj     : Receives the contents of the file.
+*    2. file    : The .obj file.
+* Returns   :
+*    true : The file is read. Release it with wavefront_release().
+*    false: It could not be mapped, a face refers to a missing attribute, or
+*           memory is exhausted.
+*******************************************************************************/
+bool wavefront_load(wavefront *obj, const char *file)
+{
+  wavefront_job  jobs[TAWY_WAVEFRONT_THREADS] = {{0}};
+  const char   **names   = NULL;
+  int           *lengths = NULL;
+  struct stat    st;
+  void          *data;
+  unsigned int   groups = 0;
+  int            cnt;
+  int            fd;
+  bool           ret = true;
+
+  memset(obj, 0, sizeof(*obj));
+  if ((fd = open(file, O_RDONLY)) < 0)
+  {
+    printf("Error, failed to read '%s'\n", file);
+    return false;
+  }
+
+  if (fstat(fd, &st) || !st.st_size ||
+      MAP_FAILED == (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
+  {
+    close(fd);
+    printf("Error, failed to map '%s'\n", file);
+    return false;
+  }
+  close(fd);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  //
+  // 1. Count what each chunk holds: where each starts in the arrays of the
+  //    whole file follows.
+  //
+  cnt = split(jobs, data, st.st_size);
+  parallel(jobs, cnt, count);
+
+  for (int i = 0; i < cnt; i++)
+  {
+    jobs[i].obj            = obj;
+    jobs[i].ret            = true;
+    jobs[i].first_position = obj->position_cnt;
+    jobs[i].first_texCoord = obj->texCoord_cnt;
+    jobs[i].first_normal   = obj->normal_cnt;
+    jobs[i].first_triangle = obj->triangle_cnt;
+    jobs[i].first_group    = groups;
+    obj->position_cnt     += jobs[i].positions;
+    obj->texCoord_cnt     += jobs[i].texCoords;
+    obj->normal_cnt       += jobs[i].normals;
+    obj->triangle_cnt     += jobs[i].triangles;
+    groups                += jobs[i].groups;
+  }
+
+  obj->positions = malloc((size_t) obj->position_cnt * 3 * sizeof(float) + 1);
+  obj->texCoords = malloc((size_t) obj->texCoord_cnt * 2 * sizeof(float) + 1);
+  obj->normals   = malloc((size_t) obj->normal_cnt * 3 * sizeof(float) + 1);
+  obj->corners   = malloc((size_t) obj->triangle_cnt * 3 * sizeof(wavefront_corner) + 1);
+  obj->groups    = malloc(groups * sizeof(wavefront_group));
+  names          = malloc(groups * sizeof(const char *));
+  lengths        = malloc(groups * sizeof(int));
+
+  if (!obj->positions || !obj->texCoords || !obj->normals || !obj->corners || !obj->groups || !names || !lengths)
+  {
+    printf("Error, not enough memory for %s\n", file);
+    ret = false;
+  }
+
+  //
+  // 2. Parse every chunk into its ranges.
+  //
+  if (ret)
+  {
+    for (int i = 0; i < cnt; i++)
+    {
+      jobs[i].names   = names;
+      jobs[i].lengths = lengths;
+    }
+    parallel(jobs, cnt, parse);
+  }
+
+  for (int i = 0; ret && i < cnt; i++)
+  {
+    if (!(ret = jobs[i].ret))
+      printf("Error, %s is corrupt or refers to missing vertices\n", file);
+  }
+
+  //
+  // 3. Name materials in the order of the file, then read their maps.
+  //
+  if (ret && !(ret = merge_groups(obj, names, lengths, groups)))
+    printf("Error, not enough memory for %s\n", file);
+
+  for (int i = 0; ret && i < cnt; i++)
+  {
+    if (jobs[i].library)
+    {
+      read_library(obj, file, jobs[i].library, jobs[i].library_len);
+      break;
+    }
+  }
+
+  munmap(data, st.st_size);
+  free(names);
+  free(lengths);
+  if (!ret)
+    wavefront_release(obj);
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : wavefront_release
+* Brief     : Free the contents of a .obj file.
+* Parameters:
+*    1. obj     : The contents.
+*******************************************************************************/
+void wavefront_release(wavefront *obj)
+{
+  free(obj->positions);
+  free(obj->texCoords);
+  free(obj->normals);
+  free(obj->corners);
+  free(obj->groups);
+  free(obj->materials);
+  memset(obj, 0, sizeof(*obj));
+}
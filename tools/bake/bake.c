@@ -0,0 +1,417 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: bake.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : Offline texture baker. Each image is encoded to BC1, BC3, BC4 or 
+*           BC5 with its full mip chain, into a KTX file next to it, which the
+*           texture loader prefers over the image. Images are baked one after
+*           the other, the block rows of each level shared by a pool of 
+*           threads. Mips are filtered as the texture cache filters them, 
+*           colors in linear space unless -l tells they are linear already.
+*           Usage: bake [-f] [-l] image...
+*******************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "image.h"
+#include "texture_cache.h"
+#include "ktx.h"
+#include "bc.h"
+
+#define BAKE_PATH_LEN 256
+#define BAKE_THREADS  16
+#define BAKE_ROWS     16  // Fewer block rows are not worth waking the pool.
+
+#define GL_RED  0x1903
+#define GL_RG   0x8227
+#define GL_RGB  0x1907
+#define GL_RGBA 0x1908
+
+
+//
+// The level the pool encodes. Threads take its block rows in turn, and the
+// last one done signals idle.
+//
+typedef struct
+{
+  const unsigned char *pixels;
+  int                  width;
+  int                  height;
+  int                  channels;
+  ktx_format           format;
+  unsigned char       *blocks;
+  int                  rows;
+  int                  next_row;
+} bake_job;
+
+
+static bake_job        job;
+static pthread_mutex_t lock       = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake       = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  idle       = PTHREAD_COND_INITIALIZER;
+static unsigned int    generation = 0;
+static int             busy       = 0;
+static int             workers    = 0;
+static bool            quit       = false;
+static bool            force      = false;
+static bool            linear     = false;
+
+
+/*******************************************************************************
+* Function  : ktx_path
+* Brief     : The path of the KTX file baked from an image: its extension is
+*             replaced.
+*******************************************************************************/
+static void ktx_path(const char *file, char *path)
+{
+  const char *dot   = strrchr(file, '.');
+  const char *slash = strrchr(file, '/');
+  int         len   = (dot && (!slash || dot > slash))? (int) (dot - file) : (int) strlen(file);
+
+  snprintf(path, BAKE_PATH_LEN, "%.*s" TAWY_KTX_EXTENSION, len, file);
+}
+
+
+/*******************************************************************************
+* Function  : up_to_date
+* Brief     : Tell whether a baked file is newer than its image.
+*******************************************************************************/
+static bool up_to_date(const char *file, const char *path)
+{
+  struct stat src;
+  struct stat dst;
+
+  return !stat(file, &src) && !stat(path, &dst) && dst.st_mtime >= src.st_mtime;
+}
+
+
+/*******************************************************************************
+* Function  : choose_format
+* Brief     : The cheapest format keeping the channels of an image: alpha only
+*             costs BC3 if some pixel is not opaque.
+*******************************************************************************/
+static ktx_format choose_format(const unsigned char *pixels, int width, int height, int channels, unsigned int *base)
+{
+  switch (channels)
+  {
+    case 1: 
+      *base = GL_RED;
+      return KTX_BC4;
+    case 2:
+      *base = GL_RG;
+      return KTX_BC5;
+    case 4:
+      for (long i = 0; i < (long) width * height; i++)
+      {
+        if (pixels[4 * i + 3] != 255)
+        {
+          *base = GL_RGBA;
+          return KTX_BC3;
+        }
+      }
+      // Fall through, alpha is unused.
+    default:
+      *base = GL_RGB;
+      return KTX_BC1;
+  }
+}
+
+
+/*******************************************************************************
+* Function  : block_size
+* Brief     : The number of bytes of a block of a format.
+*******************************************************************************/
+static int block_size(ktx_format format)
+{
+  return (format == KTX_BC1 || format == KTX_BC4)? 8 : 16;
+}
+
+
+/*******************************************************************************
+* Function  : encode_rows
+* Brief     : Encode the block rows of the job not taken yet, block by block.
+*             Blocks crossing the edges of small levels repeat the last row
+*             and column.
+*******************************************************************************/
+static void encode_rows(void)
+{
+  unsigned char  texels[64];
+  unsigned char *out;
+  int            row, x, y, c;
+
+  while ((row = __atomic_fetch_add(&job.next_row, 1, __ATOMIC_RELAXED)) < job.rows)
+  {
+    out = job.blocks + (size_t) row * ((job.width + 3) / 4) * block_size(job.format);
+    for (int bx = 0; bx < job.width; bx += 4)
+    {
+      for (int i = 0; i < 16; i++)
+      {
+        x = bx + i % 4 < job.width?  bx + i % 4 : job.width - 1;
+        y = 4 * row + i / 4 < job.height? 4 * row + i / 4 : job.height - 1;
+        for (c = 0; c < 4; c++)
+          texels[i * 4 + c] = c < job.channels? job.pixels[((size_t) y * job.width + x) * job.channels + c] : 255;
+      }
+
+      switch (job.format)
+      {
+        case KTX_BC1: bc1_block(texels, out);     break;
+        case KTX_BC3: bc3_block(texels, out);     break;
+        case KTX_BC4: bc4_block(texels, 4, out);  break;
+        case KTX_BC5: 
+          for (int i = 0; i < 16; i++)
+          {
+            texels[2 * i]     = texels[4 * i];
+            texels[2 * i + 1] = texels[4 * i + 1];
+          }
+          bc5_block(texels, out);
+          break;
+      }
+      out += block_size(job.format);
+    }
+  }
+}
+
+
+/*******************************************************************************
+* Function  : work
+* Brief     : A thread of the pool. It sleeps until a level is posted, helps
+*             encode it, and reports when it is done.
+*******************************************************************************/
+static void *work(void *arg)
+{
+  unsigned int seen = 0;
+
+  pthread_mutex_lock(&lock);
+  while (true)
+  {
+    while (seen == generation && !quit)
+      pthread_cond_wait(&wake, &lock);
+    if (quit)
+      break;
+
+    seen = generation;
+    pthread_mutex_unlock(&lock);
+    encode_rows();
+    pthread_mutex_lock(&lock);
+
+    if (--busy == 0)
+      pthread_cond_signal(&idle);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+
+/*******************************************************************************
+* Function  : encode_level
+* Brief     : Encode a mip level, with the pool if it has enough block rows.
+* Returns   :
+*    size: The number of bytes written to blocks.
+*******************************************************************************/
+static unsigned int encode_level(const unsigned char *pixels, int width, int height, int channels, ktx_format format, unsigned char *blocks)
+{
+  job.pixels   = pixels;
+  job.width    = width;
+  job.height   = height;
+  job.channels = channels;
+  job.format   = format;
+  job.blocks   = blocks;
+  job.rows     = (height + 3) / 4;
+  job.next_row = 0;
+
+  if (workers && job.rows >= BAKE_ROWS)
+  {
+    pthread_mutex_lock(&lock);
+    generation++;
+    busy = workers;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    encode_rows();
+
+    pthread_mutex_lock(&lock);
+    while (busy)
+      pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+  else
+    encode_rows();
+
+  return job.rows * ((width + 3) / 4) * block_size(format);
+}
+
+
+/*******************************************************************************
+* Function  : bake
+* Brief     : Bake an image, bottom row first as OpenGL expects it, into a KTX
+*             file with its full mip chain. The file is written aside and 
+*             renamed, so that the loader never maps it half written.
+* Returns   :
+*    true : The file is baked, or was already.
+*    false: The image could not be decoded, or the file written.
+*******************************************************************************/
+static bool bake(const char *file)
+{
+  static const unsigned char identifier[12] = TAWY_KTX_IDENTIFIER;
+  static const char          orientation[]  = TAWY_KTX_ORIENTATION "\0" TAWY_KTX_BOTTOM_UP;
+
+  char           path[BAKE_PATH_LEN];
+  char           temp[BAKE_PATH_LEN + 16];
+  ktx_header     header = {0};
+  unsigned char *pixels;
+  unsigned char *level;
+  unsigned char *next;
+  unsigned char *blocks;
+  unsigned int   size;
+  unsigned int   kv_size = (sizeof(orientation) + 3) & ~3u;
+  unsigned char  kv[64] = {0};
+  int            width, height, channels, levels = 1;
+  ktx_format     format;
+  FILE          *out;
+  bool           srgb;
+  bool           ret = true;
+
+  ktx_path(file, path);
+  if (!force && up_to_date(file, path))
+    return true;
+
+  stbi_set_flip_vertically_on_load_thread(true);
+  if (NULL == (pixels = stbi_load(file, &width, &height, &channels, 0)))
+  {
+    printf("Error, failed to load '%s'\n", file);
+    return false;
+  }
+
+  while ((width >> levels) || (height >> levels))
+    levels++;
+
+  //
+  // 1. The header, and a single key telling the rows are bottom-up.
+  //
+  format                    = choose_format(pixels, width, height, channels, &header.gl_base_format);
+  header.endianness         = TAWY_KTX_ENDIANNESS;
+  header.gl_type_size       = 1;
+  header.gl_internal_format = format;
+  header.width              = width;
+  header.height             = height;
+  header.faces              = 1;
+  header.levels             = levels;
+  header.key_value_bytes    = 4 + kv_size;
+
+  size = sizeof(orientation);
+  memcpy(kv, &size, 4);
+  memcpy(kv + 4, orientation, sizeof(orientation));
+
+  snprintf(temp, sizeof(temp), "%s.%d", path, (int) getpid());
+  if (NULL == (out = fopen(temp, "wb")) || 
+      NULL == (blocks = malloc((size_t) ((width + 3) / 4) * ((height + 3) / 4) * 16)))
+  {
+    printf("Error, failed to write '%s'\n", path);
+    if (out)
+    {
+      fclose(out);
+      remove(temp);
+    }
+    stbi_image_free(pixels);
+    return false;
+  }
+
+  fwrite(identifier, 1, sizeof(identifier), out);
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(kv, 1, 4 + kv_size, out);
+
+  //
+  // 2. Each level, its size first. Block sizes keep them 4 bytes aligned.
+  //    Levels are filtered as the texture cache does, colors as sRGB unless
+  //    told linear.
+  //
+  srgb  = !linear && channels >= 3;
+  level = pixels;
+  for (int l = 0; ret && l < levels; l++)
+  {
+    size = encode_level(level, width, height, channels, format, blocks);
+    ret  = fwrite(&size, 4, 1, out) == 1 && fwrite(blocks, 1, size, out) == size;
+
+    if (ret && l + 1 < levels)
+    {
+      ret = NULL != (next = malloc((size_t) (width > 1? width / 2 : 1) * (height > 1? height / 2 : 1) * channels)) &&
+            image_downsample(next, level, width, height, channels, TAWY_TEXTURE_MIP_FILTER, srgb);
+      if (level != pixels)
+        free(level);
+      level  = next;
+      width  = width  > 1? width  / 2 : 1;
+      height = height > 1? height / 2 : 1;
+    }
+  }
+
+  if (level != pixels)
+    free(level);
+  free(blocks);
+  stbi_image_free(pixels);
+  ret = !fclose(out) && ret && !rename(temp, path);
+
+  if (!ret)
+  {
+    printf("Error, failed to write '%s'\n", path);
+    remove(temp);
+  }
+  return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+  pthread_t threads[BAKE_THREADS];
+  long      cnt      = sysconf(_SC_NPROCESSORS_ONLN);
+  char    **files    = argv + 1;
+  int       file_cnt = argc - 1;
+  int       failures = 0;
+
+  for (; file_cnt && files[0][0] == '-'; files++, file_cnt--)
+  {
+    if (!strcmp(files[0], "-f"))
+      force = true;
+    else if (!strcmp(files[0], "-l"))
+      linear = true;
+    else
+      break;
+  }
+
+  if (!file_cnt)
+  {
+    printf("Usage: %s [-f] [-l] image...\n", argv[0]);
+    return 1;
+  }
+
+  //
+  // The main thread encodes along the pool.
+  //
+  cnt = cnt < 1? 1 : cnt > BAKE_THREADS? BAKE_THREADS : cnt;
+  while (workers + 1 < cnt && !pthread_create(&threads[workers], NULL, work, NULL))
+    workers++;
+
+  for (int i = 0; i < file_cnt; i++)
+  {
+    if (bake(files[i]))
+      printf("Baked %s\n", files[i]);
+    else
+      failures++;
+  }
+
+  pthread_mutex_lock(&lock);
+  quit = true;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  while (workers)
+    pthread_join(threads[--workers], NULL);
+
+  return failures? 1 : 0;
+}
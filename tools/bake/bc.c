@@ -0,0 +1,565 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: bc.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module encodes 4x4 blocks of pixels to BC1, BC3, BC4 and BC5 
+*           (S3TC and RGTC).
+*******************************************************************************/
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+#include "bc.h"
+
+#define BC1_REFINEMENTS 2
+
+
+#ifdef __SSE2__
+/*******************************************************************************
+* Function  : hsum
+* Brief     : The sum of the 4 lanes of a vector.
+*******************************************************************************/
+static float hsum(__m128 v)
+{
+  v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(v);
+}
+#endif
+
+
+/*******************************************************************************
+* Function  : pack565
+* Brief     : Quantize a color to 5:6:5 bits, rounding to nearest.
+*******************************************************************************/
+static unsigned short pack565(const float *c)
+{
+  int r = (int) (c[0] * 31.0f / 255.0f + 0.5f);
+  int g = (int) (c[1] * 63.0f / 255.0f + 0.5f);
+  int b = (int) (c[2] * 31.0f / 255.0f + 0.5f);
+
+  r = r < 0? 0 : r > 31? 31 : r;
+  g = g < 0? 0 : g > 63? 63 : g;
+  b = b < 0? 0 : b > 31? 31 : b;
+  return (unsigned short) (r << 11 | g << 5 | b);
+}
+
+
+/*******************************************************************************
+* Function  : unpack565
+* Brief     : Expand a 5:6:5 color to 8 bits per channel, as decoders do.
+*******************************************************************************/
+static void unpack565(unsigned short v, float *c)
+{
+  int r = (v >> 11) & 31;
+  int g = (v >> 5)  & 63;
+  int b = v & 31;
+
+  c[0] = (float) (r << 3 | r >> 2);
+  c[1] = (float) (g << 2 | g >> 4);
+  c[2] = (float) (b << 3 | b >> 2);
+}
+
+
+/*******************************************************************************
+* Function  : bc1_planes
+* Brief     : Split 16 RGBA pixels into planes of their color channels, and
+*             sum them into their mean.
+* Parameters:
+*    1. rgba    : The 16 pixels, row by row, 4 bytes each.
+*    2. r, g, b : Receive the channels of the 16 pixels.
+*    3. mean    : Receives the mean color.
+*******************************************************************************/
+static void bc1_planes(const unsigned char *rgba, float *r, float *g, float *b, float *mean)
+{
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128i px, lo, hi;
+  __m128  p0, p1, p2, p3;
+  __m128  sr = _mm_setzero_ps(), sg = _mm_setzero_ps(), sb = _mm_setzero_ps();
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    //
+    // 4 pixels widen to 4 vectors of RGBA floats, transposed to channels.
+    //
+    px = _mm_loadu_si128((const __m128i *) &rgba[4 * i]);
+    lo = _mm_unpacklo_epi8(px, zero);
+    hi = _mm_unpackhi_epi8(px, zero);
+    p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+    _mm_storeu_ps(&r[i], p0);
+    _mm_storeu_ps(&g[i], p1);
+    _mm_storeu_ps(&b[i], p2);
+    sr = _mm_add_ps(sr, p0);
+    sg = _mm_add_ps(sg, p1);
+    sb = _mm_add_ps(sb, p2);
+  }
+
+  mean[0] = hsum(sr) / 16.0f;
+  mean[1] = hsum(sg) / 16.0f;
+  mean[2] = hsum(sb) / 16.0f;
+#else
+  mean[0] = mean[1] = mean[2] = 0.0f;
+  for (int i = 0; i < 16; i++)
+  {
+    r[i] = rgba[4 * i];
+    g[i] = rgba[4 * i + 1];
+    b[i] = rgba[4 * i + 2];
+    mean[0] += r[i] / 16.0f;
+    mean[1] += g[i] / 16.0f;
+    mean[2] += b[i] / 16.0f;
+  }
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : bc1_covariance
+* Brief     : The covariance of the colors of 16 pixels: rr, rg, rb, gg, gb 
+*             and bb.
+*******************************************************************************/
+static void bc1_covariance(const float *r, const float *g, const float *b, const float *mean, float *cov)
+{
+#ifdef __SSE2__
+  __m128 mr = _mm_set1_ps(mean[0]), mg = _mm_set1_ps(mean[1]), mb = _mm_set1_ps(mean[2]);
+  __m128 c[6];
+  __m128 dr, dg, db;
+
+  for (int k = 0; k < 6; k++)
+    c[k] = _mm_setzero_ps();
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    dr   = _mm_sub_ps(_mm_loadu_ps(&r[i]), mr);
+    dg   = _mm_sub_ps(_mm_loadu_ps(&g[i]), mg);
+    db   = _mm_sub_ps(_mm_loadu_ps(&b[i]), mb);
+    c[0] = _mm_add_ps(c[0], _mm_mul_ps(dr, dr));
+    c[1] = _mm_add_ps(c[1], _mm_mul_ps(dr, dg));
+    c[2] = _mm_add_ps(c[2], _mm_mul_ps(dr, db));
+    c[3] = _mm_add_ps(c[3], _mm_mul_ps(dg, dg));
+    c[4] = _mm_add_ps(c[4], _mm_mul_ps(dg, db));
+    c[5] = _mm_add_ps(c[5], _mm_mul_ps(db, db));
+  }
+
+  for (int k = 0; k < 6; k++)
+    cov[k] = hsum(c[k]);
+#else
+  float d[3];
+
+  for (int k = 0; k < 6; k++)
+    cov[k] = 0.0f;
+
+  for (int i = 0; i < 16; i++)
+  {
+    d[0]    = r[i] - mean[0];
+    d[1]    = g[i] - mean[1];
+    d[2]    = b[i] - mean[2];
+    cov[0] += d[0] * d[0];
+    cov[1] += d[0] * d[1];
+    cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1];
+    cov[4] += d[1] * d[2];
+    cov[5] += d[2] * d[2];
+  }
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : bc1_range
+* Brief     : The range the colors of 16 pixels span along an axis, from their
+*             mean.
+*******************************************************************************/
+static void bc1_range(const float *r, const float *g, const float *b, const float *mean, const float *axis,
+                      float *tmin, float *tmax)
+{
+#ifdef __SSE2__
+  __m128 mr = _mm_set1_ps(mean[0]), mg = _mm_set1_ps(mean[1]), mb = _mm_set1_ps(mean[2]);
+  __m128 ar = _mm_set1_ps(axis[0]), ag = _mm_set1_ps(axis[1]), ab = _mm_set1_ps(axis[2]);
+  __m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+  __m128 t;
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    t  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&r[i]), mr), ar),
+                               _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&g[i]), mg), ag)),
+                               _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&b[i]), mb), ab));
+    lo = _mm_min_ps(lo, t);
+    hi = _mm_max_ps(hi, t);
+  }
+
+  lo    = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+  lo    = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1)));
+  hi    = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+  hi    = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1)));
+  *tmin = _mm_cvtss_f32(lo);
+  *tmax = _mm_cvtss_f32(hi);
+#else
+  float t;
+
+  *tmin = INFINITY;
+  *tmax = -INFINITY;
+  for (int i = 0; i < 16; i++)
+  {
+    t     = (r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2];
+    *tmin = t < *tmin? t : *tmin;
+    *tmax = t > *tmax? t : *tmax;
+  }
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : bc1_levels
+* Brief     : Project the 16 pixels on the segment between two endpoints, and
+*             round them to one of its 4 evenly spaced colors. Since these are
+*             aligned, the nearest one along the segment is the nearest one.
+* Parameters:
+*    1. r, g, b : The channels of the 16 pixels.
+*    2. c0, c1  : The endpoints, decoded.
+*    3. levels  : Receives, per pixel, 0 for c1 to 3 for c0.
+*******************************************************************************/
+static void bc1_levels(const float *r, const float *g, const float *b, const float *c0, const float *c1, int *levels)
+{
+  float dr  = c0[0] - c1[0];
+  float dg  = c0[1] - c1[1];
+  float db  = c0[2] - c1[2];
+  float len = dr * dr + dg * dg + db * db;
+  float k   = len > 0.0f? 3.0f / len : 0.0f;
+
+#ifdef __SSE2__
+  __m128 vdr = _mm_set1_ps(dr * k), vdg = _mm_set1_ps(dg * k), vdb = _mm_set1_ps(db * k);
+  __m128 vr  = _mm_set1_ps(c1[0]),  vg  = _mm_set1_ps(c1[1]),  vb  = _mm_set1_ps(c1[2]);
+  __m128 lo  = _mm_setzero_ps(),    hi  = _mm_set1_ps(3.0f);
+  __m128 t;
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&r[i]), vr), vdr),
+                              _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&g[i]), vg), vdg)),
+                              _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&b[i]), vb), vdb));
+    t = _mm_min_ps(_mm_max_ps(t, lo), hi);
+    _mm_storeu_si128((__m128i *) &levels[i], _mm_cvtps_epi32(t));
+  }
+#else
+  float t;
+
+  for (int i = 0; i < 16; i++)
+  {
+    t = ((r[i] - c1[0]) * dr + (g[i] - c1[1]) * dg + (b[i] - c1[2]) * db) * k;
+    levels[i] = (int) lrintf(t < 0.0f? 0.0f : t > 3.0f? 3.0f : t);
+  }
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : bc1_error
+* Brief     : The squared error of the pixels against their rounded colors.
+*******************************************************************************/
+static float bc1_error(const float *r, const float *g, const float *b, const float *c0, const float *c1, const int *levels)
+{
+#ifdef __SSE2__
+  __m128 third = _mm_set1_ps(1.0f / 3.0f);
+  __m128 r0 = _mm_set1_ps(c0[0]), g0 = _mm_set1_ps(c0[1]), b0 = _mm_set1_ps(c0[2]);
+  __m128 r1 = _mm_set1_ps(c1[0]), g1 = _mm_set1_ps(c1[1]), b1 = _mm_set1_ps(c1[2]);
+  __m128 error = _mm_setzero_ps();
+  __m128 a, d;
+
+  //
+  // The color of a level is c1 + a * (c0 - c1).
+  //
+  for (int i = 0; i < 16; i += 4)
+  {
+    a     = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) &levels[i])), third);
+    d     = _mm_sub_ps(_mm_add_ps(r1, _mm_mul_ps(a, _mm_sub_ps(r0, r1))), _mm_loadu_ps(&r[i]));
+    error = _mm_add_ps(error, _mm_mul_ps(d, d));
+    d     = _mm_sub_ps(_mm_add_ps(g1, _mm_mul_ps(a, _mm_sub_ps(g0, g1))), _mm_loadu_ps(&g[i]));
+    error = _mm_add_ps(error, _mm_mul_ps(d, d));
+    d     = _mm_sub_ps(_mm_add_ps(b1, _mm_mul_ps(a, _mm_sub_ps(b0, b1))), _mm_loadu_ps(&b[i]));
+    error = _mm_add_ps(error, _mm_mul_ps(d, d));
+  }
+  return hsum(error);
+#else
+  float error = 0.0f;
+  float a;
+  float d;
+
+  for (int i = 0; i < 16; i++)
+  {
+    a      = levels[i] / 3.0f;
+    d      = a * c0[0] + (1.0f - a) * c1[0] - r[i];
+    error += d * d;
+    d      = a * c0[1] + (1.0f - a) * c1[1] - g[i];
+    error += d * d;
+    d      = a * c0[2] + (1.0f - a) * c1[2] - b[i];
+    error += d * d;
+  }
+  return error;
+#endif
+}
+
+
+/*******************************************************************************
+* Function  : bc1_refine
+* Brief     : Solve, by least squares, the endpoints best reproducing the pixels
+*             with their current levels.
+* Returns   :
+*    true : The endpoints have been computed.
+*    false: All pixels use the same level, there is nothing to solve.
+*******************************************************************************/
+static bool bc1_refine(const float *r, const float *g, const float *b, const int *levels, float *e0, float *e1)
+{
+  const float *p[3] = {r, g, b};
+  float        aa = 0.0f, ab = 0.0f, bb = 0.0f, det;
+  float        ap[3] = {0.0f}, bp[3] = {0.0f};
+  float        a, w;
+
+  for (int i = 0; i < 16; i++)
+  {
+    a   = levels[i] / 3.0f;
+    w   = 1.0f - a;
+    aa += a * a;
+    ab += a * w;
+    bb += w * w;
+    for (int c = 0; c < 3; c++)
+    {
+      ap[c] += a * p[c][i];
+      bp[c] += w * p[c][i];
+    }
+  }
+
+  if (fabsf(det = aa * bb - ab * ab) < 1e-6f)
+    return false;
+
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c] = (ap[c] * bb - bp[c] * ab) / det;
+    e1[c] = (bp[c] * aa - ap[c] * ab) / det;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : bc1_encode
+* Brief     : Encode the endpoints and levels of a block. The first endpoint
+*             is kept greater, so that decoders use 4 colors, not 3.
+*******************************************************************************/
+static void bc1_encode(unsigned short q0, unsigned short q1, const int *levels, unsigned char *block)
+{
+  static const unsigned int codes[4] = {1, 3, 2, 0};  // Level to index.
+
+  unsigned int   bits = 0;
+  unsigned short t;
+  bool           swap = q0 < q1;
+
+  if (swap)
+  {
+    t  = q0;
+    q0 = q1;
+    q1 = t;
+  }
+
+  for (int i = 0; i < 16; i++)
+    bits |= (q0 == q1? 0 : codes[swap? 3 - levels[i] : levels[i]]) << (2 * i);
+
+  block[0] = q0 & 0xFF;
+  block[1] = q0 >> 8;
+  block[2] = q1 & 0xFF;
+  block[3] = q1 >> 8;
+  memcpy(&block[4], &bits, 4);
+}
+
+
+/*******************************************************************************
+* Function  : bc1_block
+* Brief     : Encode 16 RGBA pixels, ignoring alpha, to a BC1 block.
+* Parameters:
+*    1. rgba    : The 16 pixels, row by row, 4 bytes each.
+*    2. block   : Receives the 8 bytes of the block.
+*******************************************************************************/
+void bc1_block(const unsigned char *rgba, unsigned char *block)
+{
+  float          r[16], g[16], b[16];
+  float          mean[3], cov[6], axis[3], next[3];
+  float          e0[3], e1[3], c0[3], c1[3], best_c0[3], best_c1[3];
+  float          t, tmin, tmax, len;
+  float          error, best;
+  int            levels[16], best_levels[16];
+  unsigned short q0, q1, best_q0, best_q1;
+
+  bc1_planes(rgba, r, g, b, mean);
+
+  //
+  // 1. The principal axis of the colors, by power iteration on their 
+  //    covariance, gives the segment the endpoints are taken on.
+  //
+  bc1_covariance(r, g, b, mean, cov);
+
+  axis[0] = cov[0] + cov[1] + cov[2];
+  axis[1] = cov[1] + cov[3] + cov[4];
+  axis[2] = cov[2] + cov[4] + cov[5];
+  for (int k = 0; k < 4; k++)
+  {
+    next[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    next[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    next[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    if ((len = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2])) < 1e-6f)
+      break;
+    axis[0] = next[0] / len;
+    axis[1] = next[1] / len;
+    axis[2] = next[2] / len;
+  }
+
+  bc1_range(r, g, b, mean, axis, &tmin, &tmax);
+
+  //
+  // 2. Endpoints are inset by 1/16 of the range: extremes are rarely worth
+  //    their own color.
+  //
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c]  = mean[c] + axis[c] * tmax;
+    e1[c]  = mean[c] + axis[c] * tmin;
+    t      = (e0[c] - e1[c]) / 16.0f;
+    e0[c] -= t;
+    e1[c] += t;
+  }
+
+  q0 = pack565(e0);
+  q1 = pack565(e1);
+  unpack565(q0, c0);
+  unpack565(q1, c1);
+  bc1_levels(r, g, b, c0, c1, levels);
+  best = bc1_error(r, g, b, c0, c1, levels);
+
+  best_q0 = q0;
+  best_q1 = q1;
+  memcpy(best_c0, c0, sizeof(c0));
+  memcpy(best_c1, c1, sizeof(c1));
+  memcpy(best_levels, levels, sizeof(levels));
+
+  //
+  // 3. Refine endpoints from the levels chosen, as long as it helps.
+  //
+  for (int k = 0; k < BC1_REFINEMENTS && best > 0.0f && bc1_refine(r, g, b, best_levels, e0, e1); k++)
+  {
+    q0 = pack565(e0);
+    q1 = pack565(e1);
+    unpack565(q0, c0);
+    unpack565(q1, c1);
+    bc1_levels(r, g, b, c0, c1, levels);
+    if ((error = bc1_error(r, g, b, c0, c1, levels)) >= best)
+      break;
+
+    best    = error;
+    best_q0 = q0;
+    best_q1 = q1;
+    memcpy(best_c0, c0, sizeof(c0));
+    memcpy(best_c1, c1, sizeof(c1));
+    memcpy(best_levels, levels, sizeof(levels));
+  }
+
+  bc1_encode(best_q0, best_q1, best_levels, block);
+}
+
+
+/*******************************************************************************
+* Function  : bc3_block
+* Brief     : Encode 16 RGBA pixels to a BC3 block: a BC4 alpha block followed
+*             by a BC1 color block.
+* Parameters:
+*    1. rgba    : The 16 pixels, row by row, 4 bytes each.
+*    2. block   : Receives the 16 bytes of the block.
+*******************************************************************************/
+void bc3_block(const unsigned char *rgba, unsigned char *block)
+{
+  bc4_block(rgba + 3, 4, block);
+  bc1_block(rgba, block + 8);
+}
+
+
+/*******************************************************************************
+* Function  : bc4_block
+* Brief     : Encode 16 values of one channel to a BC4 block.
+* Parameters:
+*    1. values  : The 16 values, row by row.
+*    2. stride  : The distance between two values, in bytes.
+*    3. block   : Receives the 8 bytes of the block.
+*******************************************************************************/
+void bc4_block(const unsigned char *values, int stride, unsigned char *block)
+{
+  unsigned long long bits = 0;
+  int                lo   = 255;
+  int                hi   = 0;
+  int                v[16];
+  int                level[16];
+
+  for (int i = 0; i < 16; i++)
+  {
+    v[i] = values[i * stride];
+    lo   = v[i] < lo? v[i] : lo;
+    hi   = v[i] > hi? v[i] : hi;
+  }
+
+  //
+  // With the first endpoint greater, 6 values are interpolated between them.
+  // Levels go from 0 for lo to 7 for hi, and map to indices 1, 7, 6... 0.
+  // Floats divide the integers exactly enough to round down alike.
+  //
+  if (hi > lo)
+  {
+#ifdef __SSE2__
+    __m128 vlo  = _mm_set1_ps((float) lo);
+    __m128 vrng = _mm_set1_ps((float) (hi - lo));
+    __m128 vden = _mm_set1_ps((float) (2 * (hi - lo)));
+    __m128 k14  = _mm_set1_ps(14.0f);
+    __m128 t;
+
+    for (int i = 0; i < 16; i += 4)
+    {
+      t = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) &v[i])), vlo);
+      t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(t, k14), vrng), vden);
+      _mm_storeu_si128((__m128i *) &level[i], _mm_cvttps_epi32(t));
+    }
+#else
+    for (int i = 0; i < 16; i++)
+      level[i] = ((v[i] - lo) * 14 + (hi - lo)) / (2 * (hi - lo));
+#endif
+
+    for (int i = 0; i < 16; i++)
+      bits |= (unsigned long long) (level[i] == 7? 0 : level[i] == 0? 1 : 8 - level[i]) << (3 * i);
+  }
+
+  block[0] = hi;
+  block[1] = lo;
+  for (int i = 0; i < 6; i++)
+    block[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+
+/*******************************************************************************
+* Function  : bc5_block
+* Brief     : Encode 16 pixels of two channels to a BC5 block: a BC4 block for
+*             each of them.
+* Parameters:
+*    1. rg      : The 16 pixels, row by row, 2 bytes each.
+*    2. block   : Receives the 16 bytes of the block.
+*******************************************************************************/
+void bc5_block(const unsigned char *rg, unsigned char *block)
+{
+  bc4_block(rg, 2, block);
+  bc4_block(rg + 1, 2, block + 8);
+}
@@ -0,0 +1,55 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: bc.h
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : This module encodes 4x4 blocks of pixels to BC1, BC3, BC4 and BC5 
+*           (S3TC and RGTC).
+*******************************************************************************/
+#ifndef __TAWY__BC_H__
+#define __TAWY__BC_H__
+
+
+/*******************************************************************************
+* Function  : bc1_block
+* Brief     : Encode 16 RGBA pixels, ignoring alpha, to a BC1 block.
+* Parameters:
+*    1. rgba    : The 16 pixels, row by row, 4 bytes each.
+*    2. block   : Receives the 8 bytes of the block.
+*******************************************************************************/
+void bc1_block(const unsigned char *, unsigned char *);
+
+
+/*******************************************************************************
+* Function  : bc3_block
+* Brief     : Encode 16 RGBA pixels to a BC3 block: a BC4 alpha block followed
+*             by a BC1 color block.
+* Parameters:
+*    1. rgba    : The 16 pixels, row by row, 4 bytes each.
+*    2. block   : Receives the 16 bytes of the block.
+*******************************************************************************/
+void bc3_block(const unsigned char *, unsigned char *);
+
+
+/*******************************************************************************
+* Function  : bc4_block
+* Brief     : Encode 16 values of one channel to a BC4 block.
+* Parameters:
+*    1. values  : The 16 values, row by row.
+*    2. stride  : The distance between two values, in bytes.
+*    3. block   : Receives the 8 bytes of the block.
+*******************************************************************************/
+void bc4_block(const unsigned char *, int, unsigned char *);
+
+
+/*******************************************************************************
+* Function  : bc5_block
+* Brief     : Encode 16 pixels of two channels to a BC5 block: a BC4 block for
+*             each of them.
+* Parameters:
+*    1. rg      : The 16 pixels, row by row, 2 bytes each.
+*    2. block   : Receives the 16 bytes of the block.
+*******************************************************************************/
+void bc5_block(const unsigned char *, unsigned char *);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,228 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: image_bench.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : Benchmark of the image kernels. Each kernel runs on a synthetic
+*           image with every instruction set both it and the CPU have, its 
+*           output compared to the scalar reference, and its best time 
+*           printed.
+*           Usage: image_bench [size] [runs]
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "image.h"
+
+#define BENCH_SIZE 2048
+#define BENCH_RUNS 10
+
+
+typedef enum
+{
+  BENCH_FLIP,
+  BENCH_EXPAND,
+  BENCH_PREMULTIPLY,
+  BENCH_BOX,
+  BENCH_BOX_SRGB,
+  BENCH_KAISER,
+  BENCH_KAISER_SRGB,
+  BENCH_MIPMAPS,
+} bench_kernel;
+
+
+/*******************************************************************************
+* Struct    : bench_case
+* Brief     : A kernel to measure.
+* Attributes:
+*    1. name     : What is printed.
+*    2. kernel   : The kernel.
+*    3. channels : The number of channels of the image.
+*    4. isa      : The best instruction set the kernel has code for.
+*******************************************************************************/
+typedef struct bench_case
+{
+  const char   *name;
+  bench_kernel  kernel;
+  int           channels;
+  image_isa     isa;
+}bench_case;
+
+
+//
+// Flips are row copies, as fast as memcpy is. sRGB box filters do not go
+// past SSE2: their lookups leave no room for wider vectors.
+//
+static const bench_case cases[] =
+{
+  {"flip         RGBA", BENCH_FLIP,        4, IMAGE_SCALAR},
+  {"expand       RGB ", BENCH_EXPAND,      3, IMAGE_AVX2},
+  {"premultiply  RGBA", BENCH_PREMULTIPLY, 4, IMAGE_AVX2},
+  {"box          RGBA", BENCH_BOX,         4, IMAGE_AVX2},
+  {"box          R   ", BENCH_BOX,         1, IMAGE_AVX2},
+  {"box sRGB     RGBA", BENCH_BOX_SRGB,    4, IMAGE_SSE2},
+  {"kaiser       RGBA", BENCH_KAISER,      4, IMAGE_AVX2},
+  {"kaiser sRGB  RGBA", BENCH_KAISER_SRGB, 4, IMAGE_AVX2},
+  {"mipmaps      RGBA", BENCH_MIPMAPS,     4, IMAGE_AVX2},
+};
+
+static const char *isa_names[] = {"scalar", "sse2", "avx2"};
+
+
+/*******************************************************************************
+* Function  : now
+* Brief     : A monotonic time, in seconds.
+*******************************************************************************/
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*******************************************************************************
+* Function  : levels
+* Brief     : The number of levels of an image, down to 1x1.
+*******************************************************************************/
+static int levels(int size)
+{
+  int cnt = 1;
+
+  while (size >> cnt)
+    cnt++;
+  return cnt;
+}
+
+
+/*******************************************************************************
+* Function  : run
+* Brief     : Run a kernel once.
+* Parameters:
+*    1. test    : The kernel to run.
+*    2. dst     : Its output.
+*    3. src     : Its input, copied to dst first for in place kernels.
+*    4. size    : The width and height of the image.
+*******************************************************************************/
+static void run(const bench_case *test, unsigned char *dst, const unsigned char *src, int size)
+{
+  size_t bytes = (size_t) size * size * test->channels;
+
+  switch (test->kernel)
+  {
+    case BENCH_FLIP:
+      image_flip(dst, src, size, size, test->channels);
+      break;
+
+    case BENCH_EXPAND:
+      image_expand(dst, src, size, size, true);
+      break;
+
+    case BENCH_PREMULTIPLY:
+      memcpy(dst, src, bytes);
+      image_premultiply(dst, size, size);
+      break;
+
+    case BENCH_BOX:
+    case BENCH_BOX_SRGB:
+      image_downsample(dst, src, size, size, test->channels, IMAGE_BOX, test->kernel == BENCH_BOX_SRGB);
+      break;
+
+    case BENCH_KAISER:
+    case BENCH_KAISER_SRGB:
+      image_downsample(dst, src, size, size, test->channels, IMAGE_KAISER, test->kernel == BENCH_KAISER_SRGB);
+      break;
+
+    case BENCH_MIPMAPS:
+      memcpy(dst, src, bytes);
+      image_mipmaps(dst, size, size, test->channels, levels(size), IMAGE_KAISER, true);
+      break;
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  int            size  = argc > 1? atoi(argv[1]) : BENCH_SIZE;
+  int            runs  = argc > 2? atoi(argv[2]) : BENCH_RUNS;
+  size_t         bytes;
+  unsigned char *src;
+  unsigned char *ref;
+  unsigned char *out;
+  image_isa      best;
+  double         start;
+  double         time;
+  double         scalar;
+  int            diff;
+
+  if (size < 1 || runs < 1)
+  {
+    printf("Usage: %s [size] [runs]\n", argv[0]);
+    return 1;
+  }
+
+  //
+  // 1. A noisy gradient with varied alpha, and room for a mip chain of 4
+  //    channels, twice the image at most.
+  //
+  bytes = (size_t) size * size * 4;
+  src   = malloc(bytes);
+  ref   = malloc(2 * bytes);
+  out   = malloc(2 * bytes);
+  if (!src || !ref || !out)
+  {
+    printf("Error, could not allocate %dx%d images\n", size, size);
+    return 1;
+  }
+
+  srand(1);
+  for (size_t i = 0; i < bytes; i++)
+    src[i] = (i / 4 % size + i / 4 / size + rand() % 32) & 0xff;
+
+  best = image_simd(IMAGE_AVX2);
+  printf("%dx%d, best of %d runs, %d threads at most\n\n", size, size, runs, TAWY_IMAGE_THREADS);
+  printf("%-18s %-7s %10s %9s %9s\n", "kernel", "isa", "time (ms)", "speedup", "max diff");
+
+  //
+  // 2. Each kernel, scalar first to be the reference, then each instruction
+  //    set. SIMD rounds Kaiser to nearest even, hence differences of 1.
+  //
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+  {
+    scalar = 0.0;
+    for (int isa = IMAGE_SCALAR; isa <= (int) best && isa <= (int) cases[c].isa; isa++)
+    {
+      image_simd(isa);
+      memset(out, 0, 2 * bytes);
+
+      time = 1e9;
+      for (int r = 0; r < runs; r++)
+      {
+        start = now();
+        run(&cases[c], out, src, size);
+        start = now() - start;
+        time  = start < time? start : time;
+      }
+
+      if (isa == IMAGE_SCALAR)
+      {
+        memcpy(ref, out, 2 * bytes);
+        scalar = time;
+      }
+
+      diff = 0;
+      for (size_t i = 0; i < 2 * bytes; i++)
+        diff = abs(out[i] - ref[i]) > diff? abs(out[i] - ref[i]) : diff;
+
+      printf("%-18s %-7s %10.3f %8.2fx %9d\n", cases[c].name, isa_names[isa], time * 1e3, scalar / time, diff);
+    }
+  }
+
+  free(src);
+  free(ref);
+  free(out);
+  return 0;
+}
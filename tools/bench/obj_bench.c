@@ -0,0 +1,178 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: obj_bench.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : Benchmark of the .obj reader against assimp. Without a file, a
+*           synthetic scan of about 80 MB is written first: a noisy grid with
+*           texture coordinates and normals. Both readers run on the same
+*           file, and their best times and triangle counts are printed.
+*           Usage: obj_bench [model.obj] [runs]
+*******************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "wavefront.h"
+
+#define BENCH_GRID 640
+#define BENCH_RUNS 3
+
+
+/*******************************************************************************
+* Function  : now
+* Brief     : A monotonic time, in seconds.
+*******************************************************************************/
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*******************************************************************************
+* Function  : synthesize
+* Brief     : Write a grid of n x n vertices, displaced by noise, two triangles
+*             per cell, every corner indexing all three attributes.
+* Returns   :
+*    true : The file is written.
+*    false: It could not be.
+*******************************************************************************/
+static bool synthesize(FILE *out, int n)
+{
+  float h;
+
+  srand(1);
+  fprintf(out, "# obj_bench synthetic scan\no scan\n");
+  for (int y = 0; y < n; y++)
+  {
+    for (int x = 0; x < n; x++)
+    {
+      h = sinf(x * 0.05f) * cosf(y * 0.05f) + (rand() % 1000) * 1e-5f;
+      fprintf(out, "v %.6f %.6f %.6f\n", x / (float) n - 0.5f, h, y / (float) n - 0.5f);
+    }
+  }
+
+  for (int i = 0; i < n * n; i++)
+    fprintf(out, "vt %.6f %.6f\n", i % n / (float) (n - 1), i / n / (float) (n - 1));
+
+  for (int i = 0; i < n * n; i++)
+    fprintf(out, "vn %.4f %.4f %.4f\n", (rand() % 200 - 100) * 1e-3f, 1.0f, (rand() % 200 - 100) * 1e-3f);
+
+  for (int y = 0; y < n - 1; y++)
+  {
+    for (int x = 0; x < n - 1; x++)
+    {
+      int a = y * n + x + 1;
+      int b = a + 1;
+      int c = a + n;
+      int d = c + 1;
+
+      fprintf(out, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+      fprintf(out, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+    }
+  }
+  return !ferror(out);
+}
+
+
+int main(int argc, char **argv)
+{
+  char                  path[] = "/tmp/obj_benchXXXXXX.obj";
+  const char           *file   = argc > 1? argv[1] : NULL;
+  int                   runs   = argc > 2? atoi(argv[2]) : BENCH_RUNS;
+  const struct aiScene *scene;
+  wavefront             obj;
+  struct stat           st;
+  unsigned long         ours   = 0;
+  unsigned long         theirs = 0;
+  double                start;
+  double                fast   = 1e9;
+  double                slow   = 1e9;
+  FILE                 *out;
+  int                   fd;
+
+  if (runs < 1)
+  {
+    printf("Usage: %s [model.obj] [runs]\n", argv[0]);
+    return 1;
+  }
+
+  //
+  // 1. The file, synthesized if none is given.
+  //
+  if (!file)
+  {
+    if ((fd = mkstemps(path, 4)) < 0 || NULL == (out = fdopen(fd, "w")))
+    {
+      printf("Error, failed to create '%s'\n", path);
+      return 1;
+    }
+
+    if (!synthesize(out, BENCH_GRID) || fclose(out))
+    {
+      printf("Error, failed to write '%s'\n", path);
+      remove(path);
+      return 1;
+    }
+    file = path;
+  }
+
+  if (stat(file, &st))
+  {
+    printf("Error, failed to read '%s'\n", file);
+    return 1;
+  }
+
+  printf("%s, %.1f MB, best of %d runs, %d threads at most, %ld cores\n\n", file, st.st_size / 1e6, runs,
+         TAWY_WAVEFRONT_THREADS, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("%-10s %10s %10s %12s %9s\n", "reader", "time (ms)", "MB/s", "triangles", "speedup");
+
+  //
+  // 2. Each reader, until its triangles are in memory. Assimp triangulates
+  //    as the model loader asks it to.
+  //
+  for (int r = 0; r < runs; r++)
+  {
+    start = now();
+    if (!wavefront_load(&obj, file))
+      break;
+    start = now() - start;
+    fast  = start < fast? start : fast;
+    ours  = obj.triangle_cnt;
+    wavefront_release(&obj);
+  }
+
+  for (int r = 0; r < runs; r++)
+  {
+    start = now();
+    if (NULL == (scene = aiImportFile(file, aiProcess_Triangulate)))
+    {
+      printf("Assimp error: %s\n", aiGetErrorString());
+      break;
+    }
+    start  = now() - start;
+    slow   = start < slow? start : slow;
+    theirs = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+      theirs += scene->mMeshes[m]->mNumFaces;
+    aiReleaseImport(scene);
+  }
+
+  printf("%-10s %10.1f %10.1f %12lu %8.2fx\n", "assimp", slow * 1e3, st.st_size / 1e6 / slow, theirs, 1.0);
+  printf("%-10s %10.1f %10.1f %12lu %8.2fx\n", "wavefront", fast * 1e3, st.st_size / 1e6 / fast, ours, slow / fast);
+
+  if (file == path)
+    remove(path);
+  return ours && ours == theirs? 0 : 1;
+}
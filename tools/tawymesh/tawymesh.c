@@ -0,0 +1,80 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: tawymesh.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : Offline mesh baker. Each model file, .obj or any assimp reads, is
+*           imported, optimized and compressed as at load, into a baked file
+*           next to it that models map and send to OpenGL as is. -u keeps 
+*           every attribute in floats and indices in 32 bits, -n keeps the
+*           vertices and triangles as the file has them.
+*           Usage: tawymesh [-f] [-u] [-n] model...
+*******************************************************************************/
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tawymesh.h"
+
+
+static bool         force   = false;
+static unsigned int options = TAWY_MESH_OPTIONS | TAWY_MESH_VERBOSE;
+
+
+/*******************************************************************************
+* Function  : bake
+* Brief     : Import a model file and write its baked file, unless it is newer.
+* Returns   :
+*    true : The file is written, or was already.
+*    false: The model could not be imported, or the file could not be written.
+*******************************************************************************/
+static bool bake(const char *file)
+{
+  char     path[TAWY_MESH_NAME_LEN];
+  tawymesh mesh;
+  bool     ret;
+
+  if (tawymesh_baked(file, path) && !force)
+    return true;
+
+  if (!tawymesh_import(&mesh, file, options))
+    return false;
+
+  ret = tawymesh_write(&mesh, path);
+  tawymesh_release(&mesh);
+  return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+  int first    = 1;
+
+  for (; first < argc && argv[first][0] == '-'; first++)
+  {
+    if (!strcmp(argv[first], "-f"))
+      force = true;
+    else if (!strcmp(argv[first], "-u"))
+      options &= ~TAWY_MESH_COMPRESS;
+    else if (!strcmp(argv[first], "-n"))
+      options &= ~TAWY_MESH_OPTIMIZE;
+    else
+      break;
+  }
+
+  if (first >= argc)
+  {
+    printf("Usage: %s [-f] [-u] [-n] model...\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = first; i < argc; i++)
+  {
+    if (bake(argv[i]))
+      printf("Baked %s\n", argv[i]);
+    else
+      failures++;
+  }
+  return failures? 1 : 0;
+}
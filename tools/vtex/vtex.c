@@ -0,0 +1,530 @@
+/****************************************************************************
+* Title   : Tawy   
+* Filename: vtex.c
+* Author  : Guillaume Mantelet
+* Version : 1.0.0
+* Brief   : Offline virtual texture tiler. Each image is cut in pages, with a
+*           border of their neighbours, for every level down to a single page,
+*           into a tiled file next to it that virtual textures read page by
+*           page. Images must be square, a power of two and at least a page.
+*           Levels are tiled in strips of a page row: images larger than 
+*           VTEX_MAX_SIZE, which stb_image cannot decode, are read row by row
+*           from binary PPM files, and levels larger than VTEX_MEMORY_SIZE 
+*           are kept in a temporary file, up to 64k x 64k.
+*           Usage: vtex [-f] image...
+*******************************************************************************/
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "image.h"
+#include "vtex.h"
+
+#define VTEX_PATH_LEN    256
+#define VTEX_MEMORY_SIZE 8192   // Larger levels are kept in a file: 256 MiB.
+
+//
+// The largest image stb_image decodes to RGBA: its size must fit an int.
+// Larger sources are read from binary PPM files, row by row.
+//
+#define VTEX_MAX_SIZE 16384
+
+
+/*******************************************************************************
+* Struct    : vtex_level
+* Brief     : A level being tiled, or written by the one above it: in memory,
+*             or rows of a file read on demand.
+* Attributes:
+*    1. texels  : The level, bottom row first, NULL if it is in a file.
+*    2. file    : The file holding its rows otherwise.
+*    3. offset  : Where its first row starts in the file.
+*    4. size    : Its width and height.
+*    5. channels: The channels of the rows of the file, 3 or 4.
+*    6. top_down: True if the file has its top row first, as PPM does.
+*    7. row     : A row of the file, before it is expanded to RGBA.
+*    8. written : The rows written so far, by the level above.
+*******************************************************************************/
+typedef struct vtex_level
+{
+  unsigned char *texels;
+  FILE          *file;
+  off_t          offset;
+  int            size;
+  int            channels;
+  bool           top_down;
+  unsigned char *row;
+  int            written;
+}vtex_level;
+
+
+static bool force = false;
+
+
+/*******************************************************************************
+* Function  : vtex_path
+* Brief     : The path of the tiled file of an image: its extension is replaced.
+*******************************************************************************/
+static void vtex_path(const char *file, char *path)
+{
+  const char *dot   = strrchr(file, '.');
+  const char *slash = strrchr(file, '/');
+  int         len   = (dot && (!slash || dot > slash))? (int) (dot - file) : (int) strlen(file);
+
+  snprintf(path, VTEX_PATH_LEN, "%.*s" TAWY_VTEX_EXTENSION, len, file);
+}
+
+
+/*******************************************************************************
+* Function  : up_to_date
+* Brief     : Tell whether a tiled file is newer than its image.
+*******************************************************************************/
+static bool up_to_date(const char *file, const char *path)
+{
+  struct stat src;
+  struct stat dst;
+
+  return !stat(file, &src) && !stat(path, &dst) && dst.st_mtime >= src.st_mtime;
+}
+
+
+/*******************************************************************************
+* Function  : png_size
+* Brief     : Read the size of a PNG image from its header. stb_image refuses
+*             to even describe PNG images too large to decode.
+* Returns   :
+*    true : The file is a PNG image, its size is read.
+*    false: It is not, or could not be read.
+*******************************************************************************/
+static bool png_size(const char *file, int *width, int *height)
+{
+  static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+  unsigned char  head[24];
+  FILE          *in;
+  bool           ret;
+
+  if (NULL == (in = fopen(file, "rb")))
+    return false;
+
+  ret = fread(head, sizeof(head), 1, in) == 1 && !memcmp(head, signature, sizeof(signature)) &&
+        !memcmp(head + 12, "IHDR", 4);
+  fclose(in);
+
+  //
+  // The IHDR chunk comes first, its width then height in big endian.
+  //
+  if (ret)
+  {
+    *width  = (int) ((unsigned int) head[16] << 24 | head[17] << 16 | head[18] << 8 | head[19]);
+    *height = (int) ((unsigned int) head[20] << 24 | head[21] << 16 | head[22] << 8 | head[23]);
+    ret     = *width > 0 && *height > 0;
+  }
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : ppm_open
+* Brief     : Open a binary PPM image, RGB with 8 bits per channel, and read 
+*             its header. Its rows are read on demand.
+* Returns   :
+*    true : The file is a binary PPM image, open at its first row.
+*    false: It is not, or could not be read.
+*******************************************************************************/
+static bool ppm_open(const char *file, vtex_level *level)
+{
+  int values[3];
+  int c;
+
+  if (NULL == (level->file = fopen(file, "rb")))
+    return false;
+
+  //
+  // "P6", then the width, height and maximum value, separated by blanks or
+  // comments, then a single blank.
+  //
+  if (fgetc(level->file) != 'P' || fgetc(level->file) != '6')
+  {
+    fclose(level->file);
+    level->file = NULL;
+    return false;
+  }
+
+  for (int i = 0; i < 3; i++)
+  {
+    while ((c = fgetc(level->file)) == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+      if (c == '#')
+        while ((c = fgetc(level->file)) != '\n' && c != EOF);
+    }
+
+    ungetc(c, level->file);
+    if (fscanf(level->file, "%d", &values[i]) != 1)
+      values[i] = 0;
+  }
+
+  if (values[0] <= 0 || values[0] != values[1] || values[2] != 255 || fgetc(level->file) == EOF)
+  {
+    fclose(level->file);
+    level->file = NULL;
+    return false;
+  }
+
+  level->offset   = ftello(level->file);
+  level->size     = values[0];
+  level->channels = 3;
+  level->top_down = true;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : read_row
+* Brief     : Read a row of a level as RGBA.
+* Parameters:
+*    1. level   : The level.
+*    2. y       : The row, the bottom one being 0.
+*    3. dst     : Receives its size * 4 bytes.
+* Returns   :
+*    true : The row is read.
+*    false: The file could not be read.
+*******************************************************************************/
+static bool read_row(vtex_level *level, int y, unsigned char *dst)
+{
+  size_t bytes = (size_t) level->size * level->channels;
+
+  if (level->texels)
+  {
+    memcpy(dst, level->texels + (size_t) y * level->size * 4, (size_t) level->size * 4);
+    return true;
+  }
+
+  y = level->top_down? level->size - 1 - y : y;
+  if (fseeko(level->file, level->offset + (off_t) y * bytes, SEEK_SET) ||
+      fread(level->channels == 4? dst : level->row, bytes, 1, level->file) != 1)
+    return false;
+
+  if (level->channels == 3)
+    image_expand(dst, level->row, level->size, 1, false);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : write_rows
+* Brief     : Append rows to a level, after those already written.
+* Returns   :
+*    true : The rows are written.
+*    false: The file could not be written.
+*******************************************************************************/
+static bool write_rows(vtex_level *level, const unsigned char *rows, int cnt)
+{
+  size_t bytes = (size_t) level->size * 4 * cnt;
+
+  if (level->texels)
+    memcpy(level->texels + (size_t) level->written * level->size * 4, rows, bytes);
+  else if (fwrite(rows, bytes, 1, level->file) != 1)
+    return false;
+
+  level->written += cnt;
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : open_level
+* Brief     : Make room for a level written row by row: in memory if it is 
+*             small enough, or else in a file next to the tiled one, removed
+*             as soon as it is open.
+* Returns   :
+*    true : The level can be written.
+*    false: Memory could not be allocated, or the file created.
+*******************************************************************************/
+static bool open_level(vtex_level *level, int size, const char *path, int index)
+{
+  char temp[VTEX_PATH_LEN + 16];
+
+  memset(level, 0, sizeof(vtex_level));
+  level->size     = size;
+  level->channels = 4;
+
+  if (size <= VTEX_MEMORY_SIZE)
+    return NULL != (level->texels = malloc((size_t) size * size * 4));
+
+  snprintf(temp, sizeof(temp), "%s.%d", path, index);
+  if (NULL == (level->file = fopen(temp, "w+b")))
+    return false;
+  remove(temp);
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : close_level
+* Brief     : Release a level, and its file.
+*******************************************************************************/
+static void close_level(vtex_level *level)
+{
+  if (level->file)
+    fclose(level->file);
+  free(level->texels);
+  free(level->row);
+  memset(level, 0, sizeof(vtex_level));
+}
+
+
+/*******************************************************************************
+* Function  : write_pages
+* Brief     : Write the pages of a page row, from a strip of its rows and the
+*             border rows around them, each with a border wrapped around the 
+*             level, as the texture repeats.
+* Returns   :
+*    true : Every page is written.
+*    false: The file could not be written.
+*******************************************************************************/
+static bool write_pages(FILE *out, const unsigned char *strip, int size, unsigned char *slot)
+{
+  int x;
+
+  for (int px = 0; px < size / TAWY_VTEX_PAGE; px++)
+  {
+    for (int sy = 0; sy < TAWY_VTEX_SLOT; sy++)
+    {
+      for (int sx = 0; sx < TAWY_VTEX_SLOT; sx++)
+      {
+        x = (px * TAWY_VTEX_PAGE + sx - TAWY_VTEX_BORDER + size) % size;
+        memcpy(slot + (sy * TAWY_VTEX_SLOT + sx) * 4, strip + ((size_t) sy * size + x) * 4, 4);
+      }
+    }
+
+    if (fwrite(slot, (size_t) TAWY_VTEX_SLOT * TAWY_VTEX_SLOT * 4, 1, out) != 1)
+      return false;
+  }
+  return true;
+}
+
+
+/*******************************************************************************
+* Function  : tile_level
+* Brief     : Write the pages of a level, bottom page row first, and compute 
+*             the level below it strip by strip.
+* Parameters:
+*    1. out     : The tiled file.
+*    2. level   : The level.
+*    3. next    : The level below it, written here, or NULL for the last one.
+*    4. strip   : A page row and its borders, TAWY_VTEX_SLOT rows.
+*    5. half    : The rows of the next level the strip gives, and 2 rows of
+*                 context on each side.
+*    6. slot    : A page.
+* Returns   :
+*    true : The level is written.
+*    false: A file could not be read or written, or memory allocated.
+*******************************************************************************/
+static bool tile_level(FILE *out, vtex_level *level, vtex_level *next, unsigned char *strip, unsigned char *half,
+                       unsigned char *slot)
+{
+  int    size   = level->size;
+  size_t stride = (size_t) size * 4;
+  bool   ret    = true;
+
+  for (int py = 0; ret && py < size / TAWY_VTEX_PAGE; py++)
+  {
+    //
+    // 1. The rows of the page row, and its borders wrapped around the level.
+    //
+    for (int sy = 0; ret && sy < TAWY_VTEX_SLOT; sy++)
+      ret = read_row(level, (py * TAWY_VTEX_PAGE + sy - TAWY_VTEX_BORDER + size) % size, strip + sy * stride);
+
+    ret = ret && write_pages(out, strip, size, slot);
+    if (!ret || !next)
+      continue;
+
+    //
+    // 2. The borders are also the rows the 6 taps of the Kaiser filter reach
+    //    past the page row, but clamped, not wrapped, at the bottom and top
+    //    of the level: the strip is then filtered exactly as the whole level
+    //    is. Its first and last 2 rows of the next level lack context.
+    //
+    for (int sy = 0; py == 0 && sy < TAWY_VTEX_BORDER; sy++)
+      memcpy(strip + sy * stride, strip + TAWY_VTEX_BORDER * stride, stride);
+    for (int sy = TAWY_VTEX_BORDER + TAWY_VTEX_PAGE; py == size / TAWY_VTEX_PAGE - 1 && sy < TAWY_VTEX_SLOT; sy++)
+      memcpy(strip + sy * stride, strip + (TAWY_VTEX_BORDER + TAWY_VTEX_PAGE - 1) * stride, stride);
+
+    ret = image_downsample(half, strip, size, TAWY_VTEX_SLOT, 4, IMAGE_KAISER, false) &&
+          write_rows(next, half + TAWY_VTEX_BORDER / 2 * stride / 2, TAWY_VTEX_PAGE / 2);
+  }
+  return ret;
+}
+
+
+/*******************************************************************************
+* Function  : tile
+* Brief     : Tile an image, bottom row first as OpenGL expects it, into a
+*             virtual texture file, levels filtered like texture mipmaps.
+* Returns   :
+*    true : The file is written, or was already.
+*    false: The image could not be decoded or has the wrong size, or the 
+*           file could not be written.
+*******************************************************************************/
+static bool tile(const char *file)
+{
+  char           path[VTEX_PATH_LEN];
+  vtex_header    header = {0};
+  vtex_level     level  = {0};
+  vtex_level     next   = {0};
+  unsigned char *strip;
+  unsigned char *half;
+  unsigned char *slot;
+  int            width, height, channels;
+  FILE          *out;
+  bool           ret = true;
+
+  vtex_path(file, path);
+  if (!force && up_to_date(file, path))
+    return true;
+
+  //
+  // 1. Binary PPM images are read row by row, others decoded whole, once
+  //    their size is read from their header: an image too large to decode
+  //    is told apart from a corrupt one.
+  //
+  if (ppm_open(file, &level))
+  {
+    width = height = level.size;
+    if (NULL == (level.row = malloc((size_t) width * 3)))
+    {
+      printf("Error, '%s' is too large\n", file);
+      close_level(&level);
+      return false;
+    }
+  }
+  else
+  {
+    if (!png_size(file, &width, &height) && !stbi_info(file, &width, &height, &channels))
+    {
+      printf("Error, failed to load '%s': %s\n", file, stbi_failure_reason());
+      return false;
+    }
+
+    if (width > VTEX_MAX_SIZE || height > VTEX_MAX_SIZE)
+    {
+      printf("Error, '%s' is %dx%d, images larger than %d must be binary PPM files\n", file, width, height,
+             VTEX_MAX_SIZE);
+      return false;
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+    if (NULL == (level.texels = stbi_load(file, &width, &height, &channels, 4)))
+    {
+      printf("Error, failed to load '%s': %s\n", file, stbi_failure_reason());
+      return false;
+    }
+    level.size     = width;
+    level.channels = 4;
+  }
+
+  if (width != height || width < TAWY_VTEX_PAGE || (width & (width - 1)))
+  {
+    printf("Error, '%s' is %dx%d, virtual textures are square powers of two of %d at least\n",
+           file, width, height, TAWY_VTEX_PAGE);
+    close_level(&level);
+    return false;
+  }
+
+  header.magic  = TAWY_VTEX_MAGIC;
+  header.size   = width;
+  header.page   = TAWY_VTEX_PAGE;
+  header.border = TAWY_VTEX_BORDER;
+  header.levels = 1;
+  while ((width / TAWY_VTEX_PAGE) >> header.levels)
+    header.levels++;
+
+  strip = malloc((size_t) width * TAWY_VTEX_SLOT * 4);
+  half  = malloc((size_t) width / 2 * TAWY_VTEX_SLOT / 2 * 4);
+  slot  = malloc((size_t) TAWY_VTEX_SLOT * TAWY_VTEX_SLOT * 4);
+  if (header.levels > TAWY_VTEX_LEVELS || !strip || !half || !slot)
+  {
+    printf("Error, '%s' is too large\n", file);
+    free(strip);
+    free(half);
+    free(slot);
+    close_level(&level);
+    return false;
+  }
+
+  if (NULL == (out = fopen(path, "wb")))
+  {
+    printf("Error, failed to write '%s'\n", path);
+    free(strip);
+    free(half);
+    free(slot);
+    close_level(&level);
+    return false;
+  }
+
+  //
+  // 2. Each level writes the next one as it is tiled, and is then released:
+  //    only two are open at once.
+  //
+  ret = fwrite(&header, sizeof(header), 1, out) == 1;
+  for (unsigned int l = 0; ret && l < header.levels; l++)
+  {
+    if (l + 1 < header.levels && !open_level(&next, level.size / 2, path, l + 1))
+    {
+      ret = false;
+      break;
+    }
+
+    ret = tile_level(out, &level, l + 1 < header.levels? &next : NULL, strip, half, slot);
+    close_level(&level);
+    level = next;
+    memset(&next, 0, sizeof(vtex_level));
+  }
+
+  close_level(&level);
+  free(strip);
+  free(half);
+  free(slot);
+  ret = !fclose(out) && ret;
+
+  if (!ret)
+  {
+    printf("Error, failed to write '%s'\n", path);
+    remove(path);
+  }
+  return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+  int first    = 1;
+
+  if (argc > 1 && !strcmp(argv[1], "-f"))
+  {
+    force = true;
+    first++;
+  }
+
+  if (first >= argc)
+  {
+    printf("Usage: %s [-f] image...\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = first; i < argc; i++)
+  {
+    if (tile(argv[i]))
+      printf("Tiled %s\n", argv[i]);
+    else
+      failures++;
+  }
+  return failures? 1 : 0;
+}